@@ -0,0 +1,123 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "wavo/convert.h"
+
+// Throughput of the YUV conversion kernels against the scalar path, for full
+// frames and for a typical damage pattern of scattered 128x128 tiles.
+
+#define ITERATIONS 20
+#define TILE 128
+#define TILES 16
+
+struct frame_size {
+    const char *name;
+    int width, height;
+};
+
+static const struct frame_size sizes[] = {
+    { "1080p", 1920, 1080 },
+    { "4k", 3840, 2160 },
+};
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+// Best of ITERATIONS runs, in seconds
+static double run(enum wavo_convert_impl impl, const uint8_t *src,
+    const struct frame_size *size, const struct wavo_yuv_image *dst,
+    bool tiles) {
+    uint32_t stride = (uint32_t)size->width * 4;
+    double best = 1e9;
+
+    for (int i = 0; i < ITERATIONS; i++) {
+        double start = now_sec();
+        if (tiles) {
+            for (int t = 0; t < TILES; t++) {
+                int x = (t * 7 % 13) * (size->width - TILE) / 12 & ~1;
+                int y = (t * 5 % 11) * (size->height - TILE) / 10 & ~1;
+                wavo_convert_to_yuv(impl, src + (size_t)y * stride + x * 4,
+                    stride, dst, x, y, TILE, TILE);
+            }
+        } else {
+            wavo_convert_to_yuv(impl, src, stride, dst, 0, 0,
+                size->width, size->height);
+        }
+        double elapsed = now_sec() - start;
+        if (elapsed < best) {
+            best = elapsed;
+        }
+    }
+    return best;
+}
+
+static bool bench_size(const struct frame_size *size,
+    enum wavo_yuv_layout layout) {
+    size_t pixels = (size_t)size->width * (size_t)size->height;
+    uint8_t *src = malloc(pixels * 4);
+    uint8_t *dst = malloc(pixels * 3 / 2);
+    if (!src || !dst) {
+        free(src);
+        free(dst);
+        return false;
+    }
+
+    srand(42);
+    for (size_t i = 0; i < pixels * 4; i++) {
+        src[i] = (uint8_t)rand();
+    }
+
+    uint32_t width = (uint32_t)size->width;
+    struct wavo_yuv_image image = {
+        .layout = layout,
+        .planes = { dst, dst + pixels },
+        .strides = { width, width },
+    };
+    if (layout == WAVO_YUV_I420) {
+        image.strides[1] = width / 2;
+        image.planes[2] = dst + pixels + pixels / 4;
+        image.strides[2] = width / 2;
+    }
+
+    const char *layout_name = layout == WAVO_YUV_NV12 ? "nv12" : "i420";
+    for (int tiles = 0; tiles <= 1; tiles++) {
+        double scalar = 0.0;
+        double area = tiles ? (double)TILES * TILE * TILE : (double)pixels;
+
+        for (int impl = WAVO_CONVERT_SCALAR; impl <= WAVO_CONVERT_AVX2; impl++) {
+            if (!wavo_convert_impl_supported(impl)) {
+                continue;
+            }
+            double sec = run(impl, src, size, &image, tiles);
+            if (impl == WAVO_CONVERT_SCALAR) {
+                scalar = sec;
+            }
+            printf("%-6s %-5s %-6s %-7s %9.1f Mpix/s %6.2fx\n", size->name,
+                layout_name, tiles ? "tiles" : "full",
+                wavo_convert_impl_name(impl), area / sec / 1e6, scalar / sec);
+        }
+    }
+
+    free(src);
+    free(dst);
+    return true;
+}
+
+int main(void) {
+    printf("best implementation: %s\n",
+        wavo_convert_impl_name(wavo_convert_best_impl()));
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        if (!bench_size(&sizes[i], WAVO_YUV_NV12) ||
+                !bench_size(&sizes[i], WAVO_YUV_I420)) {
+            fprintf(stderr, "out of memory\n");
+            return 1;
+        }
+    }
+    return 0;
+}
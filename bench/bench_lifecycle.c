@@ -0,0 +1,473 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <wayland-client.h>
+#include <wayland-server-core.h>
+#include <wlr/interfaces/wlr_keyboard.h>
+#include <wlr/interfaces/wlr_pointer.h>
+#include <wlr/util/log.h>
+#include "wavo/config.h"
+#include "wavo/input.h"
+#include "wavo/output.h"
+#include "wavo/pool.h"
+#include "wavo/server.h"
+#include "headless.h"
+#include "xdg-shell-client-protocol.h"
+
+// Window and device churn at a growing population: toplevels and popups
+// come from a client in a child process, keyboards and pointers are
+// synthetic devices in the compositor. Each line is the cost of one create
+// or destroy with that many others alive, so a cost that grows with the
+// population points at a linear walk, and one that grows faster at a
+// quadratic one. Every pool must be empty afterwards, and under
+// -Db_sanitize=address LeakSanitizer checks the rest at exit.
+
+#define CHURN 1000  // Creates and destroys per population step
+#define WINDOW_SIZE 32
+
+static const size_t window_steps[] = { 0, 1000, 2000, 4000, 8000 };
+static const size_t device_steps[] = { 0, 250, 500, 1000, 2000 };
+#define STEP_COUNT (sizeof(window_steps) / sizeof(window_steps[0]))
+
+struct client {
+    struct wl_display *display;
+    struct wl_compositor *compositor;
+    struct wl_shm *shm;
+    struct xdg_wm_base *wm_base;
+    struct wl_buffer *buffer;
+};
+
+struct window {
+    struct wl_surface *surface;
+    struct xdg_surface *xdg_surface;
+    struct xdg_toplevel *toplevel;  // NULL for popups
+    struct xdg_popup *popup;
+    uint32_t configure_serial;
+};
+
+static double now_usec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e6 + (double)ts.tv_nsec / 1e3;
+}
+
+static void wm_base_ping(void *data, struct xdg_wm_base *wm_base,
+    uint32_t serial) {
+    (void)data;
+    xdg_wm_base_pong(wm_base, serial);
+}
+
+static const struct xdg_wm_base_listener wm_base_listener = {
+    .ping = wm_base_ping,
+};
+
+static void xdg_surface_configure(void *data, struct xdg_surface *xdg_surface,
+    uint32_t serial) {
+    (void)xdg_surface;
+    struct window *window = data;
+    window->configure_serial = serial;
+}
+
+static const struct xdg_surface_listener xdg_surface_listener = {
+    .configure = xdg_surface_configure,
+};
+
+static void toplevel_configure(void *data, struct xdg_toplevel *toplevel,
+    int32_t width, int32_t height, struct wl_array *states) {
+    (void)data;
+    (void)toplevel;
+    (void)width;
+    (void)height;
+    (void)states;
+}
+
+static void toplevel_close(void *data, struct xdg_toplevel *toplevel) {
+    (void)data;
+    (void)toplevel;
+}
+
+static const struct xdg_toplevel_listener toplevel_listener = {
+    .configure = toplevel_configure,
+    .close = toplevel_close,
+};
+
+static void popup_configure(void *data, struct xdg_popup *popup, int32_t x,
+    int32_t y, int32_t width, int32_t height) {
+    (void)data;
+    (void)popup;
+    (void)x;
+    (void)y;
+    (void)width;
+    (void)height;
+}
+
+static void popup_done(void *data, struct xdg_popup *popup) {
+    (void)data;
+    (void)popup;
+}
+
+static const struct xdg_popup_listener popup_listener = {
+    .configure = popup_configure,
+    .popup_done = popup_done,
+};
+
+static void registry_global(void *data, struct wl_registry *registry,
+    uint32_t name, const char *interface, uint32_t version) {
+    (void)version;
+    struct client *client = data;
+
+    if (strcmp(interface, wl_compositor_interface.name) == 0) {
+        client->compositor = wl_registry_bind(registry, name,
+            &wl_compositor_interface, 1);
+    } else if (strcmp(interface, wl_shm_interface.name) == 0) {
+        client->shm = wl_registry_bind(registry, name, &wl_shm_interface, 1);
+    } else if (strcmp(interface, xdg_wm_base_interface.name) == 0) {
+        client->wm_base = wl_registry_bind(registry, name,
+            &xdg_wm_base_interface, 1);
+        xdg_wm_base_add_listener(client->wm_base, &wm_base_listener, NULL);
+    }
+}
+
+static void registry_global_remove(void *data, struct wl_registry *registry,
+    uint32_t name) {
+    (void)data;
+    (void)registry;
+    (void)name;
+}
+
+static const struct wl_registry_listener registry_listener = {
+    .global = registry_global,
+    .global_remove = registry_global_remove,
+};
+
+// One black buffer shown by every window
+static struct wl_buffer *client_create_buffer(struct client *client) {
+    int stride = WINDOW_SIZE * 4;
+    int size = stride * WINDOW_SIZE;
+    int fd = memfd_create("wavo-bench", MFD_CLOEXEC);
+    if (fd < 0 || ftruncate(fd, size) != 0) {
+        perror("memfd");
+        return NULL;
+    }
+    struct wl_shm_pool *pool = wl_shm_create_pool(client->shm, fd, size);
+    struct wl_buffer *buffer = wl_shm_pool_create_buffer(pool, 0,
+        WINDOW_SIZE, WINDOW_SIZE, stride, WL_SHM_FORMAT_XRGB8888);
+    wl_shm_pool_destroy(pool);
+    close(fd);
+    return buffer;
+}
+
+static void window_init(struct client *client, struct window *window,
+    struct window *parent) {
+    window->surface = wl_compositor_create_surface(client->compositor);
+    window->xdg_surface = xdg_wm_base_get_xdg_surface(client->wm_base,
+        window->surface);
+    xdg_surface_add_listener(window->xdg_surface, &xdg_surface_listener,
+        window);
+
+    if (parent) {
+        struct xdg_positioner *positioner =
+            xdg_wm_base_create_positioner(client->wm_base);
+        xdg_positioner_set_size(positioner, WINDOW_SIZE, WINDOW_SIZE);
+        xdg_positioner_set_anchor_rect(positioner, 0, 0, WINDOW_SIZE,
+            WINDOW_SIZE);
+        window->popup = xdg_surface_get_popup(window->xdg_surface,
+            parent->xdg_surface, positioner);
+        xdg_popup_add_listener(window->popup, &popup_listener, window);
+        xdg_positioner_destroy(positioner);
+    } else {
+        window->toplevel = xdg_surface_get_toplevel(window->xdg_surface);
+        xdg_toplevel_add_listener(window->toplevel, &toplevel_listener,
+            window);
+    }
+    wl_surface_commit(window->surface);
+}
+
+static void window_map(struct client *client, struct window *window) {
+    xdg_surface_ack_configure(window->xdg_surface, window->configure_serial);
+    wl_surface_attach(window->surface, client->buffer, 0, 0);
+    wl_surface_damage(window->surface, 0, 0, WINDOW_SIZE, WINDOW_SIZE);
+    wl_surface_commit(window->surface);
+}
+
+static void window_finish(struct window *window) {
+    if (window->popup) {
+        xdg_popup_destroy(window->popup);
+    } else {
+        xdg_toplevel_destroy(window->toplevel);
+    }
+    xdg_surface_destroy(window->xdg_surface);
+    wl_surface_destroy(window->surface);
+    memset(window, 0, sizeof(*window));
+}
+
+// Creates and maps count windows, returns microseconds per window
+static double windows_create(struct client *client, struct window *windows,
+    size_t count, struct window *parent) {
+    double start = now_usec();
+    for (size_t i = 0; i < count; i++) {
+        window_init(client, &windows[i], parent);
+    }
+    wl_display_roundtrip(client->display);
+    for (size_t i = 0; i < count; i++) {
+        window_map(client, &windows[i]);
+    }
+    wl_display_roundtrip(client->display);
+    return count ? (now_usec() - start) / (double)count : 0.0;
+}
+
+// Newest first, as popups have to go, returns microseconds per window
+static double windows_destroy(struct client *client, struct window *windows,
+    size_t count) {
+    double start = now_usec();
+    for (size_t i = count; i > 0; i--) {
+        window_finish(&windows[i - 1]);
+    }
+    wl_display_roundtrip(client->display);
+    return count ? (now_usec() - start) / (double)count : 0.0;
+}
+
+static int client_run(const char *socket) {
+    struct client client = {0};
+    client.display = wl_display_connect(socket);
+    if (!client.display) {
+        fprintf(stderr, "cannot connect to %s\n", socket);
+        return 1;
+    }
+    struct wl_registry *registry = wl_display_get_registry(client.display);
+    wl_registry_add_listener(registry, &registry_listener, &client);
+    wl_display_roundtrip(client.display);
+    if (!client.compositor || !client.shm || !client.wm_base) {
+        fprintf(stderr, "%s\n", "missing globals");
+        return 1;
+    }
+    client.buffer = client_create_buffer(&client);
+
+    size_t max = window_steps[STEP_COUNT - 1];
+    struct window *population = calloc(max, sizeof(struct window));
+    struct window *churn = calloc(CHURN, sizeof(struct window));
+    struct window parent = {0};
+    if (!client.buffer || !population || !churn) {
+        fprintf(stderr, "%s\n", "out of memory");
+        return 1;
+    }
+    windows_create(&client, &parent, 1, NULL);
+
+    printf("%8s %16s %16s %16s %16s\n", "windows", "toplevel create",
+        "toplevel destroy", "popup create", "popup destroy");
+    size_t alive = 0;
+    for (size_t step = 0; step < STEP_COUNT; step++) {
+        size_t target = window_steps[step];
+        windows_create(&client, population + alive, target - alive, NULL);
+        alive = target;
+
+        double toplevel_create = windows_create(&client, churn, CHURN, NULL);
+        double toplevel_destroy = windows_destroy(&client, churn, CHURN);
+        double popup_create = windows_create(&client, churn, CHURN, &parent);
+        double popup_destroy = windows_destroy(&client, churn, CHURN);
+        printf("%8zu %14.1fus %14.1fus %14.1fus %14.1fus\n", alive,
+            toplevel_create, toplevel_destroy, popup_create, popup_destroy);
+        fflush(stdout);
+    }
+
+    windows_destroy(&client, population, alive);
+    windows_destroy(&client, &parent, 1);
+    wl_buffer_destroy(client.buffer);
+    xdg_wm_base_destroy(client.wm_base);
+    wl_shm_destroy(client.shm);
+    wl_compositor_destroy(client.compositor);
+    wl_registry_destroy(registry);
+    wl_display_roundtrip(client.display);
+    wl_display_disconnect(client.display);
+    free(population);
+    free(churn);
+    return 0;
+}
+
+static const struct wlr_keyboard_impl bench_keyboard_impl = {
+    .name = "wavo-bench-keyboard",
+};
+
+static const struct wlr_pointer_impl bench_pointer_impl = {
+    .name = "wavo-bench-pointer",
+};
+
+static double keyboards_add(struct wavo_server *server,
+    struct wlr_keyboard *keyboards, size_t count) {
+    double start = now_usec();
+    for (size_t i = 0; i < count; i++) {
+        wlr_keyboard_init(&keyboards[i], &bench_keyboard_impl,
+            bench_keyboard_impl.name);
+        wavo_input_add_device(server->input, &keyboards[i].base);
+    }
+    return count ? (now_usec() - start) / (double)count : 0.0;
+}
+
+static double keyboards_remove(struct wlr_keyboard *keyboards, size_t count) {
+    double start = now_usec();
+    for (size_t i = count; i > 0; i--) {
+        wlr_keyboard_finish(&keyboards[i - 1]);
+    }
+    return count ? (now_usec() - start) / (double)count : 0.0;
+}
+
+static double pointers_add(struct wavo_server *server,
+    struct wlr_pointer *pointers, size_t count) {
+    double start = now_usec();
+    for (size_t i = 0; i < count; i++) {
+        wlr_pointer_init(&pointers[i], &bench_pointer_impl,
+            bench_pointer_impl.name);
+        wavo_input_add_device(server->input, &pointers[i].base);
+    }
+    return count ? (now_usec() - start) / (double)count : 0.0;
+}
+
+static double pointers_remove(struct wlr_pointer *pointers, size_t count) {
+    double start = now_usec();
+    for (size_t i = count; i > 0; i--) {
+        wlr_pointer_finish(&pointers[i - 1]);
+    }
+    return count ? (now_usec() - start) / (double)count : 0.0;
+}
+
+static bool bench_devices(struct wavo_server *server) {
+    size_t max = device_steps[STEP_COUNT - 1];
+    struct wlr_keyboard *keyboards =
+        calloc(max + CHURN, sizeof(struct wlr_keyboard));
+    struct wlr_pointer *pointers =
+        calloc(max + CHURN, sizeof(struct wlr_pointer));
+    if (!keyboards || !pointers) {
+        free(keyboards);
+        free(pointers);
+        return false;
+    }
+
+    printf("%8s %16s %16s %16s %16s\n", "devices", "keyboard add",
+        "keyboard remove", "pointer add", "pointer remove");
+    size_t alive = 0;
+    for (size_t step = 0; step < STEP_COUNT; step++) {
+        size_t target = device_steps[step];
+        keyboards_add(server, keyboards + alive, target - alive);
+        pointers_add(server, pointers + alive, target - alive);
+        alive = target;
+
+        double keyboard_add = keyboards_add(server, keyboards + alive, CHURN);
+        double keyboard_remove = keyboards_remove(keyboards + alive, CHURN);
+        double pointer_add = pointers_add(server, pointers + alive, CHURN);
+        double pointer_remove = pointers_remove(pointers + alive, CHURN);
+        printf("%8zu %14.1fus %14.1fus %14.1fus %14.1fus\n", alive,
+            keyboard_add, keyboard_remove, pointer_add, pointer_remove);
+        fflush(stdout);
+    }
+
+    keyboards_remove(keyboards, alive);
+    pointers_remove(pointers, alive);
+    free(keyboards);
+    free(pointers);
+    return true;
+}
+
+static bool pool_is_empty(const struct wavo_pool *pool) {
+    if (pool->in_use != 0) {
+        fprintf(stderr, "leak: %zu %s objects still in use\n", pool->in_use,
+            pool->name);
+        return false;
+    }
+    return true;
+}
+
+static bool server_is_empty(struct wavo_server *server) {
+    bool empty = true;
+    if (!wl_list_empty(&server->views) || server->focused_view) {
+        fprintf(stderr, "leak: %d views still listed\n",
+            wl_list_length(&server->views));
+        empty = false;
+    }
+    if (server->input->grab_data) {
+        fprintf(stderr, "%s\n", "leak: grab still active");
+        empty = false;
+    }
+    empty &= pool_is_empty(&server->view_pool);
+    empty &= pool_is_empty(&server->popup_pool);
+    empty &= pool_is_empty(&server->keyboard_pool);
+    empty &= pool_is_empty(&server->pointer_pool);
+    empty &= pool_is_empty(&server->grab_pool);
+    return empty;
+}
+
+int main(void) {
+    // The client needs XDG_RUNTIME_DIR too
+    if (!headless_init_env()) {
+        return 1;
+    }
+    wlr_log_init(WLR_ERROR, NULL);
+
+    // Every keyboard holds a keymap file descriptor
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+
+    // The client is forked before the compositor starts any thread, and
+    // learns the socket name through the pipe
+    int socket_pipe[2];
+    if (pipe(socket_pipe) != 0) {
+        perror("pipe");
+        return 1;
+    }
+    fflush(stdout);
+    pid_t child = fork();
+    if (child < 0) {
+        perror("fork");
+        return 1;
+    }
+    if (child == 0) {
+        close(socket_pipe[1]);
+        char socket[64] = {0};
+        ssize_t len = read(socket_pipe[0], socket, sizeof(socket) - 1);
+        close(socket_pipe[0]);
+        // Without exit handlers, the compositor's memory is not ours to free
+        _exit(len > 0 ? client_run(socket) : 1);
+    }
+    close(socket_pipe[0]);
+
+    struct wavo_config config = {0};
+    struct wavo_server *server = headless_server_create(&config, 0);
+    if (!server || !wavo_output_create_virtual(server, 1920, 1080, 0)) {
+        fprintf(stderr, "failed to create server\n");
+        return 1;
+    }
+    const char *socket = getenv("WAYLAND_DISPLAY");
+    if (write(socket_pipe[1], socket, strlen(socket)) < 0) {
+        perror("write");
+        return 1;
+    }
+    close(socket_pipe[1]);
+
+    int status;
+    pid_t done;
+    while ((done = waitpid(child, &status, WNOHANG)) == 0) {
+        wavo_server_dispatch(server, 10);
+    }
+    bool ok = done == child && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    if (!ok) {
+        fprintf(stderr, "%s\n", "client failed");
+    }
+    // Lets the compositor notice the disconnect
+    headless_run_for(server, 100);
+
+    ok &= bench_devices(server);
+    ok &= server_is_empty(server);
+
+    wavo_server_destroy(server);
+    wavo_config_free(&config);
+    return ok ? 0 : 1;
+}
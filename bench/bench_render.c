@@ -0,0 +1,172 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <wayland-server-core.h>
+#include <wlr/types/wlr_output.h>
+#include <wlr/types/wlr_output_layout.h>
+#include <wlr/types/wlr_scene.h>
+#include <wlr/util/log.h>
+#include "wavo/buffer.h"
+#include "wavo/config.h"
+#include "wavo/latency.h"
+#include "wavo/output.h"
+#include "wavo/render.h"
+#include "wavo/server.h"
+#include "headless.h"
+
+// Frames per second of 1 to 4 headless 1080p outputs on the pixman
+// renderer, drawn on the main thread and then on the worker pool. Every
+// output shows a scaled wallpaper and two translucent windows, redrawn
+// from their frame callbacks, and runs at up to 1000 Hz, so rendering and
+// not the refresh rate sets the pace.
+
+#define RUN_MSEC 3000
+#define MAX_OUTPUTS 4
+#define WIDTH 1920
+#define HEIGHT 1080
+
+struct bench_layer {
+    struct wlr_scene_buffer *scene_buffer;
+    struct wl_listener frame_done;
+};
+
+// Opaque noise, so scaling and blending have real work to do
+static struct wlr_buffer *bench_buffer_create(int width, int height,
+    uint32_t seed) {
+    struct wavo_pixel_buffer *buffer = wavo_pixel_buffer_create(width, height);
+    if (!buffer) {
+        return NULL;
+    }
+    for (size_t i = 0; i < (size_t)width * (size_t)height; i++) {
+        seed = seed * 1103515245 + 12345;
+        buffer->pixels[i] = 0xFF000000 | (seed >> 8);
+    }
+    return &buffer->base;
+}
+
+static void layer_handle_frame_done(struct wl_listener *listener,
+    void *data) {
+    (void)data;
+    struct bench_layer *layer = wl_container_of(listener, layer, frame_done);
+    // The same buffer again damages the whole layer
+    wlr_scene_buffer_set_buffer(layer->scene_buffer,
+        layer->scene_buffer->buffer);
+}
+
+// Aggregate frames per second over every output
+static double bench_outputs(int count, bool parallel,
+    struct wlr_buffer *wallpaper, struct wlr_buffer *window) {
+    struct wavo_config config = {0};
+    struct wavo_server *server = headless_server_create(&config, 0);
+    if (!server) {
+        wavo_config_free(&config);
+        return -1.0;
+    }
+    if (parallel) {
+        server->render = wavo_render_create(server);
+        if (!server->render) {
+            goto error;
+        }
+    }
+
+    struct wavo_output *outputs[MAX_OUTPUTS];
+    struct bench_layer layers[MAX_OUTPUTS][3];
+    for (int i = 0; i < count; i++) {
+        outputs[i] = wavo_output_create_virtual(server, WIDTH, HEIGHT,
+            1000000);
+        if (!outputs[i]) {
+            goto error;
+        }
+        struct wlr_box box;
+        wlr_output_layout_get_box(server->output_layout,
+            outputs[i]->wlr_output, &box);
+
+        for (int j = 0; j < 3; j++) {
+            struct bench_layer *layer = &layers[i][j];
+            layer->scene_buffer = wlr_scene_buffer_create(server->view_tree,
+                j == 0 ? wallpaper : window);
+            if (j == 0) {
+                wlr_scene_buffer_set_dest_size(layer->scene_buffer, WIDTH,
+                    HEIGHT);
+                wlr_scene_node_set_position(&layer->scene_buffer->node,
+                    box.x, box.y);
+            } else {
+                wlr_scene_buffer_set_opacity(layer->scene_buffer, 0.9f);
+                wlr_scene_node_set_position(&layer->scene_buffer->node,
+                    box.x + 200 + j * 300, box.y + 100 + j * 150);
+            }
+            layer->frame_done.notify = layer_handle_frame_done;
+            wl_signal_add(&layer->scene_buffer->events.frame_done,
+                &layer->frame_done);
+        }
+    }
+
+    // Settle, then count commits
+    headless_run_for(server, 200);
+    uint32_t start_seq[MAX_OUTPUTS];
+    for (int i = 0; i < count; i++) {
+        start_seq[i] = outputs[i]->wlr_output->commit_seq;
+    }
+    uint64_t start = wavo_latency_now_usec();
+    headless_run_for(server, RUN_MSEC);
+    double elapsed = (double)(wavo_latency_now_usec() - start) / 1e6;
+
+    uint32_t frames = 0;
+    for (int i = 0; i < count; i++) {
+        frames += outputs[i]->wlr_output->commit_seq - start_seq[i];
+        for (int j = 0; j < 3; j++) {
+            wl_list_remove(&layers[i][j].frame_done.link);
+        }
+    }
+
+    wavo_server_destroy(server);
+    wavo_config_free(&config);
+    return frames / elapsed;
+
+error:
+    wavo_server_destroy(server);
+    wavo_config_free(&config);
+    return -1.0;
+}
+
+int main(void) {
+    if (!headless_init_env()) {
+        return 1;
+    }
+    wlr_log_init(WLR_ERROR, NULL);
+
+    struct wlr_buffer *wallpaper = bench_buffer_create(WIDTH / 2, HEIGHT / 2,
+        1);
+    struct wlr_buffer *window = bench_buffer_create(800, 600, 2);
+    if (!wallpaper || !window) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    double serial_one = 0.0, parallel_one = 0.0;
+    for (int count = 1; count <= MAX_OUTPUTS; count++) {
+        double serial = bench_outputs(count, false, wallpaper,
+            window);
+        double parallel = bench_outputs(count, true, wallpaper,
+            window);
+        if (serial < 0.0 || parallel < 0.0) {
+            fprintf(stderr, "failed to run %d outputs\n", count);
+            return 1;
+        }
+        if (count == 1) {
+            serial_one = serial;
+            parallel_one = parallel;
+        }
+
+        // Scaling is aggregate throughput against a single output, perfect
+        // scaling being the output count
+        printf("%d outputs serial   %7.1f fps %5.2fx\n", count, serial,
+            serial / serial_one);
+        printf("%d outputs parallel %7.1f fps %5.2fx\n", count, parallel,
+            parallel / parallel_one);
+    }
+
+    wlr_buffer_drop(wallpaper);
+    wlr_buffer_drop(window);
+    return 0;
+}
@@ -7,6 +7,21 @@ config = {
     menu = "rofi -show drun",
 }
 
+-- Keyboard layout, any field left out uses the XKB defaults. The compiled
+-- keymap is cached in ~/.cache/wavo/keymaps.
+keyboard = {
+    layout = "us",
+    -- variant = "",
+    -- options = "caps:escape",
+}
+
+-- Idle: after `timeout` seconds without input, and while no client inhibits
+-- idle (e.g. a video player), stop rendering. 0 never idles.
+idle = {
+    timeout = 0,
+    -- power_off = true,  -- Also turn the outputs off
+}
+
 -- Key bindings
 keys = {
     -- Terminal
@@ -32,8 +47,31 @@ window_rules = {
     },
 }
 
+-- Outputs
+-- Scale is sent to clients through wp_fractional_scale_v1 so they can render
+-- at native resolution. Mode is "WIDTHxHEIGHT" with an optional "@HZ".
+outputs = {
+    -- {name = "eDP-1", scale = 1.5},
+    -- {name = "HDMI-A-1", mode = "2560x1440@144", scale = 2},
+    -- Show eDP-1 on the projector instead of extending the desktop
+    -- {name = "DP-2", mirror = "eDP-1"},
+}
+
 -- Workspaces
 workspaces = {
     count = 9,
     names = {"1", "2", "3", "4", "5", "6", "7", "8", "9"},
 }
+
+-- Event hooks go in hooks.lua next to this file, not here: wavo.on() is
+-- ignored in this config. hooks.lua runs in a sandbox of its own, so it can
+-- not use io, require, dofile, os.execute and the like, nor string.find,
+-- match, gmatch, gsub and rep or table.concat and sort, whose single calls
+-- could run past the budget. "map", "unmap" and "focus" get a view (id,
+-- app_id, title), "output_add" and "output_remove" an output (id, name,
+-- width, height, refresh in Hz). Hooks run between frames, each call within
+-- 1ms and 200000 instructions, all of them within 8MiB. A hook over budget
+-- three times in a row is disabled. In hooks.lua:
+-- wavo.on("map", function(view)
+--     print("mapped " .. view.app_id)
+-- end)
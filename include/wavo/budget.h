@@ -0,0 +1,72 @@
+#ifndef WAVO_BUDGET_H
+#define WAVO_BUDGET_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <wayland-server-core.h>
+
+struct wavo_server;
+struct wavo_view;
+
+// Refills at rate tokens per second up to burst, starting out full
+struct wavo_token_bucket {
+    double tokens;
+    uint64_t refill_usec;  // 0 until first used
+};
+
+bool wavo_token_bucket_take(struct wavo_token_bucket *bucket, double rate,
+    double burst, uint64_t now_usec);
+
+enum wavo_budget_kind {
+    WAVO_BUDGET_COMMIT,     // Surface commits of the client's views
+    WAVO_BUDGET_METADATA,   // set_title and set_app_id
+    WAVO_BUDGET_CONFIGURE,  // Requests answered with a configure or grab
+    WAVO_BUDGET_KIND_COUNT,
+};
+
+// Per-client request budgets, so one client flooding the compositor cannot
+// slow down everyone else's frames. Work over budget is not dropped where
+// the protocol expects an answer: the view marks it deferred (see
+// wavo_view::deferred) and it runs once per tick, however many requests
+// came in meanwhile. Commits over budget are held back whole, buffer
+// upload, damage and frame callbacks included (see wavo_view::commits_held).
+struct wavo_client_budget {
+    struct wl_client *client;
+    struct wavo_token_bucket buckets[WAVO_BUDGET_KIND_COUNT];
+    uint64_t throttled[WAVO_BUDGET_KIND_COUNT];
+    struct wl_listener destroy;
+    struct wl_list link;  // wavo_budgets::clients
+};
+
+struct wavo_budgets {
+    struct wavo_server *server;
+    struct wl_list clients;   // wavo_client_budget::link
+    struct wl_list deferred;  // wavo_view::deferred_link
+    struct wl_event_source *timer;
+    bool timer_armed;
+
+    uint64_t throttled[WAVO_BUDGET_KIND_COUNT];  // Including gone clients
+    uint64_t coalesced;  // Deferred view updates run
+};
+
+struct wavo_budgets *wavo_budgets_create(struct wavo_server *server);
+void wavo_budgets_destroy(struct wavo_budgets *budgets);
+
+// Returns false once the client ran out of budget for kind
+bool wavo_budget_take(struct wavo_budgets *budgets, struct wl_client *client,
+    enum wavo_budget_kind kind);
+
+// Queues wavo_view_apply_deferred() for the next tick, flags accumulate
+void wavo_budget_defer(struct wavo_budgets *budgets, struct wavo_view *view,
+    uint32_t flags);
+// Drops the view's deferred work, for unmap and destroy
+void wavo_budget_cancel(struct wavo_view *view);
+
+// Times the client was throttled, over all kinds
+uint64_t wavo_budget_client_throttled(struct wavo_budgets *budgets,
+    struct wl_client *client);
+
+void wavo_budgets_print_metrics(struct wavo_budgets *budgets, FILE *out);
+
+#endif // WAVO_BUDGET_H
@@ -0,0 +1,19 @@
+#ifndef WAVO_BUFFER_H
+#define WAVO_BUFFER_H
+
+#include <stdint.h>
+#include <wlr/types/wlr_buffer.h>
+
+// Read-only ARGB8888 wlr_buffer in plain memory, premultiplied, stride
+// width * 4. The compositor fills these itself, e.g. thumbnails; tests,
+// benchmarks and tools use them to stand in for client buffers.
+struct wavo_pixel_buffer {
+    struct wlr_buffer base;
+    uint32_t *pixels;
+};
+
+// Returns a buffer of transparent pixels, or NULL when out of memory.
+// Freed by dropping it once unlocked, like any wlr_buffer.
+struct wavo_pixel_buffer *wavo_pixel_buffer_create(int width, int height);
+
+#endif // WAVO_BUFFER_H
@@ -0,0 +1,31 @@
+#ifndef WAVO_CLIENTS_H
+#define WAVO_CLIENTS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+#include <wayland-server-core.h>
+
+struct wavo_server;
+
+// Compositor-side memory a client is holding on to. Computed on demand by
+// walking its views, so it costs nothing until queried.
+struct wavo_client_stats {
+    pid_t pid;
+    size_t views;
+    size_t scene_nodes;
+    size_t buffers;        // Scene buffers with a client buffer attached
+    uint64_t buffer_bytes; // Exact for shm, estimated at 4 bpp otherwise
+    size_t resources;      // Protocol objects, wl_surface and up
+    uint64_t throttled;    // Requests over budget, see budget.h
+    size_t unresponsive;   // Views that missed a ping, see watchdog.h
+};
+
+void wavo_client_stats_get(struct wavo_server *server, struct wl_client *client,
+    struct wavo_client_stats *stats);
+
+// One line per connected client, largest buffer_bytes first
+void wavo_clients_print(struct wavo_server *server, FILE *out);
+
+#endif // WAVO_CLIENTS_H
@@ -2,8 +2,31 @@
 #define WAVO_CONFIG_H
 
 #include <stdbool.h>
+#include <stddef.h>
+
+struct wavo_output_config {
+    char *name;
+    float scale;
+    // Requested mode, 0 means the output's preferred mode
+    int width;
+    int height;
+    int refresh;  // mHz, 0 means any
+    char *mirror;  // Name of the output to mirror, or NULL
+};
+
+// XKB rules, model, layout, variant and options. NULL fields fall back to
+// the XKB_DEFAULT_* environment and then to xkbcommon's defaults.
+struct wavo_keyboard_config {
+    char *rules;
+    char *model;
+    char *layout;
+    char *variant;
+    char *options;
+};
 
 struct wavo_config {
+    char *path;  // File loaded, NULL for the defaults
+    char *hooks_path;  // hooks.lua next to it, which may not exist
     char *terminal;
     char *mod_key;
     char *menu;
@@ -15,11 +38,20 @@ struct wavo_config {
     // Input
     int repeat_rate;
     int repeat_delay;
+    struct wavo_keyboard_config keyboard;
+
+    // Idle: no input for idle_timeout_msec stops rendering, 0 disables it
+    int idle_timeout_msec;
+    bool idle_power_off;  // Also turn the outputs off
     
     // Theme
     char *background_color;
     int border_width;
     char *border_color;
+
+    // Outputs
+    struct wavo_output_config *outputs;
+    size_t output_count;
 };
 
 // Load the default configuration
@@ -34,4 +66,12 @@ bool wavo_config_validate(struct wavo_config *config);
 // Free configuration resources
 void wavo_config_free(struct wavo_config *config);
 
+// Find the configuration for an output by connector name
+const struct wavo_output_config *wavo_config_find_output(
+    const struct wavo_config *config, const char *name);
+
+// Parse a mode string such as "2560x1440" or "1920x1080@59.94"
+bool wavo_config_parse_mode(const char *mode, int *width, int *height,
+    int *refresh);
+
 #endif // WAVO_CONFIG_H
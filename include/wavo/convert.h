@@ -0,0 +1,37 @@
+#ifndef WAVO_CONVERT_H
+#define WAVO_CONVERT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// XRGB8888 to BT.601 limited-range YUV 4:2:0 conversion for capture
+// consumers. Every implementation produces bit-identical output.
+enum wavo_convert_impl {
+    WAVO_CONVERT_SCALAR,
+    WAVO_CONVERT_SSE41,
+    WAVO_CONVERT_AVX2,  // AVX2 luma, SSE4.1 chroma
+};
+
+enum wavo_yuv_layout {
+    WAVO_YUV_NV12,  // Y plane, interleaved UV plane
+    WAVO_YUV_I420,  // Y plane, U plane, V plane
+};
+
+struct wavo_yuv_image {
+    enum wavo_yuv_layout layout;
+    uint8_t *planes[3];
+    uint32_t strides[3];
+};
+
+// Fastest implementation supported by the running CPU
+enum wavo_convert_impl wavo_convert_best_impl(void);
+bool wavo_convert_impl_supported(enum wavo_convert_impl impl);
+const char *wavo_convert_impl_name(enum wavo_convert_impl impl);
+
+// Convert a width x height block of XRGB8888 pixels starting at src into dst
+// at (x, y). x, y, width and height must be even.
+void wavo_convert_to_yuv(enum wavo_convert_impl impl, const uint8_t *src,
+    uint32_t src_stride, const struct wavo_yuv_image *dst,
+    int x, int y, int width, int height);
+
+#endif // WAVO_CONVERT_H
@@ -0,0 +1,59 @@
+#ifndef WAVO_FOREIGN_TOPLEVEL_H
+#define WAVO_FOREIGN_TOPLEVEL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <wayland-server-core.h>
+
+struct wavo_server;
+struct wavo_output;
+struct wavo_view;
+
+// wlr-foreign-toplevel-management-unstable-v1 for taskbars and docks. Title
+// and app_id changes only mark a view dirty and schedule a frame on its
+// primary output, which sends them, so a client retitling on every keystroke
+// costs each panel at most one update per frame. Views without an output, or
+// all of them while idle, have no frame coming and are sent right away.
+struct wavo_foreign_toplevel {
+    struct wavo_view *view;
+    struct wlr_foreign_toplevel_handle_v1 *handle;
+    bool dirty;
+    struct wl_list dirty_link;  // wavo_foreign_toplevels::dirty
+
+    struct wl_listener request_activate;
+    struct wl_listener request_close;
+};
+
+struct wavo_foreign_toplevels {
+    struct wavo_server *server;
+    struct wlr_foreign_toplevel_manager_v1 *manager;
+    struct wl_list dirty;  // wavo_foreign_toplevel::dirty_link
+
+    uint64_t updates;    // Title or app_id changes sent
+    uint64_t coalesced;  // Changes folded into a pending update
+};
+
+struct wavo_foreign_toplevels *wavo_foreign_toplevels_create(
+    struct wavo_server *server);
+void wavo_foreign_toplevels_destroy(struct wavo_foreign_toplevels *toplevels);
+
+// Handle lifetime follows the view being mapped
+void wavo_foreign_toplevel_map(struct wavo_view *view);
+void wavo_foreign_toplevel_unmap(struct wavo_view *view);
+
+// Title or app_id of the view changed
+void wavo_foreign_toplevel_mark_dirty(struct wavo_view *view);
+void wavo_foreign_toplevel_set_output(struct wavo_view *view,
+    struct wavo_output *old_output);
+void wavo_foreign_toplevel_set_activated(struct wavo_view *view,
+    bool activated);
+
+// Sends pending updates of the views paced by output, called every frame
+void wavo_foreign_toplevels_flush(struct wavo_foreign_toplevels *toplevels,
+    struct wavo_output *output);
+
+void wavo_foreign_toplevels_print_metrics(
+    struct wavo_foreign_toplevels *toplevels, FILE *out);
+
+#endif // WAVO_FOREIGN_TOPLEVEL_H
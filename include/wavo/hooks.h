@@ -0,0 +1,112 @@
+#ifndef WAVO_HOOKS_H
+#define WAVO_HOOKS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "wavo/latency.h"
+
+struct lua_State;
+struct wl_event_source;
+struct wavo_server;
+struct wavo_output;
+struct wavo_view;
+
+enum wavo_hook_type {
+    WAVO_HOOK_MAP,            // "map", a view was mapped
+    WAVO_HOOK_UNMAP,          // "unmap"
+    WAVO_HOOK_FOCUS,          // "focus", a view got keyboard focus
+    WAVO_HOOK_OUTPUT_ADD,     // "output_add"
+    WAVO_HOOK_OUTPUT_REMOVE,  // "output_remove"
+    WAVO_HOOK_TYPE_COUNT,
+};
+
+// What a hook gets, copied at emit time since the view or output may be
+// gone by the time it runs
+struct wavo_hook_event {
+    enum wavo_hook_type type;
+    uint32_t id;        // View or output id
+    char name[64];      // app_id of a view, name of an output
+    char title[128];    // Views only, truncated
+    int width, height;  // Outputs only
+    int refresh;        // mHz, outputs only
+};
+
+struct wavo_hook {
+    enum wavo_hook_type type;
+    int ref;  // Function in the Lua registry
+    bool disabled;  // After too many overruns in a row
+    uint32_t overruns_in_row;
+
+    uint64_t calls;
+    uint64_t failures;  // Script errors
+    uint64_t overruns;  // Aborted for time, instructions or memory
+    struct wavo_latency_histogram run_time;
+};
+
+#define WAVO_HOOKS_QUEUE_SIZE 256
+
+// Lua callbacks registered with wavo.on(event, fn) from hooks.lua, a file
+// of its own next to the config. They run in a sandboxed Lua state of their
+// own that lives as long as the compositor, never from inside the event
+// that triggered them: events are queued and run after an output frame,
+// only as long as the next frame of every output is not due, or from a
+// timer when no frame is coming. Each call has a memory, instruction and
+// time budget; a hook over budget is aborted and disabled after a few
+// overruns in a row.
+struct wavo_hooks {
+    struct wavo_server *server;
+    struct lua_State *L;
+    struct wl_event_source *timer;  // NULL without a server
+    bool timer_armed;
+
+    struct wavo_hook *hooks;
+    size_t hook_count;
+    size_t hook_capacity;
+    size_t type_count[WAVO_HOOK_TYPE_COUNT];  // Enabled hooks per type
+
+    struct wavo_hook_event queue[WAVO_HOOKS_QUEUE_SIZE];
+    size_t queue_head;
+    size_t queue_length;
+    size_t next_hook;  // Where the head event continues after a cut
+    bool loading;  // wavo.on() only works while hooks.lua runs
+
+    // Budget of the call in progress
+    uint64_t deadline_usec;
+    uint64_t checks_left;
+    bool overrun;
+
+    size_t memory;
+    size_t memory_peak;
+
+    uint64_t queued;
+    uint64_t dropped;   // Queue full
+    uint64_t deferred;  // Runs cut short by an upcoming frame
+};
+
+// Runs the hooks file at path in a new Lua state to collect its hooks.
+// Returns NULL if the script fails to load there.
+struct wavo_hooks *wavo_hooks_create(struct wavo_server *server,
+    const char *path);
+void wavo_hooks_destroy(struct wavo_hooks *hooks);
+
+// Queues event for the hooks of its type, if there are any
+void wavo_hooks_emit(struct wavo_hooks *hooks,
+    const struct wavo_hook_event *event);
+void wavo_hooks_emit_view(struct wavo_hooks *hooks, enum wavo_hook_type type,
+    struct wavo_view *view);
+void wavo_hooks_emit_output(struct wavo_hooks *hooks,
+    enum wavo_hook_type type, struct wavo_output *output);
+
+// Runs queued events for at most budget_usec, starting a call only if its
+// whole time limit fits. Returns the number of events completed.
+size_t wavo_hooks_run(struct wavo_hooks *hooks, uint64_t budget_usec);
+
+// After a frame was committed, runs for part of the time left until the
+// earliest next frame of any output
+void wavo_hooks_run_after_frame(struct wavo_hooks *hooks);
+
+void wavo_hooks_print_metrics(struct wavo_hooks *hooks, FILE *out);
+
+#endif // WAVO_HOOKS_H
@@ -0,0 +1,42 @@
+#ifndef WAVO_IDLE_H
+#define WAVO_IDLE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <wayland-server-core.h>
+
+struct wavo_server;
+
+// Compositor idle state, plus ext-idle-notify-v1 and idle-inhibit-unstable-v1
+// for clients. Once no input arrived for the configured timeout and no
+// inhibitor exists, outputs stop rendering and sending frame callbacks
+// (optionally powering off), so an idle session has nothing to wake up for.
+// The first input event wakes every output again.
+struct wavo_idle {
+    struct wavo_server *server;
+    struct wlr_idle_notifier_v1 *notifier;
+    struct wlr_idle_inhibit_manager_v1 *inhibit_manager;
+
+    // Armed lazily: input only records its time, the timer re-arms itself
+    // for the remainder when it fires early
+    struct wl_event_source *timer;
+    bool timer_armed;
+    uint64_t last_activity_usec;
+
+    bool idle;
+    size_t inhibitors;
+    uint64_t idle_entered;
+
+    struct wl_listener new_inhibitor;
+};
+
+struct wavo_idle *wavo_idle_create(struct wavo_server *server);
+void wavo_idle_destroy(struct wavo_idle *idle);
+
+// Called for every input event
+void wavo_idle_notify_activity(struct wavo_idle *idle);
+
+void wavo_idle_print_metrics(struct wavo_idle *idle, FILE *out);
+
+#endif // WAVO_IDLE_H
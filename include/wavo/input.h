@@ -1,12 +1,18 @@
 #ifndef WAVO_INPUT_H
 #define WAVO_INPUT_H
 
+#include <stdbool.h>
+#include <stdint.h>
 #include <wayland-server-core.h>
 #include <wlr/types/wlr_cursor.h>
 #include <wlr/types/wlr_input_device.h>
 #include <wlr/types/wlr_keyboard.h>
+#include <wlr/types/wlr_keyboard_group.h>
 #include <wlr/types/wlr_pointer.h>
+#include <wlr/types/wlr_pointer_constraints_v1.h>
+#include <wlr/types/wlr_relative_pointer_v1.h>
 #include <wlr/types/wlr_seat.h>
+#include <xkbcommon/xkbcommon.h>
 
 struct wavo_input {
     struct wavo_server *server;
@@ -14,10 +20,21 @@ struct wavo_input {
     
     struct wlr_cursor *cursor;
     struct wlr_xcursor_manager *cursor_mgr;
+    bool cursor_default;  // Showing the "default" xcursor, not a client's
     
+    struct xkb_context *xkb_context;
+    struct xkb_keymap *keymap;  // Configured keymap, shared by all keyboards
+
     struct wl_list keyboards;  // wavo_keyboard::link
+    struct wl_list keyboard_groups;  // wavo_keyboard_group::link
+    uint64_t seat_keyboard_switches;
     struct wl_list pointers;   // wavo_pointer::link
     
+    struct wlr_relative_pointer_manager_v1 *relative_pointer_mgr;
+    struct wlr_pointer_constraints_v1 *pointer_constraints;
+    struct wlr_pointer_constraint_v1 *active_constraint;
+    double constraint_x, constraint_y;  // Layout position of its surface
+
     void *grab_data;  // For interactive move/resize
     
     struct wl_listener new_input;
@@ -27,15 +44,30 @@ struct wavo_input {
     struct wl_listener cursor_axis;
     struct wl_listener cursor_frame;
     struct wl_listener request_cursor;
+    struct wl_listener new_constraint;
+    struct wl_listener new_virtual_keyboard;
+    struct wl_listener new_virtual_pointer;
+};
+
+// Keyboards with the same keymap and repeat info act as one seat keyboard,
+// so typing on another member does not resend the keymap to clients
+struct wavo_keyboard_group {
+    struct wavo_input *input;
+    struct wlr_keyboard_group *wlr_group;
+    struct wl_list link;
+
+    struct wl_listener modifiers;
+    struct wl_listener key;
 };
 
 struct wavo_keyboard {
     struct wavo_input *input;
     struct wlr_input_device *device;
     struct wlr_keyboard *wlr_keyboard;
+    struct wavo_keyboard_group *group;  // NULL for virtual keyboards
     struct wl_list link;
 
-    struct wl_listener modifiers;
+    struct wl_listener modifiers;  // Virtual keyboards only
     struct wl_listener key;
     struct wl_listener destroy;
 };
@@ -49,7 +81,39 @@ struct wavo_pointer {
     struct wl_listener destroy;
 };
 
+struct wavo_pointer_constraint {
+    struct wavo_input *input;
+    struct wlr_pointer_constraint_v1 *constraint;
+
+    struct wl_listener set_region;
+    struct wl_listener destroy;
+};
+
 struct wavo_input *wavo_input_create(struct wavo_server *server);
 void wavo_input_destroy(struct wavo_input *input);
 
+// Sets up a keyboard or pointer, from the backend or a virtual input client
+void wavo_input_add_device(struct wavo_input *input,
+    struct wlr_input_device *device);
+
+// Keyboards (src/input/keyboard.c)
+bool wavo_input_init_keymap(struct wavo_input *input);
+void wavo_input_finish_keymap(struct wavo_input *input);
+struct wavo_keyboard *wavo_keyboard_create(struct wavo_input *input,
+    struct wlr_input_device *device);
+void wavo_keyboard_destroy(struct wavo_keyboard *keyboard);
+
+// Pointers (src/input/pointer.c)
+bool wavo_input_init_pointer(struct wavo_input *input);
+void wavo_input_finish_pointer(struct wavo_input *input);
+
+// Sends the deltas as relative motion, then moves the cursor within the
+// active pointer constraint and updates pointer focus
+void wavo_pointer_motion(struct wavo_input *input,
+    struct wlr_input_device *device, uint32_t time_msec,
+    double dx, double dy, double dx_unaccel, double dy_unaccel);
+
+// Hit-tests the scene at the cursor and gives the surface there pointer focus
+void wavo_pointer_update_focus(struct wavo_input *input, uint32_t time_msec);
+
 #endif // WAVO_INPUT_H
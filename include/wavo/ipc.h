@@ -0,0 +1,38 @@
+#ifndef WAVO_IPC_H
+#define WAVO_IPC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <sys/un.h>
+#include <wayland-server-core.h>
+
+struct wavo_server;
+
+// Environment variable holding the control socket path for child processes
+#define WAVO_IPC_SOCKET_ENV "WAVO_SOCK"
+
+// Control socket. A client sends a single command line and gets back "ok"
+// or "error: <reason>", followed by the command's output, after which the
+// connection is closed.
+struct wavo_ipc {
+    struct wavo_server *server;
+    int fd;
+    char path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+    struct wl_event_source *source;
+    struct wl_list clients;  // ipc_client::link
+};
+
+struct wavo_ipc *wavo_ipc_create(struct wavo_server *server,
+    const char *display_name);
+void wavo_ipc_destroy(struct wavo_ipc *ipc);
+
+// Runs a command line against the server, writing the reply body to out.
+// Returns false and writes the reason to out if the command failed.
+bool wavo_ipc_execute(struct wavo_server *server, char *line, FILE *out);
+
+// Client side of `wavo msg`: sends the arguments as one command and prints
+// the reply. Returns the process exit status.
+int wavo_ipc_client_run(int argc, char *argv[]);
+
+#endif // WAVO_IPC_H
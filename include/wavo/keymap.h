@@ -0,0 +1,27 @@
+#ifndef WAVO_KEYMAP_H
+#define WAVO_KEYMAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <xkbcommon/xkbcommon.h>
+
+// Compiling a keymap from RMLVO names resolves includes across the XKB data
+// files and dominates keyboard setup. The serialized keymap is cached on disk
+// so later startups only parse one self-contained file.
+
+// Cache key over the names, after XKB_DEFAULT_* fallbacks, and the
+// timestamps of the rules files they resolve through
+uint64_t wavo_keymap_cache_key(struct xkb_context *context,
+    const struct xkb_rule_names *names);
+
+// $XDG_CACHE_HOME/wavo/keymaps, or ~/.cache/wavo/keymaps
+bool wavo_keymap_cache_dir(char *path, size_t size);
+
+// Loads the keymap from cache_dir if possible, otherwise compiles it and
+// stores it there. cache_dir may be NULL to disable caching.
+struct xkb_keymap *wavo_keymap_load(struct xkb_context *context,
+    const struct xkb_rule_names *names, const char *cache_dir,
+    bool *cache_hit);
+
+#endif // WAVO_KEYMAP_H
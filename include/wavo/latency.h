@@ -0,0 +1,49 @@
+#ifndef WAVO_LATENCY_H
+#define WAVO_LATENCY_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+struct wavo_server;
+
+// Log-linear buckets: values below 4us get their own bucket, every power of
+// two above that is split into 4 sub-buckets (<= 25% resolution). The last
+// bucket collects everything above ~67s.
+#define WAVO_LATENCY_SUB_BUCKETS 4
+#define WAVO_LATENCY_BUCKETS (WAVO_LATENCY_SUB_BUCKETS * 26)
+
+struct wavo_latency_histogram {
+    uint64_t buckets[WAVO_LATENCY_BUCKETS];
+    uint64_t count;
+    uint64_t sum_usec;
+    uint64_t max_usec;
+};
+
+void wavo_latency_histogram_add(struct wavo_latency_histogram *hist,
+    uint64_t usec);
+void wavo_latency_histogram_reset(struct wavo_latency_histogram *hist);
+
+// Returns the upper bound of the bucket holding the given percentile
+// (0-100), so the result never under-reports against an SLO.
+uint64_t wavo_latency_histogram_percentile(
+    const struct wavo_latency_histogram *hist, double percentile);
+
+size_t wavo_latency_bucket_index(uint64_t usec);
+uint64_t wavo_latency_bucket_upper(size_t index);
+
+// Writes "<prefix>_count", "_p50", "_p90", "_p99" and "_max" metric lines
+void wavo_latency_histogram_print(const struct wavo_latency_histogram *hist,
+    const char *prefix, FILE *out);
+
+// Input events carry a 32-bit CLOCK_MONOTONIC millisecond timestamp. Expand
+// it to microseconds relative to now, handling wrap-around and clamping
+// timestamps from the future or from a different clock.
+uint64_t wavo_latency_input_usec(uint32_t time_msec, uint64_t now_usec);
+
+uint64_t wavo_latency_now_usec(void);
+
+// Records an input event so the next presentation on every output can be
+// attributed to it
+void wavo_latency_note_input(struct wavo_server *server, uint32_t time_msec);
+
+#endif // WAVO_LATENCY_H
@@ -0,0 +1,37 @@
+#ifndef WAVO_LOG_H
+#define WAVO_LOG_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <wlr/util/log.h>
+
+// wlr_log backend that never blocks the caller. Messages are formatted into
+// a fixed lock-free ring and written to fd by a background thread; when the
+// ring is full they are dropped and counted. Each call site ([file:line])
+// may log WAVO_LOG_BURST messages per second, and a message identical to the
+// site's previous one is only repeated every WAVO_LOG_REPEAT_SEC. Skipped
+// messages are summarized by the site's next line. Fatal signals write out
+// whatever is still queued, then go on to the handler installed before, a
+// sanitizer's for one, or the default action.
+#define WAVO_LOG_RING_SIZE 256  // Entries, power of two
+#define WAVO_LOG_LINE_MAX 512
+#define WAVO_LOG_BURST 10
+#define WAVO_LOG_REPEAT_SEC 10
+
+struct wavo_log_stats {
+    uint64_t written;
+    uint64_t suppressed;  // Rate limited or repeated
+    uint64_t dropped;     // Ring full
+};
+
+bool wavo_log_init(enum wlr_log_importance verbosity, int fd);
+
+// Writes out everything queued and stops the writer thread. wlr_log keeps
+// working afterwards, synchronously.
+void wavo_log_finish(void);
+
+void wavo_log_get_stats(struct wavo_log_stats *stats);
+void wavo_log_print_metrics(FILE *out);
+
+#endif // WAVO_LOG_H
@@ -0,0 +1,11 @@
+#ifndef WAVO_METRICS_H
+#define WAVO_METRICS_H
+
+#include <stdio.h>
+
+struct wavo_server;
+
+// Write all compositor metrics as "name value" lines
+void wavo_metrics_dump(struct wavo_server *server, FILE *out);
+
+#endif // WAVO_METRICS_H
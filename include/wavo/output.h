@@ -1,18 +1,61 @@
 #ifndef WAVO_OUTPUT_H
 #define WAVO_OUTPUT_H
 
+#include <stdint.h>
 #include <wayland-server-core.h>
 #include <wlr/types/wlr_output.h>
 #include <wlr/types/wlr_scene.h>
+#include <wlr/util/box.h>
+#include "wavo/latency.h"
 #include "wavo/server.h"
 
+struct wavo_output_config;
+struct wavo_render_job;
+
 struct wavo_output {
     struct wavo_server *server;
     struct wlr_output *wlr_output;
-    struct wlr_scene_output *scene_output;
+    struct wlr_scene_output *scene_output;  // NULL for mirror targets
+    const struct wavo_output_config *config;  // May be NULL
+    bool is_virtual;  // Headless output created at runtime
+    uint32_t id;  // Stable name in recordings, never reused
     struct wl_list link;  // wavo_server::outputs
 
+    // Mirror targets show their source's frames instead of compositing the
+    // scene, and are not part of the output layout
+    struct wavo_output *mirror_source;
+    struct wlr_buffer *mirror_buffer;  // Latest source frame not yet shown
+    uint64_t mirror_direct_frames;     // Source buffer scanned out as is
+    uint64_t mirror_blit_frames;       // Scaled or letterboxed copies
+    struct wl_listener mirror_commit;  // mirror_source's wlr_output commit
+
+    // Input-to-photon latency: the oldest input not yet committed, and the
+    // input carried by the commit we are waiting to see presented. Input
+    // still pending after two refresh periods redrew nothing here and is
+    // dropped at the next commit, counted in stale_inputs.
+    uint64_t pending_input_usec;
+    uint64_t inflight_input_usec;
+    uint32_t inflight_commit_seq;
+    uint64_t stale_inputs;
+    struct wavo_latency_histogram input_latency;
+
+    // Scheduling jitter: vblank to the present event being handled, and the
+    // deviation of back-to-back presents from the refresh period
+    uint64_t last_present_usec;
+    struct wavo_latency_histogram present_delay;
+    struct wavo_latency_histogram frame_jitter;
+
+    // Frame event to the commit being submitted, whether drawn here or on a
+    // worker
+    uint64_t frame_start_usec;
+    struct wavo_latency_histogram frame_time;
+
+    bool idle_off;  // Powered off by idle, powered on again when it ends
+
+    struct wavo_render_job *render_job;  // Frame drawing on a worker
+
     struct wl_listener frame;
+    struct wl_listener present;
     struct wl_listener destroy;
 };
 
@@ -20,4 +63,25 @@ struct wavo_output *wavo_output_create(struct wavo_server *server,
     struct wlr_output *wlr_output);
 void wavo_output_destroy(struct wavo_output *output);
 
+// Adds a headless output with the given mode, refresh in mHz (0 for 60Hz)
+struct wavo_output *wavo_output_create_virtual(struct wavo_server *server,
+    int width, int height, int refresh);
+
+// Idle power management. Only outputs powered off by this come back on.
+void wavo_output_set_power(struct wavo_output *output, bool on);
+
+struct wavo_output *wavo_output_find(struct wavo_server *server,
+    const char *name);
+
+// Frame callbacks and bookkeeping after a frame was committed, or after a
+// frame event with nothing to draw. commit_seq is the seq before the commit.
+void wavo_output_finish_frame(struct wavo_output *output, uint32_t commit_seq);
+
+bool wavo_output_is_mirror(const struct wavo_output *output);
+
+// Largest box with the aspect ratio of src_width x src_height that fits in
+// dst_width x dst_height, centered
+void wavo_output_letterbox(int src_width, int src_height, int dst_width,
+    int dst_height, struct wlr_box *box);
+
 #endif // WAVO_OUTPUT_H
@@ -0,0 +1,49 @@
+#ifndef WAVO_POOL_H
+#define WAVO_POOL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Slab pool for fixed-size compositor objects. Objects are carved from
+// slabs of slab_objects each and recycled through a LIFO free list, so
+// short-lived objects such as drag grabs reuse the same warm memory instead
+// of fragmenting the heap. Slabs are only released by wavo_pool_finish(), or
+// by wavo_pool_trim() under memory pressure.
+struct wavo_pool {
+    const char *name;
+    size_t object_size;  // Rounded up to max_align_t
+    size_t slab_objects;
+
+    struct wavo_pool_slab *slabs;
+    struct wavo_pool_free *free_list;
+
+    size_t in_use;
+    size_t capacity;
+    size_t slab_count;
+    uint64_t allocs;
+
+    bool locked;  // Slabs are mapped and mlock()ed as they are added
+    size_t locked_bytes;
+};
+
+void wavo_pool_init(struct wavo_pool *pool, const char *name,
+    size_t object_size, size_t slab_objects);
+void wavo_pool_finish(struct wavo_pool *pool);
+
+// Returns a zeroed object, or NULL when out of memory
+void *wavo_pool_alloc(struct wavo_pool *pool);
+void wavo_pool_free(struct wavo_pool *pool, void *object);
+
+// Frees every slab with no object in use, returns the bytes released
+size_t wavo_pool_trim(struct wavo_pool *pool);
+
+// Keeps the pool's slabs, present and future, resident in RAM. Returns false
+// if any could not be locked, e.g. over RLIMIT_MEMLOCK.
+bool wavo_pool_lock(struct wavo_pool *pool);
+
+// Writes "pool.<name>.in_use", ".capacity", ".slabs" and ".allocs" lines
+void wavo_pool_print(const struct wavo_pool *pool, FILE *out);
+
+#endif // WAVO_POOL_H
@@ -0,0 +1,46 @@
+#ifndef WAVO_PRESSURE_H
+#define WAVO_PRESSURE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <wayland-server-core.h>
+
+struct wavo_server;
+struct wavo_view;
+
+// Memory pressure handling for small machines. A PSI trigger on
+// /proc/pressure/memory wakes the event loop once tasks stall on memory for
+// too long. wavo then marks toplevels that are not visible on any output,
+// occluded ones included, as suspended (xdg_toplevel v6), so their clients
+// can drop spare buffers and caches, and returns empty pool slabs and free
+// heap to the kernel. A suspended view resumes as soon as any of its
+// surfaces is visible again.
+struct wavo_pressure {
+    struct wavo_server *server;
+    int psi_fd;    // -1 without PSI support
+    int epoll_fd;  // PSI only raises EPOLLPRI, which the event loop ignores
+    struct wl_event_source *source;  // NULL when not watching
+
+    size_t suspended_views;
+    uint64_t events;
+    uint64_t resumed_views;
+    uint64_t reclaimed_bytes;  // Drop of our own resident size
+};
+
+// Without PSI support nothing triggers a reclaim, but it can still be run
+struct wavo_pressure *wavo_pressure_create(struct wavo_server *server);
+void wavo_pressure_destroy(struct wavo_pressure *pressure);
+
+// One reclaim pass, as run for each PSI event
+void wavo_pressure_reclaim(struct wavo_pressure *pressure);
+
+// Drops an unmapped view from the suspended count
+void wavo_pressure_forget_view(struct wavo_pressure *pressure,
+    struct wavo_view *view);
+
+// Resumes suspended views that became visible, called after every frame
+void wavo_pressure_update_views(struct wavo_pressure *pressure);
+
+void wavo_pressure_print_metrics(struct wavo_pressure *pressure, FILE *out);
+
+#endif // WAVO_PRESSURE_H
@@ -0,0 +1,42 @@
+#ifndef WAVO_REALTIME_H
+#define WAVO_REALTIME_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+struct wavo_server;
+
+// Low latency mode for the compositor thread (--realtime): SCHED_RR when
+// RLIMIT_RTPRIO or CAP_SYS_NICE allows it, a negative nice value otherwise,
+// and the compositor's code and pooled objects locked in RAM, including slabs
+// the pools add later. Worker and log threads keep their normal scheduling
+// and clients never inherit it.
+struct wavo_realtime {
+    bool enabled;
+    bool sched_rr;
+    int priority;  // SCHED_RR priority, else the nice value (0 if refused)
+    int sched_error;  // errno of the refusals, logged once the logger runs
+    int nice_error;
+    size_t locked_bytes;  // Code and stack, pools count their own
+    bool lock_failed;  // Some memory could not be locked, see RLIMIT_MEMLOCK
+};
+
+// First thing in main(), while a setuid wavo still has the privileges for
+// it and before any other thread exists. Threads and processes started
+// later do not inherit the priority. Being refused one is not an error.
+void wavo_realtime_set_priority(struct wavo_realtime *realtime);
+
+// Gives up the privileges of a setuid or setgid wavo for good, real, effective
+// and saved IDs alike. Must come right after wavo_realtime_set_priority(),
+// before the config is run or anything else starts; returns false if the
+// privileges could not be dropped, which is fatal.
+bool wavo_realtime_drop_privileges(void);
+
+// Once the server is created, so its pools exist. As the user by then, so
+// bounded by RLIMIT_MEMLOCK.
+void wavo_realtime_lock_memory(struct wavo_server *server);
+
+void wavo_realtime_print_metrics(struct wavo_server *server, FILE *out);
+
+#endif // WAVO_REALTIME_H
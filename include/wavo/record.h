@@ -0,0 +1,160 @@
+#ifndef WAVO_RECORD_H
+#define WAVO_RECORD_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+#include <wlr/util/box.h>
+
+struct wavo_output;
+struct wavo_server;
+struct wavo_view;
+
+// Session recordings for reproducing performance reports: input events as
+// the handlers in src/input.c see them, toplevel maps and commits with
+// their damage, and every output frame with the time it took. wavo-replay
+// (tools/replay.c) plays one back against a headless server.
+//
+// A file is WAVO_RECORD_MAGIC followed by records of an 8 byte header
+// (type, payload length, microseconds since the previous record) and a
+// little-endian payload. Typed keys are not stored: every key other than
+// a modifier is recorded as a stand-in letter, consistently between its
+// press and release.
+#define WAVO_RECORD_MAGIC "WAVOREC1"
+#define WAVO_RECORD_MAGIC_SIZE 8
+#define WAVO_RECORD_HEADER_SIZE 8
+#define WAVO_RECORD_MAX_RECTS 16  // More damage is recorded as its extents
+#define WAVO_RECORD_MAX_SIZE \
+    (WAVO_RECORD_HEADER_SIZE + 16 + WAVO_RECORD_MAX_RECTS * 16)
+
+enum wavo_record_type {
+    WAVO_RECORD_OUTPUT = 1,
+    WAVO_RECORD_FRAME,
+    WAVO_RECORD_KEY,
+    WAVO_RECORD_MOTION,
+    WAVO_RECORD_BUTTON,
+    WAVO_RECORD_AXIS,
+    WAVO_RECORD_POINTER_FRAME,
+    WAVO_RECORD_MAP,
+    WAVO_RECORD_UNMAP,
+    WAVO_RECORD_COMMIT,
+};
+
+struct wavo_record_event {
+    enum wavo_record_type type;
+    uint64_t usec;  // Since the recording started
+
+    union {
+        struct {
+            uint32_t id;
+            int32_t x, y, width, height;
+            int32_t refresh;  // mHz
+            float scale;
+        } output;
+        struct {
+            uint32_t output_id;
+            uint32_t frame_usec;  // Frame event to commit
+        } frame;
+        struct {
+            uint32_t time_msec;
+            uint32_t keycode;
+            uint32_t state;
+        } key;
+        struct {
+            uint32_t time_msec;
+            float dx, dy, unaccel_dx, unaccel_dy;
+        } motion;
+        struct {
+            uint32_t time_msec;
+            uint32_t button;
+            uint32_t state;
+        } button;
+        struct {
+            uint32_t time_msec;
+            uint8_t orientation, source, relative_direction;
+            int32_t delta_discrete;
+            float delta;
+        } axis;
+        struct {
+            uint32_t view_id;
+            struct wlr_box box;  // Layout position and geometry size
+        } map;
+        struct {
+            uint32_t view_id;
+        } unmap;
+        struct {
+            uint32_t view_id;
+            int32_t width, height;  // Surface size
+            uint32_t rect_count;
+            struct wlr_box rects[WAVO_RECORD_MAX_RECTS];  // Buffer damage
+        } commit;
+    };
+};
+
+// Writes event after one at prev_usec, returns the bytes used. buf must hold
+// WAVO_RECORD_MAX_SIZE.
+size_t wavo_record_encode(const struct wavo_record_event *event,
+    uint64_t prev_usec, uint8_t *buf);
+
+// Reads the record at *offset following one at prev_usec and advances
+// *offset. Returns false at the end, or on a truncated or unknown record.
+bool wavo_record_decode(const uint8_t *data, size_t size, size_t *offset,
+    uint64_t prev_usec, struct wavo_record_event *event);
+
+struct wavo_recorder {
+    struct wavo_server *server;
+    int fd;
+    uint64_t start_usec;
+    uint64_t last_usec;
+
+    // Filled on the compositor thread, written by a worker once full
+    uint8_t *chunk;
+    size_t chunk_size;
+    off_t offset;  // File offset of the chunk being filled
+    size_t writes_pending;
+    bool stopped;  // Freed by the last pending write
+    bool failed;
+
+    uint32_t key_map[26];  // Real keycode behind each stand-in, 0 if free
+
+    uint64_t events;
+};
+
+// Announces the outputs and mapped views as they are now. An existing file
+// at path is truncated if replace is set and refused otherwise. Returns
+// NULL if path cannot be created.
+struct wavo_recorder *wavo_recorder_start(struct wavo_server *server,
+    const char *path, bool replace);
+
+// The only directory `wavo msg record` writes to, created if missing:
+// $XDG_STATE_HOME/wavo/recordings or ~/.local/state/wavo/recordings. False
+// if neither variable is set or it cannot be created.
+bool wavo_record_dir(char *path, size_t size);
+// Writes what is left in the background
+void wavo_recorder_stop(struct wavo_recorder *recorder);
+
+// All of these do nothing without a recorder
+void wavo_record_output(struct wavo_recorder *recorder,
+    struct wavo_output *output);
+void wavo_record_frame(struct wavo_recorder *recorder,
+    struct wavo_output *output, uint64_t frame_usec);
+void wavo_record_key(struct wavo_recorder *recorder, uint32_t time_msec,
+    uint32_t keycode, uint32_t state);
+void wavo_record_motion(struct wavo_recorder *recorder, uint32_t time_msec,
+    double dx, double dy, double unaccel_dx, double unaccel_dy);
+void wavo_record_button(struct wavo_recorder *recorder, uint32_t time_msec,
+    uint32_t button, uint32_t state);
+void wavo_record_axis(struct wavo_recorder *recorder, uint32_t time_msec,
+    uint32_t orientation, uint32_t source, uint32_t relative_direction,
+    double delta, int32_t delta_discrete);
+void wavo_record_pointer_frame(struct wavo_recorder *recorder);
+void wavo_record_map(struct wavo_recorder *recorder, struct wavo_view *view);
+void wavo_record_unmap(struct wavo_recorder *recorder, struct wavo_view *view);
+void wavo_record_commit(struct wavo_recorder *recorder,
+    struct wavo_view *view);
+
+void wavo_recorder_print_metrics(struct wavo_recorder *recorder, FILE *out);
+
+#endif // WAVO_RECORD_H
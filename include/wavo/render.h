@@ -0,0 +1,48 @@
+#ifndef WAVO_RENDER_H
+#define WAVO_RENDER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "wavo/latency.h"
+
+struct wavo_output;
+struct wavo_server;
+struct wavo_render_job;
+
+// Parallel compositing for the pixman renderer. Instead of rendering every
+// output in turn on the event loop, a frame takes a snapshot of the scene
+// on the main thread, locking each client buffer so its pixels stay put,
+// and a worker composites it into the output's next swapchain buffer. The
+// commit happens back on the main thread once the worker is done, so
+// outputs draw concurrently while everything wlroots sees stays serial.
+// Surfaces in the snapshot get presentation feedback for that commit, as
+// with the scene renderer.
+//
+// Outputs are repainted in full whenever the scene has damage on them.
+// Frames with something the snapshot cannot draw (rotated outputs or
+// buffers, non-shm formats) go through the regular scene renderer.
+struct wavo_render {
+    struct wavo_server *server;
+
+    uint64_t frames;      // Drawn on a worker
+    uint64_t fallbacks;   // Handed to the scene renderer
+    uint64_t busy;        // Frame events while the last frame was drawing
+    struct wavo_latency_histogram draw_time;  // Worker time per frame
+};
+
+// Fails unless the server uses the pixman renderer
+struct wavo_render *wavo_render_create(struct wavo_server *server);
+void wavo_render_destroy(struct wavo_render *render);
+
+// Starts drawing output's next frame. Returns false when the caller should
+// render it the usual way instead: nothing damaged, or unsupported content.
+bool wavo_render_output(struct wavo_render *render,
+    struct wavo_output *output);
+
+// The output is going away, its job commits nothing when it finishes
+void wavo_render_job_cancel(struct wavo_render_job *job);
+
+void wavo_render_print_metrics(struct wavo_render *render, FILE *out);
+
+#endif // WAVO_RENDER_H
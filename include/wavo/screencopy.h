@@ -0,0 +1,37 @@
+#ifndef WAVO_SCREENCOPY_H
+#define WAVO_SCREENCOPY_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <wayland-server-core.h>
+#include "wavo/convert.h"
+
+struct wavo_server;
+
+// wlr-screencopy-unstable-v1 with per-client damage tracking: every client
+// buffer remembers which output regions changed since it was last filled,
+// so repeated captures only copy damaged rectangles. Version 3 clients may
+// also capture into NV12 or YUV420 buffers.
+struct wavo_screencopy_manager {
+    struct wavo_server *server;
+    struct wl_global *global;
+    struct wl_list sessions;  // screencopy_session::link
+
+    // Pixels copied into client buffers vs what full-frame copies would cost
+    uint64_t frames;
+    uint64_t copied_pixels;
+    uint64_t frame_pixels;
+    uint64_t converted_pixels;  // Subset of copied_pixels written as YUV
+
+    enum wavo_convert_impl convert_impl;
+
+    struct wl_listener display_destroy;
+};
+
+struct wavo_screencopy_manager *wavo_screencopy_manager_create(
+    struct wavo_server *server);
+
+void wavo_screencopy_print_metrics(struct wavo_screencopy_manager *manager,
+    FILE *out);
+
+#endif // WAVO_SCREENCOPY_H
@@ -10,35 +10,95 @@
 #include <wlr/types/wlr_output_layout.h>
 #include <wlr/types/wlr_scene.h>
 #include <wlr/types/wlr_xdg_shell.h>
+#include "wavo/pool.h"
+#include "wavo/realtime.h"
 
+struct wavo_config;
+struct wavo_idle;
 struct wavo_input;  // Forward declaration
+struct wavo_ipc;
+struct wavo_pressure;
+struct wavo_recorder;
+struct wavo_screencopy_manager;
+struct wavo_thumbnails;
+struct wavo_budgets;
+struct wavo_foreign_toplevels;
+struct wavo_hooks;
+struct wavo_render;
+struct wavo_watchdog;
+struct wavo_workers;
 
 struct wavo_server {
+    struct wavo_config *config;
+
     struct wl_display *wl_display;
     struct wl_event_loop *event_loop;
     
-    struct wlr_backend *backend;
+    struct wlr_backend *backend;           // Multi-backend
+    struct wlr_backend *headless_backend;  // Virtual outputs, always present
     struct wlr_renderer *renderer;
     struct wlr_allocator *allocator;
     struct wlr_compositor *compositor;
     
     struct wlr_xdg_shell *xdg_shell;
     struct wlr_output_layout *output_layout;
+    struct wlr_presentation *presentation;
+    struct wavo_screencopy_manager *screencopy;
     
     struct wlr_scene *scene;           // Root scene tree
     struct wlr_scene_tree *view_tree;  // Tree for views
+    struct wlr_scene_output_layout *scene_layout;
     
     struct wl_list outputs;  // wavo_output::link
-    struct wl_list views;    // wavo_view::link
+    struct wl_list views;    // wavo_view::link, most recently focused first
+    struct wavo_view *focused_view;  // Has keyboard focus, NULL for none
+    uint32_t next_view_id;
+    uint32_t next_output_id;
     
+    // Fixed-size objects that come and go with clients and devices
+    struct wavo_pool view_pool;
+    struct wavo_pool popup_pool;
+    struct wavo_pool keyboard_pool;
+    struct wavo_pool pointer_pool;
+    struct wavo_pool grab_pool;
+
     struct wavo_input *input;  // Input device manager
+    struct wavo_ipc *ipc;      // Control socket for `wavo msg`
+    struct wavo_idle *idle;
+    struct wavo_pressure *pressure;  // Reclaims memory on PSI events
+    struct wavo_thumbnails *thumbnails;  // View thumbnails and the overview
+    struct wavo_budgets *budgets;  // Per-client request flood protection
+    struct wavo_foreign_toplevels *foreign_toplevels;  // Taskbar window list
+    struct wavo_watchdog *watchdog;  // Pings clients, flags hung ones
+    struct wavo_hooks *hooks;  // Lua event hooks, NULL without any config
+    struct wavo_workers *workers;  // Thread pool for blocking work
+    struct wavo_realtime realtime;  // --realtime state, see realtime.h
+    struct wavo_render *render;  // --parallel-render, NULL when off
+    struct wavo_recorder *recorder;  // --record or `wavo msg record`
+
+    // Event loop iterations, to check that an idle compositor really sleeps
+    bool running;
+    uint64_t wakeups;
+    uint64_t idle_wakeups;  // Subset spent in idle mode
+
+    struct wl_event_source *sigusr1_source;  // Dumps metrics to stderr
+    struct wl_event_source *sigint_source;
+    struct wl_event_source *sigterm_source;
     
     struct wl_listener new_output;
-    struct wl_listener new_xdg_surface;
+    struct wl_listener new_xdg_toplevel;
+    struct wl_listener new_xdg_popup;
+    struct wl_listener layout_change;
 };
 
-struct wavo_server *wavo_server_create(void);
+struct wavo_server *wavo_server_create(struct wavo_config *config);
 void wavo_server_destroy(struct wavo_server *server);
-bool wavo_server_start(struct wavo_server *server);
+
+// Runs the event loop until wavo_server_terminate() or SIGINT/SIGTERM
+void wavo_server_run(struct wavo_server *server);
+void wavo_server_terminate(struct wavo_server *server);
+
+// One event loop iteration, waiting at most timeout_msec (-1 for no limit)
+void wavo_server_dispatch(struct wavo_server *server, int timeout_msec);
 
 #endif // WAVO_SERVER_H
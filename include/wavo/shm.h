@@ -0,0 +1,20 @@
+#ifndef WAVO_SHM_H
+#define WAVO_SHM_H
+
+#include <wayland-server-core.h>
+#include <wlr/render/drm_format_set.h>
+#include <wlr/types/wlr_compositor.h>
+
+// wl_shm global advertising the renderer's texture formats. It also accepts
+// NV12 and YUV420 buffers without advertising them: screencopy offers those
+// to capture clients in its buffer events, ordinary clients never see them,
+// and a client attaching one to a surface of the compositor is disconnected.
+// The planes of a YUV buffer follow the luma plane at stride * height, and
+// the pool must hold all of them. Freed with the display.
+struct wavo_shm;
+
+struct wavo_shm *wavo_shm_create(struct wl_display *display,
+    struct wlr_compositor *compositor,
+    const struct wlr_drm_format_set *texture_formats);
+
+#endif // WAVO_SHM_H
@@ -0,0 +1,73 @@
+#ifndef WAVO_THUMBNAIL_H
+#define WAVO_THUMBNAIL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <wayland-server-core.h>
+#include "wavo/latency.h"
+
+struct wavo_server;
+struct wavo_view;
+
+// Longest side of a thumbnail in pixels
+#define WAVO_THUMBNAIL_SIZE 256
+
+// Downscaled copy of a view's window geometry for the overview and IPC. A
+// commit with damage only marks it dirty; a timer later renders a few dirty
+// views at a small size, reads those back and box filters them on the
+// worker pool, so neither commits nor frames pay for it and an overview
+// just shows what is cached.
+struct wavo_thumbnail {
+    struct wavo_view *view;   // NULL once the view is gone mid-refresh
+    struct wlr_buffer *buffer;  // Latest snapshot, NULL before the first
+    bool dirty;    // Damaged since the last snapshot
+    bool pending;  // Being scaled on a worker
+    uint64_t refresh_usec;  // When the latest snapshot was read back
+
+    struct wlr_scene_buffer *overview_node;  // While the overview is open
+    struct wl_listener overview_destroy;
+};
+
+struct wavo_thumbnails {
+    struct wavo_server *server;
+    struct wl_event_source *timer;
+    bool timer_armed;
+
+    struct wlr_scene_tree *overview;  // NULL while closed
+
+    uint64_t refreshes;
+    uint64_t readback_failures;
+    struct wavo_latency_histogram readback;  // Main thread share of a refresh
+};
+
+struct wavo_thumbnails *wavo_thumbnails_create(struct wavo_server *server);
+void wavo_thumbnails_destroy(struct wavo_thumbnails *thumbnails);
+
+// Called for every commit of a view's toplevel surface
+void wavo_thumbnail_damage(struct wavo_view *view);
+void wavo_thumbnail_destroy(struct wavo_thumbnail *thumbnail);
+
+// Grid of every mapped view's thumbnail on the output under the cursor.
+// Views mapped while it is open show up the next time it opens.
+void wavo_thumbnails_set_overview(struct wavo_thumbnails *thumbnails,
+    bool open);
+
+// Writes the view's thumbnail as a PAM (RGB_ALPHA) image, binary data
+bool wavo_thumbnail_write(struct wavo_thumbnail *thumbnail, FILE *out);
+
+void wavo_thumbnails_print(struct wavo_thumbnails *thumbnails, FILE *out);
+void wavo_thumbnails_print_metrics(struct wavo_thumbnails *thumbnails,
+    FILE *out);
+
+// Largest size with the aspect ratio of width x height that fits
+// WAVO_THUMBNAIL_SIZE, never upscaled and at least 1x1
+void wavo_thumbnail_get_size(int width, int height, int *thumb_width,
+    int *thumb_height);
+
+// Box filter from ARGB8888 src to dst, dst_stride in pixels
+void wavo_thumbnail_scale(const uint32_t *src, int src_width, int src_height,
+    uint32_t src_stride, uint32_t *dst, int dst_width, int dst_height,
+    uint32_t dst_stride);
+
+#endif // WAVO_THUMBNAIL_H
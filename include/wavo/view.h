@@ -8,33 +8,114 @@
 #include "wavo/server.h"
 
 struct wavo_server;
+struct wavo_output;
+struct wavo_thumbnail;
+struct wavo_foreign_toplevel;
+
+enum wavo_view_defer {
+    WAVO_VIEW_DEFER_OUTPUT = 1 << 0,     // Output and scale re-evaluation
+    WAVO_VIEW_DEFER_METADATA = 1 << 1,   // Title or app_id changed
+    WAVO_VIEW_DEFER_CONFIGURE = 1 << 2,  // Configure owed to the client
+    WAVO_VIEW_DEFER_COMMIT = 1 << 3,     // Let held commits through
+};
 
 struct wavo_view {
     struct wavo_server *server;
     struct wlr_xdg_surface *xdg_surface;
     struct wlr_scene_tree *scene_tree;
     struct wl_list link;  // wavo_server::views
+    uint32_t id;  // Stable name for IPC, never reused
 
     bool mapped;
 
+    // Output with the largest overlap and the scale last sent to the client
+    struct wavo_output *output;
+    float scale;
+
+    bool suspended;  // Hidden under memory pressure, see pressure.h
+    struct wavo_thumbnail *thumbnail;  // Created on the first damage
+    struct wavo_foreign_toplevel *foreign_toplevel;  // While mapped
+
+    // Work held back by the client's budget, see budget.h
+    uint32_t deferred;  // WAVO_VIEW_DEFER_*
+    struct wl_list deferred_link;  // wavo_budgets::deferred
+    // Over the commit budget the surface's pending state is locked, and the
+    // client's commits wait in wlroots' cache until the budget refills.
+    // held_commits counts those that came in meanwhile.
+    bool commits_held;
+    uint32_t commit_lock_seq;
+    uint32_t held_commits;
+
+    // Ping watchdog state, see watchdog.h
+    bool ping_pending;
+    bool unresponsive;
+    // A configure not sent because the client is unresponsive or, while
+    // resizing, has not acked the previous one. held_width and held_height
+    // are the size it carries, 0 for none.
+    bool configure_held;
+    int held_width, held_height;
+
     struct wl_listener map;
     struct wl_listener unmap;
     struct wl_listener destroy;
     struct wl_listener commit;
+    struct wl_listener client_commit;
     struct wl_listener request_move;
     struct wl_listener request_resize;
     struct wl_listener request_maximize;
     struct wl_listener request_fullscreen;
     struct wl_listener set_title;
     struct wl_listener set_app_id;
+    struct wl_listener ping_timeout;
+};
+
+// Only a scene tree below the parent's, kept in sync by wlroots
+struct wavo_popup {
+    struct wlr_xdg_popup *xdg_popup;
+    struct wavo_server *server;
+
+    struct wl_listener commit;
+    struct wl_listener destroy;
 };
 
+// Destroyed along with its toplevel, or earlier by wavo_view_destroy()
 struct wavo_view *wavo_view_create(struct wavo_server *server,
     struct wlr_xdg_surface *xdg_surface);
 void wavo_view_destroy(struct wavo_view *view);
 void wavo_view_activate(struct wavo_view *view, bool activate);
-void wavo_view_maximize(struct wavo_view *view, bool maximize);
-void wavo_view_set_fullscreen(struct wavo_view *view, bool fullscreen);
+
+// Raises the view and gives it keyboard focus
+void wavo_view_focus(struct wavo_view *view);
+
+// Frees itself when the popup is destroyed
+struct wavo_popup *wavo_popup_create(struct wavo_server *server,
+    struct wlr_xdg_popup *xdg_popup);
 struct wavo_view *wavo_view_from_node(struct wlr_scene_node *node);
+struct wavo_view *wavo_view_find(struct wavo_server *server, uint32_t id);
+
+// Layout-relative box of the view's window geometry
+void wavo_view_get_box(struct wavo_view *view, struct wlr_box *box);
+
+// Re-evaluate which output the view is on and send its preferred scale
+void wavo_view_update_output(struct wavo_view *view);
+
+// Runs the WAVO_VIEW_DEFER_* work in flags, once however often it was asked
+void wavo_view_apply_deferred(struct wavo_view *view, uint32_t flags);
+
+// Sends the held configure, once the client answers and acked the last one
+void wavo_view_flush_configure(struct wavo_view *view);
+
+// Apply cursor motion to the active interactive move/resize grab
+void wavo_view_grab_motion(struct wavo_server *server, uint32_t time_msec);
+
+// Ends the interactive move/resize grab, if any
+void wavo_view_end_grab(struct wavo_server *server);
+
+// Pointer button: a release ends the grab, a press focuses the view under
+// the cursor
+void wavo_view_handle_button(struct wavo_server *server, bool pressed);
+
+// Size of the grab objects kept in wavo_server::grab_pool
+size_t wavo_view_grab_size(void);
 
 #endif // WAVO_VIEW_H
@@ -0,0 +1,44 @@
+#ifndef WAVO_WATCHDOG_H
+#define WAVO_WATCHDOG_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <wayland-server-core.h>
+
+struct wavo_server;
+struct wavo_view;
+
+// Pings every mapped view's client through xdg_wm_base now and then, and
+// right away when one is focused or the user starts moving or resizing it.
+// A view whose client misses a ping is marked unresponsive until it answers
+// one again; it is pinged again right away and checked for an answer on a
+// shorter timer until then. Meanwhile nothing waits on it: configures for
+// it are held back (see wavo_view::configure_held) instead of piling up in
+// a socket nobody reads, and are sent once when it recovers.
+struct wavo_watchdog {
+    struct wavo_server *server;
+    struct wl_event_source *timer;
+    bool timer_armed;  // While views are mapped and not idle
+    struct wl_event_source *recheck;
+    bool recheck_armed;  // While views are unresponsive
+
+    uint64_t pings;      // Pings sent, at most one per client in flight
+    uint64_t timeouts;   // Views that went unresponsive
+    uint64_t recovered;  // Views that answered again afterwards
+};
+
+struct wavo_watchdog *wavo_watchdog_create(struct wavo_server *server);
+void wavo_watchdog_destroy(struct wavo_watchdog *watchdog);
+
+// Pings the view's client unless a ping is already on its way
+void wavo_watchdog_ping(struct wavo_watchdog *watchdog,
+    struct wavo_view *view);
+
+// The view's client missed a ping, from its ping_timeout listener
+void wavo_watchdog_handle_timeout(struct wavo_watchdog *watchdog,
+    struct wavo_view *view);
+
+void wavo_watchdog_print_metrics(struct wavo_watchdog *watchdog, FILE *out);
+
+#endif // WAVO_WATCHDOG_H
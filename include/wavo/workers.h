@@ -0,0 +1,54 @@
+#ifndef WAVO_WORKERS_H
+#define WAVO_WORKERS_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <wayland-server-core.h>
+#include "wavo/latency.h"
+
+#define WAVO_WORKERS_MAX 8
+
+// Runs on a worker thread. Must not touch compositor state.
+typedef void (*wavo_work_func_t)(void *data);
+// Runs on the event loop thread once work returned
+typedef void (*wavo_work_done_func_t)(void *data);
+
+// Thread pool for blocking jobs (file I/O, encoding, compiling) that would
+// otherwise stall a frame. Finished jobs are handed back through an eventfd
+// on the event loop, so their done callbacks run between other events on
+// the main thread, in completion order.
+struct wavo_workers {
+    struct wl_event_source *event_source;
+    int event_fd;
+
+    pthread_t threads[WAVO_WORKERS_MAX];
+    int thread_count;
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    struct wl_list queue;  // wavo_work::link, protected by lock
+    struct wl_list done;   // wavo_work::link, protected by lock
+    bool stopping;
+
+    uint64_t submitted;
+    uint64_t completed;
+    struct wavo_latency_histogram queue_wait;  // Protected by lock
+    struct wavo_latency_histogram run_time;    // Protected by lock
+};
+
+// thread_count 0 picks one per CPU, leaving one for the compositor
+struct wavo_workers *wavo_workers_create(struct wl_event_loop *loop,
+    int thread_count);
+
+// Finishes every queued job and runs its done callback before returning
+void wavo_workers_destroy(struct wavo_workers *workers);
+
+// done may be NULL. Returns false when out of memory, nothing runs then.
+bool wavo_workers_submit(struct wavo_workers *workers, wavo_work_func_t work,
+    wavo_work_done_func_t done, void *data);
+
+void wavo_workers_print_metrics(struct wavo_workers *workers, FILE *out);
+
+#endif // WAVO_WORKERS_H
@@ -0,0 +1,236 @@
+#include <inttypes.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <wayland-server-core.h>
+#include <wlr/util/log.h>
+#include "wavo/budget.h"
+#include "wavo/latency.h"
+#include "wavo/server.h"
+#include "wavo/view.h"
+
+// Deferred work runs at most this often per view
+#define BUDGET_TICK_MSEC 16
+
+struct budget_limit {
+    const char *name;
+    double rate;   // Per second
+    double burst;
+};
+
+// Shared by all views of a client. Commits allow a dozen windows animating
+// at 144 Hz; titles and configures are things a user does, not a stream.
+static const struct budget_limit limits[WAVO_BUDGET_KIND_COUNT] = {
+    [WAVO_BUDGET_COMMIT] = { "commits", 2000.0, 500.0 },
+    [WAVO_BUDGET_METADATA] = { "metadata", 20.0, 40.0 },
+    [WAVO_BUDGET_CONFIGURE] = { "configures", 30.0, 30.0 },
+};
+
+bool wavo_token_bucket_take(struct wavo_token_bucket *bucket, double rate,
+    double burst, uint64_t now_usec) {
+    if (bucket->refill_usec == 0) {
+        bucket->tokens = burst;
+        bucket->refill_usec = now_usec;
+    } else if (now_usec > bucket->refill_usec) {
+        bucket->tokens += (double)(now_usec - bucket->refill_usec) * rate / 1e6;
+        if (bucket->tokens > burst) {
+            bucket->tokens = burst;
+        }
+        bucket->refill_usec = now_usec;
+    }
+
+    if (bucket->tokens < 1.0) {
+        return false;
+    }
+    bucket->tokens -= 1.0;
+    return true;
+}
+
+static void client_budget_handle_destroy(struct wl_listener *listener,
+    void *data) {
+    (void)data;  // Unused parameter
+    struct wavo_client_budget *budget =
+        wl_container_of(listener, budget, destroy);
+    wl_list_remove(&budget->destroy.link);
+    wl_list_remove(&budget->link);
+    free(budget);
+}
+
+// The destroy listener doubles as the lookup, wl_client has no user data
+static struct wavo_client_budget *client_budget_find(struct wl_client *client) {
+    struct wl_listener *listener = wl_client_get_destroy_listener(client,
+        client_budget_handle_destroy);
+    if (!listener) {
+        return NULL;
+    }
+    struct wavo_client_budget *budget =
+        wl_container_of(listener, budget, destroy);
+    return budget;
+}
+
+static struct wavo_client_budget *client_budget_get(
+    struct wavo_budgets *budgets, struct wl_client *client) {
+    struct wavo_client_budget *budget = client_budget_find(client);
+    if (budget) {
+        return budget;
+    }
+
+    budget = calloc(1, sizeof(struct wavo_client_budget));
+    if (!budget) {
+        wlr_log(WLR_ERROR, "Failed to allocate client budget: %s",
+            "Out of memory");
+        return NULL;
+    }
+    budget->client = client;
+    budget->destroy.notify = client_budget_handle_destroy;
+    wl_client_add_destroy_listener(client, &budget->destroy);
+    wl_list_insert(&budgets->clients, &budget->link);
+    return budget;
+}
+
+bool wavo_budget_take(struct wavo_budgets *budgets, struct wl_client *client,
+    enum wavo_budget_kind kind) {
+    struct wavo_client_budget *budget = client_budget_get(budgets, client);
+    if (!budget) {
+        return true;
+    }
+
+    const struct budget_limit *limit = &limits[kind];
+    if (wavo_token_bucket_take(&budget->buckets[kind], limit->rate,
+            limit->burst, wavo_latency_now_usec())) {
+        return true;
+    }
+
+    if (budget->throttled[kind]++ == 0) {
+        pid_t pid;
+        wl_client_get_credentials(client, &pid, NULL, NULL);
+        wlr_log(WLR_INFO, "Throttling %s of client %d", limit->name, (int)pid);
+    }
+    budgets->throttled[kind]++;
+    return false;
+}
+
+static int budgets_handle_timer(void *data) {
+    struct wavo_budgets *budgets = data;
+    budgets->timer_armed = false;
+
+    // Views deferred again while applying wait for the next tick
+    struct wl_list ready;
+    wl_list_init(&ready);
+    wl_list_insert_list(&ready, &budgets->deferred);
+    wl_list_init(&budgets->deferred);
+
+    while (!wl_list_empty(&ready)) {
+        struct wavo_view *view =
+            wl_container_of(ready.next, view, deferred_link);
+        uint32_t flags = view->deferred;
+        view->deferred = 0;
+        wl_list_remove(&view->deferred_link);
+        wl_list_init(&view->deferred_link);
+
+        budgets->coalesced++;
+        wavo_view_apply_deferred(view, flags);
+    }
+    return 0;
+}
+
+void wavo_budget_defer(struct wavo_budgets *budgets, struct wavo_view *view,
+    uint32_t flags) {
+    if (view->deferred == 0) {
+        wl_list_insert(budgets->deferred.prev, &view->deferred_link);
+    }
+    view->deferred |= flags;
+
+    if (!budgets->timer_armed) {
+        wl_event_source_timer_update(budgets->timer, BUDGET_TICK_MSEC);
+        budgets->timer_armed = true;
+    }
+}
+
+void wavo_budget_cancel(struct wavo_view *view) {
+    if (view->deferred != 0) {
+        view->deferred = 0;
+        wl_list_remove(&view->deferred_link);
+        wl_list_init(&view->deferred_link);
+    }
+}
+
+uint64_t wavo_budget_client_throttled(struct wavo_budgets *budgets,
+    struct wl_client *client) {
+    (void)budgets;  // Unused parameter
+    struct wavo_client_budget *budget = client_budget_find(client);
+    if (!budget) {
+        return 0;
+    }
+
+    uint64_t total = 0;
+    for (int kind = 0; kind < WAVO_BUDGET_KIND_COUNT; kind++) {
+        total += budget->throttled[kind];
+    }
+    return total;
+}
+
+void wavo_budgets_print_metrics(struct wavo_budgets *budgets, FILE *out) {
+    if (!budgets) {
+        return;
+    }
+
+    for (int kind = 0; kind < WAVO_BUDGET_KIND_COUNT; kind++) {
+        fprintf(out, "budget.throttled_%s %" PRIu64 "\n", limits[kind].name,
+            budgets->throttled[kind]);
+    }
+    fprintf(out, "budget.coalesced %" PRIu64 "\n", budgets->coalesced);
+
+    // Offenders still connected
+    struct wavo_client_budget *budget;
+    wl_list_for_each(budget, &budgets->clients, link) {
+        pid_t pid;
+        wl_client_get_credentials(budget->client, &pid, NULL, NULL);
+        for (int kind = 0; kind < WAVO_BUDGET_KIND_COUNT; kind++) {
+            if (budget->throttled[kind] > 0) {
+                fprintf(out, "budget.client.%d.throttled_%s %" PRIu64 "\n",
+                    (int)pid, limits[kind].name, budget->throttled[kind]);
+            }
+        }
+    }
+}
+
+struct wavo_budgets *wavo_budgets_create(struct wavo_server *server) {
+    struct wavo_budgets *budgets = calloc(1, sizeof(struct wavo_budgets));
+    if (!budgets) {
+        wlr_log(WLR_ERROR, "Failed to allocate budgets: %s", "Out of memory");
+        return NULL;
+    }
+    budgets->server = server;
+    wl_list_init(&budgets->clients);
+    wl_list_init(&budgets->deferred);
+
+    budgets->timer = wl_event_loop_add_timer(server->event_loop,
+        budgets_handle_timer, budgets);
+    if (!budgets->timer) {
+        wlr_log(WLR_ERROR, "%s", "Failed to create budget timer");
+        free(budgets);
+        return NULL;
+    }
+    return budgets;
+}
+
+void wavo_budgets_destroy(struct wavo_budgets *budgets) {
+    if (!budgets) {
+        return;
+    }
+
+    struct wavo_client_budget *budget, *tmp;
+    wl_list_for_each_safe(budget, tmp, &budgets->clients, link) {
+        wl_list_remove(&budget->destroy.link);
+        wl_list_remove(&budget->link);
+        free(budget);
+    }
+
+    struct wavo_view *view, *view_tmp;
+    wl_list_for_each_safe(view, view_tmp, &budgets->deferred, deferred_link) {
+        wavo_budget_cancel(view);
+    }
+
+    wl_event_source_remove(budgets->timer);
+    free(budgets);
+}
@@ -0,0 +1,50 @@
+#include <stdlib.h>
+#include <drm_fourcc.h>
+#include <wayland-server-core.h>
+#include <wlr/interfaces/wlr_buffer.h>
+#include "wavo/buffer.h"
+
+static void pixel_buffer_destroy(struct wlr_buffer *wlr_buffer) {
+    struct wavo_pixel_buffer *buffer =
+        wl_container_of(wlr_buffer, buffer, base);
+    free(buffer->pixels);
+    free(buffer);
+}
+
+static bool pixel_buffer_begin_data_ptr_access(struct wlr_buffer *wlr_buffer,
+    uint32_t flags, void **data, uint32_t *format, size_t *stride) {
+    struct wavo_pixel_buffer *buffer =
+        wl_container_of(wlr_buffer, buffer, base);
+    if (flags & WLR_BUFFER_DATA_PTR_ACCESS_WRITE) {
+        return false;
+    }
+    *data = buffer->pixels;
+    *format = DRM_FORMAT_ARGB8888;
+    *stride = (size_t)wlr_buffer->width * 4;
+    return true;
+}
+
+static void pixel_buffer_end_data_ptr_access(struct wlr_buffer *wlr_buffer) {
+    (void)wlr_buffer;
+}
+
+static const struct wlr_buffer_impl pixel_buffer_impl = {
+    .destroy = pixel_buffer_destroy,
+    .begin_data_ptr_access = pixel_buffer_begin_data_ptr_access,
+    .end_data_ptr_access = pixel_buffer_end_data_ptr_access,
+};
+
+struct wavo_pixel_buffer *wavo_pixel_buffer_create(int width, int height) {
+    struct wavo_pixel_buffer *buffer =
+        calloc(1, sizeof(struct wavo_pixel_buffer));
+    if (!buffer) {
+        return NULL;
+    }
+    buffer->pixels = calloc((size_t)width * (size_t)height, 4);
+    if (!buffer->pixels) {
+        free(buffer);
+        return NULL;
+    }
+    wlr_buffer_init(&buffer->base, &pixel_buffer_impl, width, height);
+    return buffer;
+}
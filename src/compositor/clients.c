@@ -0,0 +1,132 @@
+#define _POSIX_C_SOURCE 200809L
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wayland-server-core.h>
+#include <wlr/types/wlr_buffer.h>
+#include <wlr/types/wlr_scene.h>
+#include <wlr/types/wlr_xdg_shell.h>
+#include "wavo/budget.h"
+#include "wavo/clients.h"
+#include "wavo/server.h"
+#include "wavo/view.h"
+
+static uint64_t buffer_bytes(struct wlr_buffer *buffer) {
+    struct wlr_shm_attributes shm;
+    if (wlr_buffer_get_shm(buffer, &shm)) {
+        return (uint64_t)shm.stride * (uint64_t)shm.height;
+    }
+    return (uint64_t)buffer->width * (uint64_t)buffer->height * 4;
+}
+
+static void count_node(struct wlr_scene_node *node,
+    struct wavo_client_stats *stats) {
+    stats->scene_nodes++;
+
+    if (node->type == WLR_SCENE_NODE_BUFFER) {
+        struct wlr_scene_buffer *scene_buffer = wlr_scene_buffer_from_node(node);
+        if (scene_buffer->buffer) {
+            stats->buffers++;
+            stats->buffer_bytes += buffer_bytes(scene_buffer->buffer);
+        }
+    } else if (node->type == WLR_SCENE_NODE_TREE) {
+        struct wlr_scene_tree *tree = wlr_scene_tree_from_node(node);
+        struct wlr_scene_node *child;
+        wl_list_for_each(child, &tree->children, link) {
+            count_node(child, stats);
+        }
+    }
+}
+
+static enum wl_iterator_result count_resource(struct wl_resource *resource,
+    void *user_data) {
+    (void)resource;
+    size_t *count = user_data;
+    (*count)++;
+    return WL_ITERATOR_CONTINUE;
+}
+
+void wavo_client_stats_get(struct wavo_server *server, struct wl_client *client,
+    struct wavo_client_stats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    wl_client_get_credentials(client, &stats->pid, NULL, NULL);
+    wl_client_for_each_resource(client, count_resource, &stats->resources);
+    stats->throttled = wavo_budget_client_throttled(server->budgets, client);
+
+    struct wavo_view *view;
+    wl_list_for_each(view, &server->views, link) {
+        if (wl_resource_get_client(view->xdg_surface->resource) != client) {
+            continue;
+        }
+        stats->views++;
+        if (view->unresponsive) {
+            stats->unresponsive++;
+        }
+        count_node(&view->scene_tree->node, stats);
+    }
+}
+
+struct client_entry {
+    struct wavo_client_stats stats;
+    char comm[32];
+};
+
+static int compare_entries(const void *a, const void *b) {
+    const struct client_entry *entry_a = a;
+    const struct client_entry *entry_b = b;
+    if (entry_a->stats.buffer_bytes != entry_b->stats.buffer_bytes) {
+        return entry_a->stats.buffer_bytes < entry_b->stats.buffer_bytes ?
+            1 : -1;
+    }
+    return (int)(entry_a->stats.pid - entry_b->stats.pid);
+}
+
+static void read_comm(pid_t pid, char *comm, size_t size) {
+    snprintf(comm, size, "?");
+
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/comm", (int)pid);
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        return;
+    }
+    if (fgets(comm, (int)size, file)) {
+        comm[strcspn(comm, "\n")] = '\0';
+    }
+    fclose(file);
+}
+
+void wavo_clients_print(struct wavo_server *server, FILE *out) {
+    struct wl_list *clients = wl_display_get_client_list(server->wl_display);
+    size_t count = (size_t)wl_list_length(clients);
+    if (count == 0) {
+        return;
+    }
+
+    struct client_entry *entries = calloc(count, sizeof(struct client_entry));
+    if (!entries) {
+        fputs("out of memory\n", out);
+        return;
+    }
+
+    size_t i = 0;
+    struct wl_client *client;
+    wl_client_for_each(client, clients) {
+        wavo_client_stats_get(server, client, &entries[i].stats);
+        read_comm(entries[i].stats.pid, entries[i].comm,
+            sizeof(entries[i].comm));
+        i++;
+    }
+    qsort(entries, count, sizeof(struct client_entry), compare_entries);
+
+    for (i = 0; i < count; i++) {
+        const struct wavo_client_stats *stats = &entries[i].stats;
+        fprintf(out, "%d %s views %zu nodes %zu buffers %zu "
+            "buffer_bytes %" PRIu64 " resources %zu throttled %" PRIu64
+            " unresponsive %zu\n",
+            (int)stats->pid, entries[i].comm, stats->views, stats->scene_nodes,
+            stats->buffers, stats->buffer_bytes, stats->resources,
+            stats->throttled, stats->unresponsive);
+    }
+    free(entries);
+}
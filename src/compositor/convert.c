@@ -0,0 +1,303 @@
+#include <stddef.h>
+#include <string.h>
+#include "wavo/convert.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define WAVO_CONVERT_X86 1
+#endif
+
+// BT.601 limited range, 8-bit fixed point. Chroma is computed from the sum
+// of a 2x2 block, so its shift absorbs the divide by four. The SIMD kernels
+// use the same coefficients and rounding and must stay bit-identical.
+#define Y_R 66
+#define Y_G 129
+#define Y_B 25
+#define U_R (-38)
+#define U_G (-74)
+#define U_B 112
+#define V_R 112
+#define V_G (-94)
+#define V_B (-18)
+
+// Converts one row of XRGB8888 pixels to luma
+typedef void (*luma_row_func)(const uint8_t *src, uint8_t *dst, int width);
+
+// Converts two rows of XRGB8888 pixels to width / 2 chroma samples. U and V
+// are written every `step` bytes: 1 for planar, 2 for interleaved.
+typedef void (*chroma_row_func)(const uint8_t *row0, const uint8_t *row1,
+    uint8_t *u, uint8_t *v, int step, int width);
+
+static inline uint8_t pixel_y(const uint8_t *p) {
+    int y = (Y_R * p[2] + Y_G * p[1] + Y_B * p[0] + 128) >> 8;
+    return (uint8_t)(y + 16);
+}
+
+static void luma_row_scalar(const uint8_t *src, uint8_t *dst, int width) {
+    for (int i = 0; i < width; i++) {
+        dst[i] = pixel_y(src + i * 4);
+    }
+}
+
+static void chroma_row_scalar(const uint8_t *row0, const uint8_t *row1,
+    uint8_t *u, uint8_t *v, int step, int width) {
+    for (int i = 0; i < width; i += 2) {
+        const uint8_t *a = row0 + i * 4;
+        const uint8_t *b = row1 + i * 4;
+        int sb = a[0] + a[4] + b[0] + b[4];
+        int sg = a[1] + a[5] + b[1] + b[5];
+        int sr = a[2] + a[6] + b[2] + b[6];
+
+        int cu = (U_R * sr + U_G * sg + U_B * sb + 512) >> 10;
+        int cv = (V_R * sr + V_G * sg + V_B * sb + 512) >> 10;
+        u[(i / 2) * step] = (uint8_t)(cu + 128);
+        v[(i / 2) * step] = (uint8_t)(cv + 128);
+    }
+}
+
+#ifdef WAVO_CONVERT_X86
+
+// The SSE4.1 bodies are always inlined so the AVX2 kernels get VEX-encoded
+// copies of them, mixing legacy SSE with 256-bit code stalls on transitions
+__attribute__((target("sse4.1"), always_inline))
+static inline void luma_row_sse41_body(const uint8_t *src, uint8_t *dst,
+    int width) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i coeff = _mm_setr_epi16(Y_B, Y_G, Y_R, 0, Y_B, Y_G, Y_R, 0);
+    const __m128i round = _mm_set1_epi32(128);
+    const __m128i offset = _mm_set1_epi32(16);
+
+    int i = 0;
+    for (; i + 8 <= width; i += 8) {
+        __m128i p0 = _mm_loadu_si128((const __m128i *)(src + i * 4));
+        __m128i p1 = _mm_loadu_si128((const __m128i *)(src + i * 4 + 16));
+
+        // pmaddwd leaves B+G and R+X partial sums per pixel, hadd joins them
+        __m128i a = _mm_madd_epi16(_mm_unpacklo_epi8(p0, zero), coeff);
+        __m128i b = _mm_madd_epi16(_mm_unpackhi_epi8(p0, zero), coeff);
+        __m128i c = _mm_madd_epi16(_mm_unpacklo_epi8(p1, zero), coeff);
+        __m128i d = _mm_madd_epi16(_mm_unpackhi_epi8(p1, zero), coeff);
+        __m128i y0 = _mm_hadd_epi32(a, b);
+        __m128i y1 = _mm_hadd_epi32(c, d);
+
+        y0 = _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(y0, round), 8), offset);
+        y1 = _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(y1, round), 8), offset);
+
+        __m128i y16 = _mm_packs_epi32(y0, y1);
+        _mm_storel_epi64((__m128i *)(dst + i), _mm_packus_epi16(y16, y16));
+    }
+
+    luma_row_scalar(src + i * 4, dst + i, width - i);
+}
+
+// Sums the 2x2 blocks of eight pixel columns into four 16-bit BGRX lanes
+__attribute__((target("sse4.1"), always_inline))
+static inline void chroma_block_sums_sse41(const uint8_t *row0,
+    const uint8_t *row1, __m128i *lo, __m128i *hi) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i a0 = _mm_loadu_si128((const __m128i *)row0);
+    __m128i a1 = _mm_loadu_si128((const __m128i *)(row0 + 16));
+    __m128i b0 = _mm_loadu_si128((const __m128i *)row1);
+    __m128i b1 = _mm_loadu_si128((const __m128i *)(row1 + 16));
+
+    __m128i s0 = _mm_add_epi16(_mm_unpacklo_epi8(a0, zero),
+        _mm_unpacklo_epi8(b0, zero));
+    __m128i s1 = _mm_add_epi16(_mm_unpackhi_epi8(a0, zero),
+        _mm_unpackhi_epi8(b0, zero));
+    __m128i s2 = _mm_add_epi16(_mm_unpacklo_epi8(a1, zero),
+        _mm_unpacklo_epi8(b1, zero));
+    __m128i s3 = _mm_add_epi16(_mm_unpackhi_epi8(a1, zero),
+        _mm_unpackhi_epi8(b1, zero));
+
+    s0 = _mm_add_epi16(s0, _mm_srli_si128(s0, 8));
+    s1 = _mm_add_epi16(s1, _mm_srli_si128(s1, 8));
+    s2 = _mm_add_epi16(s2, _mm_srli_si128(s2, 8));
+    s3 = _mm_add_epi16(s3, _mm_srli_si128(s3, 8));
+
+    *lo = _mm_unpacklo_epi64(s0, s1);
+    *hi = _mm_unpacklo_epi64(s2, s3);
+}
+
+__attribute__((target("sse4.1"), always_inline))
+static inline void chroma_row_sse41_body(const uint8_t *row0,
+    const uint8_t *row1, uint8_t *u, uint8_t *v, int step, int width) {
+    const __m128i u_coeff = _mm_setr_epi16(U_B, U_G, U_R, 0, U_B, U_G, U_R, 0);
+    const __m128i v_coeff = _mm_setr_epi16(V_B, V_G, V_R, 0, V_B, V_G, V_R, 0);
+    const __m128i round = _mm_set1_epi32(512);
+    const __m128i offset = _mm_set1_epi32(128);
+    const __m128i interleave = _mm_setr_epi8(
+        0, 4, 1, 5, 2, 6, 3, 7, 8, 12, 9, 13, 10, 14, 11, 15);
+
+    int i = 0;
+    for (; i + 8 <= width; i += 8) {
+        __m128i lo, hi;
+        chroma_block_sums_sse41(row0 + i * 4, row1 + i * 4, &lo, &hi);
+
+        __m128i cu = _mm_hadd_epi32(_mm_madd_epi16(lo, u_coeff),
+            _mm_madd_epi16(hi, u_coeff));
+        __m128i cv = _mm_hadd_epi32(_mm_madd_epi16(lo, v_coeff),
+            _mm_madd_epi16(hi, v_coeff));
+        cu = _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(cu, round), 10), offset);
+        cv = _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(cv, round), 10), offset);
+
+        // Bytes 0-3 hold U, 4-7 hold V
+        __m128i uv16 = _mm_packs_epi32(cu, cv);
+        __m128i uv = _mm_packus_epi16(uv16, uv16);
+
+        int out = i / 2;
+        if (step == 2) {
+            _mm_storel_epi64((__m128i *)(u + out * 2),
+                _mm_shuffle_epi8(uv, interleave));
+        } else {
+            int32_t u4 = _mm_cvtsi128_si32(uv);
+            int32_t v4 = _mm_extract_epi32(uv, 1);
+            memcpy(u + out, &u4, sizeof(u4));
+            memcpy(v + out, &v4, sizeof(v4));
+        }
+    }
+
+    int out = i / 2;
+    chroma_row_scalar(row0 + i * 4, row1 + i * 4, u + out * step,
+        v + out * step, step, width - i);
+}
+
+__attribute__((target("sse4.1")))
+static void luma_row_sse41(const uint8_t *src, uint8_t *dst, int width) {
+    luma_row_sse41_body(src, dst, width);
+}
+
+__attribute__((target("sse4.1")))
+static void chroma_row_sse41(const uint8_t *row0, const uint8_t *row1,
+    uint8_t *u, uint8_t *v, int step, int width) {
+    chroma_row_sse41_body(row0, row1, u, v, step, width);
+}
+
+__attribute__((target("avx2")))
+static void chroma_row_avx2(const uint8_t *row0, const uint8_t *row1,
+    uint8_t *u, uint8_t *v, int step, int width) {
+    chroma_row_sse41_body(row0, row1, u, v, step, width);
+}
+
+__attribute__((target("avx2")))
+static void luma_row_avx2(const uint8_t *src, uint8_t *dst, int width) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i coeff = _mm256_setr_epi16(Y_B, Y_G, Y_R, 0, Y_B, Y_G, Y_R, 0,
+        Y_B, Y_G, Y_R, 0, Y_B, Y_G, Y_R, 0);
+    const __m256i round = _mm256_set1_epi32(128);
+    const __m256i offset = _mm256_set1_epi32(16);
+
+    int i = 0;
+    for (; i + 16 <= width; i += 16) {
+        __m256i p0 = _mm256_loadu_si256((const __m256i *)(src + i * 4));
+        __m256i p1 = _mm256_loadu_si256((const __m256i *)(src + i * 4 + 32));
+
+        // Lane-local like the SSE version: lane 0 of y0 holds pixels 0-3,
+        // lane 1 pixels 4-7
+        __m256i a = _mm256_madd_epi16(_mm256_unpacklo_epi8(p0, zero), coeff);
+        __m256i b = _mm256_madd_epi16(_mm256_unpackhi_epi8(p0, zero), coeff);
+        __m256i c = _mm256_madd_epi16(_mm256_unpacklo_epi8(p1, zero), coeff);
+        __m256i d = _mm256_madd_epi16(_mm256_unpackhi_epi8(p1, zero), coeff);
+        __m256i y0 = _mm256_hadd_epi32(a, b);
+        __m256i y1 = _mm256_hadd_epi32(c, d);
+
+        y0 = _mm256_add_epi32(
+            _mm256_srai_epi32(_mm256_add_epi32(y0, round), 8), offset);
+        y1 = _mm256_add_epi32(
+            _mm256_srai_epi32(_mm256_add_epi32(y1, round), 8), offset);
+
+        // Packs interleave lanes; permute restores pixel order after each
+        __m256i y16 = _mm256_packs_epi32(y0, y1);
+        y16 = _mm256_permute4x64_epi64(y16, _MM_SHUFFLE(3, 1, 2, 0));
+        __m256i y8 = _mm256_packus_epi16(y16, y16);
+        y8 = _mm256_permute4x64_epi64(y8, _MM_SHUFFLE(3, 1, 2, 0));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm256_castsi256_si128(y8));
+    }
+
+    luma_row_sse41_body(src + i * 4, dst + i, width - i);
+}
+
+#endif // WAVO_CONVERT_X86
+
+bool wavo_convert_impl_supported(enum wavo_convert_impl impl) {
+    switch (impl) {
+    case WAVO_CONVERT_SCALAR:
+        return true;
+#ifdef WAVO_CONVERT_X86
+    case WAVO_CONVERT_SSE41:
+        return __builtin_cpu_supports("sse4.1");
+    case WAVO_CONVERT_AVX2:
+        return __builtin_cpu_supports("avx2") &&
+            __builtin_cpu_supports("sse4.1");
+#endif
+    default:
+        return false;
+    }
+}
+
+enum wavo_convert_impl wavo_convert_best_impl(void) {
+    if (wavo_convert_impl_supported(WAVO_CONVERT_AVX2)) {
+        return WAVO_CONVERT_AVX2;
+    }
+    if (wavo_convert_impl_supported(WAVO_CONVERT_SSE41)) {
+        return WAVO_CONVERT_SSE41;
+    }
+    return WAVO_CONVERT_SCALAR;
+}
+
+const char *wavo_convert_impl_name(enum wavo_convert_impl impl) {
+    switch (impl) {
+    case WAVO_CONVERT_SCALAR:
+        return "scalar";
+    case WAVO_CONVERT_SSE41:
+        return "sse4.1";
+    case WAVO_CONVERT_AVX2:
+        return "avx2";
+    }
+    return "unknown";
+}
+
+void wavo_convert_to_yuv(enum wavo_convert_impl impl, const uint8_t *src,
+    uint32_t src_stride, const struct wavo_yuv_image *dst,
+    int x, int y, int width, int height) {
+    luma_row_func luma = luma_row_scalar;
+    chroma_row_func chroma = chroma_row_scalar;
+
+#ifdef WAVO_CONVERT_X86
+    if (impl == WAVO_CONVERT_AVX2) {
+        luma = luma_row_avx2;
+        chroma = chroma_row_avx2;
+    } else if (impl == WAVO_CONVERT_SSE41) {
+        luma = luma_row_sse41;
+        chroma = chroma_row_sse41;
+    }
+#else
+    (void)impl;
+#endif
+
+    uint8_t *y_plane = dst->planes[0] + (size_t)y * dst->strides[0] + x;
+    uint8_t *u_plane, *v_plane;
+    int step;
+    if (dst->layout == WAVO_YUV_NV12) {
+        u_plane = dst->planes[1] + (size_t)(y / 2) * dst->strides[1] + x;
+        v_plane = u_plane + 1;
+        step = 2;
+    } else {
+        u_plane = dst->planes[1] + (size_t)(y / 2) * dst->strides[1] + x / 2;
+        v_plane = dst->planes[2] + (size_t)(y / 2) * dst->strides[2] + x / 2;
+        step = 1;
+    }
+
+    for (int row = 0; row + 1 < height; row += 2) {
+        const uint8_t *row0 = src + (size_t)row * src_stride;
+        const uint8_t *row1 = row0 + src_stride;
+
+        luma(row0, y_plane, width);
+        luma(row1, y_plane + dst->strides[0], width);
+        chroma(row0, row1, u_plane, v_plane, step, width);
+
+        y_plane += 2 * (size_t)dst->strides[0];
+        u_plane += dst->strides[1];
+        v_plane += dst->layout == WAVO_YUV_NV12 ?
+            dst->strides[1] : dst->strides[2];
+    }
+}
@@ -0,0 +1,229 @@
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wayland-server-core.h>
+#include <wlr/types/wlr_foreign_toplevel_management_v1.h>
+#include <wlr/types/wlr_output.h>
+#include <wlr/types/wlr_xdg_shell.h>
+#include <wlr/util/log.h>
+#include "wavo/foreign_toplevel.h"
+#include "wavo/idle.h"
+#include "wavo/output.h"
+#include "wavo/server.h"
+#include "wavo/view.h"
+
+static bool string_changed(const char *old, const char *new) {
+    return strcmp(old ? old : "", new ? new : "") != 0;
+}
+
+// Sends title and app_id, skipping values a panel already has. A title that
+// flickered and came back within one frame sends nothing at all.
+static void foreign_toplevel_send(struct wavo_foreign_toplevels *toplevels,
+    struct wavo_foreign_toplevel *toplevel) {
+    struct wlr_xdg_toplevel *xdg_toplevel =
+        toplevel->view->xdg_surface->toplevel;
+    struct wlr_foreign_toplevel_handle_v1 *handle = toplevel->handle;
+
+    if (string_changed(handle->title, xdg_toplevel->title)) {
+        wlr_foreign_toplevel_handle_v1_set_title(handle,
+            xdg_toplevel->title ? xdg_toplevel->title : "");
+        toplevels->updates++;
+    }
+    if (string_changed(handle->app_id, xdg_toplevel->app_id)) {
+        wlr_foreign_toplevel_handle_v1_set_app_id(handle,
+            xdg_toplevel->app_id ? xdg_toplevel->app_id : "");
+        toplevels->updates++;
+    }
+}
+
+static void foreign_toplevel_clear_dirty(
+    struct wavo_foreign_toplevel *toplevel) {
+    if (toplevel->dirty) {
+        toplevel->dirty = false;
+        wl_list_remove(&toplevel->dirty_link);
+        wl_list_init(&toplevel->dirty_link);
+    }
+}
+
+static void foreign_toplevel_handle_request_activate(
+    struct wl_listener *listener, void *data) {
+    (void)data;  // Unused parameter
+    struct wavo_foreign_toplevel *toplevel =
+        wl_container_of(listener, toplevel, request_activate);
+    // Raises it and takes activation and keyboard focus from the last one
+    wavo_view_focus(toplevel->view);
+}
+
+static void foreign_toplevel_handle_request_close(
+    struct wl_listener *listener, void *data) {
+    (void)data;  // Unused parameter
+    struct wavo_foreign_toplevel *toplevel =
+        wl_container_of(listener, toplevel, request_close);
+    wlr_xdg_toplevel_send_close(toplevel->view->xdg_surface->toplevel);
+}
+
+void wavo_foreign_toplevel_map(struct wavo_view *view) {
+    struct wavo_foreign_toplevels *toplevels = view->server->foreign_toplevels;
+    if (!toplevels || view->foreign_toplevel) {
+        return;
+    }
+
+    struct wavo_foreign_toplevel *toplevel =
+        calloc(1, sizeof(struct wavo_foreign_toplevel));
+    if (!toplevel) {
+        wlr_log(WLR_ERROR, "Failed to allocate foreign toplevel: %s",
+            "Out of memory");
+        return;
+    }
+
+    toplevel->handle =
+        wlr_foreign_toplevel_handle_v1_create(toplevels->manager);
+    if (!toplevel->handle) {
+        wlr_log(WLR_ERROR, "%s", "Failed to create foreign toplevel handle");
+        free(toplevel);
+        return;
+    }
+    toplevel->view = view;
+    wl_list_init(&toplevel->dirty_link);
+
+    toplevel->request_activate.notify =
+        foreign_toplevel_handle_request_activate;
+    wl_signal_add(&toplevel->handle->events.request_activate,
+        &toplevel->request_activate);
+    toplevel->request_close.notify = foreign_toplevel_handle_request_close;
+    wl_signal_add(&toplevel->handle->events.request_close,
+        &toplevel->request_close);
+
+    view->foreign_toplevel = toplevel;
+    foreign_toplevel_send(toplevels, toplevel);
+    wavo_foreign_toplevel_set_output(view, NULL);
+}
+
+void wavo_foreign_toplevel_unmap(struct wavo_view *view) {
+    struct wavo_foreign_toplevel *toplevel = view->foreign_toplevel;
+    if (!toplevel) {
+        return;
+    }
+
+    foreign_toplevel_clear_dirty(toplevel);
+    wl_list_remove(&toplevel->request_activate.link);
+    wl_list_remove(&toplevel->request_close.link);
+    wlr_foreign_toplevel_handle_v1_destroy(toplevel->handle);
+    free(toplevel);
+    view->foreign_toplevel = NULL;
+}
+
+void wavo_foreign_toplevel_mark_dirty(struct wavo_view *view) {
+    struct wavo_foreign_toplevel *toplevel = view->foreign_toplevel;
+    if (!toplevel) {
+        // Sent with everything else once the view maps
+        return;
+    }
+
+    struct wavo_foreign_toplevels *toplevels = view->server->foreign_toplevels;
+    struct wavo_idle *idle = view->server->idle;
+    if (!view->output || (idle && idle->idle)) {
+        foreign_toplevel_clear_dirty(toplevel);
+        foreign_toplevel_send(toplevels, toplevel);
+        return;
+    }
+
+    if (toplevel->dirty) {
+        toplevels->coalesced++;
+        return;
+    }
+    toplevel->dirty = true;
+    wl_list_insert(&toplevels->dirty, &toplevel->dirty_link);
+    // An output with nothing to draw has no frame coming by itself. Asking
+    // again for a frame already scheduled is free.
+    wlr_output_schedule_frame(view->output->wlr_output);
+}
+
+void wavo_foreign_toplevel_set_output(struct wavo_view *view,
+    struct wavo_output *old_output) {
+    struct wavo_foreign_toplevel *toplevel = view->foreign_toplevel;
+    if (!toplevel || view->output == old_output) {
+        return;
+    }
+
+    // Panels show a window on its primary output only
+    if (old_output) {
+        wlr_foreign_toplevel_handle_v1_output_leave(toplevel->handle,
+            old_output->wlr_output);
+    }
+    if (view->output) {
+        wlr_foreign_toplevel_handle_v1_output_enter(toplevel->handle,
+            view->output->wlr_output);
+    }
+}
+
+void wavo_foreign_toplevel_set_activated(struct wavo_view *view,
+    bool activated) {
+    if (view->foreign_toplevel) {
+        wlr_foreign_toplevel_handle_v1_set_activated(
+            view->foreign_toplevel->handle, activated);
+    }
+}
+
+void wavo_foreign_toplevels_flush(struct wavo_foreign_toplevels *toplevels,
+    struct wavo_output *output) {
+    if (!toplevels) {
+        return;
+    }
+
+    struct wavo_foreign_toplevel *toplevel, *tmp;
+    wl_list_for_each_safe(toplevel, tmp, &toplevels->dirty, dirty_link) {
+        // Views that lost their output since have no frame of their own
+        if (toplevel->view->output && toplevel->view->output != output) {
+            continue;
+        }
+        foreign_toplevel_clear_dirty(toplevel);
+        foreign_toplevel_send(toplevels, toplevel);
+    }
+}
+
+void wavo_foreign_toplevels_print_metrics(
+    struct wavo_foreign_toplevels *toplevels, FILE *out) {
+    if (!toplevels) {
+        return;
+    }
+
+    fprintf(out, "foreign_toplevel.updates %" PRIu64 "\n", toplevels->updates);
+    fprintf(out, "foreign_toplevel.coalesced %" PRIu64 "\n",
+        toplevels->coalesced);
+}
+
+struct wavo_foreign_toplevels *wavo_foreign_toplevels_create(
+    struct wavo_server *server) {
+    struct wavo_foreign_toplevels *toplevels =
+        calloc(1, sizeof(struct wavo_foreign_toplevels));
+    if (!toplevels) {
+        wlr_log(WLR_ERROR, "Failed to allocate foreign toplevels: %s",
+            "Out of memory");
+        return NULL;
+    }
+
+    toplevels->manager =
+        wlr_foreign_toplevel_manager_v1_create(server->wl_display);
+    if (!toplevels->manager) {
+        wlr_log(WLR_ERROR, "%s", "Failed to create foreign toplevel manager");
+        free(toplevels);
+        return NULL;
+    }
+    toplevels->server = server;
+    wl_list_init(&toplevels->dirty);
+    return toplevels;
+}
+
+void wavo_foreign_toplevels_destroy(struct wavo_foreign_toplevels *toplevels) {
+    if (!toplevels) {
+        return;
+    }
+
+    // Mapped views keep their handles until the display goes away
+    struct wavo_foreign_toplevel *toplevel, *tmp;
+    wl_list_for_each_safe(toplevel, tmp, &toplevels->dirty, dirty_link) {
+        foreign_toplevel_clear_dirty(toplevel);
+    }
+    free(toplevels);
+}
@@ -0,0 +1,198 @@
+#include <inttypes.h>
+#include <stdlib.h>
+#include <wayland-server-core.h>
+#include <wlr/types/wlr_idle_inhibit_v1.h>
+#include <wlr/types/wlr_idle_notify_v1.h>
+#include <wlr/types/wlr_output.h>
+#include <wlr/util/log.h>
+#include "wavo/config.h"
+#include "wavo/idle.h"
+#include "wavo/input.h"
+#include "wavo/latency.h"
+#include "wavo/output.h"
+#include "wavo/server.h"
+
+struct idle_inhibitor {
+    struct wavo_idle *idle;
+    struct wl_listener destroy;
+};
+
+static void idle_arm_timer(struct wavo_idle *idle, uint64_t delay_usec) {
+    // Round up, firing early only costs another re-arm
+    int delay_msec = (int)((delay_usec + 999) / 1000);
+    wl_event_source_timer_update(idle->timer, delay_msec > 0 ? delay_msec : 1);
+    idle->timer_armed = true;
+}
+
+static void idle_enter(struct wavo_idle *idle) {
+    struct wavo_server *server = idle->server;
+
+    idle->idle = true;
+    idle->idle_entered++;
+    wlr_log(WLR_INFO, "%s", "Entering idle");
+
+    if (server->config->idle_power_off) {
+        struct wavo_output *output;
+        wl_list_for_each(output, &server->outputs, link) {
+            wavo_output_set_power(output, false);
+        }
+    }
+}
+
+static void idle_wake(struct wavo_idle *idle) {
+    struct wavo_server *server = idle->server;
+
+    idle->idle = false;
+    wlr_log(WLR_INFO, "%s", "Leaving idle");
+
+    // Damage collected while idle is drawn by the next frame
+    struct wavo_output *output;
+    wl_list_for_each(output, &server->outputs, link) {
+        wavo_output_set_power(output, true);
+        wlr_output_schedule_frame(output->wlr_output);
+    }
+}
+
+static int idle_handle_timer(void *data) {
+    struct wavo_idle *idle = data;
+    idle->timer_armed = false;
+
+    if (idle->idle || idle->inhibitors > 0) {
+        return 0;
+    }
+
+    uint64_t timeout_usec =
+        (uint64_t)idle->server->config->idle_timeout_msec * 1000;
+    uint64_t elapsed_usec =
+        wavo_latency_now_usec() - idle->last_activity_usec;
+    if (elapsed_usec < timeout_usec) {
+        idle_arm_timer(idle, timeout_usec - elapsed_usec);
+        return 0;
+    }
+
+    idle_enter(idle);
+    return 0;
+}
+
+static void idle_restart_timer(struct wavo_idle *idle) {
+    int timeout_msec = idle->server->config->idle_timeout_msec;
+    if (timeout_msec > 0 && !idle->timer_armed && idle->inhibitors == 0) {
+        idle_arm_timer(idle, (uint64_t)timeout_msec * 1000);
+    }
+}
+
+void wavo_idle_notify_activity(struct wavo_idle *idle) {
+    // Keeps ext-idle-notify clients such as screen lockers informed
+    wlr_idle_notifier_v1_notify_activity(idle->notifier,
+        idle->server->input->seat);
+
+    idle->last_activity_usec = wavo_latency_now_usec();
+    if (idle->idle) {
+        idle_wake(idle);
+    }
+    idle_restart_timer(idle);
+}
+
+static void inhibitor_handle_destroy(struct wl_listener *listener,
+    void *data) {
+    (void)data;  // Unused parameter
+    struct idle_inhibitor *inhibitor =
+        wl_container_of(listener, inhibitor, destroy);
+    struct wavo_idle *idle = inhibitor->idle;
+
+    wl_list_remove(&inhibitor->destroy.link);
+    free(inhibitor);
+
+    if (--idle->inhibitors == 0) {
+        wlr_idle_notifier_v1_set_inhibited(idle->notifier, false);
+        // The timeout counts from the end of the inhibition
+        idle->last_activity_usec = wavo_latency_now_usec();
+        idle_restart_timer(idle);
+    }
+}
+
+static void idle_handle_new_inhibitor(struct wl_listener *listener,
+    void *data) {
+    struct wavo_idle *idle = wl_container_of(listener, idle, new_inhibitor);
+    struct wlr_idle_inhibitor_v1 *wlr_inhibitor = data;
+
+    struct idle_inhibitor *inhibitor = calloc(1, sizeof(struct idle_inhibitor));
+    if (!inhibitor) {
+        wlr_log(WLR_ERROR, "Failed to allocate idle inhibitor: %s",
+            "Out of memory");
+        return;
+    }
+
+    inhibitor->idle = idle;
+    inhibitor->destroy.notify = inhibitor_handle_destroy;
+    wl_signal_add(&wlr_inhibitor->events.destroy, &inhibitor->destroy);
+
+    if (idle->inhibitors++ == 0) {
+        wlr_idle_notifier_v1_set_inhibited(idle->notifier, true);
+    }
+    if (idle->idle) {
+        idle_wake(idle);
+    }
+}
+
+struct wavo_idle *wavo_idle_create(struct wavo_server *server) {
+    struct wavo_idle *idle = calloc(1, sizeof(struct wavo_idle));
+    if (!idle) {
+        wlr_log(WLR_ERROR, "%s", "Failed to allocate idle manager");
+        return NULL;
+    }
+
+    idle->server = server;
+
+    idle->notifier = wlr_idle_notifier_v1_create(server->wl_display);
+    if (!idle->notifier) {
+        wlr_log(WLR_ERROR, "%s", "Failed to create idle notifier");
+        goto error;
+    }
+
+    idle->inhibit_manager = wlr_idle_inhibit_v1_create(server->wl_display);
+    if (!idle->inhibit_manager) {
+        wlr_log(WLR_ERROR, "%s", "Failed to create idle inhibit manager");
+        goto error;
+    }
+
+    idle->timer = wl_event_loop_add_timer(server->event_loop,
+        idle_handle_timer, idle);
+    if (!idle->timer) {
+        wlr_log(WLR_ERROR, "%s", "Failed to create idle timer");
+        goto error;
+    }
+
+    idle->new_inhibitor.notify = idle_handle_new_inhibitor;
+    wl_signal_add(&idle->inhibit_manager->events.new_inhibitor,
+        &idle->new_inhibitor);
+
+    idle->last_activity_usec = wavo_latency_now_usec();
+    idle_restart_timer(idle);
+    return idle;
+
+error:
+    free(idle);
+    return NULL;
+}
+
+void wavo_idle_destroy(struct wavo_idle *idle) {
+    if (!idle) {
+        return;
+    }
+
+    // Inhibitors are gone with their clients, the globals with the display
+    wl_list_remove(&idle->new_inhibitor.link);
+    wl_event_source_remove(idle->timer);
+    free(idle);
+}
+
+void wavo_idle_print_metrics(struct wavo_idle *idle, FILE *out) {
+    if (!idle) {
+        return;
+    }
+
+    fprintf(out, "idle.active %d\n", idle->idle ? 1 : 0);
+    fprintf(out, "idle.entered %" PRIu64 "\n", idle->idle_entered);
+    fprintf(out, "idle.inhibitors %zu\n", idle->inhibitors);
+}
@@ -0,0 +1,122 @@
+#define _POSIX_C_SOURCE 200809L
+#include <inttypes.h>
+#include <string.h>
+#include <time.h>
+#include "wavo/latency.h"
+#include "wavo/output.h"
+#include "wavo/server.h"
+
+// Input timestamps further than this from now are not on our clock
+#define INPUT_CLOCK_SKEW_MSEC 10000
+
+size_t wavo_latency_bucket_index(uint64_t usec) {
+    if (usec < WAVO_LATENCY_SUB_BUCKETS) {
+        return usec;
+    }
+
+    int exp = 63 - __builtin_clzll(usec);  // >= 2
+    size_t sub = (usec >> (exp - 2)) & (WAVO_LATENCY_SUB_BUCKETS - 1);
+    size_t index = WAVO_LATENCY_SUB_BUCKETS +
+        (size_t)(exp - 2) * WAVO_LATENCY_SUB_BUCKETS + sub;
+    if (index >= WAVO_LATENCY_BUCKETS) {
+        index = WAVO_LATENCY_BUCKETS - 1;
+    }
+    return index;
+}
+
+uint64_t wavo_latency_bucket_upper(size_t index) {
+    if (index < WAVO_LATENCY_SUB_BUCKETS) {
+        return index;
+    }
+
+    size_t exp = (index - WAVO_LATENCY_SUB_BUCKETS) / WAVO_LATENCY_SUB_BUCKETS + 2;
+    size_t sub = (index - WAVO_LATENCY_SUB_BUCKETS) % WAVO_LATENCY_SUB_BUCKETS;
+    uint64_t lower = (uint64_t)(WAVO_LATENCY_SUB_BUCKETS + sub) << (exp - 2);
+    return lower + ((uint64_t)1 << (exp - 2)) - 1;
+}
+
+void wavo_latency_histogram_add(struct wavo_latency_histogram *hist,
+    uint64_t usec) {
+    hist->buckets[wavo_latency_bucket_index(usec)]++;
+    hist->count++;
+    hist->sum_usec += usec;
+    if (usec > hist->max_usec) {
+        hist->max_usec = usec;
+    }
+}
+
+void wavo_latency_histogram_reset(struct wavo_latency_histogram *hist) {
+    memset(hist, 0, sizeof(*hist));
+}
+
+uint64_t wavo_latency_histogram_percentile(
+    const struct wavo_latency_histogram *hist, double percentile) {
+    if (hist->count == 0) {
+        return 0;
+    }
+
+    double exact = percentile / 100.0 * (double)hist->count;
+    uint64_t rank = (uint64_t)exact;
+    if ((double)rank < exact) {
+        rank++;
+    }
+    if (rank == 0) {
+        rank = 1;
+    }
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < WAVO_LATENCY_BUCKETS; i++) {
+        seen += hist->buckets[i];
+        if (seen >= rank) {
+            uint64_t upper = wavo_latency_bucket_upper(i);
+            return upper < hist->max_usec ? upper : hist->max_usec;
+        }
+    }
+    return hist->max_usec;
+}
+
+void wavo_latency_histogram_print(const struct wavo_latency_histogram *hist,
+    const char *prefix, FILE *out) {
+    fprintf(out, "%s_count %" PRIu64 "\n", prefix, hist->count);
+    fprintf(out, "%s_mean_usec %" PRIu64 "\n", prefix,
+        hist->count ? hist->sum_usec / hist->count : 0);
+    fprintf(out, "%s_p50_usec %" PRIu64 "\n", prefix,
+        wavo_latency_histogram_percentile(hist, 50.0));
+    fprintf(out, "%s_p90_usec %" PRIu64 "\n", prefix,
+        wavo_latency_histogram_percentile(hist, 90.0));
+    fprintf(out, "%s_p99_usec %" PRIu64 "\n", prefix,
+        wavo_latency_histogram_percentile(hist, 99.0));
+    fprintf(out, "%s_max_usec %" PRIu64 "\n", prefix, hist->max_usec);
+}
+
+uint64_t wavo_latency_input_usec(uint32_t time_msec, uint64_t now_usec) {
+    uint32_t now_msec = (uint32_t)(now_usec / 1000);
+    uint32_t delta = now_msec - time_msec;  // Wraps every ~49 days
+    if (delta > INPUT_CLOCK_SKEW_MSEC || (uint64_t)delta * 1000 > now_usec) {
+        return now_usec;
+    }
+    return now_usec - (uint64_t)delta * 1000;
+}
+
+uint64_t wavo_latency_now_usec(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000 + (uint64_t)now.tv_nsec / 1000;
+}
+
+void wavo_latency_note_input(struct wavo_server *server, uint32_t time_msec) {
+    uint64_t input_usec = 0;
+
+    struct wavo_output *output;
+    wl_list_for_each(output, &server->outputs, link) {
+        // Only the oldest input not yet on screen matters for the latency
+        if (output->pending_input_usec != 0) {
+            continue;
+        }
+        if (input_usec == 0) {
+            input_usec = wavo_latency_input_usec(time_msec,
+                wavo_latency_now_usec());
+        }
+        output->pending_input_usec = input_usec;
+    }
+}
@@ -1,41 +1,492 @@
 #define _POSIX_C_SOURCE 200809L
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
+#include <wlr/backend/headless.h>
+#include <wlr/interfaces/wlr_output.h>
+#include <wlr/render/pass.h>
+#include <wlr/render/wlr_renderer.h>
+#include <wlr/render/wlr_texture.h>
+#include <wlr/types/wlr_buffer.h>
 #include <wlr/types/wlr_output.h>
 #include <wlr/types/wlr_output_layout.h>
 #include <wlr/types/wlr_scene.h>
 #include <wlr/types/wlr_output_management_v1.h>
 #include <wlr/util/log.h>
+#include <wlr/util/transform.h>
+#include "wavo/config.h"
+#include "wavo/foreign_toplevel.h"
+#include "wavo/hooks.h"
+#include "wavo/idle.h"
+#include "wavo/latency.h"
 #include "wavo/output.h"
+#include "wavo/pressure.h"
+#include "wavo/record.h"
+#include "wavo/render.h"
 #include "wavo/server.h"
+#include "wavo/view.h"
+
+// Refresh periods input may wait for a commit: one for the client to redraw
+// in response, one for the frame carrying it
+#define INPUT_MAX_WAIT_PERIODS 2
+
+// Attribute pending input to the first frame actually submitted after it.
+// Input that no commit followed in time caused no redraw here, charging it
+// to a later frame from whatever else changed would only add a bogus sample.
+static void output_track_commit(struct wavo_output *output,
+    uint32_t prev_commit_seq) {
+    struct wlr_output *wlr_output = output->wlr_output;
+    if (wlr_output->commit_seq == prev_commit_seq ||
+            output->pending_input_usec == 0 ||
+            output->inflight_input_usec != 0) {
+        return;
+    }
+
+    int refresh = wlr_output->refresh > 0 ? wlr_output->refresh : 60000;
+    uint64_t max_wait_usec =
+        INPUT_MAX_WAIT_PERIODS * 1000000000ull / (uint64_t)refresh;
+    if (wavo_latency_now_usec() - output->pending_input_usec > max_wait_usec) {
+        output->pending_input_usec = 0;
+        output->stale_inputs++;
+        return;
+    }
+
+    output->inflight_input_usec = output->pending_input_usec;
+    output->inflight_commit_seq = wlr_output->commit_seq;
+    output->pending_input_usec = 0;
+}
+
+void wavo_output_letterbox(int src_width, int src_height, int dst_width,
+    int dst_height, struct wlr_box *box) {
+    *box = (struct wlr_box){ .width = dst_width, .height = dst_height };
+    if (src_width <= 0 || src_height <= 0) {
+        return;
+    }
+
+    int64_t src_w = src_width, src_h = src_height;
+    if (src_w * dst_height > src_h * dst_width) {
+        // Wider than the target, bars above and below
+        box->height = (int)((src_h * dst_width + src_w / 2) / src_w);
+    } else {
+        box->width = (int)((src_w * dst_height + src_h / 2) / src_h);
+    }
+    box->x = (dst_width - box->width) / 2;
+    box->y = (dst_height - box->height) / 2;
+}
+
+bool wavo_output_is_mirror(const struct wavo_output *output) {
+    return output->config && output->config->mirror;
+}
+
+// Renders the source frame into a target buffer, scaled to fit and rotated
+// from the source's transform to the target's
+static bool output_mirror_blit(struct wavo_output *output,
+    struct wlr_buffer *buffer, struct wlr_output_state *state) {
+    struct wlr_output *wlr_output = output->wlr_output;
+    struct wlr_output *source = output->mirror_source->wlr_output;
+
+    struct wlr_texture *texture =
+        wlr_texture_from_buffer(output->server->renderer, buffer);
+    if (!texture) {
+        return false;
+    }
+
+    struct wlr_render_pass *pass =
+        wlr_output_begin_render_pass(wlr_output, state, NULL, NULL);
+    if (!pass) {
+        wlr_texture_destroy(texture);
+        return false;
+    }
+
+    enum wl_output_transform transform = wlr_output_transform_compose(
+        wlr_output_transform_invert(source->transform), wlr_output->transform);
+    int width = buffer->width;
+    int height = buffer->height;
+    if (transform & WL_OUTPUT_TRANSFORM_90) {
+        width = buffer->height;
+        height = buffer->width;
+    }
+
+    struct wlr_box box;
+    wavo_output_letterbox(width, height, wlr_output->width, wlr_output->height,
+        &box);
+
+    wlr_render_pass_add_rect(pass, &(struct wlr_render_rect_options){
+        .box = { .width = wlr_output->width, .height = wlr_output->height },
+        .color = { .a = 1.0f },
+    });
+    wlr_render_pass_add_texture(pass, &(struct wlr_render_texture_options){
+        .texture = texture,
+        .dst_box = box,
+        .transform = transform,
+        .filter_mode = WLR_SCALE_FILTER_BILINEAR,
+    });
+
+    bool ok = wlr_render_pass_submit(pass);
+    wlr_texture_destroy(texture);
+    return ok;
+}
+
+static void output_mirror_frame(struct wavo_output *output) {
+    struct wlr_buffer *buffer = output->mirror_buffer;
+    if (!buffer) {
+        return;
+    }
+    output->mirror_buffer = NULL;
+
+    struct wlr_output *wlr_output = output->wlr_output;
+    struct wlr_output *source = output->mirror_source->wlr_output;
+    uint32_t commit_seq = wlr_output->commit_seq;
+
+    struct wlr_output_state state;
+    wlr_output_state_init(&state);
+
+    // Same size and transform: scan out the source's buffer without touching
+    // it, if the target's hardware can take it
+    bool committed = false;
+    if (buffer->width == wlr_output->width &&
+            buffer->height == wlr_output->height &&
+            source->transform == wlr_output->transform) {
+        wlr_output_state_set_buffer(&state, buffer);
+        committed = wlr_output_test_state(wlr_output, &state) &&
+            wlr_output_commit_state(wlr_output, &state);
+        if (committed) {
+            output->mirror_direct_frames++;
+        } else {
+            wlr_output_state_finish(&state);
+            wlr_output_state_init(&state);
+        }
+    }
+
+    if (!committed) {
+        committed = output_mirror_blit(output, buffer, &state) &&
+            wlr_output_commit_state(wlr_output, &state);
+        if (committed) {
+            output->mirror_blit_frames++;
+        } else {
+            wlr_log(WLR_ERROR, "Failed to mirror %s to %s", source->name,
+                wlr_output->name);
+        }
+    }
+
+    wlr_output_state_finish(&state);
+    wlr_buffer_unlock(buffer);
+    output_track_commit(output, commit_seq);
+}
+
+static void output_mirror_commit(struct wl_listener *listener, void *data) {
+    struct wavo_output *output = wl_container_of(listener, output, mirror_commit);
+    struct wlr_output_event_commit *event = data;
+
+    if (!(event->state->committed & WLR_OUTPUT_STATE_BUFFER)) {
+        return;
+    }
+
+    // Only the newest frame matters if the source outruns the target
+    if (output->mirror_buffer) {
+        wlr_buffer_unlock(output->mirror_buffer);
+    }
+    output->mirror_buffer = wlr_buffer_lock(event->state->buffer);
+    wlr_output_schedule_frame(output->wlr_output);
+}
+
+static void output_mirror_detach(struct wavo_output *output) {
+    if (!output->mirror_source) {
+        return;
+    }
+
+    wl_list_remove(&output->mirror_commit.link);
+    if (output->mirror_buffer) {
+        wlr_buffer_unlock(output->mirror_buffer);
+        output->mirror_buffer = NULL;
+    }
+    output->mirror_source = NULL;
+}
+
+// Pairs mirror targets with their sources, either may appear first
+static void output_update_mirrors(struct wavo_server *server) {
+    struct wavo_output *target;
+    wl_list_for_each(target, &server->outputs, link) {
+        if (!wavo_output_is_mirror(target) || target->mirror_source) {
+            continue;
+        }
+
+        struct wavo_output *source;
+        wl_list_for_each(source, &server->outputs, link) {
+            if (source == target || wavo_output_is_mirror(source) ||
+                    strcmp(source->wlr_output->name,
+                        target->config->mirror) != 0) {
+                continue;
+            }
+
+            wlr_log(WLR_INFO, "Mirroring %s to %s", source->wlr_output->name,
+                target->wlr_output->name);
+            target->mirror_source = source;
+            target->mirror_commit.notify = output_mirror_commit;
+            wl_signal_add(&source->wlr_output->events.commit,
+                &target->mirror_commit);
+
+            // The source may be idle, make it produce a first frame
+            wlr_output_update_needs_frame(source->wlr_output);
+            break;
+        }
+    }
+}
+
+// Stops targets mirroring an output that is going away
+static void output_release_mirrors(struct wavo_output *output) {
+    output_mirror_detach(output);
+
+    struct wavo_output *target;
+    wl_list_for_each(target, &output->server->outputs, link) {
+        if (target->mirror_source == output) {
+            output_mirror_detach(target);
+        }
+    }
+}
+
+struct frame_done_data {
+    struct wavo_output *output;
+    struct timespec *when;
+};
+
+static void output_frame_done_iterator(struct wlr_scene_buffer *buffer,
+    int sx, int sy, void *user_data) {
+    (void)sx;
+    (void)sy;
+    struct frame_done_data *data = user_data;
+
+    // Surfaces of a placed view are paced by the view's output below
+    struct wavo_view *view = wavo_view_from_node(&buffer->node);
+    if (view && view->output) {
+        return;
+    }
+    if (buffer->primary_output == data->output->scene_output) {
+        wlr_scene_buffer_send_frame_done(buffer, data->when);
+    }
+}
+
+static void view_frame_done_iterator(struct wlr_scene_buffer *buffer,
+    int sx, int sy, void *user_data) {
+    (void)sx;
+    (void)sy;
+    wlr_scene_buffer_send_frame_done(buffer, user_data);
+}
+
+static void output_send_frame_done(struct wavo_output *output,
+    struct timespec *when) {
+    struct frame_done_data data = {
+        .output = output,
+        .when = when,
+    };
+    wlr_scene_output_for_each_buffer(output->scene_output,
+        output_frame_done_iterator, &data);
+
+    // Every surface of a view, popups on other outputs included, follows the
+    // view's primary output. A view spanning outputs with different refresh
+    // rates then renders at one even rate, not the fastest or a mix.
+    struct wavo_view *view;
+    wl_list_for_each(view, &output->server->views, link) {
+        if (view->output == output) {
+            wlr_scene_node_for_each_buffer(&view->scene_tree->node,
+                view_frame_done_iterator, when);
+        }
+    }
+}
+
+void wavo_output_finish_frame(struct wavo_output *output, uint32_t commit_seq) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    if (output->wlr_output->commit_seq != commit_seq) {
+        uint64_t now_usec = (uint64_t)now.tv_sec * 1000000 +
+            (uint64_t)now.tv_nsec / 1000;
+        uint64_t frame_usec = now_usec > output->frame_start_usec ?
+            now_usec - output->frame_start_usec : 0;
+        wavo_latency_histogram_add(&output->frame_time, frame_usec);
+        wavo_record_frame(output->server->recorder, output, frame_usec);
+    }
+
+    output_track_commit(output, commit_seq);
+    output_send_frame_done(output, &now);
+    wavo_pressure_update_views(output->server->pressure);
+    wavo_foreign_toplevels_flush(output->server->foreign_toplevels, output);
+    // Right after a frame is when the next one is furthest away
+    wavo_hooks_run_after_frame(output->server->hooks);
+}
 
 static void output_frame(struct wl_listener *listener, void *data) {
     (void)data;
     struct wavo_output *output = wl_container_of(listener, output, frame);
     struct wlr_scene_output *scene_output = output->scene_output;
-    struct timespec now;
 
-    // Get the current time for presentation feedback
-    clock_gettime(CLOCK_MONOTONIC, &now);
+    // No commit and no frame callbacks, so clients stop drawing too and the
+    // next frame only comes from wavo_idle_notify_activity()
+    if (output->server->idle && output->server->idle->idle) {
+        return;
+    }
+
+    if (!scene_output) {
+        output_mirror_frame(output);
+        return;
+    }
+    output->frame_start_usec = wavo_latency_now_usec();
+
+    // Drawn on a worker, which finishes the frame once committed
+    if (output->server->render &&
+            wavo_render_output(output->server->render, output)) {
+        return;
+    }
 
     // Render the scene
+    uint32_t commit_seq = output->wlr_output->commit_seq;
     if (!wlr_scene_output_commit(scene_output, NULL)) {
         wlr_log(WLR_ERROR, "%s", "Failed to commit scene output");
         return;
     }
+    wavo_output_finish_frame(output, commit_seq);
+}
 
-    wlr_scene_output_send_frame_done(scene_output, &now);
+// Realtime scheduling shows up here: how long after vblank the compositor
+// got to run, and how far consecutive presents stray from the refresh period
+static void output_note_present(struct wavo_output *output,
+    const struct wlr_output_event_present *event, uint64_t when_usec) {
+    uint64_t now_usec = wavo_latency_now_usec();
+    if (now_usec >= when_usec) {
+        wavo_latency_histogram_add(&output->present_delay,
+            now_usec - when_usec);
+    }
+
+    uint64_t last_usec = output->last_present_usec;
+    output->last_present_usec = when_usec;
+    if (last_usec == 0 || when_usec <= last_usec || event->refresh <= 0) {
+        return;
+    }
+
+    // Longer gaps are frames that were never drawn, not jitter
+    uint64_t interval = when_usec - last_usec;
+    uint64_t period = (uint64_t)event->refresh / 1000;
+    if (interval > period + period / 2) {
+        return;
+    }
+    wavo_latency_histogram_add(&output->frame_jitter,
+        interval > period ? interval - period : period - interval);
 }
 
-static void output_destroy(struct wl_listener *listener, void *data) {
-    (void)data;
-    struct wavo_output *output = wl_container_of(listener, output, destroy);
+static void output_present(struct wl_listener *listener, void *data) {
+    struct wavo_output *output = wl_container_of(listener, output, present);
+    struct wlr_output_event_present *event = data;
+
+    uint64_t when_usec = 0;
+    if (event->presented && event->when) {
+        when_usec = (uint64_t)event->when->tv_sec * 1000000 +
+            (uint64_t)event->when->tv_nsec / 1000;
+        output_note_present(output, event, when_usec);
+    }
+
+    if (output->inflight_input_usec == 0 ||
+            event->commit_seq != output->inflight_commit_seq) {
+        return;
+    }
+
+    uint64_t input_usec = output->inflight_input_usec;
+    output->inflight_input_usec = 0;
+
+    if (when_usec == 0) {
+        // The frame was discarded, the input is still waiting for a photon
+        if (output->pending_input_usec == 0 ||
+                input_usec < output->pending_input_usec) {
+            output->pending_input_usec = input_usec;
+        }
+        return;
+    }
+
+    if (when_usec >= input_usec) {
+        wavo_latency_histogram_add(&output->input_latency,
+            when_usec - input_usec);
+    }
+}
+
+static void output_forget_views(struct wavo_output *output) {
+    struct wavo_view *view;
+    wl_list_for_each(view, &output->server->views, link) {
+        if (view->output == output) {
+            view->output = NULL;
+        }
+    }
+}
+
+// Shared by unplugging and failed creation. A frame still on a render worker
+// is dropped instead of being committed through the freed output.
+static void output_finish(struct wavo_output *output) {
+    wavo_render_job_cancel(output->render_job);
+    output_forget_views(output);
+    output_release_mirrors(output);
     wl_list_remove(&output->frame.link);
+    wl_list_remove(&output->present.link);
     wl_list_remove(&output->destroy.link);
     wl_list_remove(&output->link);
     free(output);
 }
 
+static void output_destroy(struct wl_listener *listener, void *data) {
+    (void)data;
+    struct wavo_output *output = wl_container_of(listener, output, destroy);
+    wavo_hooks_emit_output(output->server->hooks, WAVO_HOOK_OUTPUT_REMOVE,
+        output);
+    output_finish(output);
+}
+
+static struct wlr_output_mode *output_find_mode(struct wlr_output *wlr_output,
+    const struct wavo_output_config *config) {
+    struct wlr_output_mode *best = NULL;
+
+    struct wlr_output_mode *mode;
+    wl_list_for_each(mode, &wlr_output->modes, link) {
+        if (mode->width != config->width || mode->height != config->height) {
+            continue;
+        }
+        if (config->refresh == 0) {
+            return mode;
+        }
+        if (!best || abs(mode->refresh - config->refresh) <
+                abs(best->refresh - config->refresh)) {
+            best = mode;
+        }
+    }
+    return best;
+}
+
+static void output_state_apply_config(struct wlr_output *wlr_output,
+    const struct wavo_output_config *config, struct wlr_output_state *state) {
+    if (config && config->width > 0) {
+        if (wl_list_empty(&wlr_output->modes)) {
+            // Nested and headless outputs accept any mode
+            wlr_output_state_set_custom_mode(state, config->width,
+                config->height, config->refresh);
+        } else {
+            struct wlr_output_mode *mode = output_find_mode(wlr_output, config);
+            if (mode) {
+                wlr_output_state_set_mode(state, mode);
+            } else {
+                wlr_log(WLR_ERROR, "Output %s has no mode %dx%d, using preferred",
+                    wlr_output->name, config->width, config->height);
+            }
+        }
+    }
+
+    if (!(state->committed & WLR_OUTPUT_STATE_MODE)) {
+        struct wlr_output_mode *mode = wlr_output_preferred_mode(wlr_output);
+        if (mode != NULL) {
+            wlr_output_state_set_mode(state, mode);
+        }
+    }
+
+    if (config) {
+        wlr_output_state_set_scale(state, config->scale);
+    }
+}
+
 struct wavo_output *wavo_output_create(struct wavo_server *server,
     struct wlr_output *wlr_output) {
     struct wavo_output *output = calloc(1, sizeof(struct wavo_output));
@@ -46,6 +497,8 @@ struct wavo_output *wavo_output_create(struct wavo_server *server,
 
     output->server = server;
     output->wlr_output = wlr_output;
+    output->id = ++server->next_output_id;
+    wl_list_init(&output->mirror_commit.link);
 
     // Setup output mode
     if (!wlr_output_init_render(wlr_output, server->allocator, server->renderer)) {
@@ -54,36 +507,47 @@ struct wavo_output *wavo_output_create(struct wavo_server *server,
         return NULL;
     }
 
-    struct wlr_output_mode *mode = wlr_output_preferred_mode(wlr_output);
-    if (mode != NULL) {
-        struct wlr_output_state state;
-        wlr_output_state_init(&state);
-        wlr_output_state_set_enabled(&state, true);
-        wlr_output_state_set_mode(&state, mode);
-        if (!wlr_output_commit_state(wlr_output, &state)) {
-            wlr_log(WLR_ERROR, "%s", "Failed to commit output mode");
-            wlr_output_state_finish(&state);
-            free(output);
-            return NULL;
-        }
-        wlr_output_state_finish(&state);
-    }
+    const struct wavo_output_config *config =
+        wavo_config_find_output(server->config, wlr_output->name);
+    output->config = config;
 
-    // Create scene output
-    output->scene_output = wlr_scene_output_create(server->scene, wlr_output);
-    if (!output->scene_output) {
-        wlr_log(WLR_ERROR, "%s", "Failed to create scene output");
+    struct wlr_output_state mode_state;
+    wlr_output_state_init(&mode_state);
+    wlr_output_state_set_enabled(&mode_state, true);
+    output_state_apply_config(wlr_output, config, &mode_state);
+    if (!wlr_output_commit_state(wlr_output, &mode_state)) {
+        wlr_log(WLR_ERROR, "%s", "Failed to commit output mode");
+        wlr_output_state_finish(&mode_state);
         free(output);
         return NULL;
     }
+    wlr_output_state_finish(&mode_state);
 
-    // Add it to the output layout
-    wlr_output_layout_add_auto(server->output_layout, wlr_output);
+    // Mirror targets never composite the scene themselves
+    if (!wavo_output_is_mirror(output)) {
+        output->scene_output = wlr_scene_output_create(server->scene, wlr_output);
+        if (!output->scene_output) {
+            wlr_log(WLR_ERROR, "%s", "Failed to create scene output");
+            free(output);
+            return NULL;
+        }
+
+        // Add it to the output layout
+        struct wlr_output_layout_output *layout_output =
+            wlr_output_layout_add_auto(server->output_layout, wlr_output);
+        if (layout_output) {
+            wlr_scene_output_layout_add_output(server->scene_layout,
+                layout_output, output->scene_output);
+        }
+    }
 
     // Setup listeners
     output->frame.notify = output_frame;
     wl_signal_add(&wlr_output->events.frame, &output->frame);
 
+    output->present.notify = output_present;
+    wl_signal_add(&wlr_output->events.present, &output->present);
+
     output->destroy.notify = output_destroy;
     wl_signal_add(&wlr_output->events.destroy, &output->destroy);
 
@@ -102,14 +566,76 @@ struct wavo_output *wavo_output_create(struct wavo_server *server,
     }
     wlr_output_state_finish(&state);
 
+    output_update_mirrors(server);
+    wavo_record_output(server->recorder, output);
+    wavo_hooks_emit_output(server->hooks, WAVO_HOOK_OUTPUT_ADD, output);
     return output;
 }
 
+void wavo_output_set_power(struct wavo_output *output, bool on) {
+    struct wlr_output *wlr_output = output->wlr_output;
+    if (on ? !output->idle_off : !wlr_output->enabled) {
+        return;
+    }
+
+    struct wlr_output_state state;
+    wlr_output_state_init(&state);
+    wlr_output_state_set_enabled(&state, on);
+    if (wlr_output_commit_state(wlr_output, &state)) {
+        output->idle_off = !on;
+    } else {
+        wlr_log(WLR_ERROR, "Failed to power %s output %s", on ? "on" : "off",
+            wlr_output->name);
+    }
+    wlr_output_state_finish(&state);
+}
+
 void wavo_output_destroy(struct wavo_output *output) {
     if (!output) return;
-    wlr_scene_output_destroy(output->scene_output);
-    wl_list_remove(&output->frame.link);
-    wl_list_remove(&output->destroy.link);
-    wl_list_remove(&output->link);
-    free(output);
+    if (output->scene_output) {
+        wlr_scene_output_destroy(output->scene_output);
+    }
+    output_finish(output);
+}
+
+struct wavo_output *wavo_output_find(struct wavo_server *server,
+    const char *name) {
+    struct wavo_output *output;
+    wl_list_for_each(output, &server->outputs, link) {
+        if (strcmp(output->wlr_output->name, name) == 0) {
+            return output;
+        }
+    }
+    return NULL;
+}
+
+struct wavo_output *wavo_output_create_virtual(struct wavo_server *server,
+    int width, int height, int refresh) {
+    // new_output fires synchronously and creates the wavo_output
+    struct wlr_output *wlr_output = wlr_headless_add_output(
+        server->headless_backend, (unsigned int)width, (unsigned int)height);
+    if (!wlr_output) {
+        wlr_log(WLR_ERROR, "%s", "Failed to create headless output");
+        return NULL;
+    }
+
+    struct wavo_output *output = wavo_output_find(server, wlr_output->name);
+    if (!output) {
+        wlr_output_destroy(wlr_output);
+        return NULL;
+    }
+    output->is_virtual = true;
+
+    // The headless backend paces frames by the mode's refresh rate
+    struct wlr_output_state state;
+    wlr_output_state_init(&state);
+    wlr_output_state_set_custom_mode(&state, width, height,
+        refresh > 0 ? refresh : 60000);
+    if (!wlr_output_commit_state(wlr_output, &state)) {
+        wlr_log(WLR_ERROR, "Failed to set mode on %s", wlr_output->name);
+    }
+    wlr_output_state_finish(&state);
+
+    wlr_log(WLR_INFO, "Created virtual output %s", wlr_output->name);
+    return output;
 }
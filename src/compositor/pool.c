@@ -0,0 +1,290 @@
+#define _GNU_SOURCE
+#include <inttypes.h>
+#include <stdalign.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <wlr/util/log.h>
+#include "wavo/pool.h"
+
+// Free objects are poisoned under ASan, so pooling does not hide
+// use-after-free bugs
+#if defined(__SANITIZE_ADDRESS__)
+#include <sanitizer/asan_interface.h>
+#define POOL_POISON(addr, size) ASAN_POISON_MEMORY_REGION(addr, size)
+#define POOL_UNPOISON(addr, size) ASAN_UNPOISON_MEMORY_REGION(addr, size)
+#else
+#define POOL_POISON(addr, size) ((void)(addr), (void)(size))
+#define POOL_UNPOISON(addr, size) ((void)(addr), (void)(size))
+#endif
+
+#define POOL_ALIGN alignof(max_align_t)
+#define POOL_DEFAULT_SLAB_OBJECTS 32
+
+struct wavo_pool_slab {
+    struct wavo_pool_slab *next;
+    bool mapped;  // Whole pages of its own, from mmap()
+    bool locked;
+};
+
+struct wavo_pool_free {
+    struct wavo_pool_free *next;
+};
+
+static size_t align_up(size_t size) {
+    return (size + POOL_ALIGN - 1) & ~(POOL_ALIGN - 1);
+}
+
+static size_t slab_size(const struct wavo_pool *pool) {
+    return align_up(sizeof(struct wavo_pool_slab)) +
+        pool->object_size * pool->slab_objects;
+}
+
+// What a slab takes up, mapped slabs being rounded up to whole pages
+static size_t slab_bytes(const struct wavo_pool *pool,
+    const struct wavo_pool_slab *slab) {
+    size_t size = slab_size(pool);
+    if (!slab->mapped) {
+        return size;
+    }
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    return (size + page - 1) & ~(page - 1);
+}
+
+// A locked pool maps its slabs, so no two share a page and each one's lock
+// goes away with it
+static struct wavo_pool_slab *slab_alloc(struct wavo_pool *pool) {
+    struct wavo_pool_slab *slab;
+    if (pool->locked) {
+        size_t page = (size_t)sysconf(_SC_PAGESIZE);
+        size_t size = (slab_size(pool) + page - 1) & ~(page - 1);
+        slab = mmap(NULL, size, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (slab == MAP_FAILED) {
+            return NULL;
+        }
+        slab->mapped = true;
+    } else {
+        slab = malloc(slab_size(pool));
+        if (!slab) {
+            return NULL;
+        }
+        slab->mapped = false;
+    }
+    slab->locked = false;
+    return slab;
+}
+
+// Never munlock()ed: locks are per page, and a malloc()ed slab shares its
+// first and last page with memory that may still need them. munmap() drops
+// the lock of a mapped slab.
+static void slab_release(struct wavo_pool *pool, struct wavo_pool_slab *slab) {
+    size_t bytes = slab_bytes(pool, slab);
+    POOL_UNPOISON(slab, slab_size(pool));
+    if (slab->locked) {
+        pool->locked_bytes -= bytes;
+    }
+    if (slab->mapped) {
+        munmap(slab, bytes);
+    } else {
+        free(slab);
+    }
+}
+
+static bool slab_lock(struct wavo_pool *pool, struct wavo_pool_slab *slab) {
+    if (slab->locked) {
+        return true;
+    }
+    size_t bytes = slab_bytes(pool, slab);
+    if (mlock(slab, bytes) != 0) {
+        return false;
+    }
+    slab->locked = true;
+    pool->locked_bytes += bytes;
+    return true;
+}
+
+void wavo_pool_init(struct wavo_pool *pool, const char *name,
+    size_t object_size, size_t slab_objects) {
+    memset(pool, 0, sizeof(*pool));
+    pool->name = name;
+    pool->slab_objects = slab_objects > 0 ?
+        slab_objects : POOL_DEFAULT_SLAB_OBJECTS;
+
+    if (object_size < sizeof(struct wavo_pool_free)) {
+        object_size = sizeof(struct wavo_pool_free);
+    }
+    pool->object_size = align_up(object_size);
+}
+
+void wavo_pool_finish(struct wavo_pool *pool) {
+    if (pool->in_use > 0) {
+        wlr_log(WLR_ERROR, "Pool %s destroyed with %zu objects in use",
+            pool->name, pool->in_use);
+    }
+
+    struct wavo_pool_slab *slab = pool->slabs;
+    while (slab) {
+        struct wavo_pool_slab *next = slab->next;
+        slab_release(pool, slab);
+        slab = next;
+    }
+
+    pool->slabs = NULL;
+    pool->free_list = NULL;
+    pool->in_use = 0;
+    pool->capacity = 0;
+    pool->slab_count = 0;
+    pool->locked = false;
+    pool->locked_bytes = 0;
+}
+
+static bool pool_grow(struct wavo_pool *pool) {
+    size_t header = align_up(sizeof(struct wavo_pool_slab));
+    struct wavo_pool_slab *slab = slab_alloc(pool);
+    if (!slab) {
+        wlr_log(WLR_ERROR, "Failed to grow pool %s: %s", pool->name,
+            "Out of memory");
+        return false;
+    }
+    if (pool->locked && !slab_lock(pool, slab)) {
+        wlr_log(WLR_ERROR, "Failed to lock new slab of pool %s", pool->name);
+    }
+
+    slab->next = pool->slabs;
+    pool->slabs = slab;
+    pool->slab_count++;
+    pool->capacity += pool->slab_objects;
+
+    // Pushed in reverse, so the first allocations come out in address order
+    char *objects = (char *)slab + header;
+    for (size_t i = pool->slab_objects; i-- > 0;) {
+        struct wavo_pool_free *object =
+            (struct wavo_pool_free *)(objects + i * pool->object_size);
+        object->next = pool->free_list;
+        pool->free_list = object;
+        POOL_POISON(object, pool->object_size);
+    }
+    return true;
+}
+
+bool wavo_pool_lock(struct wavo_pool *pool) {
+    // Make sure there is something to lock before the first object is
+    // needed, mapped and locked as it is added
+    pool->locked = true;
+    if (!pool->slabs && !pool_grow(pool)) {
+        return false;
+    }
+
+    // Slabs from before are locked as they are, see slab_release()
+    bool ok = true;
+    for (struct wavo_pool_slab *slab = pool->slabs; slab; slab = slab->next) {
+        ok = slab_lock(pool, slab) && ok;
+    }
+    return ok;
+}
+
+static bool slab_contains(const struct wavo_pool *pool,
+    const struct wavo_pool_slab *slab, const void *object) {
+    const char *objects = (const char *)slab + align_up(sizeof(*slab));
+    const char *end = objects + pool->object_size * pool->slab_objects;
+    return (const char *)object >= objects && (const char *)object < end;
+}
+
+static void free_list_poison(struct wavo_pool *pool, bool poison) {
+    struct wavo_pool_free *object = pool->free_list;
+    while (object) {
+        POOL_UNPOISON(object, pool->object_size);
+        struct wavo_pool_free *next = object->next;
+        if (poison) {
+            POOL_POISON(object, pool->object_size);
+        }
+        object = next;
+    }
+}
+
+size_t wavo_pool_trim(struct wavo_pool *pool) {
+    if (pool->capacity - pool->in_use < pool->slab_objects) {
+        return 0;
+    }
+
+    // The free list is read and relinked below
+    free_list_poison(pool, false);
+
+    size_t released = 0;
+    struct wavo_pool_slab **link = &pool->slabs;
+    while (*link) {
+        struct wavo_pool_slab *slab = *link;
+
+        size_t free_count = 0;
+        struct wavo_pool_free *object;
+        for (object = pool->free_list; object; object = object->next) {
+            if (slab_contains(pool, slab, object)) {
+                free_count++;
+            }
+        }
+        if (free_count < pool->slab_objects) {
+            link = &slab->next;
+            continue;
+        }
+
+        struct wavo_pool_free **free_link = &pool->free_list;
+        while (*free_link) {
+            if (slab_contains(pool, slab, *free_link)) {
+                *free_link = (*free_link)->next;
+            } else {
+                free_link = &(*free_link)->next;
+            }
+        }
+
+        *link = slab->next;
+        released += slab_bytes(pool, slab);
+        slab_release(pool, slab);
+        pool->slab_count--;
+        pool->capacity -= pool->slab_objects;
+    }
+
+    free_list_poison(pool, true);
+    return released;
+}
+
+void *wavo_pool_alloc(struct wavo_pool *pool) {
+    if (!pool->free_list && !pool_grow(pool)) {
+        return NULL;
+    }
+
+    struct wavo_pool_free *object = pool->free_list;
+    POOL_UNPOISON(object, pool->object_size);
+    pool->free_list = object->next;
+    pool->in_use++;
+    pool->allocs++;
+
+    memset(object, 0, pool->object_size);
+    return object;
+}
+
+void wavo_pool_free(struct wavo_pool *pool, void *object) {
+    if (!object) {
+        return;
+    }
+
+    struct wavo_pool_free *free_object = object;
+    free_object->next = pool->free_list;
+    pool->free_list = free_object;
+    pool->in_use--;
+    POOL_POISON(free_object, pool->object_size);
+}
+
+void wavo_pool_print(const struct wavo_pool *pool, FILE *out) {
+    fprintf(out, "pool.%s.in_use %zu\n", pool->name, pool->in_use);
+    fprintf(out, "pool.%s.capacity %zu\n", pool->name, pool->capacity);
+    fprintf(out, "pool.%s.slabs %zu\n", pool->name, pool->slab_count);
+    fprintf(out, "pool.%s.allocs %" PRIu64 "\n", pool->name, pool->allocs);
+    if (pool->locked) {
+        fprintf(out, "pool.%s.locked_bytes %zu\n", pool->name,
+            pool->locked_bytes);
+    }
+}
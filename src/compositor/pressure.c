@@ -0,0 +1,234 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <malloc.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <wayland-server-core.h>
+#include <wlr/types/wlr_scene.h>
+#include <wlr/types/wlr_xdg_shell.h>
+#include <wlr/util/log.h>
+#include "wavo/pool.h"
+#include "wavo/pressure.h"
+#include "wavo/server.h"
+#include "wavo/view.h"
+
+// Tasks stalled on memory for 150ms within 2s. Unprivileged processes may
+// only use windows that are a multiple of 2s.
+#define PRESSURE_TRIGGER "some 150000 2000000"
+
+static uint64_t resident_bytes(void) {
+    FILE *f = fopen("/proc/self/statm", "re");
+    if (!f) {
+        return 0;
+    }
+    unsigned long long size = 0, resident = 0;
+    if (fscanf(f, "%llu %llu", &size, &resident) != 2) {
+        resident = 0;
+    }
+    fclose(f);
+    return (uint64_t)resident * (uint64_t)sysconf(_SC_PAGESIZE);
+}
+
+static void visible_iterator(struct wlr_scene_buffer *buffer, int sx, int sy,
+    void *user_data) {
+    (void)sx;
+    (void)sy;
+    bool *visible = user_data;
+    if (buffer->primary_output) {
+        *visible = true;
+    }
+}
+
+// The scene leaves primary_output unset for buffers that are off every
+// output or fully behind opaque surfaces
+static bool view_is_visible(struct wavo_view *view) {
+    bool visible = false;
+    wlr_scene_node_for_each_buffer(&view->scene_tree->node, visible_iterator,
+        &visible);
+    return visible;
+}
+
+static void view_set_suspended(struct wavo_pressure *pressure,
+    struct wavo_view *view, bool suspended) {
+    view->suspended = suspended;
+    if (suspended) {
+        pressure->suspended_views++;
+    } else {
+        pressure->suspended_views--;
+    }
+    wlr_xdg_toplevel_set_suspended(view->xdg_surface->toplevel, suspended);
+}
+
+void wavo_pressure_reclaim(struct wavo_pressure *pressure) {
+    if (!pressure) {
+        return;
+    }
+    struct wavo_server *server = pressure->server;
+    uint64_t start_bytes = resident_bytes();
+
+    struct wavo_view *view;
+    wl_list_for_each(view, &server->views, link) {
+        if (!view->suspended && !view_is_visible(view)) {
+            view_set_suspended(pressure, view, true);
+        }
+    }
+
+    size_t pool_bytes = wavo_pool_trim(&server->view_pool) +
+        wavo_pool_trim(&server->popup_pool) +
+        wavo_pool_trim(&server->keyboard_pool) +
+        wavo_pool_trim(&server->pointer_pool) +
+        wavo_pool_trim(&server->grab_pool);
+#ifdef __GLIBC__
+    malloc_trim(0);
+#endif
+
+    uint64_t end_bytes = resident_bytes();
+    if (end_bytes < start_bytes) {
+        pressure->reclaimed_bytes += start_bytes - end_bytes;
+    }
+    wlr_log(WLR_INFO, "Memory pressure: %zu views suspended, %zu pool bytes "
+        "freed, resident size %" PRIu64 " -> %" PRIu64,
+        pressure->suspended_views, pool_bytes, start_bytes, end_bytes);
+}
+
+void wavo_pressure_update_views(struct wavo_pressure *pressure) {
+    if (!pressure || pressure->suspended_views == 0) {
+        return;
+    }
+
+    struct wavo_view *view;
+    wl_list_for_each(view, &pressure->server->views, link) {
+        if (view->suspended && view_is_visible(view)) {
+            view_set_suspended(pressure, view, false);
+            pressure->resumed_views++;
+        }
+    }
+}
+
+static int handle_pressure(int fd, uint32_t mask, void *data) {
+    (void)fd;
+    (void)mask;
+    struct wavo_pressure *pressure = data;
+
+    struct epoll_event event;
+    int n = epoll_wait(pressure->epoll_fd, &event, 1, 0);
+    if (n <= 0) {
+        return 0;
+    }
+    if (event.events & EPOLLERR) {
+        // The trigger's cgroup went away
+        wlr_log(WLR_ERROR, "%s", "Memory pressure trigger lost");
+        wl_event_source_remove(pressure->source);
+        pressure->source = NULL;
+        return 0;
+    }
+
+    pressure->events++;
+    wavo_pressure_reclaim(pressure);
+    return 0;
+}
+
+static bool pressure_watch(struct wavo_pressure *pressure) {
+    pressure->psi_fd = open("/proc/pressure/memory",
+        O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (pressure->psi_fd < 0) {
+        wlr_log(WLR_INFO, "Memory pressure unavailable: %s", strerror(errno));
+        return false;
+    }
+    if (write(pressure->psi_fd, PRESSURE_TRIGGER,
+            strlen(PRESSURE_TRIGGER) + 1) < 0) {
+        wlr_log(WLR_INFO, "Failed to add memory pressure trigger: %s",
+            strerror(errno));
+        return false;
+    }
+
+    pressure->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (pressure->epoll_fd < 0) {
+        wlr_log(WLR_ERROR, "Failed to create epoll instance: %s",
+            strerror(errno));
+        return false;
+    }
+    struct epoll_event event = {
+        .events = EPOLLPRI,
+    };
+    if (epoll_ctl(pressure->epoll_fd, EPOLL_CTL_ADD, pressure->psi_fd,
+            &event) != 0) {
+        wlr_log(WLR_ERROR, "Failed to watch memory pressure: %s",
+            strerror(errno));
+        return false;
+    }
+
+    pressure->source = wl_event_loop_add_fd(pressure->server->event_loop,
+        pressure->epoll_fd, WL_EVENT_READABLE, handle_pressure, pressure);
+    if (!pressure->source) {
+        wlr_log(WLR_ERROR, "%s", "Failed to add memory pressure source");
+        return false;
+    }
+    return true;
+}
+
+struct wavo_pressure *wavo_pressure_create(struct wavo_server *server) {
+    struct wavo_pressure *pressure = calloc(1, sizeof(struct wavo_pressure));
+    if (!pressure) {
+        wlr_log(WLR_ERROR, "Failed to allocate memory pressure: %s",
+            "Out of memory");
+        return NULL;
+    }
+    pressure->server = server;
+    pressure->psi_fd = -1;
+    pressure->epoll_fd = -1;
+
+    // Reclaim still works when asked for, nothing triggers it
+    if (!pressure_watch(pressure)) {
+        if (pressure->epoll_fd >= 0) {
+            close(pressure->epoll_fd);
+            pressure->epoll_fd = -1;
+        }
+        if (pressure->psi_fd >= 0) {
+            close(pressure->psi_fd);
+            pressure->psi_fd = -1;
+        }
+    }
+    return pressure;
+}
+
+void wavo_pressure_forget_view(struct wavo_pressure *pressure,
+    struct wavo_view *view) {
+    if (view->suspended) {
+        view->suspended = false;
+        pressure->suspended_views--;
+    }
+}
+
+void wavo_pressure_destroy(struct wavo_pressure *pressure) {
+    if (!pressure) {
+        return;
+    }
+    if (pressure->source) {
+        wl_event_source_remove(pressure->source);
+    }
+    if (pressure->epoll_fd >= 0) {
+        close(pressure->epoll_fd);
+    }
+    if (pressure->psi_fd >= 0) {
+        close(pressure->psi_fd);
+    }
+    free(pressure);
+}
+
+void wavo_pressure_print_metrics(struct wavo_pressure *pressure, FILE *out) {
+    if (!pressure) {
+        return;
+    }
+    fprintf(out, "pressure.watching %d\n", pressure->source ? 1 : 0);
+    fprintf(out, "pressure.events %" PRIu64 "\n", pressure->events);
+    fprintf(out, "pressure.suspended_views %zu\n", pressure->suspended_views);
+    fprintf(out, "pressure.resumed_views %" PRIu64 "\n",
+        pressure->resumed_views);
+    fprintf(out, "pressure.reclaimed_bytes %" PRIu64 "\n",
+        pressure->reclaimed_bytes);
+}
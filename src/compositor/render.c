@@ -0,0 +1,569 @@
+#define _POSIX_C_SOURCE 200809L
+#include <inttypes.h>
+#include <stdlib.h>
+#include <drm_fourcc.h>
+#include <pixman.h>
+#include <wlr/interfaces/wlr_buffer.h>
+#include <wlr/render/pixman.h>
+#include <wlr/render/swapchain.h>
+#include <wlr/render/wlr_texture.h>
+#include <wlr/types/wlr_buffer.h>
+#include <wlr/types/wlr_output.h>
+#include <wlr/types/wlr_scene.h>
+#include <wlr/util/box.h>
+#include <wlr/util/log.h>
+#include "wavo/output.h"
+#include "wavo/render.h"
+#include "wavo/server.h"
+#include "wavo/workers.h"
+
+// One composite onto the target, in output buffer coordinates
+struct render_op {
+    pixman_image_t *src;   // Own image sharing the buffer's pixels
+    pixman_image_t *mask;  // Opacity below 1, NULL otherwise
+    struct wlr_box dst;
+};
+
+// Scene buffer kept locked, and for compositor-owned buffers mapped, until
+// the worker is done with its pixels
+struct render_hold {
+    struct wlr_buffer *buffer;
+    bool data_ptr;
+};
+
+struct wavo_render_job {
+    struct wavo_render *render;
+    struct wavo_output *output;  // NULL once the output is gone
+
+    struct wlr_buffer *buffer;  // Swapchain buffer being drawn into
+    pixman_image_t *target;
+
+    struct render_op *ops;
+    size_t op_count, op_capacity;
+    struct render_hold *holds;
+    size_t hold_count, hold_capacity;
+
+    uint64_t draw_usec;  // Written by the worker
+};
+
+static pixman_format_code_t pixman_format_from_drm(uint32_t format) {
+    switch (format) {
+    case DRM_FORMAT_ARGB8888:
+        return PIXMAN_a8r8g8b8;
+    case DRM_FORMAT_XRGB8888:
+        return PIXMAN_x8r8g8b8;
+    case DRM_FORMAT_ABGR8888:
+        return PIXMAN_a8b8g8r8;
+    case DRM_FORMAT_XBGR8888:
+        return PIXMAN_x8b8g8r8;
+    default:
+        return 0;
+    }
+}
+
+static bool job_add_op(struct wavo_render_job *job, pixman_image_t *src,
+    pixman_image_t *mask, const struct wlr_box *dst) {
+    if (job->op_count == job->op_capacity) {
+        size_t capacity = job->op_capacity ? job->op_capacity * 2 : 32;
+        struct render_op *ops = realloc(job->ops,
+            capacity * sizeof(struct render_op));
+        if (!ops) {
+            return false;
+        }
+        job->ops = ops;
+        job->op_capacity = capacity;
+    }
+    job->ops[job->op_count++] = (struct render_op){
+        .src = src,
+        .mask = mask,
+        .dst = *dst,
+    };
+    return true;
+}
+
+static bool job_hold(struct wavo_render_job *job, struct wlr_buffer *buffer,
+    bool data_ptr) {
+    if (job->hold_count == job->hold_capacity) {
+        size_t capacity = job->hold_capacity ? job->hold_capacity * 2 : 16;
+        struct render_hold *holds = realloc(job->holds,
+            capacity * sizeof(struct render_hold));
+        if (!holds) {
+            return false;
+        }
+        job->holds = holds;
+        job->hold_capacity = capacity;
+    }
+    job->holds[job->hold_count++] = (struct render_hold){
+        .buffer = wlr_buffer_lock(buffer),
+        .data_ptr = data_ptr,
+    };
+    return true;
+}
+
+// Frees the snapshot, runs on the main thread
+static void job_release(struct wavo_render_job *job) {
+    for (size_t i = 0; i < job->op_count; i++) {
+        pixman_image_unref(job->ops[i].src);
+        if (job->ops[i].mask) {
+            pixman_image_unref(job->ops[i].mask);
+        }
+    }
+    for (size_t i = 0; i < job->hold_count; i++) {
+        if (job->holds[i].data_ptr) {
+            wlr_buffer_end_data_ptr_access(job->holds[i].buffer);
+        }
+        wlr_buffer_unlock(job->holds[i].buffer);
+    }
+    if (job->target) {
+        pixman_image_unref(job->target);
+        wlr_buffer_end_data_ptr_access(job->buffer);
+    }
+    if (job->buffer) {
+        wlr_buffer_unlock(job->buffer);
+    }
+    free(job->ops);
+    free(job->holds);
+    free(job);
+}
+
+static int round_half_away(float value) {
+    return (int)(value < 0.0f ? value - 0.5f : value + 0.5f);
+}
+
+// Same rounding as the scene renderer, so edges land on the same pixels
+static void scale_box(struct wlr_box *box, float scale) {
+    int x = round_half_away((float)box->x * scale);
+    int y = round_half_away((float)box->y * scale);
+    box->width = round_half_away((float)(box->x + box->width) * scale) - x;
+    box->height = round_half_away((float)(box->y + box->height) * scale) - y;
+    box->x = x;
+    box->y = y;
+}
+
+// Wraps pixels the job holds in an image of its own, sampling src_box of
+// them into dst. Sharing the image itself would race on its transform.
+static bool job_add_image(struct wavo_render_job *job, pixman_image_t *image,
+    const struct wlr_fbox *src_box, const struct wlr_box *dst, float opacity,
+    enum wlr_scale_filter_mode filter_mode) {
+    int width = pixman_image_get_width(image);
+    int height = pixman_image_get_height(image);
+    struct wlr_fbox src = *src_box;
+    if (wlr_fbox_empty(&src)) {
+        src = (struct wlr_fbox){ .width = width, .height = height };
+    }
+
+    pixman_image_t *src_image = pixman_image_create_bits_no_clear(
+        pixman_image_get_format(image), width, height,
+        pixman_image_get_data(image), pixman_image_get_stride(image));
+    if (!src_image) {
+        return false;
+    }
+
+    bool scaled = src.width != dst->width || src.height != dst->height ||
+        src.x != (int)src.x || src.y != (int)src.y;
+    struct pixman_f_transform ftransform;
+    pixman_f_transform_init_scale(&ftransform, src.width / dst->width,
+        src.height / dst->height);
+    pixman_f_transform_translate(&ftransform, NULL, src.x, src.y);
+    struct pixman_transform transform;
+    pixman_transform_from_pixman_f_transform(&transform, &ftransform);
+    pixman_image_set_transform(src_image, &transform);
+    pixman_image_set_filter(src_image,
+        scaled && filter_mode != WLR_SCALE_FILTER_NEAREST ?
+            PIXMAN_FILTER_BILINEAR : PIXMAN_FILTER_NEAREST, NULL, 0);
+
+    pixman_image_t *mask = NULL;
+    if (opacity < 1.0f) {
+        pixman_color_t color = { .alpha = (uint16_t)(opacity * 0xFFFF) };
+        mask = pixman_image_create_solid_fill(&color);
+        if (!mask) {
+            pixman_image_unref(src_image);
+            return false;
+        }
+    }
+
+    if (!job_add_op(job, src_image, mask, dst)) {
+        pixman_image_unref(src_image);
+        if (mask) {
+            pixman_image_unref(mask);
+        }
+        return false;
+    }
+    return true;
+}
+
+static bool snapshot_rect(struct wavo_render_job *job,
+    struct wlr_scene_rect *rect, const struct wlr_box *dst) {
+    const float *c = rect->color;
+    pixman_color_t color = {
+        .red = (uint16_t)(c[0] * 0xFFFF),
+        .green = (uint16_t)(c[1] * 0xFFFF),
+        .blue = (uint16_t)(c[2] * 0xFFFF),
+        .alpha = (uint16_t)(c[3] * 0xFFFF),
+    };
+    pixman_image_t *fill = pixman_image_create_solid_fill(&color);
+    if (!fill) {
+        return false;
+    }
+    if (!job_add_op(job, fill, NULL, dst)) {
+        pixman_image_unref(fill);
+        return false;
+    }
+    return true;
+}
+
+static bool snapshot_buffer(struct wavo_render_job *job,
+    struct wlr_scene_buffer *scene_buffer, const struct wlr_box *dst) {
+    struct wlr_buffer *buffer = scene_buffer->buffer;
+    if (scene_buffer->transform != WL_OUTPUT_TRANSFORM_NORMAL) {
+        return false;
+    }
+
+    // Client buffers were uploaded into a pixman texture. Holding a lock
+    // makes wlroots put the next commit into a new texture rather than
+    // updating this one under the worker.
+    struct wlr_client_buffer *client_buffer = wlr_client_buffer_get(buffer);
+    if (client_buffer) {
+        if (!client_buffer->texture ||
+                !wlr_texture_is_pixman(client_buffer->texture) ||
+                !job_hold(job, buffer, false)) {
+            return false;
+        }
+        return job_add_image(job,
+            wlr_pixman_texture_get_image(client_buffer->texture),
+            &scene_buffer->src_box, dst, scene_buffer->opacity,
+            scene_buffer->filter_mode);
+    }
+
+    // Compositor buffers such as thumbnails are mapped for the whole frame
+    void *data;
+    uint32_t format;
+    size_t stride;
+    if (!wlr_buffer_begin_data_ptr_access(buffer,
+            WLR_BUFFER_DATA_PTR_ACCESS_READ, &data, &format, &stride)) {
+        return false;
+    }
+    pixman_format_code_t pixman_format = pixman_format_from_drm(format);
+    if (!pixman_format || !job_hold(job, buffer, true)) {
+        wlr_buffer_end_data_ptr_access(buffer);
+        return false;
+    }
+
+    pixman_image_t *image = pixman_image_create_bits_no_clear(pixman_format,
+        buffer->width, buffer->height, data, (int)stride);
+    if (!image) {
+        return false;
+    }
+    bool ok = job_add_image(job, image, &scene_buffer->src_box, dst,
+        scene_buffer->opacity, scene_buffer->filter_mode);
+    pixman_image_unref(image);
+    return ok;
+}
+
+// As wlr_scene_output_build_state() does for every buffer it draws, so scene
+// surfaces on their primary output queue their presentation feedback for the
+// output's next commit, the one this job makes. Should the snapshot fail
+// after all, the scene renderer samples them again, which is harmless.
+static void sample_buffer(struct wlr_scene_output *scene_output,
+    struct wlr_scene_buffer *scene_buffer) {
+    struct wlr_scene_output_sample_event event = {
+        .output = scene_output,
+        .direct_scanout = false,
+    };
+    wl_signal_emit_mutable(&scene_buffer->events.output_sample, &event);
+}
+
+// Painter's order, bottom to top. lx/ly is the parent's layout position.
+static bool snapshot_node(struct wavo_render_job *job,
+    struct wlr_scene_output *scene_output, struct wlr_scene_node *node,
+    int lx, int ly) {
+    if (!node->enabled) {
+        return true;
+    }
+    lx += node->x;
+    ly += node->y;
+
+    struct wlr_output *wlr_output = scene_output->output;
+    struct wlr_box dst = { .x = lx - scene_output->x, .y = ly - scene_output->y };
+
+    switch (node->type) {
+    case WLR_SCENE_NODE_TREE: {
+        struct wlr_scene_tree *tree = wlr_scene_tree_from_node(node);
+        struct wlr_scene_node *child;
+        wl_list_for_each(child, &tree->children, link) {
+            if (!snapshot_node(job, scene_output, child, lx, ly)) {
+                return false;
+            }
+        }
+        return true;
+    }
+    case WLR_SCENE_NODE_RECT: {
+        struct wlr_scene_rect *rect = wlr_scene_rect_from_node(node);
+        dst.width = rect->width;
+        dst.height = rect->height;
+        break;
+    }
+    case WLR_SCENE_NODE_BUFFER: {
+        struct wlr_scene_buffer *scene_buffer =
+            wlr_scene_buffer_from_node(node);
+        if (!scene_buffer->buffer) {
+            return true;
+        }
+        dst.width = scene_buffer->dst_width > 0 ?
+            scene_buffer->dst_width : scene_buffer->buffer->width;
+        dst.height = scene_buffer->dst_height > 0 ?
+            scene_buffer->dst_height : scene_buffer->buffer->height;
+        break;
+    }
+    }
+
+    scale_box(&dst, wlr_output->scale);
+    struct wlr_box output_box = {
+        .width = wlr_output->width,
+        .height = wlr_output->height,
+    };
+    struct wlr_box visible;
+    if (!wlr_box_intersection(&visible, &dst, &output_box)) {
+        return true;
+    }
+
+    if (node->type == WLR_SCENE_NODE_RECT) {
+        return snapshot_rect(job, wlr_scene_rect_from_node(node), &dst);
+    }
+    struct wlr_scene_buffer *scene_buffer = wlr_scene_buffer_from_node(node);
+    if (!snapshot_buffer(job, scene_buffer, &dst)) {
+        return false;
+    }
+    sample_buffer(scene_output, scene_buffer);
+    return true;
+}
+
+static void release_copy(pixman_image_t *image, void *data) {
+    (void)image;  // Unused parameter
+    pixman_image_unref(data);
+}
+
+// Software cursors are drawn last. Their texture changes with the cursor
+// image, so the pixels are copied rather than held.
+static bool snapshot_cursors(struct wavo_render_job *job,
+    struct wlr_output *wlr_output) {
+    struct wlr_output_cursor *cursor;
+    wl_list_for_each(cursor, &wlr_output->cursors, link) {
+        if (!cursor->enabled || !cursor->visible || !cursor->texture ||
+                wlr_output->hardware_cursor == cursor) {
+            continue;
+        }
+        if (cursor->transform != WL_OUTPUT_TRANSFORM_NORMAL ||
+                !wlr_texture_is_pixman(cursor->texture)) {
+            return false;
+        }
+
+        pixman_image_t *texture_image =
+            wlr_pixman_texture_get_image(cursor->texture);
+        int width = pixman_image_get_width(texture_image);
+        int height = pixman_image_get_height(texture_image);
+        pixman_image_t *copy = pixman_image_create_bits(PIXMAN_a8r8g8b8,
+            width, height, NULL, 0);
+        if (!copy) {
+            return false;
+        }
+        pixman_image_composite32(PIXMAN_OP_SRC, texture_image, NULL, copy,
+            0, 0, 0, 0, 0, 0, width, height);
+
+        struct wlr_box dst = {
+            .x = (int)cursor->x - cursor->hotspot_x,
+            .y = (int)cursor->y - cursor->hotspot_y,
+            .width = (int)cursor->width,
+            .height = (int)cursor->height,
+        };
+        if (!job_add_image(job, copy, &cursor->src_box, &dst, 1.0f,
+                WLR_SCALE_FILTER_BILINEAR)) {
+            pixman_image_unref(copy);
+            return false;
+        }
+        // The op's image shares the copy's pixels and frees them last
+        pixman_image_set_destroy_function(job->ops[job->op_count - 1].src,
+            release_copy, copy);
+    }
+    return true;
+}
+
+static void job_draw(void *data) {
+    struct wavo_render_job *job = data;
+    uint64_t start = wavo_latency_now_usec();
+
+    pixman_color_t black = { .alpha = 0xFFFF };
+    pixman_box32_t box = {
+        .x2 = pixman_image_get_width(job->target),
+        .y2 = pixman_image_get_height(job->target),
+    };
+    pixman_image_fill_boxes(PIXMAN_OP_SRC, job->target, &black, 1, &box);
+
+    for (size_t i = 0; i < job->op_count; i++) {
+        struct render_op *op = &job->ops[i];
+        pixman_image_composite32(PIXMAN_OP_OVER, op->src, op->mask,
+            job->target, 0, 0, 0, 0, op->dst.x, op->dst.y, op->dst.width,
+            op->dst.height);
+    }
+
+    job->draw_usec = wavo_latency_now_usec() - start;
+}
+
+static void job_commit(struct wavo_render_job *job) {
+    struct wavo_output *output = job->output;
+    struct wlr_output *wlr_output = output->wlr_output;
+
+    struct wlr_output_state state;
+    wlr_output_state_init(&state);
+    wlr_output_state_set_buffer(&state, job->buffer);
+
+    // Also clears the scene's pending damage for the output
+    pixman_region32_t damage;
+    pixman_region32_init_rect(&damage, 0, 0, (unsigned int)wlr_output->width,
+        (unsigned int)wlr_output->height);
+    wlr_output_state_set_damage(&state, &damage);
+    pixman_region32_fini(&damage);
+
+    uint32_t commit_seq = wlr_output->commit_seq;
+    if (!wlr_output_commit_state(wlr_output, &state)) {
+        wlr_log(WLR_ERROR, "Failed to commit frame on %s", wlr_output->name);
+    }
+    wlr_output_state_finish(&state);
+    wavo_output_finish_frame(output, commit_seq);
+}
+
+static void job_done(void *data) {
+    struct wavo_render_job *job = data;
+    struct wavo_render *render = job->render;
+
+    // Unmapped before the commit, the output needs a buffer it can read
+    pixman_image_unref(job->target);
+    job->target = NULL;
+    wlr_buffer_end_data_ptr_access(job->buffer);
+
+    if (job->output) {
+        job->output->render_job = NULL;
+        render->frames++;
+        wavo_latency_histogram_add(&render->draw_time, job->draw_usec);
+        job_commit(job);
+    }
+    job_release(job);
+}
+
+void wavo_render_job_cancel(struct wavo_render_job *job) {
+    if (job) {
+        job->output = NULL;
+    }
+}
+
+// Maps the output's next swapchain buffer for the worker to draw into
+static bool job_acquire_target(struct wavo_render_job *job,
+    struct wlr_output *wlr_output) {
+    struct wlr_output_state state;
+    wlr_output_state_init(&state);
+    bool ok = wlr_output_configure_primary_swapchain(wlr_output, &state,
+        &wlr_output->swapchain);
+    wlr_output_state_finish(&state);
+    if (!ok) {
+        return false;
+    }
+
+    job->buffer = wlr_swapchain_acquire(wlr_output->swapchain, NULL);
+    if (!job->buffer) {
+        return false;
+    }
+
+    void *data;
+    uint32_t format;
+    size_t stride;
+    if (!wlr_buffer_begin_data_ptr_access(job->buffer,
+            WLR_BUFFER_DATA_PTR_ACCESS_WRITE, &data, &format, &stride)) {
+        return false;
+    }
+    pixman_format_code_t pixman_format = pixman_format_from_drm(format);
+    if (pixman_format) {
+        job->target = pixman_image_create_bits_no_clear(pixman_format,
+            job->buffer->width, job->buffer->height, data, (int)stride);
+    }
+    if (!job->target) {
+        wlr_buffer_end_data_ptr_access(job->buffer);
+        return false;
+    }
+    return true;
+}
+
+bool wavo_render_output(struct wavo_render *render,
+    struct wavo_output *output) {
+    struct wlr_scene_output *scene_output = output->scene_output;
+    struct wlr_output *wlr_output = output->wlr_output;
+
+    if (output->render_job) {
+        // Its commit brings the next frame event
+        render->busy++;
+        return true;
+    }
+    if (!wlr_scene_output_needs_frame(scene_output)) {
+        return false;
+    }
+
+    struct wavo_render_job *job = calloc(1, sizeof(struct wavo_render_job));
+    if (!job) {
+        wlr_log(WLR_ERROR, "Failed to allocate render job: %s",
+            "Out of memory");
+        return false;
+    }
+    job->render = render;
+    job->output = output;
+
+    if (wlr_output->transform != WL_OUTPUT_TRANSFORM_NORMAL ||
+            !snapshot_node(job, scene_output,
+                &render->server->scene->tree.node, 0, 0) ||
+            !snapshot_cursors(job, wlr_output) ||
+            !job_acquire_target(job, wlr_output)) {
+        goto error_job;
+    }
+
+    if (!wavo_workers_submit(render->server->workers, job_draw, job_done,
+            job)) {
+        goto error_job;
+    }
+    output->render_job = job;
+    return true;
+
+error_job:
+    render->fallbacks++;
+    job_release(job);
+    return false;
+}
+
+void wavo_render_print_metrics(struct wavo_render *render, FILE *out) {
+    if (!render) {
+        return;
+    }
+
+    fprintf(out, "render.parallel_frames %" PRIu64 "\n", render->frames);
+    fprintf(out, "render.fallbacks %" PRIu64 "\n", render->fallbacks);
+    fprintf(out, "render.busy %" PRIu64 "\n", render->busy);
+    wavo_latency_histogram_print(&render->draw_time, "render.draw_time", out);
+}
+
+struct wavo_render *wavo_render_create(struct wavo_server *server) {
+    if (!wlr_renderer_is_pixman(server->renderer)) {
+        wlr_log(WLR_ERROR, "%s",
+            "Parallel rendering needs the pixman renderer (WLR_RENDERER=pixman)");
+        return NULL;
+    }
+
+    struct wavo_render *render = calloc(1, sizeof(struct wavo_render));
+    if (!render) {
+        wlr_log(WLR_ERROR, "Failed to allocate render: %s", "Out of memory");
+        return NULL;
+    }
+    render->server = server;
+    wavo_latency_histogram_reset(&render->draw_time);
+    return render;
+}
+
+void wavo_render_destroy(struct wavo_render *render) {
+    free(render);
+}
@@ -0,0 +1,795 @@
+#define _POSIX_C_SOURCE 200809L
+#include <assert.h>
+#include <drm_fourcc.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pixman.h>
+#include <wayland-server-core.h>
+#include <wlr/interfaces/wlr_output.h>
+#include <wlr/render/wlr_renderer.h>
+#include <wlr/render/wlr_texture.h>
+#include <wlr/types/wlr_buffer.h>
+#include <wlr/types/wlr_output.h>
+#include <wlr/util/box.h>
+#include <wlr/util/log.h>
+#include "wlr-screencopy-unstable-v1-protocol.h"
+#include "wavo/convert.h"
+#include "wavo/screencopy.h"
+#include "wavo/server.h"
+
+#define SCREENCOPY_MANAGER_VERSION 3
+
+// Past this many rectangles a single damage box is cheaper for clients
+#define MAX_DAMAGE_RECTS 32
+
+// Version 3 clients may pick one of several buffer formats. The YUV formats
+// are 4:2:0 with all planes packed into a single wl_buffer of the advertised
+// size, chroma following the luma at stride * height. wl_shm only accepts
+// such buffers from pools that hold every plane, see wavo/shm.h.
+#define YUV_FORMATS_SINCE_VERSION 3
+
+// A client wl_buffer used as a copy destination
+struct screencopy_buffer {
+    struct screencopy_session *session;
+    struct wl_resource *resource;  // wl_buffer
+    pixman_region32_t damage;      // Output damage not yet copied into it
+    struct wl_list link;           // screencopy_session::buffers
+
+    struct wl_listener destroy;
+};
+
+// Capture state of one client on one output
+struct screencopy_session {
+    struct wavo_screencopy_manager *manager;
+    struct wl_client *client;
+    struct wlr_output *output;
+    pixman_region32_t damage;  // Damage since the client's previous capture
+    struct wl_list buffers;    // screencopy_buffer::link
+    uint8_t *staging;          // XRGB8888 read-back for YUV conversion
+    size_t staging_size;
+    struct wl_list frames;     // screencopy_frame::link, waiting for a commit
+    struct wl_list link;       // wavo_screencopy_manager::sessions
+
+    struct wl_listener output_commit;
+    struct wl_listener output_destroy;
+    struct wl_listener client_destroy;
+};
+
+struct screencopy_frame {
+    struct wl_resource *resource;
+    struct screencopy_session *session;  // NULL once the capture is over
+    struct wlr_box box;  // Captured region in output buffer coordinates
+    uint32_t format;     // DRM fourcc, chosen by the client's buffer
+    uint32_t stride;     // Advertised XRGB8888 stride
+    bool yuv;            // YUV formats were advertised
+    bool with_damage;
+    bool used;
+    struct screencopy_buffer *buffer;  // Set while waiting for a commit
+    struct wl_list link;  // screencopy_session::frames
+};
+
+static const struct zwlr_screencopy_frame_v1_interface frame_impl;
+
+static struct screencopy_frame *frame_from_resource(
+    struct wl_resource *resource) {
+    assert(wl_resource_instance_of(resource,
+        &zwlr_screencopy_frame_v1_interface, &frame_impl));
+    return wl_resource_get_user_data(resource);
+}
+
+static void frame_end(struct screencopy_frame *frame, bool failed) {
+    if (failed) {
+        zwlr_screencopy_frame_v1_send_failed(frame->resource);
+    }
+    wl_list_remove(&frame->link);
+    wl_list_init(&frame->link);
+    frame->session = NULL;
+    frame->buffer = NULL;
+}
+
+static void buffer_destroy(struct screencopy_buffer *buffer) {
+    wl_list_remove(&buffer->destroy.link);
+    wl_list_remove(&buffer->link);
+    pixman_region32_fini(&buffer->damage);
+    free(buffer);
+}
+
+static void buffer_handle_destroy(struct wl_listener *listener, void *data) {
+    (void)data;
+    struct screencopy_buffer *buffer = wl_container_of(listener, buffer, destroy);
+
+    struct screencopy_frame *frame, *tmp;
+    wl_list_for_each_safe(frame, tmp, &buffer->session->frames, link) {
+        if (frame->buffer == buffer) {
+            frame_end(frame, true);
+        }
+    }
+
+    buffer_destroy(buffer);
+}
+
+static void session_destroy(struct screencopy_session *session, bool failed) {
+    struct screencopy_frame *frame, *frame_tmp;
+    wl_list_for_each_safe(frame, frame_tmp, &session->frames, link) {
+        frame_end(frame, failed);
+    }
+
+    struct screencopy_buffer *buffer, *buffer_tmp;
+    wl_list_for_each_safe(buffer, buffer_tmp, &session->buffers, link) {
+        buffer_destroy(buffer);
+    }
+
+    wl_list_remove(&session->output_commit.link);
+    wl_list_remove(&session->output_destroy.link);
+    wl_list_remove(&session->client_destroy.link);
+    wl_list_remove(&session->link);
+    pixman_region32_fini(&session->damage);
+    free(session->staging);
+    free(session);
+}
+
+static bool copy_region(struct wlr_texture *texture, struct wlr_buffer *dst,
+    pixman_region32_t *region, const struct wlr_box *box) {
+    void *data;
+    uint32_t format;
+    size_t stride;
+    if (!wlr_buffer_begin_data_ptr_access(dst,
+            WLR_BUFFER_DATA_PTR_ACCESS_WRITE, &data, &format, &stride)) {
+        return false;
+    }
+
+    bool ok = true;
+    int rects_len;
+    const pixman_box32_t *rects = pixman_region32_rectangles(region, &rects_len);
+    for (int i = 0; i < rects_len && ok; i++) {
+        ok = wlr_texture_read_pixels(texture,
+            &(struct wlr_texture_read_pixels_options){
+                .data = data,
+                .format = format,
+                .stride = (uint32_t)stride,
+                .dst_x = (uint32_t)(rects[i].x1 - box->x),
+                .dst_y = (uint32_t)(rects[i].y1 - box->y),
+                .src_box = {
+                    .x = rects[i].x1,
+                    .y = rects[i].y1,
+                    .width = rects[i].x2 - rects[i].x1,
+                    .height = rects[i].y2 - rects[i].y1,
+                },
+            });
+    }
+
+    wlr_buffer_end_data_ptr_access(dst);
+    return ok;
+}
+
+static bool format_is_yuv(uint32_t format) {
+    return format == DRM_FORMAT_NV12 || format == DRM_FORMAT_YUV420;
+}
+
+// 4:2:0 chroma covers 2x2 blocks, grow every rect to even bounds. The box
+// itself is even-aligned whenever YUV formats are offered.
+static void region_align_even(pixman_region32_t *region,
+    const struct wlr_box *box) {
+    int rects_len;
+    const pixman_box32_t *rects = pixman_region32_rectangles(region, &rects_len);
+
+    pixman_region32_t aligned;
+    pixman_region32_init(&aligned);
+    for (int i = 0; i < rects_len; i++) {
+        int x1 = rects[i].x1 & ~1;
+        int y1 = rects[i].y1 & ~1;
+        int x2 = (rects[i].x2 + 1) & ~1;
+        int y2 = (rects[i].y2 + 1) & ~1;
+        pixman_region32_union_rect(&aligned, &aligned, x1, y1,
+            (unsigned int)(x2 - x1), (unsigned int)(y2 - y1));
+    }
+    pixman_region32_intersect_rect(region, &aligned, box->x, box->y,
+        (unsigned int)box->width, (unsigned int)box->height);
+    pixman_region32_fini(&aligned);
+}
+
+static bool session_ensure_staging(struct screencopy_session *session,
+    size_t size) {
+    if (session->staging_size >= size) {
+        return true;
+    }
+    uint8_t *staging = realloc(session->staging, size);
+    if (!staging) {
+        return false;
+    }
+    session->staging = staging;
+    session->staging_size = size;
+    return true;
+}
+
+// Reads each damaged rect back as XRGB8888 and converts it straight into
+// the client's planes
+static bool copy_region_yuv(struct screencopy_session *session,
+    struct wlr_texture *texture, struct wlr_buffer *dst,
+    pixman_region32_t *region, const struct wlr_box *box) {
+    struct wavo_screencopy_manager *manager = session->manager;
+    void *data;
+    uint32_t format;
+    size_t stride;
+    if (!wlr_buffer_begin_data_ptr_access(dst,
+            WLR_BUFFER_DATA_PTR_ACCESS_WRITE, &data, &format, &stride)) {
+        return false;
+    }
+
+    uint8_t *luma = data;
+    uint8_t *chroma = luma + stride * (size_t)box->height;
+    struct wavo_yuv_image image = {
+        .planes = { luma, chroma },
+        .strides = { (uint32_t)stride, (uint32_t)stride },
+    };
+    if (format == DRM_FORMAT_NV12) {
+        image.layout = WAVO_YUV_NV12;
+    } else {
+        image.layout = WAVO_YUV_I420;
+        image.strides[1] = (uint32_t)stride / 2;
+        image.planes[2] = chroma + (stride / 2) * (size_t)(box->height / 2);
+        image.strides[2] = (uint32_t)stride / 2;
+    }
+
+    bool ok = true;
+    int rects_len;
+    const pixman_box32_t *rects = pixman_region32_rectangles(region, &rects_len);
+    for (int i = 0; i < rects_len && ok; i++) {
+        int width = rects[i].x2 - rects[i].x1;
+        int height = rects[i].y2 - rects[i].y1;
+        uint32_t staging_stride = (uint32_t)width * 4;
+
+        ok = session_ensure_staging(session, staging_stride * (size_t)height) &&
+            wlr_texture_read_pixels(texture,
+                &(struct wlr_texture_read_pixels_options){
+                    .data = session->staging,
+                    .format = DRM_FORMAT_XRGB8888,
+                    .stride = staging_stride,
+                    .src_box = {
+                        .x = rects[i].x1,
+                        .y = rects[i].y1,
+                        .width = width,
+                        .height = height,
+                    },
+                });
+        if (ok) {
+            wavo_convert_to_yuv(manager->convert_impl, session->staging,
+                staging_stride, &image, rects[i].x1 - box->x,
+                rects[i].y1 - box->y, width, height);
+        }
+    }
+
+    wlr_buffer_end_data_ptr_access(dst);
+    return ok;
+}
+
+static uint64_t region_area(pixman_region32_t *region) {
+    uint64_t area = 0;
+    int rects_len;
+    const pixman_box32_t *rects = pixman_region32_rectangles(region, &rects_len);
+    for (int i = 0; i < rects_len; i++) {
+        area += (uint64_t)(rects[i].x2 - rects[i].x1) *
+            (uint64_t)(rects[i].y2 - rects[i].y1);
+    }
+    return area;
+}
+
+static void frame_send_damage(struct screencopy_frame *frame,
+    pixman_region32_t *damage) {
+    int rects_len;
+    const pixman_box32_t *rects = pixman_region32_rectangles(damage, &rects_len);
+    if (rects_len > MAX_DAMAGE_RECTS) {
+        rects = pixman_region32_extents(damage);
+        rects_len = 1;
+    }
+
+    for (int i = 0; i < rects_len; i++) {
+        zwlr_screencopy_frame_v1_send_damage(frame->resource,
+            (uint32_t)(rects[i].x1 - frame->box.x),
+            (uint32_t)(rects[i].y1 - frame->box.y),
+            (uint32_t)(rects[i].x2 - rects[i].x1),
+            (uint32_t)(rects[i].y2 - rects[i].y1));
+    }
+}
+
+static void frame_copy_from(struct screencopy_frame *frame,
+    struct wlr_buffer *src) {
+    struct screencopy_session *session = frame->session;
+    struct wavo_screencopy_manager *manager = session->manager;
+    struct screencopy_buffer *buffer = frame->buffer;
+    const struct wlr_box *box = &frame->box;
+
+    struct wlr_buffer *dst = wlr_buffer_try_from_resource(buffer->resource);
+    if (!dst) {
+        frame_end(frame, true);
+        return;
+    }
+
+    // Only what changed since this particular buffer was last filled
+    pixman_region32_t region;
+    pixman_region32_init(&region);
+    pixman_region32_intersect_rect(&region, &buffer->damage,
+        box->x, box->y, box->width, box->height);
+    bool yuv = format_is_yuv(frame->format);
+    if (yuv) {
+        region_align_even(&region, box);
+    }
+
+    bool ok = true;
+    if (pixman_region32_not_empty(&region)) {
+        struct wlr_texture *texture =
+            wlr_texture_from_buffer(manager->server->renderer, src);
+        if (!texture) {
+            ok = false;
+        } else if (yuv) {
+            ok = copy_region_yuv(session, texture, dst, &region, box);
+        } else {
+            ok = copy_region(texture, dst, &region, box);
+        }
+        if (texture) {
+            wlr_texture_destroy(texture);
+        }
+    }
+    wlr_buffer_unlock(dst);
+
+    if (!ok) {
+        wlr_log(WLR_ERROR, "%s", "Failed to copy output to screencopy buffer");
+        pixman_region32_fini(&region);
+        frame_end(frame, true);
+        return;
+    }
+
+    manager->frames++;
+    manager->copied_pixels += region_area(&region);
+    if (yuv) {
+        manager->converted_pixels += region_area(&region);
+    }
+    manager->frame_pixels += (uint64_t)box->width * (uint64_t)box->height;
+    pixman_region32_subtract(&buffer->damage, &buffer->damage, &region);
+    pixman_region32_fini(&region);
+
+    // Report what changed since the client's previous capture
+    pixman_region32_t damage;
+    pixman_region32_init(&damage);
+    pixman_region32_intersect_rect(&damage, &session->damage,
+        box->x, box->y, box->width, box->height);
+    if (frame->with_damage) {
+        frame_send_damage(frame, &damage);
+    }
+    pixman_region32_subtract(&session->damage, &session->damage, &damage);
+    pixman_region32_fini(&damage);
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    uint64_t tv_sec = (uint64_t)now.tv_sec;
+
+    zwlr_screencopy_frame_v1_send_flags(frame->resource, 0);
+    zwlr_screencopy_frame_v1_send_ready(frame->resource,
+        (uint32_t)(tv_sec >> 32), (uint32_t)tv_sec, (uint32_t)now.tv_nsec);
+    frame_end(frame, false);
+}
+
+static void session_handle_output_commit(struct wl_listener *listener,
+    void *data) {
+    struct screencopy_session *session =
+        wl_container_of(listener, session, output_commit);
+    struct wlr_output_event_commit *event = data;
+    const struct wlr_output_state *state = event->state;
+    struct wlr_output *output = session->output;
+
+    if (!(state->committed & WLR_OUTPUT_STATE_BUFFER)) {
+        return;
+    }
+
+    pixman_region32_t damage;
+    pixman_region32_init(&damage);
+    if ((state->committed & WLR_OUTPUT_STATE_DAMAGE) &&
+            !(state->committed & WLR_OUTPUT_STATE_MODE)) {
+        pixman_region32_copy(&damage, (pixman_region32_t *)&state->damage);
+    } else {
+        pixman_region32_union_rect(&damage, &damage, 0, 0,
+            output->width, output->height);
+    }
+
+    pixman_region32_union(&session->damage, &session->damage, &damage);
+    struct screencopy_buffer *buffer;
+    wl_list_for_each(buffer, &session->buffers, link) {
+        pixman_region32_union(&buffer->damage, &buffer->damage, &damage);
+    }
+    pixman_region32_fini(&damage);
+
+    struct screencopy_frame *frame, *tmp;
+    wl_list_for_each_safe(frame, tmp, &session->frames, link) {
+        if (state->committed & WLR_OUTPUT_STATE_MODE) {
+            // The frame's advertised buffer size no longer matches
+            frame_end(frame, true);
+            continue;
+        }
+
+        if (frame->with_damage) {
+            pixman_region32_t frame_damage;
+            pixman_region32_init(&frame_damage);
+            pixman_region32_intersect_rect(&frame_damage, &session->damage,
+                frame->box.x, frame->box.y, frame->box.width, frame->box.height);
+            bool damaged = pixman_region32_not_empty(&frame_damage);
+            pixman_region32_fini(&frame_damage);
+            if (!damaged) {
+                continue;
+            }
+        }
+
+        frame_copy_from(frame, state->buffer);
+    }
+}
+
+static void session_handle_output_destroy(struct wl_listener *listener,
+    void *data) {
+    (void)data;
+    struct screencopy_session *session =
+        wl_container_of(listener, session, output_destroy);
+    session_destroy(session, true);
+}
+
+static void session_handle_client_destroy(struct wl_listener *listener,
+    void *data) {
+    (void)data;
+    struct screencopy_session *session =
+        wl_container_of(listener, session, client_destroy);
+    // The client's resources are going away, don't send anything
+    session_destroy(session, false);
+}
+
+static struct screencopy_session *session_get(
+    struct wavo_screencopy_manager *manager, struct wl_client *client,
+    struct wlr_output *output) {
+    struct screencopy_session *session;
+    wl_list_for_each(session, &manager->sessions, link) {
+        if (session->client == client && session->output == output) {
+            return session;
+        }
+    }
+
+    session = calloc(1, sizeof(struct screencopy_session));
+    if (!session) {
+        return NULL;
+    }
+
+    session->manager = manager;
+    session->client = client;
+    session->output = output;
+    wl_list_init(&session->buffers);
+    wl_list_init(&session->frames);
+
+    // A new client has seen nothing yet
+    pixman_region32_init_rect(&session->damage, 0, 0,
+        output->width, output->height);
+
+    session->output_commit.notify = session_handle_output_commit;
+    wl_signal_add(&output->events.commit, &session->output_commit);
+
+    session->output_destroy.notify = session_handle_output_destroy;
+    wl_signal_add(&output->events.destroy, &session->output_destroy);
+
+    session->client_destroy.notify = session_handle_client_destroy;
+    wl_client_add_destroy_listener(client, &session->client_destroy);
+
+    wl_list_insert(&manager->sessions, &session->link);
+    return session;
+}
+
+static struct screencopy_buffer *session_get_buffer(
+    struct screencopy_session *session, struct wl_resource *resource) {
+    struct screencopy_buffer *buffer;
+    wl_list_for_each(buffer, &session->buffers, link) {
+        if (buffer->resource == resource) {
+            return buffer;
+        }
+    }
+
+    buffer = calloc(1, sizeof(struct screencopy_buffer));
+    if (!buffer) {
+        return NULL;
+    }
+
+    // Unknown contents, the first copy into it has to be a full one
+    buffer->session = session;
+    buffer->resource = resource;
+    pixman_region32_init_rect(&buffer->damage, 0, 0,
+        session->output->width, session->output->height);
+
+    buffer->destroy.notify = buffer_handle_destroy;
+    wl_resource_add_destroy_listener(resource, &buffer->destroy);
+
+    wl_list_insert(&session->buffers, &buffer->link);
+    return buffer;
+}
+
+static bool frame_buffer_valid(struct screencopy_frame *frame,
+    struct wl_resource *buffer_resource) {
+    struct wlr_buffer *buffer = wlr_buffer_try_from_resource(buffer_resource);
+    if (!buffer) {
+        return false;
+    }
+
+    void *data;
+    uint32_t format;
+    size_t stride;
+    bool valid = false;
+    if (wlr_buffer_begin_data_ptr_access(buffer,
+            WLR_BUFFER_DATA_PTR_ACCESS_WRITE, &data, &format, &stride)) {
+        size_t width = (size_t)frame->box.width;
+        if (format == DRM_FORMAT_XRGB8888) {
+            valid = buffer->height == frame->box.height &&
+                stride >= frame->stride;
+        } else if (frame->yuv && format_is_yuv(format)) {
+            // Planar chroma rows are half the luma stride
+            valid = buffer->height == frame->box.height && stride >= width &&
+                (format == DRM_FORMAT_NV12 || stride % 2 == 0);
+        }
+        valid = valid && buffer->width == frame->box.width;
+        wlr_buffer_end_data_ptr_access(buffer);
+    }
+
+    if (valid) {
+        frame->format = format;
+    }
+    wlr_buffer_unlock(buffer);
+    return valid;
+}
+
+static void frame_handle_copy_common(struct wl_resource *frame_resource,
+    struct wl_resource *buffer_resource, bool with_damage) {
+    struct screencopy_frame *frame = frame_from_resource(frame_resource);
+
+    if (frame->used) {
+        wl_resource_post_error(frame_resource,
+            ZWLR_SCREENCOPY_FRAME_V1_ERROR_ALREADY_USED,
+            "frame already used");
+        return;
+    }
+    frame->used = true;
+
+    if (!frame->session) {
+        zwlr_screencopy_frame_v1_send_failed(frame_resource);
+        return;
+    }
+
+    if (!frame_buffer_valid(frame, buffer_resource)) {
+        wl_resource_post_error(frame_resource,
+            ZWLR_SCREENCOPY_FRAME_V1_ERROR_INVALID_BUFFER,
+            "invalid buffer attributes");
+        return;
+    }
+
+    struct screencopy_session *session = frame->session;
+    frame->buffer = session_get_buffer(session, buffer_resource);
+    if (!frame->buffer) {
+        wl_resource_post_no_memory(frame_resource);
+        return;
+    }
+
+    frame->with_damage = with_damage;
+    wl_list_insert(session->frames.prev, &frame->link);
+
+    // Plain copies want the next frame, damage copies only when there is
+    // something the client has not seen yet
+    if (!with_damage || pixman_region32_not_empty(&session->damage)) {
+        wlr_output_update_needs_frame(session->output);
+    }
+}
+
+static void frame_handle_copy(struct wl_client *client,
+    struct wl_resource *frame_resource, struct wl_resource *buffer_resource) {
+    (void)client;
+    frame_handle_copy_common(frame_resource, buffer_resource, false);
+}
+
+static void frame_handle_copy_with_damage(struct wl_client *client,
+    struct wl_resource *frame_resource, struct wl_resource *buffer_resource) {
+    (void)client;
+    frame_handle_copy_common(frame_resource, buffer_resource, true);
+}
+
+static void frame_handle_destroy(struct wl_client *client,
+    struct wl_resource *frame_resource) {
+    (void)client;
+    wl_resource_destroy(frame_resource);
+}
+
+static const struct zwlr_screencopy_frame_v1_interface frame_impl = {
+    .copy = frame_handle_copy,
+    .destroy = frame_handle_destroy,
+    .copy_with_damage = frame_handle_copy_with_damage,
+};
+
+static void frame_handle_resource_destroy(struct wl_resource *resource) {
+    struct screencopy_frame *frame = frame_from_resource(resource);
+    wl_list_remove(&frame->link);
+    free(frame);
+}
+
+static void capture_output(struct wl_client *client,
+    struct wl_resource *manager_resource, uint32_t id,
+    struct wl_resource *output_resource, const struct wlr_box *logical_box) {
+    struct wavo_screencopy_manager *manager =
+        wl_resource_get_user_data(manager_resource);
+    struct wlr_output *output = wlr_output_from_resource(output_resource);
+
+    struct screencopy_frame *frame = calloc(1, sizeof(struct screencopy_frame));
+    if (!frame) {
+        wl_client_post_no_memory(client);
+        return;
+    }
+    wl_list_init(&frame->link);
+
+    frame->resource = wl_resource_create(client,
+        &zwlr_screencopy_frame_v1_interface,
+        wl_resource_get_version(manager_resource), id);
+    if (!frame->resource) {
+        free(frame);
+        wl_client_post_no_memory(client);
+        return;
+    }
+    wl_resource_set_implementation(frame->resource, &frame_impl, frame,
+        frame_handle_resource_destroy);
+
+    if (!output || !output->enabled) {
+        zwlr_screencopy_frame_v1_send_failed(frame->resource);
+        return;
+    }
+
+    frame->box = (struct wlr_box){
+        .width = output->width,
+        .height = output->height,
+    };
+    if (logical_box) {
+        // Logical to buffer coordinates, transformed outputs are clipped
+        // against their untransformed buffer
+        struct wlr_box region = {
+            .x = (int)(logical_box->x * output->scale),
+            .y = (int)(logical_box->y * output->scale),
+            .width = (int)(logical_box->width * output->scale),
+            .height = (int)(logical_box->height * output->scale),
+        };
+        struct wlr_box full = frame->box;
+        if (!wlr_box_intersection(&frame->box, &full, &region)) {
+            zwlr_screencopy_frame_v1_send_failed(frame->resource);
+            return;
+        }
+    }
+
+    frame->session = session_get(manager, client, output);
+    if (!frame->session) {
+        wl_client_post_no_memory(client);
+        return;
+    }
+
+    uint32_t width = (uint32_t)frame->box.width;
+    uint32_t height = (uint32_t)frame->box.height;
+    frame->format = DRM_FORMAT_XRGB8888;
+    frame->stride = width * 4;
+    zwlr_screencopy_frame_v1_send_buffer(frame->resource,
+        WL_SHM_FORMAT_XRGB8888, width, height, frame->stride);
+
+    frame->yuv = wl_resource_get_version(frame->resource) >=
+            YUV_FORMATS_SINCE_VERSION &&
+        frame->box.x % 2 == 0 && frame->box.y % 2 == 0 &&
+        width % 2 == 0 && height % 2 == 0;
+    if (frame->yuv) {
+        zwlr_screencopy_frame_v1_send_buffer(frame->resource,
+            WL_SHM_FORMAT_NV12, width, height, width);
+        zwlr_screencopy_frame_v1_send_buffer(frame->resource,
+            WL_SHM_FORMAT_YUV420, width, height, width);
+    }
+
+    if (wl_resource_get_version(frame->resource) >=
+            ZWLR_SCREENCOPY_FRAME_V1_BUFFER_DONE_SINCE_VERSION) {
+        zwlr_screencopy_frame_v1_send_buffer_done(frame->resource);
+    }
+}
+
+static void manager_handle_capture_output(struct wl_client *client,
+    struct wl_resource *manager_resource, uint32_t id, int32_t overlay_cursor,
+    struct wl_resource *output_resource) {
+    (void)overlay_cursor;  // The cursor is part of the scene either way
+    capture_output(client, manager_resource, id, output_resource, NULL);
+}
+
+static void manager_handle_capture_output_region(struct wl_client *client,
+    struct wl_resource *manager_resource, uint32_t id, int32_t overlay_cursor,
+    struct wl_resource *output_resource, int32_t x, int32_t y, int32_t width,
+    int32_t height) {
+    (void)overlay_cursor;
+    struct wlr_box box = {
+        .x = x,
+        .y = y,
+        .width = width,
+        .height = height,
+    };
+    capture_output(client, manager_resource, id, output_resource, &box);
+}
+
+static void manager_handle_destroy(struct wl_client *client,
+    struct wl_resource *manager_resource) {
+    (void)client;
+    wl_resource_destroy(manager_resource);
+}
+
+static const struct zwlr_screencopy_manager_v1_interface manager_impl = {
+    .capture_output = manager_handle_capture_output,
+    .capture_output_region = manager_handle_capture_output_region,
+    .destroy = manager_handle_destroy,
+};
+
+static void manager_bind(struct wl_client *client, void *data,
+    uint32_t version, uint32_t id) {
+    struct wavo_screencopy_manager *manager = data;
+
+    struct wl_resource *resource = wl_resource_create(client,
+        &zwlr_screencopy_manager_v1_interface, (int)version, id);
+    if (!resource) {
+        wl_client_post_no_memory(client);
+        return;
+    }
+    wl_resource_set_implementation(resource, &manager_impl, manager, NULL);
+}
+
+static void manager_handle_display_destroy(struct wl_listener *listener,
+    void *data) {
+    (void)data;
+    struct wavo_screencopy_manager *manager =
+        wl_container_of(listener, manager, display_destroy);
+
+    struct screencopy_session *session, *tmp;
+    wl_list_for_each_safe(session, tmp, &manager->sessions, link) {
+        session_destroy(session, false);
+    }
+
+    wl_list_remove(&manager->display_destroy.link);
+    wl_global_destroy(manager->global);
+    free(manager);
+}
+
+struct wavo_screencopy_manager *wavo_screencopy_manager_create(
+    struct wavo_server *server) {
+    struct wavo_screencopy_manager *manager =
+        calloc(1, sizeof(struct wavo_screencopy_manager));
+    if (!manager) {
+        wlr_log(WLR_ERROR, "%s", "Failed to allocate screencopy manager");
+        return NULL;
+    }
+
+    manager->server = server;
+    manager->convert_impl = wavo_convert_best_impl();
+    wl_list_init(&manager->sessions);
+    wlr_log(WLR_INFO, "Screencopy YUV conversion: %s",
+        wavo_convert_impl_name(manager->convert_impl));
+
+    manager->global = wl_global_create(server->wl_display,
+        &zwlr_screencopy_manager_v1_interface, SCREENCOPY_MANAGER_VERSION,
+        manager, manager_bind);
+    if (!manager->global) {
+        wlr_log(WLR_ERROR, "%s", "Failed to create screencopy global");
+        free(manager);
+        return NULL;
+    }
+
+    manager->display_destroy.notify = manager_handle_display_destroy;
+    wl_display_add_destroy_listener(server->wl_display,
+        &manager->display_destroy);
+
+    return manager;
+}
+
+void wavo_screencopy_print_metrics(struct wavo_screencopy_manager *manager,
+    FILE *out) {
+    fprintf(out, "screencopy.frames %" PRIu64 "\n", manager->frames);
+    fprintf(out, "screencopy.copied_pixels %" PRIu64 "\n",
+        manager->copied_pixels);
+    fprintf(out, "screencopy.frame_pixels %" PRIu64 "\n",
+        manager->frame_pixels);
+    fprintf(out, "screencopy.converted_pixels %" PRIu64 "\n",
+        manager->converted_pixels);
+}
@@ -0,0 +1,539 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <drm_fourcc.h>
+#include <wayland-server-core.h>
+#include <wayland-server-protocol.h>
+#include <wlr/interfaces/wlr_buffer.h>
+#include <wlr/types/wlr_compositor.h>
+#include <wlr/util/log.h>
+#include "wavo/shm.h"
+
+#define SHM_VERSION 1
+
+struct shm_format {
+    uint32_t format;           // DRM fourcc
+    uint32_t bytes_per_pixel;  // Of the first plane
+    bool yuv;                  // 4:2:0, chroma planes after the luma
+};
+
+// Formats renderers may texture from shm. Anything else they report is not
+// advertised, its stride could not be checked.
+static const struct shm_format shm_formats[] = {
+    { DRM_FORMAT_ARGB8888, 4, false },
+    { DRM_FORMAT_XRGB8888, 4, false },
+    { DRM_FORMAT_ABGR8888, 4, false },
+    { DRM_FORMAT_XBGR8888, 4, false },
+    { DRM_FORMAT_RGBA8888, 4, false },
+    { DRM_FORMAT_RGBX8888, 4, false },
+    { DRM_FORMAT_BGRA8888, 4, false },
+    { DRM_FORMAT_BGRX8888, 4, false },
+    { DRM_FORMAT_ARGB2101010, 4, false },
+    { DRM_FORMAT_XRGB2101010, 4, false },
+    { DRM_FORMAT_ABGR2101010, 4, false },
+    { DRM_FORMAT_XBGR2101010, 4, false },
+    { DRM_FORMAT_RGB888, 3, false },
+    { DRM_FORMAT_BGR888, 3, false },
+    { DRM_FORMAT_RGB565, 2, false },
+    { DRM_FORMAT_BGR565, 2, false },
+    { DRM_FORMAT_ARGB4444, 2, false },
+    { DRM_FORMAT_XRGB4444, 2, false },
+    { DRM_FORMAT_ARGB1555, 2, false },
+    { DRM_FORMAT_XRGB1555, 2, false },
+    { DRM_FORMAT_ABGR16161616, 8, false },
+    { DRM_FORMAT_XBGR16161616, 8, false },
+    { DRM_FORMAT_ABGR16161616F, 8, false },
+    { DRM_FORMAT_XBGR16161616F, 8, false },
+};
+
+// Accepted for screencopy destinations only, never advertised
+static const struct shm_format capture_formats[] = {
+    { DRM_FORMAT_NV12, 1, true },
+    { DRM_FORMAT_YUV420, 1, true },
+};
+
+#define SHM_FORMATS_MAX (sizeof(shm_formats) / sizeof(shm_formats[0]))
+
+struct wavo_shm {
+    struct wl_global *global;
+    const struct shm_format *formats[SHM_FORMATS_MAX];  // Advertised
+    size_t formats_len;
+
+    struct wl_listener new_surface;
+    struct wl_listener compositor_destroy;
+    struct wl_listener display_destroy;
+};
+
+// Watches what the client attaches, capture formats have no texture
+struct shm_surface {
+    struct wlr_surface *surface;
+    struct wl_listener client_commit;
+    struct wl_listener destroy;
+};
+
+// The pool's file mapped once; buffers keep the mapping they were created
+// in alive across pool resizes
+struct shm_mapping {
+    void *data;
+    size_t size;
+    int refs;
+};
+
+struct shm_pool {
+    struct wavo_shm *shm;
+    struct wl_resource *resource;  // NULL once destroyed by the client
+    int fd;
+    struct shm_mapping *mapping;
+    int refs;  // The resource and every buffer
+};
+
+struct shm_buffer {
+    struct wlr_buffer base;
+    struct wl_resource *resource;  // NULL once destroyed by the client
+    struct shm_pool *pool;
+    struct shm_mapping *mapping;
+    const struct shm_format *format;
+    size_t offset;
+    size_t stride;
+
+    struct wl_listener release;
+};
+
+static uint32_t shm_format_to_drm(uint32_t format) {
+    switch (format) {
+    case WL_SHM_FORMAT_ARGB8888:
+        return DRM_FORMAT_ARGB8888;
+    case WL_SHM_FORMAT_XRGB8888:
+        return DRM_FORMAT_XRGB8888;
+    default:
+        return format;
+    }
+}
+
+static uint32_t drm_format_to_shm(uint32_t format) {
+    switch (format) {
+    case DRM_FORMAT_ARGB8888:
+        return WL_SHM_FORMAT_ARGB8888;
+    case DRM_FORMAT_XRGB8888:
+        return WL_SHM_FORMAT_XRGB8888;
+    default:
+        return format;
+    }
+}
+
+static const struct shm_format *shm_find_format(struct wavo_shm *shm,
+    uint32_t format) {
+    for (size_t i = 0; i < shm->formats_len; i++) {
+        if (shm->formats[i]->format == format) {
+            return shm->formats[i];
+        }
+    }
+    for (size_t i = 0; i < sizeof(capture_formats) / sizeof(capture_formats[0]);
+            i++) {
+        if (capture_formats[i].format == format) {
+            return &capture_formats[i];
+        }
+    }
+    return NULL;
+}
+
+static struct shm_mapping *mapping_create(int fd, size_t size) {
+    struct shm_mapping *mapping = calloc(1, sizeof(struct shm_mapping));
+    if (!mapping) {
+        return NULL;
+    }
+    mapping->data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapping->data == MAP_FAILED) {
+        free(mapping);
+        return NULL;
+    }
+    mapping->size = size;
+    mapping->refs = 1;
+    return mapping;
+}
+
+static void mapping_unref(struct shm_mapping *mapping) {
+    if (--mapping->refs > 0) {
+        return;
+    }
+    munmap(mapping->data, mapping->size);
+    free(mapping);
+}
+
+static void pool_unref(struct shm_pool *pool) {
+    if (--pool->refs > 0) {
+        return;
+    }
+    mapping_unref(pool->mapping);
+    close(pool->fd);
+    free(pool);
+}
+
+static const struct wl_buffer_interface buffer_impl;
+
+static bool buffer_resource_is_instance(struct wl_resource *resource) {
+    return wl_resource_instance_of(resource, &wl_buffer_interface,
+        &buffer_impl);
+}
+
+static struct wlr_buffer *buffer_from_resource(struct wl_resource *resource) {
+    struct shm_buffer *buffer = wl_resource_get_user_data(resource);
+    return &buffer->base;
+}
+
+static const struct wlr_buffer_resource_interface buffer_resource_interface = {
+    .name = "wavo_shm",
+    .is_instance = buffer_resource_is_instance,
+    .from_resource = buffer_from_resource,
+};
+
+static void buffer_destroy(struct wlr_buffer *wlr_buffer) {
+    struct shm_buffer *buffer = wl_container_of(wlr_buffer, buffer, base);
+    wl_list_remove(&buffer->release.link);
+    mapping_unref(buffer->mapping);
+    pool_unref(buffer->pool);
+    free(buffer);
+}
+
+static bool buffer_begin_data_ptr_access(struct wlr_buffer *wlr_buffer,
+    uint32_t flags, void **data, uint32_t *format, size_t *stride) {
+    (void)flags;  // The client may write too, nothing to protect
+    struct shm_buffer *buffer = wl_container_of(wlr_buffer, buffer, base);
+    *data = (uint8_t *)buffer->mapping->data + buffer->offset;
+    *format = buffer->format->format;
+    *stride = buffer->stride;
+    return true;
+}
+
+static void buffer_end_data_ptr_access(struct wlr_buffer *wlr_buffer) {
+    (void)wlr_buffer;
+}
+
+static bool buffer_get_shm(struct wlr_buffer *wlr_buffer,
+    struct wlr_shm_attributes *attribs) {
+    struct shm_buffer *buffer = wl_container_of(wlr_buffer, buffer, base);
+    *attribs = (struct wlr_shm_attributes){
+        .fd = buffer->pool->fd,
+        .format = buffer->format->format,
+        .width = wlr_buffer->width,
+        .height = wlr_buffer->height,
+        .stride = (int)buffer->stride,
+        .offset = (off_t)buffer->offset,
+    };
+    return true;
+}
+
+static const struct wlr_buffer_impl shm_buffer_impl = {
+    .destroy = buffer_destroy,
+    .get_shm = buffer_get_shm,
+    .begin_data_ptr_access = buffer_begin_data_ptr_access,
+    .end_data_ptr_access = buffer_end_data_ptr_access,
+};
+
+static void buffer_handle_destroy_request(struct wl_client *client,
+    struct wl_resource *resource) {
+    (void)client;
+    wl_resource_destroy(resource);
+}
+
+static const struct wl_buffer_interface buffer_impl = {
+    .destroy = buffer_handle_destroy_request,
+};
+
+static void buffer_handle_resource_destroy(struct wl_resource *resource) {
+    struct shm_buffer *buffer = wl_resource_get_user_data(resource);
+    buffer->resource = NULL;
+    wlr_buffer_drop(&buffer->base);
+}
+
+static void buffer_handle_release(struct wl_listener *listener, void *data) {
+    (void)data;
+    struct shm_buffer *buffer = wl_container_of(listener, buffer, release);
+    if (buffer->resource) {
+        wl_buffer_send_release(buffer->resource);
+    }
+}
+
+// Bytes the buffer spans in its pool, 0 if the stride does not fit
+static uint64_t buffer_size(const struct shm_format *format, int32_t width,
+    int32_t height, int32_t stride) {
+    if ((uint64_t)stride < (uint64_t)width * format->bytes_per_pixel) {
+        return 0;
+    }
+    uint64_t size = (uint64_t)stride * (uint64_t)height;
+    if (!format->yuv) {
+        return size;
+    }
+
+    // Subsampled chroma needs even sizes, and planar chroma rows half the
+    // luma stride
+    if (width % 2 != 0 || height % 2 != 0 ||
+            (format->format == DRM_FORMAT_YUV420 && stride % 2 != 0)) {
+        return 0;
+    }
+    return size + size / 2;
+}
+
+static void pool_handle_create_buffer(struct wl_client *client,
+    struct wl_resource *pool_resource, uint32_t id, int32_t offset,
+    int32_t width, int32_t height, int32_t stride, uint32_t shm_format) {
+    struct shm_pool *pool = wl_resource_get_user_data(pool_resource);
+
+    const struct shm_format *format =
+        shm_find_format(pool->shm, shm_format_to_drm(shm_format));
+    if (!format) {
+        wl_resource_post_error(pool_resource, WL_SHM_ERROR_INVALID_FORMAT,
+            "Unsupported format 0x%08X", shm_format);
+        return;
+    }
+
+    uint64_t size = 0;
+    if (offset >= 0 && width > 0 && height > 0 && stride > 0) {
+        size = buffer_size(format, width, height, stride);
+    }
+    if (size == 0 || (uint64_t)offset + size > pool->mapping->size) {
+        wl_resource_post_error(pool_resource, WL_SHM_ERROR_INVALID_STRIDE,
+            "Invalid buffer %dx%d, stride %d, offset %d in a pool of %zu "
+            "bytes", width, height, stride, offset, pool->mapping->size);
+        return;
+    }
+
+    struct shm_buffer *buffer = calloc(1, sizeof(struct shm_buffer));
+    if (!buffer) {
+        wl_client_post_no_memory(client);
+        return;
+    }
+    buffer->resource = wl_resource_create(client, &wl_buffer_interface, 1, id);
+    if (!buffer->resource) {
+        free(buffer);
+        wl_client_post_no_memory(client);
+        return;
+    }
+
+    buffer->pool = pool;
+    pool->refs++;
+    buffer->mapping = pool->mapping;
+    buffer->mapping->refs++;
+    buffer->format = format;
+    buffer->offset = (size_t)offset;
+    buffer->stride = (size_t)stride;
+    wlr_buffer_init(&buffer->base, &shm_buffer_impl, width, height);
+    wl_resource_set_implementation(buffer->resource, &buffer_impl, buffer,
+        buffer_handle_resource_destroy);
+
+    buffer->release.notify = buffer_handle_release;
+    wl_signal_add(&buffer->base.events.release, &buffer->release);
+}
+
+static void pool_handle_destroy(struct wl_client *client,
+    struct wl_resource *resource) {
+    (void)client;
+    wl_resource_destroy(resource);
+}
+
+static void pool_handle_resize(struct wl_client *client,
+    struct wl_resource *resource, int32_t size) {
+    struct shm_pool *pool = wl_resource_get_user_data(resource);
+    if (size <= 0 || (size_t)size < pool->mapping->size) {
+        wl_resource_post_error(resource, WL_SHM_ERROR_INVALID_STRIDE,
+            "Pools may only grow, not from %zu to %d bytes",
+            pool->mapping->size, size);
+        return;
+    }
+
+    struct shm_mapping *mapping = mapping_create(pool->fd, (size_t)size);
+    if (!mapping) {
+        wl_client_post_no_memory(client);
+        return;
+    }
+    mapping_unref(pool->mapping);
+    pool->mapping = mapping;
+}
+
+static const struct wl_shm_pool_interface pool_impl = {
+    .create_buffer = pool_handle_create_buffer,
+    .destroy = pool_handle_destroy,
+    .resize = pool_handle_resize,
+};
+
+static void pool_handle_resource_destroy(struct wl_resource *resource) {
+    struct shm_pool *pool = wl_resource_get_user_data(resource);
+    pool->resource = NULL;
+    pool_unref(pool);
+}
+
+static void shm_handle_create_pool(struct wl_client *client,
+    struct wl_resource *shm_resource, uint32_t id, int32_t fd, int32_t size) {
+    struct wavo_shm *shm = wl_resource_get_user_data(shm_resource);
+
+    if (size <= 0) {
+        wl_resource_post_error(shm_resource, WL_SHM_ERROR_INVALID_STRIDE,
+            "Invalid pool size %d", size);
+        close(fd);
+        return;
+    }
+
+    struct shm_pool *pool = calloc(1, sizeof(struct shm_pool));
+    if (!pool) {
+        wl_client_post_no_memory(client);
+        close(fd);
+        return;
+    }
+    pool->mapping = mapping_create(fd, (size_t)size);
+    if (!pool->mapping) {
+        wl_resource_post_error(shm_resource, WL_SHM_ERROR_INVALID_FD,
+            "%s", "Failed to map pool");
+        free(pool);
+        close(fd);
+        return;
+    }
+    pool->resource = wl_resource_create(client, &wl_shm_pool_interface,
+        wl_resource_get_version(shm_resource), id);
+    if (!pool->resource) {
+        mapping_unref(pool->mapping);
+        free(pool);
+        close(fd);
+        wl_client_post_no_memory(client);
+        return;
+    }
+
+    pool->shm = shm;
+    pool->fd = fd;
+    pool->refs = 1;
+    wl_resource_set_implementation(pool->resource, &pool_impl, pool,
+        pool_handle_resource_destroy);
+}
+
+static const struct wl_shm_interface shm_impl = {
+    .create_pool = shm_handle_create_pool,
+};
+
+static void surface_client_commit(struct wl_listener *listener, void *data) {
+    (void)data;
+    struct shm_surface *shm_surface =
+        wl_container_of(listener, shm_surface, client_commit);
+    struct wlr_surface *surface = shm_surface->surface;
+    struct wlr_buffer *wlr_buffer = surface->pending.buffer;
+    if (!(surface->pending.committed & WLR_SURFACE_STATE_BUFFER) ||
+            !wlr_buffer || wlr_buffer->impl != &shm_buffer_impl) {
+        return;
+    }
+
+    struct shm_buffer *buffer = wl_container_of(wlr_buffer, buffer, base);
+    if (buffer->format->yuv) {
+        wl_client_post_implementation_error(
+            wl_resource_get_client(surface->resource),
+            "Format 0x%08X is for screencopy only", buffer->format->format);
+    }
+}
+
+static void surface_destroy(struct wl_listener *listener, void *data) {
+    (void)data;
+    struct shm_surface *shm_surface =
+        wl_container_of(listener, shm_surface, destroy);
+    wl_list_remove(&shm_surface->client_commit.link);
+    wl_list_remove(&shm_surface->destroy.link);
+    free(shm_surface);
+}
+
+static void shm_new_surface(struct wl_listener *listener, void *data) {
+    (void)listener;
+    struct wlr_surface *surface = data;
+
+    struct shm_surface *shm_surface = calloc(1, sizeof(struct shm_surface));
+    if (!shm_surface) {
+        wl_resource_post_no_memory(surface->resource);
+        return;
+    }
+    shm_surface->surface = surface;
+    shm_surface->client_commit.notify = surface_client_commit;
+    wl_signal_add(&surface->events.client_commit,
+        &shm_surface->client_commit);
+    shm_surface->destroy.notify = surface_destroy;
+    wl_signal_add(&surface->events.destroy, &shm_surface->destroy);
+}
+
+// Left initialized for shm_handle_display_destroy(), whichever goes first
+static void shm_compositor_destroy(struct wl_listener *listener,
+    void *data) {
+    (void)data;
+    struct wavo_shm *shm = wl_container_of(listener, shm, compositor_destroy);
+    wl_list_remove(&shm->new_surface.link);
+    wl_list_remove(&shm->compositor_destroy.link);
+    wl_list_init(&shm->new_surface.link);
+    wl_list_init(&shm->compositor_destroy.link);
+}
+
+static void shm_bind(struct wl_client *client, void *data, uint32_t version,
+    uint32_t id) {
+    struct wavo_shm *shm = data;
+
+    struct wl_resource *resource = wl_resource_create(client,
+        &wl_shm_interface, (int)version, id);
+    if (!resource) {
+        wl_client_post_no_memory(client);
+        return;
+    }
+    wl_resource_set_implementation(resource, &shm_impl, shm, NULL);
+
+    for (size_t i = 0; i < shm->formats_len; i++) {
+        wl_shm_send_format(resource,
+            drm_format_to_shm(shm->formats[i]->format));
+    }
+}
+
+static void shm_handle_display_destroy(struct wl_listener *listener,
+    void *data) {
+    (void)data;
+    struct wavo_shm *shm = wl_container_of(listener, shm, display_destroy);
+    wl_list_remove(&shm->new_surface.link);
+    wl_list_remove(&shm->compositor_destroy.link);
+    wl_list_remove(&shm->display_destroy.link);
+    wl_global_destroy(shm->global);
+    free(shm);
+}
+
+struct wavo_shm *wavo_shm_create(struct wl_display *display,
+    struct wlr_compositor *compositor,
+    const struct wlr_drm_format_set *texture_formats) {
+    struct wavo_shm *shm = calloc(1, sizeof(struct wavo_shm));
+    if (!shm) {
+        wlr_log(WLR_ERROR, "%s", "Failed to allocate wl_shm");
+        return NULL;
+    }
+
+    for (size_t i = 0; i < SHM_FORMATS_MAX; i++) {
+        if (wlr_drm_format_set_get(texture_formats, shm_formats[i].format)) {
+            shm->formats[shm->formats_len++] = &shm_formats[i];
+        }
+    }
+
+    // Every client may assume these two
+    if (!shm_find_format(shm, DRM_FORMAT_ARGB8888) ||
+            !shm_find_format(shm, DRM_FORMAT_XRGB8888)) {
+        wlr_log(WLR_ERROR, "%s", "Renderer cannot texture ARGB8888 and "
+            "XRGB8888 from shm");
+        free(shm);
+        return NULL;
+    }
+
+    shm->global = wl_global_create(display, &wl_shm_interface, SHM_VERSION,
+        shm, shm_bind);
+    if (!shm->global) {
+        wlr_log(WLR_ERROR, "%s", "Failed to create wl_shm global");
+        free(shm);
+        return NULL;
+    }
+
+    wlr_buffer_register_resource_interface(&buffer_resource_interface);
+
+    shm->new_surface.notify = shm_new_surface;
+    wl_signal_add(&compositor->events.new_surface, &shm->new_surface);
+    shm->compositor_destroy.notify = shm_compositor_destroy;
+    wl_signal_add(&compositor->events.destroy, &shm->compositor_destroy);
+    shm->display_destroy.notify = shm_handle_display_destroy;
+    wl_display_add_destroy_listener(display, &shm->display_destroy);
+
+    return shm;
+}
@@ -0,0 +1,632 @@
+#define _POSIX_C_SOURCE 200809L
+#include <inttypes.h>
+#include <stdlib.h>
+#include <drm_fourcc.h>
+#include <wayland-server-core.h>
+#include <wlr/render/allocator.h>
+#include <wlr/render/drm_format_set.h>
+#include <wlr/render/pass.h>
+#include <wlr/render/wlr_renderer.h>
+#include <wlr/render/wlr_texture.h>
+#include <wlr/types/wlr_buffer.h>
+#include <wlr/types/wlr_cursor.h>
+#include <wlr/types/wlr_output_layout.h>
+#include <wlr/types/wlr_scene.h>
+#include <wlr/types/wlr_xdg_shell.h>
+#include <wlr/util/box.h>
+#include <wlr/util/log.h>
+#include "wavo/buffer.h"
+#include "wavo/input.h"
+#include "wavo/latency.h"
+#include "wavo/output.h"
+#include "wavo/server.h"
+#include "wavo/thumbnail.h"
+#include "wavo/view.h"
+#include "wavo/workers.h"
+
+// Dirty thumbnails are picked up this long after the first damage, a few
+// at a time, and a busy view is read back at most once per interval
+#define THUMBNAIL_TICK_MSEC 250
+#define THUMBNAIL_BATCH 4
+#define THUMBNAIL_MIN_INTERVAL_USEC 2000000
+
+// Views are rendered at this multiple of the thumbnail size, at most their
+// own, and box filtered down from there on a worker
+#define THUMBNAIL_OVERSAMPLE 2
+
+#define OVERVIEW_MARGIN 16
+
+struct thumbnail_job {
+    struct wavo_thumbnails *thumbnails;
+    struct wavo_thumbnail *thumbnail;
+    uint32_t *src;  // Oversampled render read back
+    int src_width, src_height;
+    struct wavo_pixel_buffer *buffer;
+};
+
+void wavo_thumbnail_get_size(int width, int height, int *thumb_width,
+    int *thumb_height) {
+    int longest = width > height ? width : height;
+    if (longest <= WAVO_THUMBNAIL_SIZE) {
+        *thumb_width = width;
+        *thumb_height = height;
+    } else {
+        *thumb_width = (int)(((int64_t)width * WAVO_THUMBNAIL_SIZE +
+            longest / 2) / longest);
+        *thumb_height = (int)(((int64_t)height * WAVO_THUMBNAIL_SIZE +
+            longest / 2) / longest);
+    }
+    if (*thumb_width < 1) {
+        *thumb_width = 1;
+    }
+    if (*thumb_height < 1) {
+        *thumb_height = 1;
+    }
+}
+
+void wavo_thumbnail_scale(const uint32_t *src, int src_width, int src_height,
+    uint32_t src_stride, uint32_t *dst, int dst_width, int dst_height,
+    uint32_t dst_stride) {
+    for (int y = 0; y < dst_height; y++) {
+        int y0 = (int)((int64_t)y * src_height / dst_height);
+        int y1 = (int)((int64_t)(y + 1) * src_height / dst_height);
+        if (y1 == y0) {
+            y1 = y0 + 1;
+        }
+
+        for (int x = 0; x < dst_width; x++) {
+            int x0 = (int)((int64_t)x * src_width / dst_width);
+            int x1 = (int)((int64_t)(x + 1) * src_width / dst_width);
+            if (x1 == x0) {
+                x1 = x0 + 1;
+            }
+
+            // Premultiplied, so averaging every channel alike is correct
+            uint64_t sum[4] = {0};
+            for (int sy = y0; sy < y1; sy++) {
+                const uint32_t *row = src + (size_t)sy * src_stride;
+                for (int sx = x0; sx < x1; sx++) {
+                    uint32_t pixel = row[sx];
+                    sum[0] += pixel >> 24;
+                    sum[1] += (pixel >> 16) & 0xff;
+                    sum[2] += (pixel >> 8) & 0xff;
+                    sum[3] += pixel & 0xff;
+                }
+            }
+
+            uint64_t count = (uint64_t)(y1 - y0) * (uint64_t)(x1 - x0);
+            uint32_t pixel = 0;
+            for (int i = 0; i < 4; i++) {
+                pixel = (pixel << 8) | (uint32_t)((sum[i] + count / 2) / count);
+            }
+            dst[(size_t)y * dst_stride + (size_t)x] = pixel;
+        }
+    }
+}
+
+static void thumbnail_handle_overview_destroy(struct wl_listener *listener,
+    void *data) {
+    (void)data;  // Unused parameter
+    struct wavo_thumbnail *thumbnail =
+        wl_container_of(listener, thumbnail, overview_destroy);
+    wl_list_remove(&thumbnail->overview_destroy.link);
+    thumbnail->overview_node = NULL;
+}
+
+static void thumbnail_free(struct wavo_thumbnail *thumbnail) {
+    if (thumbnail->overview_node) {
+        wlr_scene_node_destroy(&thumbnail->overview_node->node);
+    }
+    wlr_buffer_drop(thumbnail->buffer);
+    free(thumbnail);
+}
+
+static void thumbnails_arm_timer(struct wavo_thumbnails *thumbnails) {
+    if (!thumbnails->timer_armed) {
+        wl_event_source_timer_update(thumbnails->timer, THUMBNAIL_TICK_MSEC);
+        thumbnails->timer_armed = true;
+    }
+}
+
+static void job_scale(void *data) {
+    struct thumbnail_job *job = data;
+    struct wavo_pixel_buffer *buffer = job->buffer;
+    wavo_thumbnail_scale(job->src, job->src_width, job->src_height,
+        (uint32_t)job->src_width, buffer->pixels, buffer->base.width,
+        buffer->base.height, (uint32_t)buffer->base.width);
+}
+
+static void job_done(void *data) {
+    struct thumbnail_job *job = data;
+    struct wavo_thumbnail *thumbnail = job->thumbnail;
+    struct wlr_buffer *buffer = &job->buffer->base;
+    free(job->src);
+
+    thumbnail->pending = false;
+    if (!thumbnail->view) {
+        wlr_buffer_drop(buffer);
+        thumbnail_free(thumbnail);
+        free(job);
+        return;
+    }
+
+    wlr_buffer_drop(thumbnail->buffer);
+    thumbnail->buffer = buffer;
+    if (thumbnail->overview_node) {
+        wlr_scene_buffer_set_buffer(thumbnail->overview_node, buffer);
+    }
+    job->thumbnails->refreshes++;
+
+    // Damaged again while it was being scaled
+    if (thumbnail->dirty) {
+        thumbnails_arm_timer(job->thumbnails);
+    }
+    free(job);
+}
+
+struct thumbnail_render {
+    struct wlr_renderer *renderer;
+    struct wlr_render_pass *pass;
+    struct wlr_box geometry;  // Window geometry in the view's tree
+    double scale_x, scale_y;
+};
+
+// Half away from zero, buffers may start left of or above the geometry
+static int thumbnail_round(double value) {
+    return value < 0.0 ? -(int)(-value + 0.5) : (int)(value + 0.5);
+}
+
+static void thumbnail_render_buffer(struct wlr_scene_buffer *scene_buffer,
+    int sx, int sy, void *data) {
+    struct thumbnail_render *render = data;
+    struct wlr_buffer *buffer = scene_buffer->buffer;
+    if (!buffer) {
+        return;
+    }
+
+    // Surfaces keep their texture around, anything else is uploaded here
+    struct wlr_client_buffer *client_buffer = wlr_client_buffer_get(buffer);
+    struct wlr_texture *texture =
+        client_buffer ? client_buffer->texture : NULL;
+    bool own_texture = false;
+    if (!texture) {
+        texture = wlr_texture_from_buffer(render->renderer, buffer);
+        if (!texture) {
+            return;
+        }
+        own_texture = true;
+    }
+
+    int width = scene_buffer->dst_width, height = scene_buffer->dst_height;
+    if (width <= 0 || height <= 0) {
+        bool rotated = scene_buffer->transform & WL_OUTPUT_TRANSFORM_90;
+        width = rotated ? buffer->height : buffer->width;
+        height = rotated ? buffer->width : buffer->height;
+    }
+    double x = sx - render->geometry.x, y = sy - render->geometry.y;
+    int x0 = thumbnail_round(x * render->scale_x);
+    int y0 = thumbnail_round(y * render->scale_y);
+    int x1 = thumbnail_round((x + width) * render->scale_x);
+    int y1 = thumbnail_round((y + height) * render->scale_y);
+    if (x1 > x0 && y1 > y0) {
+        // Whatever lies outside the geometry, CSD shadows say, falls off
+        // the edges of the target
+        wlr_render_pass_add_texture(render->pass,
+            &(struct wlr_render_texture_options){
+                .texture = texture,
+                .src_box = scene_buffer->src_box,
+                .dst_box = { .x = x0, .y = y0, .width = x1 - x0,
+                    .height = y1 - y0 },
+                .alpha = &scene_buffer->opacity,
+                .transform = scene_buffer->transform,
+                .filter_mode = WLR_SCALE_FILTER_BILINEAR,
+            });
+    }
+
+    if (own_texture) {
+        wlr_texture_destroy(texture);
+    }
+}
+
+// Renders the view's window geometry, subsurfaces and popups included, into
+// a buffer of width x height and reads that back into dst
+static bool thumbnail_render_view(struct wavo_server *server,
+    struct wavo_view *view, const struct wlr_box *geometry, int width,
+    int height, uint32_t *dst) {
+    // Linear ARGB8888 renders and reads back with every renderer
+    uint64_t modifier = DRM_FORMAT_MOD_LINEAR;
+    struct wlr_drm_format format = {
+        .format = DRM_FORMAT_ARGB8888,
+        .len = 1,
+        .capacity = 1,
+        .modifiers = &modifier,
+    };
+    struct wlr_buffer *target = wlr_allocator_create_buffer(server->allocator,
+        width, height, &format);
+    if (!target) {
+        return false;
+    }
+
+    bool ok = false;
+    struct wlr_render_pass *pass =
+        wlr_renderer_begin_buffer_pass(server->renderer, target, NULL);
+    if (!pass) {
+        goto out;
+    }
+    // Transparent where no buffer covers the geometry
+    wlr_render_pass_add_rect(pass, &(struct wlr_render_rect_options){
+        .box = { .width = width, .height = height },
+        .blend_mode = WLR_RENDER_BLEND_MODE_NONE,
+    });
+    struct thumbnail_render render = {
+        .renderer = server->renderer,
+        .pass = pass,
+        .geometry = *geometry,
+        .scale_x = (double)width / geometry->width,
+        .scale_y = (double)height / geometry->height,
+    };
+    wlr_scene_node_for_each_buffer(&view->scene_tree->node,
+        thumbnail_render_buffer, &render);
+    if (!wlr_render_pass_submit(pass)) {
+        goto out;
+    }
+
+    struct wlr_texture *texture =
+        wlr_texture_from_buffer(server->renderer, target);
+    if (!texture) {
+        goto out;
+    }
+    ok = wlr_texture_read_pixels(texture,
+        &(struct wlr_texture_read_pixels_options){
+            .data = dst,
+            .format = DRM_FORMAT_ARGB8888,
+            .stride = (uint32_t)width * 4,
+        });
+    wlr_texture_destroy(texture);
+
+out:
+    wlr_buffer_drop(target);
+    return ok;
+}
+
+// Rendering and reading back a small copy happens here, only the box
+// filter moves to a worker
+static bool thumbnail_refresh(struct wavo_thumbnails *thumbnails,
+    struct wavo_thumbnail *thumbnail) {
+    struct wavo_view *view = thumbnail->view;
+    thumbnail->dirty = false;
+    thumbnail->refresh_usec = wavo_latency_now_usec();
+
+    struct wlr_box geometry;
+    wlr_xdg_surface_get_geometry(view->xdg_surface, &geometry);
+    if (wlr_box_empty(&geometry)) {
+        return false;
+    }
+    int thumb_width, thumb_height;
+    wavo_thumbnail_get_size(geometry.width, geometry.height, &thumb_width,
+        &thumb_height);
+    int width = thumb_width * THUMBNAIL_OVERSAMPLE;
+    int height = thumb_height * THUMBNAIL_OVERSAMPLE;
+    if (width > geometry.width || height > geometry.height) {
+        width = geometry.width;
+        height = geometry.height;
+    }
+
+    struct thumbnail_job *job = calloc(1, sizeof(struct thumbnail_job));
+    if (!job) {
+        return false;
+    }
+    job->thumbnails = thumbnails;
+    job->thumbnail = thumbnail;
+    job->src_width = width;
+    job->src_height = height;
+    job->src = malloc((size_t)width * (size_t)height * 4);
+    job->buffer = wavo_pixel_buffer_create(thumb_width, thumb_height);
+    if (!job->src || !job->buffer) {
+        goto error_job;
+    }
+
+    if (!thumbnail_render_view(thumbnails->server, view, &geometry, width,
+            height, job->src)) {
+        goto error_job;
+    }
+    wavo_latency_histogram_add(&thumbnails->readback,
+        wavo_latency_now_usec() - thumbnail->refresh_usec);
+
+    if (!wavo_workers_submit(thumbnails->server->workers, job_scale, job_done,
+            job)) {
+        wlr_buffer_drop(&job->buffer->base);
+        free(job->src);
+        free(job);
+        return false;
+    }
+    thumbnail->pending = true;
+    return true;
+
+error_job:
+    if (job->buffer) {
+        wlr_buffer_drop(&job->buffer->base);
+    }
+    free(job->src);
+    free(job);
+    return false;
+}
+
+static int thumbnails_handle_timer(void *data) {
+    struct wavo_thumbnails *thumbnails = data;
+    struct wavo_server *server = thumbnails->server;
+    thumbnails->timer_armed = false;
+
+    uint64_t now_usec = wavo_latency_now_usec();
+    for (int i = 0; i < THUMBNAIL_BATCH; i++) {
+        // Oldest snapshot first, so one busy view cannot starve the others
+        struct wavo_thumbnail *oldest = NULL;
+        struct wavo_view *view;
+        wl_list_for_each(view, &server->views, link) {
+            struct wavo_thumbnail *thumbnail = view->thumbnail;
+            if (!thumbnail || !thumbnail->dirty || thumbnail->pending ||
+                    now_usec - thumbnail->refresh_usec <
+                        THUMBNAIL_MIN_INTERVAL_USEC) {
+                continue;
+            }
+            if (!oldest || thumbnail->refresh_usec < oldest->refresh_usec) {
+                oldest = thumbnail;
+            }
+        }
+        if (!oldest) {
+            break;
+        }
+        if (!thumbnail_refresh(thumbnails, oldest)) {
+            thumbnails->readback_failures++;
+        }
+    }
+
+    struct wavo_view *view;
+    wl_list_for_each(view, &server->views, link) {
+        if (view->thumbnail && view->thumbnail->dirty &&
+                !view->thumbnail->pending) {
+            thumbnails_arm_timer(thumbnails);
+            break;
+        }
+    }
+    return 0;
+}
+
+void wavo_thumbnail_damage(struct wavo_view *view) {
+    struct wavo_thumbnails *thumbnails = view->server->thumbnails;
+    if (!thumbnails) {
+        return;
+    }
+
+    if (!view->thumbnail) {
+        view->thumbnail = calloc(1, sizeof(struct wavo_thumbnail));
+        if (!view->thumbnail) {
+            wlr_log(WLR_ERROR, "Failed to allocate thumbnail: %s",
+                "Out of memory");
+            return;
+        }
+        view->thumbnail->view = view;
+    }
+
+    view->thumbnail->dirty = true;
+    thumbnails_arm_timer(thumbnails);
+}
+
+void wavo_thumbnail_destroy(struct wavo_thumbnail *thumbnail) {
+    if (!thumbnail) {
+        return;
+    }
+    // job_done() frees it
+    if (thumbnail->pending) {
+        thumbnail->view = NULL;
+        return;
+    }
+    thumbnail_free(thumbnail);
+}
+
+static void overview_close(struct wavo_thumbnails *thumbnails) {
+    // Thumbnails let go of their nodes through overview_destroy
+    wlr_scene_node_destroy(&thumbnails->overview->node);
+    thumbnails->overview = NULL;
+}
+
+static struct wlr_output *overview_output(struct wavo_server *server) {
+    struct wlr_cursor *cursor = server->input->cursor;
+    struct wlr_output *wlr_output = wlr_output_layout_output_at(
+        server->output_layout, cursor->x, cursor->y);
+    if (wlr_output) {
+        return wlr_output;
+    }
+
+    struct wavo_output *output;
+    wl_list_for_each(output, &server->outputs, link) {
+        if (output->scene_output) {
+            return output->wlr_output;
+        }
+    }
+    return NULL;
+}
+
+static void overview_open(struct wavo_thumbnails *thumbnails) {
+    struct wavo_server *server = thumbnails->server;
+    struct wlr_output *wlr_output = overview_output(server);
+    if (!wlr_output) {
+        return;
+    }
+
+    struct wlr_box box;
+    wlr_output_layout_get_box(server->output_layout, wlr_output, &box);
+
+    // Above the views, which were added to the scene first
+    thumbnails->overview = wlr_scene_tree_create(&server->scene->tree);
+    if (!thumbnails->overview) {
+        wlr_log(WLR_ERROR, "%s", "Failed to create overview");
+        return;
+    }
+    wlr_scene_node_set_position(&thumbnails->overview->node, box.x, box.y);
+
+    static const float dim[4] = { 0.0f, 0.0f, 0.0f, 0.7f };
+    wlr_scene_rect_create(thumbnails->overview, box.width, box.height, dim);
+
+    int count = wl_list_length(&server->views);
+    if (count == 0) {
+        return;
+    }
+    int columns = 1;
+    while (columns * columns < count) {
+        columns++;
+    }
+    int rows = (count + columns - 1) / columns;
+    int cell_width = box.width / columns;
+    int cell_height = box.height / rows;
+
+    // In mapping order
+    int i = 0;
+    struct wavo_view *view;
+    wl_list_for_each_reverse(view, &server->views, link) {
+        int x = (i % columns) * cell_width + OVERVIEW_MARGIN;
+        int y = (i / columns) * cell_height + OVERVIEW_MARGIN;
+        int width = cell_width - 2 * OVERVIEW_MARGIN;
+        int height = cell_height - 2 * OVERVIEW_MARGIN;
+        i++;
+        if (width <= 0 || height <= 0) {
+            continue;
+        }
+
+        struct wavo_thumbnail *thumbnail = view->thumbnail;
+        if (!thumbnail || !thumbnail->buffer) {
+            // Not read back yet, the slot keeps the grid stable
+            static const float placeholder[4] = { 0.2f, 0.2f, 0.2f, 1.0f };
+            struct wlr_scene_rect *rect = wlr_scene_rect_create(
+                thumbnails->overview, width, height, placeholder);
+            if (rect) {
+                wlr_scene_node_set_position(&rect->node, x, y);
+            }
+            continue;
+        }
+
+        struct wlr_box fit;
+        wavo_output_letterbox(thumbnail->buffer->width,
+            thumbnail->buffer->height, width, height, &fit);
+        struct wlr_scene_buffer *node = wlr_scene_buffer_create(
+            thumbnails->overview, thumbnail->buffer);
+        if (!node) {
+            continue;
+        }
+        wlr_scene_buffer_set_dest_size(node, fit.width, fit.height);
+        wlr_scene_node_set_position(&node->node, x + fit.x, y + fit.y);
+        thumbnail->overview_node = node;
+        thumbnail->overview_destroy.notify = thumbnail_handle_overview_destroy;
+        wl_signal_add(&node->node.events.destroy, &thumbnail->overview_destroy);
+    }
+}
+
+void wavo_thumbnails_set_overview(struct wavo_thumbnails *thumbnails,
+    bool open) {
+    if (open == (thumbnails->overview != NULL)) {
+        return;
+    }
+    if (open) {
+        overview_open(thumbnails);
+    } else {
+        overview_close(thumbnails);
+    }
+}
+
+bool wavo_thumbnail_write(struct wavo_thumbnail *thumbnail, FILE *out) {
+    if (!thumbnail || !thumbnail->buffer) {
+        return false;
+    }
+    struct wavo_pixel_buffer *buffer =
+        wl_container_of(thumbnail->buffer, buffer, base);
+    int width = buffer->base.width, height = buffer->base.height;
+
+    fprintf(out, "P7\nWIDTH %d\nHEIGHT %d\nDEPTH 4\nMAXVAL 255\n"
+        "TUPLTYPE RGB_ALPHA\nENDHDR\n", width, height);
+    for (size_t i = 0; i < (size_t)width * (size_t)height; i++) {
+        uint32_t pixel = buffer->pixels[i];
+        uint32_t alpha = pixel >> 24;
+        uint8_t rgba[4] = { 0, 0, 0, (uint8_t)alpha };
+        // PAM alpha is straight, ours premultiplied
+        for (int c = 0; c < 3 && alpha > 0; c++) {
+            uint32_t value = (pixel >> (16 - 8 * c)) & 0xff;
+            value = (value * 255 + alpha / 2) / alpha;
+            rgba[c] = (uint8_t)(value > 255 ? 255 : value);
+        }
+        fwrite(rgba, 1, sizeof(rgba), out);
+    }
+    return !ferror(out);
+}
+
+void wavo_thumbnails_print(struct wavo_thumbnails *thumbnails, FILE *out) {
+    uint64_t now_usec = wavo_latency_now_usec();
+    struct wavo_view *view;
+    wl_list_for_each_reverse(view, &thumbnails->server->views, link) {
+        const char *app_id = view->xdg_surface->toplevel->app_id;
+        fprintf(out, "%" PRIu32 " %s", view->id, app_id ? app_id : "-");
+
+        struct wavo_thumbnail *thumbnail = view->thumbnail;
+        if (!thumbnail || !thumbnail->buffer) {
+            fputs(" none\n", out);
+            continue;
+        }
+        fprintf(out, " %dx%d age_ms %" PRIu64 "%s\n", thumbnail->buffer->width,
+            thumbnail->buffer->height,
+            (now_usec - thumbnail->refresh_usec) / 1000,
+            thumbnail->dirty || thumbnail->pending ? " stale" : "");
+    }
+}
+
+void wavo_thumbnails_print_metrics(struct wavo_thumbnails *thumbnails,
+    FILE *out) {
+    if (!thumbnails) {
+        return;
+    }
+
+    size_t bytes = 0;
+    struct wavo_view *view;
+    wl_list_for_each(view, &thumbnails->server->views, link) {
+        if (view->thumbnail && view->thumbnail->buffer) {
+            bytes += (size_t)view->thumbnail->buffer->width *
+                (size_t)view->thumbnail->buffer->height * 4;
+        }
+    }
+
+    fprintf(out, "thumbnails.bytes %zu\n", bytes);
+    fprintf(out, "thumbnails.refreshes %" PRIu64 "\n", thumbnails->refreshes);
+    fprintf(out, "thumbnails.readback_failures %" PRIu64 "\n",
+        thumbnails->readback_failures);
+    wavo_latency_histogram_print(&thumbnails->readback, "thumbnails.readback",
+        out);
+}
+
+struct wavo_thumbnails *wavo_thumbnails_create(struct wavo_server *server) {
+    struct wavo_thumbnails *thumbnails =
+        calloc(1, sizeof(struct wavo_thumbnails));
+    if (!thumbnails) {
+        wlr_log(WLR_ERROR, "Failed to allocate thumbnails: %s",
+            "Out of memory");
+        return NULL;
+    }
+    thumbnails->server = server;
+
+    thumbnails->timer = wl_event_loop_add_timer(server->event_loop,
+        thumbnails_handle_timer, thumbnails);
+    if (!thumbnails->timer) {
+        wlr_log(WLR_ERROR, "%s", "Failed to create thumbnail timer");
+        free(thumbnails);
+        return NULL;
+    }
+    return thumbnails;
+}
+
+void wavo_thumbnails_destroy(struct wavo_thumbnails *thumbnails) {
+    if (!thumbnails) {
+        return;
+    }
+    if (thumbnails->overview) {
+        overview_close(thumbnails);
+    }
+    wl_event_source_remove(thumbnails->timer);
+    free(thumbnails);
+}
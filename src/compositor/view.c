@@ -1,18 +1,34 @@
 #include <stdlib.h>
+#include <pixman.h>
 #include <string.h>
 #include <wayland-server-core.h>
 #include <wlr/types/wlr_scene.h>
 #include <wlr/types/wlr_xdg_shell.h>
 #include <wlr/types/wlr_cursor.h>
+#include <wlr/types/wlr_fractional_scale_v1.h>
+#include <wlr/types/wlr_output_layout.h>
 #include <wlr/types/wlr_seat.h>
 #include <wlr/types/wlr_input_device.h>
 #include <wlr/types/wlr_pointer.h>
+#include <wlr/util/box.h>
 #include <wlr/util/edges.h>
 #include <wlr/util/log.h>
 #include <linux/input-event-codes.h>
 #include "wavo/view.h"
+#include "wavo/budget.h"
+#include "wavo/foreign_toplevel.h"
+#include "wavo/hooks.h"
 #include "wavo/server.h"
 #include "wavo/input.h"
+#include "wavo/output.h"
+#include "wavo/pressure.h"
+#include "wavo/record.h"
+#include "wavo/thumbnail.h"
+#include "wavo/watchdog.h"
+
+// Commits a held surface may take before its client is disconnected, the
+// whole commit burst
+#define VIEW_MAX_HELD_COMMITS 500
 
 struct wavo_drag_grab {
     struct wavo_view *view;
@@ -30,11 +46,18 @@ static void process_cursor_move(struct wavo_server *server, uint32_t time_msec)
     double dy = server->input->cursor->y - grab->y;
 
     struct wlr_scene_node *node = &view->scene_tree->node;
-    node->x = node->x + dx;
-    node->y = node->y + dy;
+    wlr_scene_node_set_position(node, node->x + dx, node->y + dy);
 
     grab->x = server->input->cursor->x;
     grab->y = server->input->cursor->y;
+
+    wavo_view_update_output(view);
+}
+
+// Sent and not acked yet, or about to be sent
+static bool view_configure_in_flight(struct wavo_view *view) {
+    return view->xdg_surface->configure_idle ||
+        !wl_list_empty(&view->xdg_surface->configure_list);
 }
 
 static void process_cursor_resize(struct wavo_server *server, uint32_t time_msec) {
@@ -62,93 +85,240 @@ static void process_cursor_resize(struct wavo_server *server, uint32_t time_msec
     }
 
     // Ensure minimum size
-    new_geo.width = fmax(new_geo.width, 50);
-    new_geo.height = fmax(new_geo.height, 50);
-
-    // Apply the new geometry
+    if (new_geo.width < 50) new_geo.width = 50;
+    if (new_geo.height < 50) new_geo.height = 50;
+
+    // One configure in flight at a time; a hung client gets none, so
+    // motion never piles up configures it will not read
+    if (view->unresponsive || view_configure_in_flight(view)) {
+        view->configure_held = true;
+        view->held_width = new_geo.width;
+        view->held_height = new_geo.height;
+        return;
+    }
     wlr_xdg_toplevel_set_size(surface->toplevel, new_geo.width, new_geo.height);
 }
 
-static void handle_pointer_button(struct wl_listener *listener, void *data) {
-    struct wavo_input *input = wl_container_of(listener, input, cursor_button);
-    struct wlr_pointer_button_event *event = data;
+size_t wavo_view_grab_size(void) {
+    return sizeof(struct wavo_drag_grab);
+}
+
+void wavo_view_grab_motion(struct wavo_server *server, uint32_t time_msec) {
+    struct wavo_drag_grab *grab = server->input->grab_data;
+    if (grab->resize_edges) {
+        process_cursor_resize(server, time_msec);
+    } else {
+        process_cursor_move(server, time_msec);
+    }
+}
 
-    if (event->state == WLR_BUTTON_RELEASED && input->grab_data) {
-        free(input->grab_data);
-        input->grab_data = NULL;
+void wavo_view_end_grab(struct wavo_server *server) {
+    struct wavo_input *input = server->input;
+    if (!input->grab_data) {
         return;
     }
+    wavo_pool_free(&server->grab_pool, input->grab_data);
+    input->grab_data = NULL;
+}
 
-    // Only handle button press
-    if (event->state != WLR_BUTTON_PRESSED) {
+void wavo_view_handle_button(struct wavo_server *server, bool pressed) {
+    struct wavo_input *input = server->input;
+    if (!pressed) {
+        wavo_view_end_grab(server);
         return;
     }
 
-    // Focus the view under the cursor
     double sx, sy;
-    struct wlr_scene_node *node = wlr_scene_node_at(
-        &input->server->scene->tree.node,
+    struct wlr_scene_node *node = wlr_scene_node_at(&server->scene->tree.node,
         input->cursor->x, input->cursor->y, &sx, &sy);
-    
     if (!node || node->type != WLR_SCENE_NODE_BUFFER) {
         return;
     }
 
     struct wavo_view *view = wavo_view_from_node(node);
-    if (!view) {
+    if (view && view->mapped) {
+        wavo_view_focus(view);
+    }
+}
+
+void wavo_view_focus(struct wavo_view *view) {
+    struct wavo_server *server = view->server;
+    struct wlr_seat *seat = server->input->seat;
+
+    wlr_scene_node_raise_to_top(&view->scene_tree->node);
+    wl_list_remove(&view->link);
+    wl_list_insert(&server->views, &view->link);
+    if (server->focused_view == view) {
         return;
     }
 
+    if (server->focused_view) {
+        wavo_view_activate(server->focused_view, false);
+    }
+    server->focused_view = view;
     wavo_view_activate(view, true);
-
-    if (event->button == BTN_LEFT) {
-        struct wavo_drag_grab *grab = calloc(1, sizeof(struct wavo_drag_grab));
-        grab->view = view;
-        grab->x = input->cursor->x;
-        grab->y = input->cursor->y;
-        input->grab_data = grab;
+    wavo_watchdog_ping(server->watchdog, view);
+    wavo_hooks_emit_view(server->hooks, WAVO_HOOK_FOCUS, view);
+
+    struct wlr_keyboard *keyboard = wlr_seat_get_keyboard(seat);
+    if (keyboard) {
+        wlr_seat_keyboard_notify_enter(seat, view->xdg_surface->surface,
+            keyboard->keycodes, keyboard->num_keycodes, &keyboard->modifiers);
+    } else {
+        wlr_seat_keyboard_notify_enter(seat, view->xdg_surface->surface,
+            NULL, 0, NULL);
     }
 }
 
 static void view_map(struct wl_listener *listener, void *data) {
     (void)data;
     struct wavo_view *view = wl_container_of(listener, view, map);
-    struct wlr_xdg_surface *xdg_surface = view->xdg_surface;
 
-    if (!xdg_surface->toplevel) {
-        wlr_log(WLR_ERROR, "XDG surface has no toplevel");
-        return;
+    view->mapped = true;
+    wl_list_insert(&view->server->views, &view->link);
+    wavo_view_update_output(view);
+    wavo_foreign_toplevel_map(view);
+    wavo_record_map(view->server->recorder, view);
+    wavo_hooks_emit_view(view->server->hooks, WAVO_HOOK_MAP, view);
+    wavo_view_focus(view);
+}
+
+// Everything that points at a mapped view lets go of it here, so unmap and
+// destroy cannot leave anything dangling
+static void view_release(struct wavo_view *view) {
+    struct wavo_server *server = view->server;
+    struct wavo_drag_grab *grab = server->input->grab_data;
+    if (grab && grab->view == view) {
+        wavo_view_end_grab(server);
     }
+    wavo_budget_cancel(view);
+    // The held commits still go through on the next tick, the client may
+    // map the surface again
+    if (view->commits_held) {
+        wavo_budget_defer(server->budgets, view, WAVO_VIEW_DEFER_COMMIT);
+    }
+    wavo_foreign_toplevel_unmap(view);
+    view->configure_held = false;
+    view->held_width = 0;
+    view->held_height = 0;
 
-    view->scene_tree = wlr_scene_xdg_surface_create(
-        view->server->view_tree, view->xdg_surface);
-    if (!view->scene_tree) {
-        wlr_log(WLR_ERROR, "Failed to create scene tree");
+    if (!view->mapped) {
         return;
     }
+    view->mapped = false;
+    wavo_record_unmap(server->recorder, view);
+    wavo_hooks_emit_view(server->hooks, WAVO_HOOK_UNMAP, view);
+    view->output = NULL;
+    view->scale = 0.0f;
+    if (server->pressure) {
+        wavo_pressure_forget_view(server->pressure, view);
+    }
+    wl_list_remove(&view->link);
 
-    view->scene_tree->node.data = view;
-    wl_list_insert(&view->server->views, &view->link);
+    if (server->focused_view == view) {
+        server->focused_view = NULL;
+        wlr_seat_keyboard_notify_clear_focus(server->input->seat);
+        if (!wl_list_empty(&server->views)) {
+            struct wavo_view *next =
+                wl_container_of(server->views.next, next, link);
+            wavo_view_focus(next);
+        }
+    }
 }
 
 static void view_unmap(struct wl_listener *listener, void *data) {
     (void)data;
     struct wavo_view *view = wl_container_of(listener, view, unmap);
-    wl_list_remove(&view->link);
+    view_release(view);
+}
+
+static bool view_take_budget(struct wavo_view *view,
+    enum wavo_budget_kind kind) {
+    struct wavo_budgets *budgets = view->server->budgets;
+    if (!budgets) {
+        return true;
+    }
+    return wavo_budget_take(budgets,
+        wl_resource_get_client(view->xdg_surface->resource), kind);
+}
+
+// A client committing faster than the budget would cost a buffer upload,
+// damage and a frame callback each time. Instead its next commits wait in
+// the surface's cache, holding their buffers, so a client drawing from
+// frame callbacks or into released buffers stalls until the budget refills.
+static void view_hold_commits(struct wavo_view *view) {
+    if (view->commits_held) {
+        return;
+    }
+    view->commits_held = true;
+    view->held_commits = 0;
+    view->commit_lock_seq =
+        wlr_surface_lock_pending(view->xdg_surface->surface);
+}
+
+// Applies the held commits right away, each one through view_commit()
+static void view_release_commits(struct wavo_view *view) {
+    if (!view->commits_held) {
+        return;
+    }
+    view->commits_held = false;
+    wlr_surface_unlock_cached(view->xdg_surface->surface,
+        view->commit_lock_seq);
+}
+
+// A client that keeps committing into a held surface without waiting for
+// anything would only grow the cache
+static void view_client_commit(struct wl_listener *listener, void *data) {
+    (void)data;
+    struct wavo_view *view = wl_container_of(listener, view, client_commit);
+    if (view->commits_held &&
+            ++view->held_commits == VIEW_MAX_HELD_COMMITS) {
+        wl_client_post_implementation_error(
+            wl_resource_get_client(view->xdg_surface->resource),
+            "%d commits over budget", VIEW_MAX_HELD_COMMITS);
+    }
+}
+
+static void view_commit(struct wl_listener *listener, void *data) {
+    (void)data;
+    struct wavo_view *view = wl_container_of(listener, view, commit);
+
+    if (view->xdg_surface->initial_commit) {
+        // Let the client pick its own size for the first configure
+        wlr_xdg_toplevel_set_size(view->xdg_surface->toplevel, 0, 0);
+        return;
+    }
+
+    if (view->configure_held && !view_configure_in_flight(view)) {
+        wavo_view_flush_configure(view);
+    }
+
+    if (view->mapped) {
+        wavo_record_commit(view->server->recorder, view);
+        // Thumbnails only mark themselves dirty, cheap enough for any rate
+        if (pixman_region32_not_empty(&view->xdg_surface->surface->buffer_damage)) {
+            wavo_thumbnail_damage(view);
+        }
+        if (view_take_budget(view, WAVO_BUDGET_COMMIT)) {
+            wavo_view_update_output(view);
+        } else {
+            view_hold_commits(view);
+            wavo_budget_defer(view->server->budgets, view,
+                WAVO_VIEW_DEFER_OUTPUT | WAVO_VIEW_DEFER_COMMIT);
+        }
+    }
 }
 
 static void view_destroy(struct wl_listener *listener, void *data) {
     (void)data;
     struct wavo_view *view = wl_container_of(listener, view, destroy);
-    wl_list_remove(&view->link);
-    wl_list_remove(&view->map.link);
-    wl_list_remove(&view->unmap.link);
-    wl_list_remove(&view->destroy.link);
-    wl_list_remove(&view->request_move.link);
-    wl_list_remove(&view->request_resize.link);
-    wl_list_remove(&view->request_maximize.link);
-    wl_list_remove(&view->request_fullscreen.link);
-    free(view);
+    wavo_view_destroy(view);
+}
+
+static void view_ping_timeout(struct wl_listener *listener, void *data) {
+    (void)data;
+    struct wavo_view *view = wl_container_of(listener, view, ping_timeout);
+    wavo_watchdog_handle_timeout(view->server->watchdog, view);
 }
 
 static void view_request_move(struct wl_listener *listener, void *data) {
@@ -157,15 +327,20 @@ static void view_request_move(struct wl_listener *listener, void *data) {
     struct wavo_server *server = view->server;
     struct wavo_input *input = server->input;
 
-    if (input->grab_data) {
+    // Nothing is owed for a grab request, a late one would surprise the user
+    if (input->grab_data || !view_take_budget(view, WAVO_BUDGET_CONFIGURE)) {
         return;
     }
 
-    struct wavo_drag_grab *grab = calloc(1, sizeof(struct wavo_drag_grab));
+    struct wavo_drag_grab *grab = wavo_pool_alloc(&server->grab_pool);
+    if (!grab) {
+        return;
+    }
     grab->view = view;
     grab->x = input->cursor->x;
     grab->y = input->cursor->y;
     input->grab_data = grab;
+    wavo_watchdog_ping(server->watchdog, view);
 }
 
 static void view_request_resize(struct wl_listener *listener, void *data) {
@@ -174,11 +349,14 @@ static void view_request_resize(struct wl_listener *listener, void *data) {
     struct wavo_server *server = view->server;
     struct wavo_input *input = server->input;
 
-    if (input->grab_data) {
+    if (input->grab_data || !view_take_budget(view, WAVO_BUDGET_CONFIGURE)) {
         return;
     }
 
-    struct wavo_drag_grab *grab = calloc(1, sizeof(struct wavo_drag_grab));
+    struct wavo_drag_grab *grab = wavo_pool_alloc(&server->grab_pool);
+    if (!grab) {
+        return;
+    }
     grab->view = view;
     grab->x = input->cursor->x;
     grab->y = input->cursor->y;
@@ -190,23 +368,100 @@ static void view_request_resize(struct wl_listener *listener, void *data) {
     grab->geometry = geo;
 
     input->grab_data = grab;
+    wavo_watchdog_ping(server->watchdog, view);
+}
+
+// The protocol requires a configure in reply, so one over budget or for an
+// unresponsive client is sent later instead, a single one for any number of
+// requests
+static void view_schedule_configure(struct wavo_view *view) {
+    if (view->unresponsive) {
+        view->configure_held = true;
+    } else if (view_take_budget(view, WAVO_BUDGET_CONFIGURE)) {
+        wlr_xdg_surface_schedule_configure(view->xdg_surface);
+    } else {
+        wavo_budget_defer(view->server->budgets, view,
+            WAVO_VIEW_DEFER_CONFIGURE);
+    }
 }
 
 static void view_request_maximize(struct wl_listener *listener, void *data) {
     (void)data;
     struct wavo_view *view = wl_container_of(listener, view, request_maximize);
-    wlr_xdg_surface_schedule_configure(view->xdg_surface);
+    view_schedule_configure(view);
 }
 
 static void view_request_fullscreen(struct wl_listener *listener, void *data) {
     (void)data;
     struct wavo_view *view = wl_container_of(listener, view, request_fullscreen);
-    wlr_xdg_surface_schedule_configure(view->xdg_surface);
+    view_schedule_configure(view);
+}
+
+static void view_metadata_changed(struct wavo_view *view) {
+    if (view_take_budget(view, WAVO_BUDGET_METADATA)) {
+        wavo_view_apply_deferred(view, WAVO_VIEW_DEFER_METADATA);
+    } else {
+        wavo_budget_defer(view->server->budgets, view,
+            WAVO_VIEW_DEFER_METADATA);
+    }
+}
+
+static void view_set_title(struct wl_listener *listener, void *data) {
+    (void)data;
+    struct wavo_view *view = wl_container_of(listener, view, set_title);
+    view_metadata_changed(view);
+}
+
+static void view_set_app_id(struct wl_listener *listener, void *data) {
+    (void)data;
+    struct wavo_view *view = wl_container_of(listener, view, set_app_id);
+    view_metadata_changed(view);
+}
+
+void wavo_view_apply_deferred(struct wavo_view *view, uint32_t flags) {
+    if ((flags & WAVO_VIEW_DEFER_OUTPUT) && view->mapped) {
+        wavo_view_update_output(view);
+    }
+    if (flags & WAVO_VIEW_DEFER_METADATA) {
+        wavo_foreign_toplevel_mark_dirty(view);
+    }
+    if ((flags & WAVO_VIEW_DEFER_CONFIGURE) && view->xdg_surface->initialized) {
+        if (view->unresponsive) {
+            view->configure_held = true;
+        } else {
+            wlr_xdg_surface_schedule_configure(view->xdg_surface);
+        }
+    }
+    if (flags & WAVO_VIEW_DEFER_COMMIT) {
+        if (view_take_budget(view, WAVO_BUDGET_COMMIT)) {
+            view_release_commits(view);
+        } else {
+            wavo_budget_defer(view->server->budgets, view,
+                WAVO_VIEW_DEFER_COMMIT);
+        }
+    }
+}
+
+void wavo_view_flush_configure(struct wavo_view *view) {
+    struct wlr_xdg_surface *surface = view->xdg_surface;
+    if (!view->configure_held || view->unresponsive || !surface->initialized) {
+        return;
+    }
+
+    view->configure_held = false;
+    if (view->held_width > 0) {
+        wlr_xdg_toplevel_set_size(surface->toplevel, view->held_width,
+            view->held_height);
+        view->held_width = 0;
+        view->held_height = 0;
+    } else {
+        wlr_xdg_surface_schedule_configure(surface);
+    }
 }
 
 struct wavo_view *wavo_view_create(struct wavo_server *server,
     struct wlr_xdg_surface *xdg_surface) {
-    struct wavo_view *view = calloc(1, sizeof(struct wavo_view));
+    struct wavo_view *view = wavo_pool_alloc(&server->view_pool);
     if (!view) {
         wlr_log(WLR_ERROR, "Failed to allocate view");
         return NULL;
@@ -214,19 +469,39 @@ struct wavo_view *wavo_view_create(struct wavo_server *server,
 
     view->server = server;
     view->xdg_surface = xdg_surface;
-    xdg_surface->data = view;
+    view->id = ++server->next_view_id;
+
+    view->scene_tree = wlr_scene_xdg_surface_create(server->view_tree,
+        xdg_surface);
+    if (!view->scene_tree) {
+        wlr_log(WLR_ERROR, "Failed to create scene tree");
+        wavo_pool_free(&server->view_pool, view);
+        return NULL;
+    }
+    view->scene_tree->node.data = view;
+    // Lets popups find the scene tree to attach to
+    xdg_surface->data = view->scene_tree;
 
     view->map.notify = view_map;
     view->unmap.notify = view_unmap;
+    view->commit.notify = view_commit;
+    view->client_commit.notify = view_client_commit;
     view->destroy.notify = view_destroy;
     view->request_move.notify = view_request_move;
     view->request_resize.notify = view_request_resize;
     view->request_maximize.notify = view_request_maximize;
     view->request_fullscreen.notify = view_request_fullscreen;
-
-    wl_signal_add(&xdg_surface->events.map, &view->map);
-    wl_signal_add(&xdg_surface->events.unmap, &view->unmap);
-    wl_signal_add(&xdg_surface->events.destroy, &view->destroy);
+    view->set_title.notify = view_set_title;
+    view->set_app_id.notify = view_set_app_id;
+    view->ping_timeout.notify = view_ping_timeout;
+    wl_list_init(&view->deferred_link);
+
+    wl_signal_add(&xdg_surface->surface->events.map, &view->map);
+    wl_signal_add(&xdg_surface->surface->events.unmap, &view->unmap);
+    wl_signal_add(&xdg_surface->surface->events.commit, &view->commit);
+    wl_signal_add(&xdg_surface->surface->events.client_commit,
+        &view->client_commit);
+    wl_signal_add(&xdg_surface->toplevel->events.destroy, &view->destroy);
     wl_signal_add(&xdg_surface->toplevel->events.request_move,
         &view->request_move);
     wl_signal_add(&xdg_surface->toplevel->events.request_resize,
@@ -235,6 +510,10 @@ struct wavo_view *wavo_view_create(struct wavo_server *server,
         &view->request_maximize);
     wl_signal_add(&xdg_surface->toplevel->events.request_fullscreen,
         &view->request_fullscreen);
+    wl_signal_add(&xdg_surface->toplevel->events.set_title, &view->set_title);
+    wl_signal_add(&xdg_surface->toplevel->events.set_app_id,
+        &view->set_app_id);
+    wl_signal_add(&xdg_surface->events.ping_timeout, &view->ping_timeout);
 
     return view;
 }
@@ -244,11 +523,81 @@ void wavo_view_destroy(struct wavo_view *view) {
         return;
     }
 
-    if (view->scene_tree) {
-        wlr_scene_node_destroy(&view->scene_tree->node);
+    view_release(view);
+    wl_list_remove(&view->map.link);
+    wl_list_remove(&view->unmap.link);
+    wl_list_remove(&view->commit.link);
+    wl_list_remove(&view->client_commit.link);
+    wl_list_remove(&view->destroy.link);
+    wl_list_remove(&view->request_move.link);
+    wl_list_remove(&view->request_resize.link);
+    wl_list_remove(&view->request_maximize.link);
+    wl_list_remove(&view->request_fullscreen.link);
+    wl_list_remove(&view->set_title.link);
+    wl_list_remove(&view->set_app_id.link);
+    wl_list_remove(&view->ping_timeout.link);
+
+    // With the listeners gone, so the held commits apply to the bare surface
+    wavo_budget_cancel(view);
+    view_release_commits(view);
+
+    // Takes the popup trees below it along
+    view->xdg_surface->data = NULL;
+    wlr_scene_node_destroy(&view->scene_tree->node);
+
+    wavo_thumbnail_destroy(view->thumbnail);
+    wavo_pool_free(&view->server->view_pool, view);
+}
+
+static void popup_commit(struct wl_listener *listener, void *data) {
+    (void)data;
+    struct wavo_popup *popup = wl_container_of(listener, popup, commit);
+
+    // xdg-shell wants a configure in reply to the first commit
+    if (popup->xdg_popup->base->initial_commit) {
+        wlr_xdg_surface_schedule_configure(popup->xdg_popup->base);
+    }
+}
+
+static void popup_destroy(struct wl_listener *listener, void *data) {
+    (void)data;
+    struct wavo_popup *popup = wl_container_of(listener, popup, destroy);
+    wl_list_remove(&popup->commit.link);
+    wl_list_remove(&popup->destroy.link);
+    wavo_pool_free(&popup->server->popup_pool, popup);
+}
+
+struct wavo_popup *wavo_popup_create(struct wavo_server *server,
+    struct wlr_xdg_popup *xdg_popup) {
+    // Parents are toplevels or popups, both keep their tree in data. One
+    // without a tree (parent gone, or not an xdg surface) is never shown.
+    struct wlr_xdg_surface *parent = xdg_popup->parent ?
+        wlr_xdg_surface_try_from_wlr_surface(xdg_popup->parent) : NULL;
+    if (!parent || !parent->data) {
+        return NULL;
+    }
+
+    struct wavo_popup *popup = wavo_pool_alloc(&server->popup_pool);
+    if (!popup) {
+        wlr_log(WLR_ERROR, "Failed to allocate popup: %s", "Out of memory");
+        return NULL;
     }
 
-    free(view);
+    struct wlr_scene_tree *tree = wlr_scene_xdg_surface_create(parent->data,
+        xdg_popup->base);
+    if (!tree) {
+        wavo_pool_free(&server->popup_pool, popup);
+        return NULL;
+    }
+    xdg_popup->base->data = tree;
+
+    popup->xdg_popup = xdg_popup;
+    popup->server = server;
+    popup->commit.notify = popup_commit;
+    wl_signal_add(&xdg_popup->base->surface->events.commit, &popup->commit);
+    popup->destroy.notify = popup_destroy;
+    wl_signal_add(&xdg_popup->events.destroy, &popup->destroy);
+    return popup;
 }
 
 void wavo_view_activate(struct wavo_view *view, bool activate) {
@@ -257,22 +606,82 @@ void wavo_view_activate(struct wavo_view *view, bool activate) {
     }
 
     wlr_xdg_toplevel_set_activated(view->xdg_surface->toplevel, activate);
+    wavo_foreign_toplevel_set_activated(view, activate);
 }
 
 struct wavo_view *wavo_view_from_node(struct wlr_scene_node *node) {
-    if (!node || node->type != WLR_SCENE_NODE_BUFFER) {
-        return NULL;
+    // Surface buffers sit in subsurface and popup trees below the view's
+    // tree, which is the only node carrying data
+    while (node) {
+        if (node->data) {
+            return node->data;
+        }
+        node = node->parent ? &node->parent->node : NULL;
     }
+    return NULL;
+}
 
-    struct wlr_scene_buffer *buffer = wlr_scene_buffer_from_node(node);
-    if (!buffer) {
-        return NULL;
+struct wavo_view *wavo_view_find(struct wavo_server *server, uint32_t id) {
+    struct wavo_view *view;
+    wl_list_for_each(view, &server->views, link) {
+        if (view->id == id) {
+            return view;
+        }
     }
+    return NULL;
+}
 
-    struct wlr_scene_tree *tree = buffer->node.parent;
-    if (!tree) {
-        return NULL;
+void wavo_view_get_box(struct wavo_view *view, struct wlr_box *box) {
+    struct wlr_box geo;
+    wlr_xdg_surface_get_geometry(view->xdg_surface, &geo);
+
+    box->x = view->scene_tree->node.x + geo.x;
+    box->y = view->scene_tree->node.y + geo.y;
+    box->width = geo.width;
+    box->height = geo.height;
+}
+
+void wavo_view_update_output(struct wavo_view *view) {
+    struct wavo_server *server = view->server;
+    struct wlr_box view_box;
+    wavo_view_get_box(view, &view_box);
+
+    struct wavo_output *best = NULL;
+    long best_area = 0;
+
+    struct wavo_output *output;
+    wl_list_for_each(output, &server->outputs, link) {
+        struct wlr_box output_box, intersection;
+        wlr_output_layout_get_box(server->output_layout, output->wlr_output,
+            &output_box);
+        if (!wlr_box_intersection(&intersection, &view_box, &output_box)) {
+            continue;
+        }
+
+        long area = (long)intersection.width * intersection.height;
+        if (area > best_area) {
+            best = output;
+            best_area = area;
+        }
+    }
+
+    struct wavo_output *old_output = view->output;
+    view->output = best;
+    wavo_foreign_toplevel_set_output(view, old_output);
+    if (!best || best->wlr_output->scale == view->scale) {
+        return;
+    }
+
+    // Tell the client the real scale so it renders at native resolution
+    // instead of having the compositor resample its buffer
+    float scale = best->wlr_output->scale;
+    int32_t buffer_scale = (int32_t)scale;
+    if ((float)buffer_scale < scale) {
+        buffer_scale++;
     }
 
-    return tree->node.data;
+    struct wlr_surface *surface = view->xdg_surface->surface;
+    wlr_fractional_scale_v1_notify_scale(surface, scale);
+    wlr_surface_set_preferred_buffer_scale(surface, buffer_scale);
+    view->scale = scale;
 }
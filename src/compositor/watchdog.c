@@ -0,0 +1,200 @@
+#include <inttypes.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <wayland-server-core.h>
+#include <wlr/types/wlr_xdg_shell.h>
+#include <wlr/util/log.h>
+#include "wavo/idle.h"
+#include "wavo/server.h"
+#include "wavo/view.h"
+#include "wavo/watchdog.h"
+
+// Every mapped view's client is pinged this often, unless idle
+#define WATCHDOG_INTERVAL_MSEC 5000
+// A ping not answered within this is missed. Users call an application
+// hung after a second or two; the periodic check needs an answer before the
+// next round.
+#define WATCHDOG_TIMEOUT_MSEC 1500
+// Unresponsive views are pinged again right after a miss, and checked for
+// an answer this often, so they recover long before the next round
+#define WATCHDOG_RECHECK_MSEC (WATCHDOG_TIMEOUT_MSEC / 3)
+
+static pid_t view_pid(struct wavo_view *view) {
+    pid_t pid;
+    wl_client_get_credentials(wl_resource_get_client(
+        view->xdg_surface->resource), &pid, NULL, NULL);
+    return pid;
+}
+
+void wavo_watchdog_ping(struct wavo_watchdog *watchdog,
+    struct wavo_view *view) {
+    if (!watchdog) {
+        return;
+    }
+    // Also collects the answer to a ping left over from going idle
+    if (!watchdog->timer_armed) {
+        wl_event_source_timer_update(watchdog->timer, WATCHDOG_INTERVAL_MSEC);
+        watchdog->timer_armed = true;
+    }
+    if (view->ping_pending) {
+        return;
+    }
+
+    // wlroots keeps one ping per client in flight, its other views share it
+    struct wlr_xdg_client *client = view->xdg_surface->client;
+    if (client->ping_serial == 0) {
+        wlr_xdg_surface_ping(view->xdg_surface);
+        watchdog->pings++;
+    }
+    view->ping_pending = true;
+}
+
+static void watchdog_arm_recheck(struct wavo_watchdog *watchdog,
+    int delay_msec) {
+    if (!watchdog->recheck_armed) {
+        wl_event_source_timer_update(watchdog->recheck, delay_msec);
+        watchdog->recheck_armed = true;
+    }
+}
+
+void wavo_watchdog_handle_timeout(struct wavo_watchdog *watchdog,
+    struct wavo_view *view) {
+    view->ping_pending = false;
+    if (!watchdog) {
+        return;
+    }
+    // wlroots forgets the missed ping only after this returns, the next one
+    // goes out on the following iteration
+    wl_event_source_timer_update(watchdog->recheck, 1);
+    watchdog->recheck_armed = true;
+    if (view->unresponsive) {
+        return;
+    }
+
+    view->unresponsive = true;
+    watchdog->timeouts++;
+    wlr_log(WLR_INFO, "View %" PRIu32 " of client %d is not responding",
+        view->id, (int)view_pid(view));
+}
+
+// An answered ping clears the client's serial without any event, and a
+// missed one has already reset ping_pending through the timeout
+static void watchdog_check(struct wavo_watchdog *watchdog,
+    struct wavo_view *view) {
+    if (!view->ping_pending || view->xdg_surface->client->ping_serial != 0) {
+        return;
+    }
+
+    view->ping_pending = false;
+    if (view->unresponsive) {
+        view->unresponsive = false;
+        watchdog->recovered++;
+        wlr_log(WLR_INFO, "View %" PRIu32 " of client %d responds again",
+            view->id, (int)view_pid(view));
+        wavo_view_flush_configure(view);
+    }
+}
+
+static int watchdog_handle_timer(void *data) {
+    struct wavo_watchdog *watchdog = data;
+    struct wavo_server *server = watchdog->server;
+    watchdog->timer_armed = false;
+
+    // Answers are collected first, so one view's new ping does not look
+    // like an outstanding one to another view of the same client
+    struct wavo_view *view;
+    wl_list_for_each(view, &server->views, link) {
+        watchdog_check(watchdog, view);
+    }
+
+    // An idle compositor sleeps, the next focus change starts over
+    if (server->idle && server->idle->idle) {
+        return 0;
+    }
+    wl_list_for_each(view, &server->views, link) {
+        wavo_watchdog_ping(watchdog, view);
+    }
+    return 0;
+}
+
+static int watchdog_handle_recheck(void *data) {
+    struct wavo_watchdog *watchdog = data;
+    struct wavo_server *server = watchdog->server;
+    watchdog->recheck_armed = false;
+
+    struct wavo_view *view;
+    wl_list_for_each(view, &server->views, link) {
+        watchdog_check(watchdog, view);
+    }
+    if (server->idle && server->idle->idle) {
+        return 0;
+    }
+
+    bool waiting = false;
+    wl_list_for_each(view, &server->views, link) {
+        if (view->unresponsive) {
+            wavo_watchdog_ping(watchdog, view);
+            waiting = true;
+        }
+    }
+    if (waiting) {
+        watchdog_arm_recheck(watchdog, WATCHDOG_RECHECK_MSEC);
+    }
+    return 0;
+}
+
+void wavo_watchdog_print_metrics(struct wavo_watchdog *watchdog, FILE *out) {
+    if (!watchdog) {
+        return;
+    }
+
+    size_t unresponsive = 0;
+    struct wavo_view *view;
+    wl_list_for_each(view, &watchdog->server->views, link) {
+        if (view->unresponsive) {
+            unresponsive++;
+        }
+    }
+    fprintf(out, "watchdog.pings %" PRIu64 "\n", watchdog->pings);
+    fprintf(out, "watchdog.timeouts %" PRIu64 "\n", watchdog->timeouts);
+    fprintf(out, "watchdog.recovered %" PRIu64 "\n", watchdog->recovered);
+    fprintf(out, "watchdog.unresponsive_views %zu\n", unresponsive);
+}
+
+struct wavo_watchdog *wavo_watchdog_create(struct wavo_server *server) {
+    struct wavo_watchdog *watchdog = calloc(1, sizeof(struct wavo_watchdog));
+    if (!watchdog) {
+        wlr_log(WLR_ERROR, "Failed to allocate watchdog: %s", "Out of memory");
+        return NULL;
+    }
+    watchdog->server = server;
+
+    watchdog->timer = wl_event_loop_add_timer(server->event_loop,
+        watchdog_handle_timer, watchdog);
+    watchdog->recheck = wl_event_loop_add_timer(server->event_loop,
+        watchdog_handle_recheck, watchdog);
+    if (!watchdog->timer || !watchdog->recheck) {
+        wlr_log(WLR_ERROR, "%s", "Failed to create watchdog timer");
+        if (watchdog->timer) {
+            wl_event_source_remove(watchdog->timer);
+        }
+        if (watchdog->recheck) {
+            wl_event_source_remove(watchdog->recheck);
+        }
+        free(watchdog);
+        return NULL;
+    }
+
+    server->xdg_shell->ping_timeout = WATCHDOG_TIMEOUT_MSEC;
+    return watchdog;
+}
+
+void wavo_watchdog_destroy(struct wavo_watchdog *watchdog) {
+    if (!watchdog) {
+        return;
+    }
+
+    wl_event_source_remove(watchdog->timer);
+    wl_event_source_remove(watchdog->recheck);
+    free(watchdog);
+}
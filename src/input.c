@@ -6,85 +6,69 @@
 #include <wlr/types/wlr_input_device.h>
 #include <wlr/types/wlr_keyboard.h>
 #include <wlr/types/wlr_pointer.h>
+#include <wlr/types/wlr_virtual_keyboard_v1.h>
+#include <wlr/types/wlr_virtual_pointer_v1.h>
 #include <wlr/util/log.h>
+#include "wavo/idle.h"
 #include "wavo/input.h"
+#include "wavo/latency.h"
+#include "wavo/record.h"
 #include "wavo/server.h"
+#include "wavo/view.h"
 
-// Forward declarations
-static void process_cursor_move(struct wavo_server *server, uint32_t time_msec);
-static void process_cursor_resize(struct wavo_server *server, uint32_t time_msec);
-
-static void keyboard_handle_modifiers(struct wl_listener *listener, void *data) {
-    (void)data;  // Unused parameter
-    struct wavo_keyboard *keyboard = wl_container_of(listener, keyboard, modifiers);
-    struct wlr_keyboard *wlr_keyboard = keyboard->wlr_keyboard;
-
-    wlr_seat_keyboard_notify_modifiers(keyboard->input->seat,
-        &wlr_keyboard->modifiers);
-}
-
-static void keyboard_handle_key(struct wl_listener *listener, void *data) {
-    struct wavo_keyboard *keyboard = wl_container_of(listener, keyboard, key);
-    struct wlr_keyboard_key_event *event = data;
-
-    wlr_seat_keyboard_notify_key(keyboard->input->seat, event->time_msec,
-        event->keycode, event->state);
-}
-
-static void keyboard_handle_destroy(struct wl_listener *listener, void *data) {
-    (void)data;  // Unused parameter
-    struct wavo_keyboard *keyboard = wl_container_of(listener, keyboard, destroy);
-
-    wl_list_remove(&keyboard->modifiers.link);
-    wl_list_remove(&keyboard->key.link);
-    wl_list_remove(&keyboard->destroy.link);
-    wl_list_remove(&keyboard->link);
-    free(keyboard);
+static void pointer_destroy(struct wavo_pointer *pointer) {
+    wl_list_remove(&pointer->destroy.link);
+    wl_list_remove(&pointer->link);
+    wavo_pool_free(&pointer->input->server->pointer_pool, pointer);
 }
 
 static void pointer_handle_destroy(struct wl_listener *listener, void *data) {
     (void)data;  // Unused parameter
     struct wavo_pointer *pointer = wl_container_of(listener, pointer, destroy);
-
-    wl_list_remove(&pointer->destroy.link);
-    wl_list_remove(&pointer->link);
-    free(pointer);
+    pointer_destroy(pointer);
 }
 
 static void handle_cursor_motion(struct wl_listener *listener, void *data) {
     struct wavo_input *input = wl_container_of(listener, input, cursor_motion);
     struct wlr_pointer_motion_event *event = data;
 
-    wlr_cursor_move(input->cursor, &event->pointer->base, event->delta_x, event->delta_y);
-
-    if (input->grab_data) {
-        process_cursor_move(input->server, event->time_msec);
-        return;
-    }
-
-    wlr_seat_pointer_notify_motion(input->seat, event->time_msec, 
-        input->cursor->x, input->cursor->y);
+    wavo_latency_note_input(input->server, event->time_msec);
+    wavo_idle_notify_activity(input->server->idle);
+    wavo_record_motion(input->server->recorder, event->time_msec,
+        event->delta_x, event->delta_y, event->unaccel_dx, event->unaccel_dy);
+    wavo_pointer_motion(input, &event->pointer->base, event->time_msec,
+        event->delta_x, event->delta_y, event->unaccel_dx, event->unaccel_dy);
 }
 
 static void handle_cursor_motion_absolute(struct wl_listener *listener, void *data) {
     struct wavo_input *input = wl_container_of(listener, input, cursor_motion_absolute);
     struct wlr_pointer_motion_absolute_event *event = data;
 
-    wlr_cursor_warp_absolute(input->cursor, &event->pointer->base, event->x, event->y);
-
-    if (input->grab_data) {
-        process_cursor_move(input->server, event->time_msec);
-        return;
-    }
-
-    wlr_seat_pointer_notify_motion(input->seat, event->time_msec,
-        input->cursor->x, input->cursor->y);
+    wavo_latency_note_input(input->server, event->time_msec);
+    wavo_idle_notify_activity(input->server->idle);
+
+    // Same path as relative motion, so constraints apply to tablets and VMs
+    double lx, ly;
+    wlr_cursor_absolute_to_layout_coords(input->cursor, &event->pointer->base,
+        event->x, event->y, &lx, &ly);
+    double dx = lx - input->cursor->x;
+    double dy = ly - input->cursor->y;
+    wavo_record_motion(input->server->recorder, event->time_msec, dx, dy,
+        dx, dy);
+    wavo_pointer_motion(input, &event->pointer->base, event->time_msec,
+        dx, dy, dx, dy);
 }
 
 static void handle_cursor_button(struct wl_listener *listener, void *data) {
     struct wavo_input *input = wl_container_of(listener, input, cursor_button);
     struct wlr_pointer_button_event *event = data;
 
+    wavo_latency_note_input(input->server, event->time_msec);
+    wavo_idle_notify_activity(input->server->idle);
+    wavo_record_button(input->server->recorder, event->time_msec,
+        event->button, event->state);
+    wavo_view_handle_button(input->server,
+        event->state == WL_POINTER_BUTTON_STATE_PRESSED);
     wlr_seat_pointer_notify_button(input->seat, event->time_msec,
         event->button, event->state);
 }
@@ -93,6 +77,11 @@ static void handle_cursor_axis(struct wl_listener *listener, void *data) {
     struct wavo_input *input = wl_container_of(listener, input, cursor_axis);
     struct wlr_pointer_axis_event *event = data;
 
+    wavo_latency_note_input(input->server, event->time_msec);
+    wavo_idle_notify_activity(input->server->idle);
+    wavo_record_axis(input->server->recorder, event->time_msec,
+        event->orientation, event->source, event->relative_direction,
+        event->delta, event->delta_discrete);
     wlr_seat_pointer_notify_axis(input->seat, event->time_msec,
         event->orientation, event->delta, event->delta_discrete, event->source,
         event->relative_direction);
@@ -101,44 +90,19 @@ static void handle_cursor_axis(struct wl_listener *listener, void *data) {
 static void handle_cursor_frame(struct wl_listener *listener, void *data) {
     (void)data;  // Unused parameter
     struct wavo_input *input = wl_container_of(listener, input, cursor_frame);
+    wavo_record_pointer_frame(input->server->recorder);
     wlr_seat_pointer_notify_frame(input->seat);
 }
 
-static void handle_new_input(struct wl_listener *listener, void *data) {
-    struct wavo_input *input = wl_container_of(listener, input, new_input);
-    struct wlr_input_device *device = data;
-
+void wavo_input_add_device(struct wavo_input *input,
+    struct wlr_input_device *device) {
     switch (device->type) {
-    case WLR_INPUT_DEVICE_KEYBOARD: {
-        struct wavo_keyboard *keyboard = calloc(1, sizeof(struct wavo_keyboard));
-        if (!keyboard) {
-            wlr_log(WLR_ERROR, "Failed to allocate keyboard: %s", "Out of memory");
-            return;
-        }
-
-        keyboard->input = input;
-        keyboard->device = device;
-        keyboard->wlr_keyboard = wlr_keyboard_from_input_device(device);
-
-        keyboard->modifiers.notify = keyboard_handle_modifiers;
-        wl_signal_add(&keyboard->wlr_keyboard->events.modifiers,
-            &keyboard->modifiers);
-
-        keyboard->key.notify = keyboard_handle_key;
-        wl_signal_add(&keyboard->wlr_keyboard->events.key, &keyboard->key);
-
-        keyboard->destroy.notify = keyboard_handle_destroy;
-        wl_signal_add(&device->events.destroy, &keyboard->destroy);
-
-        wlr_keyboard_set_repeat_info(keyboard->wlr_keyboard, 25, 600);
-
-        wl_list_insert(&input->keyboards, &keyboard->link);
-
-        wlr_seat_set_keyboard(input->seat, keyboard->wlr_keyboard);
+    case WLR_INPUT_DEVICE_KEYBOARD:
+        wavo_keyboard_create(input, device);
         break;
-    }
     case WLR_INPUT_DEVICE_POINTER: {
-        struct wavo_pointer *pointer = calloc(1, sizeof(struct wavo_pointer));
+        struct wavo_pointer *pointer =
+            wavo_pool_alloc(&input->server->pointer_pool);
         if (!pointer) {
             wlr_log(WLR_ERROR, "Failed to allocate pointer: %s", "Out of memory");
             return;
@@ -168,6 +132,34 @@ static void handle_new_input(struct wl_listener *listener, void *data) {
     wlr_seat_set_capabilities(input->seat, caps);
 }
 
+static void handle_new_input(struct wl_listener *listener, void *data) {
+    struct wavo_input *input = wl_container_of(listener, input, new_input);
+    wavo_input_add_device(input, data);
+}
+
+static void handle_new_virtual_keyboard(struct wl_listener *listener,
+    void *data) {
+    struct wavo_input *input =
+        wl_container_of(listener, input, new_virtual_keyboard);
+    struct wlr_virtual_keyboard_v1 *keyboard = data;
+
+    wavo_input_add_device(input, &keyboard->keyboard.base);
+}
+
+static void handle_new_virtual_pointer(struct wl_listener *listener,
+    void *data) {
+    struct wavo_input *input =
+        wl_container_of(listener, input, new_virtual_pointer);
+    struct wlr_virtual_pointer_v1_new_pointer_event *event = data;
+    struct wlr_input_device *device = &event->new_pointer->pointer.base;
+
+    wavo_input_add_device(input, device);
+    if (event->suggested_output) {
+        wlr_cursor_map_input_to_output(input->cursor, device,
+            event->suggested_output);
+    }
+}
+
 struct wavo_input *wavo_input_create(struct wavo_server *server) {
     struct wavo_input *input = calloc(1, sizeof(struct wavo_input));
     if (!input) {
@@ -203,11 +195,44 @@ struct wavo_input *wavo_input_create(struct wavo_server *server) {
     }
 
     wl_list_init(&input->keyboards);
+    wl_list_init(&input->keyboard_groups);
     wl_list_init(&input->pointers);
 
+    if (!wavo_input_init_keymap(input) || !wavo_input_init_pointer(input)) {
+        wavo_input_finish_keymap(input);
+        wlr_xcursor_manager_destroy(input->cursor_mgr);
+        wlr_cursor_destroy(input->cursor);
+        wlr_seat_destroy(input->seat);
+        free(input);
+        return NULL;
+    }
+
     input->new_input.notify = handle_new_input;
     wl_signal_add(&server->backend->events.new_input, &input->new_input);
 
+    // Synthetic input for headless benchmarks, handled like real devices
+    struct wlr_virtual_keyboard_manager_v1 *virtual_keyboard_mgr =
+        wlr_virtual_keyboard_manager_v1_create(server->wl_display);
+    if (virtual_keyboard_mgr) {
+        input->new_virtual_keyboard.notify = handle_new_virtual_keyboard;
+        wl_signal_add(&virtual_keyboard_mgr->events.new_virtual_keyboard,
+            &input->new_virtual_keyboard);
+    } else {
+        wlr_log(WLR_ERROR, "%s", "Failed to create virtual keyboard manager");
+        wl_list_init(&input->new_virtual_keyboard.link);
+    }
+
+    struct wlr_virtual_pointer_manager_v1 *virtual_pointer_mgr =
+        wlr_virtual_pointer_manager_v1_create(server->wl_display);
+    if (virtual_pointer_mgr) {
+        input->new_virtual_pointer.notify = handle_new_virtual_pointer;
+        wl_signal_add(&virtual_pointer_mgr->events.new_virtual_pointer,
+            &input->new_virtual_pointer);
+    } else {
+        wlr_log(WLR_ERROR, "%s", "Failed to create virtual pointer manager");
+        wl_list_init(&input->new_virtual_pointer.link);
+    }
+
     input->cursor_motion.notify = handle_cursor_motion;
     wl_signal_add(&input->cursor->events.motion, &input->cursor_motion);
 
@@ -233,14 +258,28 @@ void wavo_input_destroy(struct wavo_input *input) {
     }
 
     wl_list_remove(&input->new_input.link);
+    wl_list_remove(&input->new_virtual_keyboard.link);
+    wl_list_remove(&input->new_virtual_pointer.link);
     wl_list_remove(&input->cursor_motion.link);
     wl_list_remove(&input->cursor_motion_absolute.link);
     wl_list_remove(&input->cursor_button.link);
     wl_list_remove(&input->cursor_axis.link);
     wl_list_remove(&input->cursor_frame.link);
+    wavo_input_finish_pointer(input);
+
+    // Devices outlive us until the backend is destroyed
+    struct wavo_keyboard *keyboard, *keyboard_tmp;
+    wl_list_for_each_safe(keyboard, keyboard_tmp, &input->keyboards, link) {
+        wavo_keyboard_destroy(keyboard);
+    }
+    struct wavo_pointer *pointer, *pointer_tmp;
+    wl_list_for_each_safe(pointer, pointer_tmp, &input->pointers, link) {
+        pointer_destroy(pointer);
+    }
 
     wlr_xcursor_manager_destroy(input->cursor_mgr);
     wlr_cursor_destroy(input->cursor);
     wlr_seat_destroy(input->seat);
+    wavo_input_finish_keymap(input);
     free(input);
 }
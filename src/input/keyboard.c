@@ -1,6 +1,291 @@
+#define _POSIX_C_SOURCE 200809L
+#include <inttypes.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <wayland-server-core.h>
 #include <wlr/types/wlr_keyboard.h>
+#include <wlr/types/wlr_keyboard_group.h>
 #include <wlr/types/wlr_input_device.h>
+#include <wlr/types/wlr_seat.h>
+#include <wlr/types/wlr_virtual_keyboard_v1.h>
+#include <wlr/util/log.h>
 #include <xkbcommon/xkbcommon.h>
+#include "wavo/config.h"
+#include "wavo/idle.h"
+#include "wavo/input.h"
+#include "wavo/keymap.h"
+#include "wavo/latency.h"
+#include "wavo/record.h"
+#include "wavo/server.h"
 
-// Placeholder for keyboard implementation
-// TODO: Implement keyboard handling
+// Only switching between groups makes clients receive a different keymap
+static void keyboard_activate(struct wavo_input *input,
+    struct wlr_keyboard *wlr_keyboard) {
+    if (wlr_seat_get_keyboard(input->seat) != wlr_keyboard) {
+        wlr_seat_set_keyboard(input->seat, wlr_keyboard);
+        input->seat_keyboard_switches++;
+    }
+}
+
+static void keyboard_notify_modifiers(struct wavo_input *input,
+    struct wlr_keyboard *wlr_keyboard) {
+    keyboard_activate(input, wlr_keyboard);
+    wlr_seat_keyboard_notify_modifiers(input->seat, &wlr_keyboard->modifiers);
+}
+
+static void keyboard_notify_key(struct wavo_input *input,
+    struct wlr_keyboard *wlr_keyboard, struct wlr_keyboard_key_event *event) {
+    wavo_latency_note_input(input->server, event->time_msec);
+    wavo_idle_notify_activity(input->server->idle);
+    wavo_record_key(input->server->recorder, event->time_msec,
+        event->keycode, event->state);
+    keyboard_activate(input, wlr_keyboard);
+    wlr_seat_keyboard_notify_key(input->seat, event->time_msec,
+        event->keycode, event->state);
+}
+
+static void keyboard_group_handle_modifiers(struct wl_listener *listener,
+    void *data) {
+    (void)data;  // Unused parameter
+    struct wavo_keyboard_group *group =
+        wl_container_of(listener, group, modifiers);
+    keyboard_notify_modifiers(group->input, &group->wlr_group->keyboard);
+}
+
+static void keyboard_group_handle_key(struct wl_listener *listener, void *data) {
+    struct wavo_keyboard_group *group = wl_container_of(listener, group, key);
+    keyboard_notify_key(group->input, &group->wlr_group->keyboard, data);
+}
+
+static void keyboard_handle_modifiers(struct wl_listener *listener, void *data) {
+    (void)data;  // Unused parameter
+    struct wavo_keyboard *keyboard = wl_container_of(listener, keyboard, modifiers);
+    keyboard_notify_modifiers(keyboard->input, keyboard->wlr_keyboard);
+}
+
+static void keyboard_handle_key(struct wl_listener *listener, void *data) {
+    struct wavo_keyboard *keyboard = wl_container_of(listener, keyboard, key);
+    keyboard_notify_key(keyboard->input, keyboard->wlr_keyboard, data);
+}
+
+static bool keymaps_match(struct xkb_keymap *a, struct xkb_keymap *b) {
+    // Keyboards normally share the configured keymap, skip serializing it
+    return a == b || wlr_keyboard_keymaps_match(a, b);
+}
+
+static struct wavo_keyboard_group *keyboard_group_create(
+    struct wavo_input *input, struct wlr_keyboard *template) {
+    struct wavo_keyboard_group *group =
+        calloc(1, sizeof(struct wavo_keyboard_group));
+    if (!group) {
+        wlr_log(WLR_ERROR, "Failed to allocate keyboard group: %s",
+            "Out of memory");
+        return NULL;
+    }
+
+    group->wlr_group = wlr_keyboard_group_create();
+    if (!group->wlr_group) {
+        wlr_log(WLR_ERROR, "%s", "Failed to create keyboard group");
+        free(group);
+        return NULL;
+    }
+
+    group->input = input;
+    group->wlr_group->data = group;
+    wlr_keyboard_set_keymap(&group->wlr_group->keyboard, template->keymap);
+    wlr_keyboard_set_repeat_info(&group->wlr_group->keyboard,
+        template->repeat_info.rate, template->repeat_info.delay);
+
+    group->modifiers.notify = keyboard_group_handle_modifiers;
+    wl_signal_add(&group->wlr_group->keyboard.events.modifiers,
+        &group->modifiers);
+
+    group->key.notify = keyboard_group_handle_key;
+    wl_signal_add(&group->wlr_group->keyboard.events.key, &group->key);
+
+    wl_list_insert(&input->keyboard_groups, &group->link);
+    return group;
+}
+
+static void keyboard_group_destroy(struct wavo_keyboard_group *group) {
+    struct wavo_input *input = group->input;
+
+    if (wlr_seat_get_keyboard(input->seat) == &group->wlr_group->keyboard) {
+        struct wlr_keyboard *next = NULL;
+        struct wavo_keyboard_group *other;
+        wl_list_for_each(other, &input->keyboard_groups, link) {
+            if (other != group) {
+                next = &other->wlr_group->keyboard;
+                break;
+            }
+        }
+        wlr_seat_set_keyboard(input->seat, next);
+        input->seat_keyboard_switches++;
+    }
+
+    wl_list_remove(&group->modifiers.link);
+    wl_list_remove(&group->key.link);
+    wl_list_remove(&group->link);
+    wlr_keyboard_group_destroy(group->wlr_group);
+    free(group);
+}
+
+static bool keyboard_join_group(struct wavo_keyboard *keyboard) {
+    struct wavo_input *input = keyboard->input;
+    struct wlr_keyboard *wlr_keyboard = keyboard->wlr_keyboard;
+
+    struct wavo_keyboard_group *group;
+    wl_list_for_each(group, &input->keyboard_groups, link) {
+        struct wlr_keyboard *group_keyboard = &group->wlr_group->keyboard;
+        if (group_keyboard->repeat_info.rate != wlr_keyboard->repeat_info.rate ||
+                group_keyboard->repeat_info.delay !=
+                    wlr_keyboard->repeat_info.delay ||
+                !keymaps_match(group_keyboard->keymap, wlr_keyboard->keymap)) {
+            continue;
+        }
+        if (wlr_keyboard_group_add_keyboard(group->wlr_group, wlr_keyboard)) {
+            keyboard->group = group;
+            return true;
+        }
+    }
+
+    // A real keymap difference, the seat switches once it is typed on
+    group = keyboard_group_create(input, wlr_keyboard);
+    if (!group) {
+        return false;
+    }
+    if (!wlr_keyboard_group_add_keyboard(group->wlr_group, wlr_keyboard)) {
+        wlr_log(WLR_ERROR, "%s", "Failed to add keyboard to its group");
+        keyboard_group_destroy(group);
+        return false;
+    }
+    keyboard->group = group;
+
+    if (!wlr_seat_get_keyboard(input->seat)) {
+        keyboard_activate(input, &group->wlr_group->keyboard);
+    }
+    return true;
+}
+
+void wavo_keyboard_destroy(struct wavo_keyboard *keyboard) {
+    struct wavo_keyboard_group *group = keyboard->group;
+
+    if (!group) {
+        wl_list_remove(&keyboard->modifiers.link);
+        wl_list_remove(&keyboard->key.link);
+    } else {
+        // Already done by the group's own listener when the device goes away
+        if (keyboard->wlr_keyboard->group) {
+            wlr_keyboard_group_remove_keyboard(group->wlr_group,
+                keyboard->wlr_keyboard);
+        }
+        if (wl_list_empty(&group->wlr_group->devices)) {
+            keyboard_group_destroy(group);
+        }
+    }
+
+    wl_list_remove(&keyboard->destroy.link);
+    wl_list_remove(&keyboard->link);
+    wavo_pool_free(&keyboard->input->server->keyboard_pool, keyboard);
+}
+
+static void keyboard_handle_destroy(struct wl_listener *listener, void *data) {
+    (void)data;  // Unused parameter
+    struct wavo_keyboard *keyboard = wl_container_of(listener, keyboard, destroy);
+    wavo_keyboard_destroy(keyboard);
+}
+
+struct wavo_keyboard *wavo_keyboard_create(struct wavo_input *input,
+    struct wlr_input_device *device) {
+    struct wavo_keyboard *keyboard =
+        wavo_pool_alloc(&input->server->keyboard_pool);
+    if (!keyboard) {
+        wlr_log(WLR_ERROR, "Failed to allocate keyboard: %s", "Out of memory");
+        return NULL;
+    }
+
+    keyboard->input = input;
+    keyboard->device = device;
+    keyboard->wlr_keyboard = wlr_keyboard_from_input_device(device);
+
+    if (wlr_input_device_get_virtual_keyboard(device)) {
+        // The client sends its own keymap. A keyboard group would copy it
+        // onto every physical keyboard, so dispatch this one on its own.
+        keyboard->modifiers.notify = keyboard_handle_modifiers;
+        wl_signal_add(&keyboard->wlr_keyboard->events.modifiers,
+            &keyboard->modifiers);
+
+        keyboard->key.notify = keyboard_handle_key;
+        wl_signal_add(&keyboard->wlr_keyboard->events.key, &keyboard->key);
+    } else {
+        // Every keyboard shares the keymap compiled at startup, hotplug only
+        // serializes it for clients
+        struct wavo_config *config = input->server->config;
+        if (input->keymap) {
+            wlr_keyboard_set_keymap(keyboard->wlr_keyboard, input->keymap);
+        }
+        wlr_keyboard_set_repeat_info(keyboard->wlr_keyboard,
+            config->repeat_rate, config->repeat_delay);
+
+        if (!keyboard_join_group(keyboard)) {
+            wavo_pool_free(&input->server->keyboard_pool, keyboard);
+            return NULL;
+        }
+    }
+
+    keyboard->destroy.notify = keyboard_handle_destroy;
+    wl_signal_add(&device->events.destroy, &keyboard->destroy);
+
+    wl_list_insert(&input->keyboards, &keyboard->link);
+    return keyboard;
+}
+
+bool wavo_input_init_keymap(struct wavo_input *input) {
+    input->xkb_context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
+    if (!input->xkb_context) {
+        wlr_log(WLR_ERROR, "%s", "Failed to create XKB context");
+        return false;
+    }
+
+    const struct wavo_keyboard_config *config =
+        &input->server->config->keyboard;
+    struct xkb_rule_names names = {
+        .rules = config->rules,
+        .model = config->model,
+        .layout = config->layout,
+        .variant = config->variant,
+        .options = config->options,
+    };
+
+    char cache_dir[PATH_MAX];
+    bool use_cache = wavo_keymap_cache_dir(cache_dir, sizeof(cache_dir));
+
+    uint64_t start = wavo_latency_now_usec();
+    bool cache_hit = false;
+    input->keymap = wavo_keymap_load(input->xkb_context, &names,
+        use_cache ? cache_dir : NULL, &cache_hit);
+    if (!input->keymap) {
+        wlr_log(WLR_ERROR, "Failed to compile keymap for layout '%s', "
+            "using defaults", config->layout ? config->layout : "");
+        input->keymap = wavo_keymap_load(input->xkb_context, NULL,
+            use_cache ? cache_dir : NULL, &cache_hit);
+    }
+    if (!input->keymap) {
+        wlr_log(WLR_ERROR, "%s", "Failed to compile default keymap");
+        xkb_context_unref(input->xkb_context);
+        input->xkb_context = NULL;
+        return false;
+    }
+
+    wlr_log(WLR_INFO, "Keymap %s in %" PRIu64 "us",
+        cache_hit ? "loaded from cache" : "compiled",
+        wavo_latency_now_usec() - start);
+    return true;
+}
+
+void wavo_input_finish_keymap(struct wavo_input *input) {
+    xkb_keymap_unref(input->keymap);
+    xkb_context_unref(input->xkb_context);
+    input->keymap = NULL;
+    input->xkb_context = NULL;
+}
@@ -0,0 +1,231 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <wlr/util/log.h>
+#include <xkbcommon/xkbcommon.h>
+#include "wavo/keymap.h"
+
+#define FNV_OFFSET 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+
+// xkbcommon's built-in default when neither the names nor the environment
+// pick a rules file
+#define DEFAULT_RULES "evdev"
+
+// Names with the same fallbacks xkb_keymap_new_from_names() applies, so the
+// cache key does not depend on how a default was chosen
+struct resolved_names {
+    const char *rules;
+    const char *model;
+    const char *layout;
+    const char *variant;
+    const char *options;
+};
+
+static const char *resolve(const char *value, const char *env) {
+    if (value && value[0] != '\0') {
+        return value;
+    }
+    const char *env_value = getenv(env);
+    return env_value ? env_value : "";
+}
+
+static void resolve_names(const struct xkb_rule_names *names,
+    struct resolved_names *out) {
+    out->rules = resolve(names ? names->rules : NULL, "XKB_DEFAULT_RULES");
+    out->model = resolve(names ? names->model : NULL, "XKB_DEFAULT_MODEL");
+    out->layout = resolve(names ? names->layout : NULL, "XKB_DEFAULT_LAYOUT");
+    out->variant = resolve(names ? names->variant : NULL,
+        "XKB_DEFAULT_VARIANT");
+    out->options = resolve(names ? names->options : NULL,
+        "XKB_DEFAULT_OPTIONS");
+}
+
+static uint64_t hash_bytes(uint64_t hash, const void *data, size_t len) {
+    const unsigned char *bytes = data;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= bytes[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+static uint64_t hash_string(uint64_t hash, const char *str) {
+    // Include the terminator so ("ab", "") and ("a", "b") differ
+    return hash_bytes(hash, str, strlen(str) + 1);
+}
+
+uint64_t wavo_keymap_cache_key(struct xkb_context *context,
+    const struct xkb_rule_names *names) {
+    struct resolved_names resolved;
+    resolve_names(names, &resolved);
+
+    uint64_t hash = FNV_OFFSET;
+    hash = hash_string(hash, resolved.rules);
+    hash = hash_string(hash, resolved.model);
+    hash = hash_string(hash, resolved.layout);
+    hash = hash_string(hash, resolved.variant);
+    hash = hash_string(hash, resolved.options);
+
+    // Package updates to the XKB data touch the rules files
+    const char *rules = resolved.rules[0] != '\0' ?
+        resolved.rules : DEFAULT_RULES;
+    unsigned int paths = xkb_context_num_include_paths(context);
+    for (unsigned int i = 0; i < paths; i++) {
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s/rules/%s",
+            xkb_context_include_path_get(context, i), rules);
+
+        struct stat st;
+        if (stat(path, &st) == 0) {
+            hash = hash_string(hash, path);
+            hash = hash_bytes(hash, &st.st_mtim, sizeof(st.st_mtim));
+        }
+    }
+
+    return hash;
+}
+
+bool wavo_keymap_cache_dir(char *path, size_t size) {
+    int len;
+    const char *cache_home = getenv("XDG_CACHE_HOME");
+    if (cache_home && cache_home[0] != '\0') {
+        len = snprintf(path, size, "%s/wavo/keymaps", cache_home);
+    } else {
+        const char *home = getenv("HOME");
+        if (!home) {
+            return false;
+        }
+        len = snprintf(path, size, "%s/.cache/wavo/keymaps", home);
+    }
+    return len > 0 && (size_t)len < size;
+}
+
+static bool mkdir_parents(const char *dir) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s", dir);
+
+    for (char *p = path + 1; *p; p++) {
+        if (*p != '/') {
+            continue;
+        }
+        *p = '\0';
+        if (mkdir(path, 0700) != 0 && errno != EEXIST) {
+            return false;
+        }
+        *p = '/';
+    }
+    return mkdir(path, 0700) == 0 || errno == EEXIST;
+}
+
+// First line of every cache file. Guards against hash collisions, XKB
+// treats it as a comment.
+static void format_header(char *header, size_t size, uint64_t key,
+    const struct resolved_names *names) {
+    snprintf(header, size, "// wavo-keymap %016" PRIx64 " %s:%s:%s:%s:%s\n",
+        key, names->rules, names->model, names->layout, names->variant,
+        names->options);
+}
+
+static char *read_file(const char *path) {
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        return NULL;
+    }
+
+    char *data = NULL;
+    struct stat st;
+    if (fstat(fileno(file), &st) == 0 && st.st_size > 0) {
+        data = malloc((size_t)st.st_size + 1);
+        if (data && fread(data, 1, (size_t)st.st_size, file) ==
+                (size_t)st.st_size) {
+            data[st.st_size] = '\0';
+        } else {
+            free(data);
+            data = NULL;
+        }
+    }
+
+    fclose(file);
+    return data;
+}
+
+static struct xkb_keymap *cache_read(struct xkb_context *context,
+    const char *path, const char *header) {
+    char *data = read_file(path);
+    if (!data) {
+        return NULL;
+    }
+
+    struct xkb_keymap *keymap = NULL;
+    if (strncmp(data, header, strlen(header)) == 0) {
+        keymap = xkb_keymap_new_from_string(context, data,
+            XKB_KEYMAP_FORMAT_TEXT_V1, XKB_KEYMAP_COMPILE_NO_FLAGS);
+    }
+    free(data);
+    return keymap;
+}
+
+static void cache_write(struct xkb_keymap *keymap, const char *cache_dir,
+    const char *path, const char *header) {
+    char *text = xkb_keymap_get_as_string(keymap, XKB_KEYMAP_FORMAT_TEXT_V1);
+    if (!text) {
+        return;
+    }
+
+    // Write then rename, so concurrent startups never see a partial file
+    char tmp_path[PATH_MAX];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.%d.tmp", path, (int)getpid());
+
+    FILE *file = NULL;
+    if (mkdir_parents(cache_dir)) {
+        file = fopen(tmp_path, "w");
+    }
+    if (!file) {
+        wlr_log(WLR_INFO, "Cannot write keymap cache in %s", cache_dir);
+        free(text);
+        return;
+    }
+
+    bool ok = fputs(header, file) >= 0 && fputs(text, file) >= 0;
+    ok = fclose(file) == 0 && ok;
+    if (!ok || rename(tmp_path, path) != 0) {
+        unlink(tmp_path);
+    }
+    free(text);
+}
+
+struct xkb_keymap *wavo_keymap_load(struct xkb_context *context,
+    const struct xkb_rule_names *names, const char *cache_dir,
+    bool *cache_hit) {
+    *cache_hit = false;
+
+    char path[PATH_MAX];
+    char header[1024];
+    if (cache_dir) {
+        struct resolved_names resolved;
+        resolve_names(names, &resolved);
+        uint64_t key = wavo_keymap_cache_key(context, names);
+        format_header(header, sizeof(header), key, &resolved);
+        snprintf(path, sizeof(path), "%s/%016" PRIx64 ".xkb", cache_dir, key);
+
+        struct xkb_keymap *keymap = cache_read(context, path, header);
+        if (keymap) {
+            *cache_hit = true;
+            return keymap;
+        }
+    }
+
+    struct xkb_keymap *keymap = xkb_keymap_new_from_names(context, names,
+        XKB_KEYMAP_COMPILE_NO_FLAGS);
+    if (keymap && cache_dir) {
+        cache_write(keymap, cache_dir, path, header);
+    }
+    return keymap;
+}
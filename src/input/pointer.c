@@ -1,5 +1,281 @@
-#include <wlr/types/wlr_pointer.h>
+#include <stdlib.h>
+#include <pixman.h>
+#include <wayland-server-core.h>
+#include <wlr/types/wlr_compositor.h>
+#include <wlr/types/wlr_cursor.h>
 #include <wlr/types/wlr_input_device.h>
+#include <wlr/types/wlr_pointer.h>
+#include <wlr/types/wlr_pointer_constraints_v1.h>
+#include <wlr/types/wlr_relative_pointer_v1.h>
+#include <wlr/types/wlr_scene.h>
+#include <wlr/types/wlr_seat.h>
+#include <wlr/types/wlr_xcursor_manager.h>
+#include <wlr/types/wlr_xdg_shell.h>
+#include <wlr/util/log.h>
+#include <wlr/util/region.h>
+#include "wavo/input.h"
+#include "wavo/server.h"
+#include "wavo/view.h"
+
+static struct wlr_surface *surface_at(struct wavo_input *input,
+    double lx, double ly, double *sx, double *sy) {
+    struct wlr_scene_node *node = wlr_scene_node_at(
+        &input->server->scene->tree.node, lx, ly, sx, sy);
+    if (!node || node->type != WLR_SCENE_NODE_BUFFER) {
+        return NULL;
+    }
+
+    struct wlr_scene_surface *scene_surface =
+        wlr_scene_surface_try_from_buffer(wlr_scene_buffer_from_node(node));
+    return scene_surface ? scene_surface->surface : NULL;
+}
+
+// Refreshes the layout position of the constraint's surface, which moves
+// with its view. Subsurfaces keep the position found on activation.
+static void pointer_update_constraint_origin(struct wavo_input *input,
+    struct wlr_pointer_constraint_v1 *constraint) {
+    struct wlr_xdg_surface *xdg_surface =
+        wlr_xdg_surface_try_from_wlr_surface(constraint->surface);
+    int x, y;
+    if (!xdg_surface || !xdg_surface->data ||
+            !wlr_scene_node_coords(
+                &((struct wlr_scene_tree *)xdg_surface->data)->node, &x, &y)) {
+        return;
+    }
+
+    // The scene tree sits at the window geometry, not the surface origin
+    input->constraint_x = x - xdg_surface->current.geometry.x;
+    input->constraint_y = y - xdg_surface->current.geometry.y;
+}
+
+static void pointer_warp_to_hint(struct wavo_input *input,
+    struct wlr_pointer_constraint_v1 *constraint) {
+    if (constraint->type != WLR_POINTER_CONSTRAINT_V1_LOCKED ||
+            !constraint->current.cursor_hint.enabled) {
+        return;
+    }
+
+    pointer_update_constraint_origin(input, constraint);
+
+    double lx = input->constraint_x + constraint->current.cursor_hint.x;
+    double ly = input->constraint_y + constraint->current.cursor_hint.y;
+    wlr_cursor_warp(input->cursor, NULL, lx, ly);
+}
+
+static void pointer_constrain(struct wavo_input *input,
+    struct wlr_pointer_constraint_v1 *constraint) {
+    struct wlr_pointer_constraint_v1 *active = input->active_constraint;
+    if (active == constraint) {
+        return;
+    }
+
+    if (active) {
+        pointer_warp_to_hint(input, active);
+        wlr_pointer_constraint_v1_send_deactivated(active);
+    }
+
+    input->active_constraint = constraint;
+    if (constraint) {
+        wlr_pointer_constraint_v1_send_activated(constraint);
+    }
+}
+
+// Activates the constraint of the focused surface once the pointer is inside
+// its region. sx, sy are the surface-local pointer position.
+static void pointer_check_constraint(struct wavo_input *input,
+    struct wlr_surface *surface, double sx, double sy) {
+    struct wlr_pointer_constraint_v1 *constraint =
+        wlr_pointer_constraints_v1_constraint_for_surface(
+            input->pointer_constraints, surface, input->seat);
+    if (!constraint || !pixman_region32_contains_point(&constraint->region,
+            (int)sx, (int)sy, NULL)) {
+        return;
+    }
+
+    input->constraint_x = input->cursor->x - sx;
+    input->constraint_y = input->cursor->y - sy;
+    pointer_constrain(input, constraint);
+}
+
+void wavo_pointer_update_focus(struct wavo_input *input, uint32_t time_msec) {
+    double sx, sy;
+    struct wlr_surface *surface = surface_at(input, input->cursor->x,
+        input->cursor->y, &sx, &sy);
+    if (!surface) {
+        pointer_constrain(input, NULL);
+        // Once on leaving a surface, not on every motion over the background
+        if (!input->cursor_default) {
+            wlr_cursor_set_xcursor(input->cursor, input->cursor_mgr,
+                "default");
+            input->cursor_default = true;
+        }
+        wlr_seat_pointer_clear_focus(input->seat);
+        return;
+    }
+
+    if (input->active_constraint &&
+            input->active_constraint->surface != surface) {
+        pointer_constrain(input, NULL);
+    }
+
+    // Both are no-ops for the surface that already has focus
+    wlr_seat_pointer_notify_enter(input->seat, surface, sx, sy);
+    wlr_seat_pointer_notify_motion(input->seat, time_msec, sx, sy);
+
+    if (!input->active_constraint) {
+        pointer_check_constraint(input, surface, sx, sy);
+    }
+}
+
+void wavo_pointer_motion(struct wavo_input *input,
+    struct wlr_input_device *device, uint32_t time_msec,
+    double dx, double dy, double dx_unaccel, double dy_unaccel) {
+    wlr_relative_pointer_manager_v1_send_relative_motion(
+        input->relative_pointer_mgr, input->seat,
+        (uint64_t)time_msec * 1000, dx, dy, dx_unaccel, dy_unaccel);
+
+    struct wlr_pointer_constraint_v1 *constraint = input->active_constraint;
+    if (constraint && !input->grab_data) {
+        // The raw delta above is all a locked client gets, the cursor stays
+        // put and the scene is not hit-tested
+        if (constraint->type == WLR_POINTER_CONSTRAINT_V1_LOCKED) {
+            return;
+        }
+
+        pointer_update_constraint_origin(input, constraint);
+        double sx = input->cursor->x - input->constraint_x;
+        double sy = input->cursor->y - input->constraint_y;
+        double sx_confined, sy_confined;
+        if (!wlr_region_confine(&constraint->region, sx, sy, sx + dx, sy + dy,
+                &sx_confined, &sy_confined)) {
+            return;
+        }
+
+        wlr_cursor_move(input->cursor, device, sx_confined - sx,
+            sy_confined - sy);
+        wlr_seat_pointer_notify_motion(input->seat, time_msec,
+            input->cursor->x - input->constraint_x,
+            input->cursor->y - input->constraint_y);
+        return;
+    }
+
+    wlr_cursor_move(input->cursor, device, dx, dy);
+
+    if (input->grab_data) {
+        wavo_view_grab_motion(input->server, time_msec);
+        return;
+    }
+
+    wavo_pointer_update_focus(input, time_msec);
+}
+
+static void constraint_handle_set_region(struct wl_listener *listener,
+    void *data) {
+    (void)data;  // Unused parameter
+    struct wavo_pointer_constraint *constraint =
+        wl_container_of(listener, constraint, set_region);
+    struct wavo_input *input = constraint->input;
+
+    if (input->active_constraint != constraint->constraint) {
+        return;
+    }
+
+    // Reactivated by the next motion that lands inside the new region
+    pointer_update_constraint_origin(input, constraint->constraint);
+    double sx = input->cursor->x - input->constraint_x;
+    double sy = input->cursor->y - input->constraint_y;
+    if (!pixman_region32_contains_point(&constraint->constraint->region,
+            (int)sx, (int)sy, NULL)) {
+        pointer_constrain(input, NULL);
+    }
+}
+
+static void constraint_handle_destroy(struct wl_listener *listener,
+    void *data) {
+    (void)data;  // Unused parameter
+    struct wavo_pointer_constraint *constraint =
+        wl_container_of(listener, constraint, destroy);
+    struct wavo_input *input = constraint->input;
+
+    if (input->active_constraint == constraint->constraint) {
+        // The resource is going away, so only restore the cursor
+        pointer_warp_to_hint(input, constraint->constraint);
+        input->active_constraint = NULL;
+    }
+
+    wl_list_remove(&constraint->set_region.link);
+    wl_list_remove(&constraint->destroy.link);
+    free(constraint);
+}
+
+static void handle_new_constraint(struct wl_listener *listener, void *data) {
+    struct wavo_input *input = wl_container_of(listener, input, new_constraint);
+    struct wlr_pointer_constraint_v1 *wlr_constraint = data;
+
+    struct wavo_pointer_constraint *constraint =
+        calloc(1, sizeof(struct wavo_pointer_constraint));
+    if (!constraint) {
+        wlr_log(WLR_ERROR, "Failed to allocate pointer constraint: %s",
+            "Out of memory");
+        return;
+    }
+
+    constraint->input = input;
+    constraint->constraint = wlr_constraint;
+
+    constraint->set_region.notify = constraint_handle_set_region;
+    wl_signal_add(&wlr_constraint->events.set_region, &constraint->set_region);
+
+    constraint->destroy.notify = constraint_handle_destroy;
+    wl_signal_add(&wlr_constraint->events.destroy, &constraint->destroy);
+
+    struct wlr_seat_pointer_state *pointer = &input->seat->pointer_state;
+    if (!input->active_constraint &&
+            pointer->focused_surface == wlr_constraint->surface) {
+        pointer_check_constraint(input, pointer->focused_surface,
+            pointer->sx, pointer->sy);
+    }
+}
+
+static void handle_request_cursor(struct wl_listener *listener, void *data) {
+    struct wavo_input *input = wl_container_of(listener, input, request_cursor);
+    struct wlr_seat_pointer_request_set_cursor_event *event = data;
+
+    if (event->seat_client != input->seat->pointer_state.focused_client) {
+        return;
+    }
+    wlr_cursor_set_surface(input->cursor, event->surface, event->hotspot_x,
+        event->hotspot_y);
+    input->cursor_default = false;
+}
+
+bool wavo_input_init_pointer(struct wavo_input *input) {
+    struct wl_display *display = input->server->wl_display;
+
+    input->relative_pointer_mgr = wlr_relative_pointer_manager_v1_create(display);
+    if (!input->relative_pointer_mgr) {
+        wlr_log(WLR_ERROR, "%s", "Failed to create relative pointer manager");
+        return false;
+    }
+
+    input->pointer_constraints = wlr_pointer_constraints_v1_create(display);
+    if (!input->pointer_constraints) {
+        wlr_log(WLR_ERROR, "%s", "Failed to create pointer constraints");
+        return false;
+    }
+
+    input->new_constraint.notify = handle_new_constraint;
+    wl_signal_add(&input->pointer_constraints->events.new_constraint,
+        &input->new_constraint);
+
+    input->request_cursor.notify = handle_request_cursor;
+    wl_signal_add(&input->seat->events.request_set_cursor,
+        &input->request_cursor);
+
+    return true;
+}
 
-// Placeholder for pointer implementation
-// TODO: Implement pointer handling
+void wavo_input_finish_pointer(struct wavo_input *input) {
+    wl_list_remove(&input->new_constraint.link);
+    wl_list_remove(&input->request_cursor.link);
+}
@@ -0,0 +1,574 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <wayland-server-core.h>
+#include <wlr/types/wlr_output.h>
+#include <wlr/util/log.h>
+#include "wavo/clients.h"
+#include "wavo/config.h"
+#include "wavo/ipc.h"
+#include "wavo/metrics.h"
+#include "wavo/output.h"
+#include "wavo/record.h"
+#include "wavo/server.h"
+#include "wavo/thumbnail.h"
+#include "wavo/view.h"
+
+#define IPC_MAX_REQUEST 4096
+#define IPC_MAX_ARGS 16
+
+struct ipc_client {
+    struct wavo_ipc *ipc;
+    int fd;
+    struct wl_event_source *source;
+    struct wl_list link;  // wavo_ipc::clients
+
+    char request[IPC_MAX_REQUEST];
+    size_t request_len;
+
+    char *reply;
+    size_t reply_len;
+    size_t reply_sent;
+};
+
+// Handlers write their output, or the reason they failed, to out
+typedef bool (*ipc_handler)(struct wavo_server *server, int argc, char **argv,
+    FILE *out);
+
+struct ipc_command {
+    const char *name;
+    const char *usage;
+    ipc_handler handler;
+};
+
+static bool cmd_help(struct wavo_server *server, int argc, char **argv,
+    FILE *out);
+
+static bool cmd_outputs(struct wavo_server *server, int argc, char **argv,
+    FILE *out) {
+    (void)argc;
+    (void)argv;
+
+    struct wavo_output *output;
+    wl_list_for_each_reverse(output, &server->outputs, link) {
+        struct wlr_output *wlr_output = output->wlr_output;
+        fprintf(out, "%s %dx%d@%.3f scale %.2f", wlr_output->name,
+            wlr_output->width, wlr_output->height,
+            wlr_output->refresh / 1000.0, wlr_output->scale);
+        if (!wlr_output->enabled) {
+            fputs(" disabled", out);
+        }
+        if (output->is_virtual) {
+            fputs(" virtual", out);
+        }
+        if (wavo_output_is_mirror(output)) {
+            fprintf(out, " mirror %s", output->config->mirror);
+        }
+        fputc('\n', out);
+    }
+    return true;
+}
+
+static bool cmd_output(struct wavo_server *server, int argc, char **argv,
+    FILE *out) {
+    if (argc == 3 && strcmp(argv[1], "create") == 0) {
+        int width, height, refresh;
+        if (!wavo_config_parse_mode(argv[2], &width, &height, &refresh)) {
+            fprintf(out, "invalid mode '%s'", argv[2]);
+            return false;
+        }
+
+        struct wavo_output *output =
+            wavo_output_create_virtual(server, width, height, refresh);
+        if (!output) {
+            fputs("failed to create output", out);
+            return false;
+        }
+        fprintf(out, "%s\n", output->wlr_output->name);
+        return true;
+    }
+
+    if (argc == 3 && strcmp(argv[1], "destroy") == 0) {
+        struct wavo_output *output = wavo_output_find(server, argv[2]);
+        if (!output) {
+            fprintf(out, "no output named '%s'", argv[2]);
+            return false;
+        }
+        if (!output->is_virtual) {
+            fprintf(out, "'%s' is not a virtual output", argv[2]);
+            return false;
+        }
+        wlr_output_destroy(output->wlr_output);
+        return true;
+    }
+
+    fputs("usage: output create WxH[@Hz] | output destroy NAME", out);
+    return false;
+}
+
+static bool cmd_metrics(struct wavo_server *server, int argc, char **argv,
+    FILE *out) {
+    (void)argc;
+    (void)argv;
+    wavo_metrics_dump(server, out);
+    return true;
+}
+
+static bool cmd_clients(struct wavo_server *server, int argc, char **argv,
+    FILE *out) {
+    (void)argc;
+    (void)argv;
+    wavo_clients_print(server, out);
+    return true;
+}
+
+static bool cmd_thumbnails(struct wavo_server *server, int argc, char **argv,
+    FILE *out) {
+    (void)argc;
+    (void)argv;
+    wavo_thumbnails_print(server->thumbnails, out);
+    return true;
+}
+
+static bool cmd_thumbnail(struct wavo_server *server, int argc, char **argv,
+    FILE *out) {
+    if (argc != 2) {
+        fputs("usage: thumbnail ID", out);
+        return false;
+    }
+
+    char *end;
+    unsigned long id = strtoul(argv[1], &end, 10);
+    struct wavo_view *view = *end == '\0' && id <= UINT32_MAX ?
+        wavo_view_find(server, (uint32_t)id) : NULL;
+    if (!view) {
+        fprintf(out, "no view with id '%s'", argv[1]);
+        return false;
+    }
+    if (!view->thumbnail || !view->thumbnail->buffer) {
+        fprintf(out, "view %s has no thumbnail yet", argv[1]);
+        return false;
+    }
+
+    // The image is the reply, the caller decides where it goes
+    return wavo_thumbnail_write(view->thumbnail, out);
+}
+
+static bool cmd_overview(struct wavo_server *server, int argc, char **argv,
+    FILE *out) {
+    bool open = !server->thumbnails->overview;
+    if (argc == 2 && strcmp(argv[1], "on") == 0) {
+        open = true;
+    } else if (argc == 2 && strcmp(argv[1], "off") == 0) {
+        open = false;
+    } else if (argc != 1) {
+        fputs("usage: overview [on|off]", out);
+        return false;
+    }
+    wavo_thumbnails_set_overview(server->thumbnails, open);
+    return true;
+}
+
+// A recording file directly in dir, named by an absolute path
+static bool record_path_allowed(const char *dir, const char *path) {
+    size_t len = strlen(dir);
+    if (strncmp(path, dir, len) != 0 || path[len] != '/') {
+        return false;
+    }
+    const char *name = path + len + 1;
+    return name[0] != '\0' && strcmp(name, ".") != 0 &&
+        strcmp(name, "..") != 0 && !strchr(name, '/');
+}
+
+static bool cmd_record(struct wavo_server *server, int argc, char **argv,
+    FILE *out) {
+    if (argc != 2) {
+        fputs("usage: record PATH|stop", out);
+        return false;
+    }
+
+    if (strcmp(argv[1], "stop") == 0) {
+        wavo_recorder_stop(server->recorder);
+        server->recorder = NULL;
+        return true;
+    }
+
+    // Only new files in one directory: a path from the client must not
+    // resolve against our working directory or replace the user's files
+    char dir[PATH_MAX];
+    if (!wavo_record_dir(dir, sizeof(dir))) {
+        fputs("no recordings directory, set XDG_STATE_HOME or HOME", out);
+        return false;
+    }
+    if (!record_path_allowed(dir, argv[1])) {
+        fprintf(out, "recordings go directly in %s, as an absolute path",
+            dir);
+        return false;
+    }
+
+    // A new recording replaces the running one, which keeps going if this
+    // one cannot start
+    struct wavo_recorder *recorder = wavo_recorder_start(server, argv[1],
+        false);
+    if (!recorder) {
+        fprintf(out, "cannot record to '%s', it may already exist", argv[1]);
+        return false;
+    }
+    wavo_recorder_stop(server->recorder);
+    server->recorder = recorder;
+    return true;
+}
+
+static const struct ipc_command commands[] = {
+    { "help", "help", cmd_help },
+    { "outputs", "outputs", cmd_outputs },
+    { "output", "output create WxH[@Hz] | output destroy NAME", cmd_output },
+    { "metrics", "metrics", cmd_metrics },
+    { "clients", "clients", cmd_clients },
+    { "thumbnails", "thumbnails", cmd_thumbnails },
+    { "thumbnail", "thumbnail ID", cmd_thumbnail },
+    { "overview", "overview [on|off]", cmd_overview },
+    { "record", "record PATH|stop", cmd_record },
+};
+
+static bool cmd_help(struct wavo_server *server, int argc, char **argv,
+    FILE *out) {
+    (void)server;
+    (void)argc;
+    (void)argv;
+    for (size_t i = 0; i < sizeof(commands) / sizeof(commands[0]); i++) {
+        fprintf(out, "%s\n", commands[i].usage);
+    }
+    return true;
+}
+
+bool wavo_ipc_execute(struct wavo_server *server, char *line, FILE *out) {
+    char *argv[IPC_MAX_ARGS];
+    int argc = 0;
+    char *saveptr = NULL;
+    for (char *arg = strtok_r(line, " \t\r\n", &saveptr); arg;
+            arg = strtok_r(NULL, " \t\r\n", &saveptr)) {
+        if (argc == IPC_MAX_ARGS) {
+            fputs("too many arguments", out);
+            return false;
+        }
+        argv[argc++] = arg;
+    }
+
+    if (argc == 0) {
+        fputs("empty command", out);
+        return false;
+    }
+
+    for (size_t i = 0; i < sizeof(commands) / sizeof(commands[0]); i++) {
+        if (strcmp(commands[i].name, argv[0]) == 0) {
+            return commands[i].handler(server, argc, argv, out);
+        }
+    }
+
+    fprintf(out, "unknown command '%s'", argv[0]);
+    return false;
+}
+
+static void client_destroy(struct ipc_client *client) {
+    wl_event_source_remove(client->source);
+    close(client->fd);
+    wl_list_remove(&client->link);
+    free(client->reply);
+    free(client);
+}
+
+static bool client_prepare_reply(struct ipc_client *client) {
+    char *body = NULL;
+    size_t body_len = 0;
+    FILE *out = open_memstream(&body, &body_len);
+    if (!out) {
+        return false;
+    }
+
+    client->request[client->request_len] = '\0';
+    bool ok = wavo_ipc_execute(client->ipc->server, client->request, out);
+    if (fclose(out) != 0) {
+        free(body);
+        return false;
+    }
+
+    FILE *reply = open_memstream(&client->reply, &client->reply_len);
+    if (!reply) {
+        free(body);
+        return false;
+    }
+    if (ok) {
+        // Binary for thumbnails, so not as a string
+        fputs("ok\n", reply);
+        fwrite(body, 1, body_len, reply);
+    } else {
+        fprintf(reply, "error: %s\n", body);
+    }
+    free(body);
+    return fclose(reply) == 0;
+}
+
+static int client_handle_event(int fd, uint32_t mask, void *data) {
+    struct ipc_client *client = data;
+
+    if (mask & WL_EVENT_READABLE) {
+        size_t space = sizeof(client->request) - 1 - client->request_len;
+        ssize_t n = read(fd, client->request + client->request_len, space);
+        if (n < 0) {
+            if (errno != EAGAIN && errno != EINTR) {
+                client_destroy(client);
+            }
+            return 0;
+        }
+
+        char *newline = memchr(client->request + client->request_len, '\n',
+            (size_t)n);
+        client->request_len += (size_t)n;
+        if (newline) {
+            client->request_len = (size_t)(newline - client->request);
+        } else if (n > 0 && client->request_len < sizeof(client->request) - 1) {
+            return 0;  // Wait for the rest of the line
+        }
+
+        // Full line, end of stream or an overlong request
+        if (!client_prepare_reply(client)) {
+            client_destroy(client);
+            return 0;
+        }
+        wl_event_source_fd_update(client->source, WL_EVENT_WRITABLE);
+        return 0;
+    }
+
+    if (mask & WL_EVENT_WRITABLE) {
+        // A client that went away must not SIGPIPE the compositor
+        ssize_t n = send(fd, client->reply + client->reply_sent,
+            client->reply_len - client->reply_sent, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno != EAGAIN && errno != EINTR) {
+                client_destroy(client);
+            }
+            return 0;
+        }
+        client->reply_sent += (size_t)n;
+        if (client->reply_sent == client->reply_len) {
+            client_destroy(client);
+        }
+        return 0;
+    }
+
+    // Hangup or error
+    client_destroy(client);
+    return 0;
+}
+
+static int ipc_handle_connection(int fd, uint32_t mask, void *data) {
+    (void)mask;
+    struct wavo_ipc *ipc = data;
+
+    int client_fd = accept(fd, NULL, NULL);
+    if (client_fd < 0) {
+        wlr_log_errno(WLR_ERROR, "%s", "Failed to accept IPC client");
+        return 0;
+    }
+    if (fcntl(client_fd, F_SETFD, FD_CLOEXEC) != 0 ||
+            fcntl(client_fd, F_SETFL, O_NONBLOCK) != 0) {
+        close(client_fd);
+        return 0;
+    }
+
+    struct ipc_client *client = calloc(1, sizeof(struct ipc_client));
+    if (!client) {
+        close(client_fd);
+        return 0;
+    }
+
+    client->ipc = ipc;
+    client->fd = client_fd;
+    client->source = wl_event_loop_add_fd(ipc->server->event_loop, client_fd,
+        WL_EVENT_READABLE, client_handle_event, client);
+    if (!client->source) {
+        close(client_fd);
+        free(client);
+        return 0;
+    }
+
+    wl_list_insert(&ipc->clients, &client->link);
+    return 0;
+}
+
+static bool socket_path(char *path, size_t size, const char *display_name) {
+    const char *runtime_dir = getenv("XDG_RUNTIME_DIR");
+    if (!runtime_dir || !display_name) {
+        return false;
+    }
+    int len = snprintf(path, size, "%s/wavo-%s.sock", runtime_dir,
+        display_name);
+    return len > 0 && (size_t)len < size;
+}
+
+struct wavo_ipc *wavo_ipc_create(struct wavo_server *server,
+    const char *display_name) {
+    struct wavo_ipc *ipc = calloc(1, sizeof(struct wavo_ipc));
+    if (!ipc) {
+        wlr_log(WLR_ERROR, "%s", "Failed to allocate IPC");
+        return NULL;
+    }
+
+    ipc->server = server;
+    wl_list_init(&ipc->clients);
+
+    if (!socket_path(ipc->path, sizeof(ipc->path), display_name)) {
+        wlr_log(WLR_ERROR, "%s", "No usable IPC socket path, is "
+            "XDG_RUNTIME_DIR set?");
+        goto error;
+    }
+
+    ipc->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (ipc->fd < 0) {
+        wlr_log_errno(WLR_ERROR, "%s", "Failed to create IPC socket");
+        goto error;
+    }
+
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    memcpy(addr.sun_path, ipc->path, sizeof(addr.sun_path));
+
+    // The Wayland socket lock already guarantees no live compositor owns
+    // this name, anything left over is from a crash
+    unlink(ipc->path);
+    if (bind(ipc->fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+            listen(ipc->fd, 16) != 0) {
+        wlr_log_errno(WLR_ERROR, "Failed to listen on %s", ipc->path);
+        goto error_fd;
+    }
+
+    ipc->source = wl_event_loop_add_fd(server->event_loop, ipc->fd,
+        WL_EVENT_READABLE, ipc_handle_connection, ipc);
+    if (!ipc->source) {
+        goto error_socket;
+    }
+
+    setenv(WAVO_IPC_SOCKET_ENV, ipc->path, true);
+    wlr_log(WLR_INFO, "IPC listening on %s", ipc->path);
+    return ipc;
+
+error_socket:
+    unlink(ipc->path);
+error_fd:
+    close(ipc->fd);
+error:
+    free(ipc);
+    return NULL;
+}
+
+void wavo_ipc_destroy(struct wavo_ipc *ipc) {
+    if (!ipc) {
+        return;
+    }
+
+    struct ipc_client *client, *tmp;
+    wl_list_for_each_safe(client, tmp, &ipc->clients, link) {
+        client_destroy(client);
+    }
+
+    wl_event_source_remove(ipc->source);
+    close(ipc->fd);
+    unlink(ipc->path);
+    free(ipc);
+}
+
+static bool write_all(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+int wavo_ipc_client_run(int argc, char *argv[]) {
+    if (argc < 1) {
+        fprintf(stderr, "usage: wavo msg <command> [args...]\n");
+        return 2;
+    }
+
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    const char *env_path = getenv(WAVO_IPC_SOCKET_ENV);
+    if (env_path) {
+        snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", env_path);
+    } else {
+        const char *display = getenv("WAYLAND_DISPLAY");
+        if (!socket_path(addr.sun_path, sizeof(addr.sun_path),
+                display ? display : "wayland-0")) {
+            fprintf(stderr, "Cannot find the wavo socket, set %s\n",
+                WAVO_IPC_SOCKET_ENV);
+            return 1;
+        }
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        fprintf(stderr, "Failed to connect to %s: %s\n", addr.sun_path,
+            strerror(errno));
+        if (fd >= 0) {
+            close(fd);
+        }
+        return 1;
+    }
+
+    bool ok = true;
+    for (int i = 0; i < argc && ok; i++) {
+        ok = write_all(fd, argv[i], strlen(argv[i])) &&
+            write_all(fd, i + 1 < argc ? " " : "\n", 1);
+    }
+    if (!ok) {
+        fprintf(stderr, "Failed to send command: %s\n", strerror(errno));
+        close(fd);
+        return 1;
+    }
+
+    char *reply = NULL;
+    size_t reply_len = 0;
+    FILE *stream = open_memstream(&reply, &reply_len);
+    if (!stream) {
+        close(fd);
+        return 1;
+    }
+
+    char buf[4096];
+    ssize_t n;
+    while ((n = read(fd, buf, sizeof(buf))) > 0 ||
+            (n < 0 && errno == EINTR)) {
+        if (n > 0) {
+            fwrite(buf, 1, (size_t)n, stream);
+        }
+    }
+    fclose(stream);
+    close(fd);
+
+    int status = 1;
+    if (reply_len >= 3 && strncmp(reply, "ok\n", 3) == 0) {
+        fwrite(reply + 3, 1, reply_len - 3, stdout);
+        status = 0;
+    } else if (reply_len > 0) {
+        fwrite(reply, 1, reply_len, stderr);
+    } else {
+        fprintf(stderr, "No reply from wavo\n");
+    }
+    free(reply);
+    return status;
+}
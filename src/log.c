@@ -0,0 +1,469 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <wlr/util/log.h>
+#include "wavo/log.h"
+
+#define RING_MASK (WAVO_LOG_RING_SIZE - 1)
+#define SITE_TABLE_SIZE 256  // Power of two
+#define SITE_PROBES 8
+
+#define FNV_OFFSET 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+
+// Bounded MPMC queue (Vyukov): seq tells producers and consumers whose turn
+// a slot is, so neither side takes a lock
+struct log_entry {
+    atomic_size_t seq;
+    enum wlr_log_importance importance;
+    uint64_t time_msec;
+    size_t len;
+    char text[WAVO_LOG_LINE_MAX];
+};
+
+// Rate limit state of one [file:line]. Updated with relaxed atomics from
+// any thread; a race only miscounts a message.
+struct log_site {
+    _Atomic uint64_t key;  // 0 while unused
+    _Atomic uint64_t window_msec;
+    _Atomic uint32_t window_count;
+    _Atomic uint64_t last_hash;
+    _Atomic uint64_t last_msec;
+    _Atomic uint32_t suppressed;
+};
+
+static const int fatal_signals[] = { SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT };
+#define FATAL_SIGNAL_COUNT (sizeof(fatal_signals) / sizeof(fatal_signals[0]))
+
+static struct {
+    enum wlr_log_importance verbosity;
+    int fd;
+    struct timespec start;
+
+    struct log_entry ring[WAVO_LOG_RING_SIZE];
+    atomic_size_t enqueue_pos;
+    atomic_size_t dequeue_pos;
+    struct log_site sites[SITE_TABLE_SIZE];
+
+    sem_t pending;
+    pthread_t thread;
+    atomic_bool running;
+    atomic_bool stopping;
+    struct sigaction old_actions[FATAL_SIGNAL_COUNT];
+
+    _Atomic uint64_t written;
+    _Atomic uint64_t suppressed;
+    _Atomic uint64_t dropped;
+} logger = {
+    .verbosity = WLR_ERROR,
+    .fd = STDERR_FILENO,
+};
+
+// Since wavo_log_init(), like wlroots' own timestamps
+static uint64_t now_msec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    int64_t msec = (int64_t)(ts.tv_sec - logger.start.tv_sec) * 1000 +
+        (ts.tv_nsec - logger.start.tv_nsec) / 1000000;
+    return msec > 0 ? (uint64_t)msec : 0;
+}
+
+static uint64_t hash_bytes(const char *data, size_t len) {
+    uint64_t hash = FNV_OFFSET;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (unsigned char)data[i];
+        hash *= FNV_PRIME;
+    }
+    return hash | 1;  // Never 0, which marks unused sites
+}
+
+static void write_all(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t written = write(fd, data, len);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        data += written;
+        len -= (size_t)written;
+    }
+}
+
+static char *format_digits(char *out, uint64_t value, int digits) {
+    for (int i = digits - 1; i >= 0; i--) {
+        out[i] = (char)('0' + value % 10);
+        value /= 10;
+    }
+    return out + digits;
+}
+
+// "HH:MM:SS.mmm [LEVEL] text\n", without stdio so that the fatal signal
+// handler can use it
+static size_t format_line(const struct log_entry *entry, char *line) {
+    static const char *const levels[] = {
+        [WLR_SILENT] = "",
+        [WLR_ERROR] = "[ERROR] ",
+        [WLR_INFO] = "[INFO] ",
+        [WLR_DEBUG] = "[DEBUG] ",
+    };
+
+    uint64_t msec = entry->time_msec;
+    char *p = line;
+    p = format_digits(p, msec / 3600000 % 100, 2);
+    *p++ = ':';
+    p = format_digits(p, msec / 60000 % 60, 2);
+    *p++ = ':';
+    p = format_digits(p, msec / 1000 % 60, 2);
+    *p++ = '.';
+    p = format_digits(p, msec % 1000, 3);
+    *p++ = ' ';
+
+    const char *level = entry->importance < WLR_LOG_IMPORTANCE_LAST ?
+        levels[entry->importance] : "";
+    size_t level_len = strlen(level);
+    memcpy(p, level, level_len);
+    p += level_len;
+
+    memcpy(p, entry->text, entry->len);
+    p += entry->len;
+    *p++ = '\n';
+    return (size_t)(p - line);
+}
+
+#define LINE_BUFFER_SIZE (WAVO_LOG_LINE_MAX + 32)
+
+static bool log_write_next(void) {
+    size_t pos = atomic_load_explicit(&logger.dequeue_pos, memory_order_relaxed);
+    struct log_entry *entry;
+    for (;;) {
+        entry = &logger.ring[pos & RING_MASK];
+        size_t seq = atomic_load_explicit(&entry->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&logger.dequeue_pos,
+                    &pos, pos + 1, memory_order_relaxed,
+                    memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return false;  // Empty
+        } else {
+            pos = atomic_load_explicit(&logger.dequeue_pos,
+                memory_order_relaxed);
+        }
+    }
+
+    char line[LINE_BUFFER_SIZE];
+    size_t len = format_line(entry, line);
+    atomic_store_explicit(&entry->seq, pos + WAVO_LOG_RING_SIZE,
+        memory_order_release);
+
+    write_all(logger.fd, line, len);
+    atomic_fetch_add_explicit(&logger.written, 1, memory_order_relaxed);
+    return true;
+}
+
+static void log_submit(enum wlr_log_importance importance, uint64_t time_msec,
+    const char *text, size_t len) {
+    if (!atomic_load_explicit(&logger.running, memory_order_acquire)) {
+        struct log_entry entry = {
+            .importance = importance,
+            .time_msec = time_msec,
+            .len = len,
+        };
+        memcpy(entry.text, text, len);
+        char line[LINE_BUFFER_SIZE];
+        write_all(logger.fd, line, format_line(&entry, line));
+        atomic_fetch_add_explicit(&logger.written, 1, memory_order_relaxed);
+        return;
+    }
+
+    size_t pos = atomic_load_explicit(&logger.enqueue_pos, memory_order_relaxed);
+    struct log_entry *entry;
+    for (;;) {
+        entry = &logger.ring[pos & RING_MASK];
+        size_t seq = atomic_load_explicit(&entry->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&logger.enqueue_pos,
+                    &pos, pos + 1, memory_order_relaxed,
+                    memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // Full, the writer is stuck on a slow fd
+            atomic_fetch_add_explicit(&logger.dropped, 1, memory_order_relaxed);
+            return;
+        } else {
+            pos = atomic_load_explicit(&logger.enqueue_pos,
+                memory_order_relaxed);
+        }
+    }
+
+    entry->importance = importance;
+    entry->time_msec = time_msec;
+    entry->len = len;
+    memcpy(entry->text, text, len);
+    atomic_store_explicit(&entry->seq, pos + 1, memory_order_release);
+    sem_post(&logger.pending);
+}
+
+static struct log_site *site_lookup(uint64_t key) {
+    for (size_t i = 0; i < SITE_PROBES; i++) {
+        struct log_site *site =
+            &logger.sites[(key + i) & (SITE_TABLE_SIZE - 1)];
+        uint64_t current = atomic_load_explicit(&site->key,
+            memory_order_relaxed);
+        if (current == 0 && atomic_compare_exchange_strong_explicit(
+                &site->key, &current, key, memory_order_relaxed,
+                memory_order_relaxed)) {
+            return site;
+        }
+        if (current == key) {
+            return site;
+        }
+    }
+    return NULL;  // Table full around here, not rate limited
+}
+
+static bool site_admit(struct log_site *site, uint64_t text_hash,
+    uint64_t now) {
+    uint64_t last_hash = atomic_exchange_explicit(&site->last_hash, text_hash,
+        memory_order_relaxed);
+    uint64_t last_msec = atomic_load_explicit(&site->last_msec,
+        memory_order_relaxed);
+    if (last_hash == text_hash &&
+            now - last_msec < (uint64_t)WAVO_LOG_REPEAT_SEC * 1000) {
+        return false;
+    }
+
+    uint64_t window = atomic_load_explicit(&site->window_msec,
+        memory_order_relaxed);
+    if (now - window >= 1000) {
+        atomic_store_explicit(&site->window_msec, now, memory_order_relaxed);
+        atomic_store_explicit(&site->window_count, 0, memory_order_relaxed);
+    }
+    if (atomic_fetch_add_explicit(&site->window_count, 1,
+            memory_order_relaxed) >= WAVO_LOG_BURST) {
+        return false;
+    }
+
+    atomic_store_explicit(&site->last_msec, now, memory_order_relaxed);
+    return true;
+}
+
+// Length of the "[file:line]" wlr_log() puts in front, 0 if there is none
+static size_t site_prefix_len(const char *text, size_t len) {
+    if (len == 0 || text[0] != '[') {
+        return 0;
+    }
+    const char *end = memchr(text, ']', len);
+    return end ? (size_t)(end - text) + 1 : 0;
+}
+
+static void log_callback(enum wlr_log_importance importance, const char *fmt,
+    va_list args) {
+    if (importance > logger.verbosity) {
+        return;
+    }
+
+    char text[WAVO_LOG_LINE_MAX];
+    int ret = vsnprintf(text, sizeof(text), fmt, args);
+    if (ret < 0) {
+        return;
+    }
+    size_t len = (size_t)ret < sizeof(text) ? (size_t)ret : sizeof(text) - 1;
+    uint64_t now = now_msec();
+
+    size_t prefix_len = site_prefix_len(text, len);
+    struct log_site *site = prefix_len > 0 ?
+        site_lookup(hash_bytes(text, prefix_len)) : NULL;
+    if (!site) {
+        log_submit(importance, now, text, len);
+        return;
+    }
+
+    if (!site_admit(site, hash_bytes(text, len), now)) {
+        atomic_fetch_add_explicit(&site->suppressed, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&logger.suppressed, 1, memory_order_relaxed);
+        return;
+    }
+
+    uint32_t suppressed = atomic_exchange_explicit(&site->suppressed, 0,
+        memory_order_relaxed);
+    if (suppressed > 0) {
+        char summary[WAVO_LOG_LINE_MAX];
+        int summary_len = snprintf(summary, sizeof(summary),
+            "%.*s %" PRIu32 " similar messages suppressed", (int)prefix_len,
+            text, suppressed);
+        if (summary_len > 0 && (size_t)summary_len < sizeof(summary)) {
+            log_submit(importance, now, summary, (size_t)summary_len);
+        }
+    }
+    log_submit(importance, now, text, len);
+}
+
+static void *log_thread(void *data) {
+    (void)data;
+    for (;;) {
+        while (sem_wait(&logger.pending) != 0 && errno == EINTR) {
+            continue;
+        }
+        while (log_write_next()) {
+            continue;
+        }
+        if (atomic_load_explicit(&logger.stopping, memory_order_acquire)) {
+            return NULL;
+        }
+    }
+}
+
+// Writes out every published entry up to the last one claimed. Unlike
+// log_write_next() it goes past slots claimed but never published, likely
+// by the very thread that crashed. Racing the writer thread is fine, each
+// position is taken exactly once; the ring is not used after a crash.
+static void log_drain_crash(void) {
+    size_t end = atomic_load_explicit(&logger.enqueue_pos,
+        memory_order_relaxed);
+    size_t pos = atomic_load_explicit(&logger.dequeue_pos,
+        memory_order_relaxed);
+    while ((intptr_t)(end - pos) > 0) {
+        struct log_entry *entry = &logger.ring[pos & RING_MASK];
+        size_t seq = atomic_load_explicit(&entry->seq, memory_order_acquire);
+        if (!atomic_compare_exchange_weak_explicit(&logger.dequeue_pos, &pos,
+                pos + 1, memory_order_relaxed, memory_order_relaxed)) {
+            continue;
+        }
+        if (seq == pos + 1) {
+            char line[LINE_BUFFER_SIZE];
+            write_all(logger.fd, line, format_line(entry, line));
+            atomic_fetch_add_explicit(&logger.written, 1,
+                memory_order_relaxed);
+        }
+        pos++;
+    }
+}
+
+static void handle_fatal_signal(int signal_number, siginfo_t *info,
+    void *context) {
+    log_drain_crash();
+
+    // Whoever had the signal before, a sanitizer say, gets it next with the
+    // original siginfo. Once that returns, a fault recurs straight into the
+    // restored handler.
+    const struct sigaction *old = NULL;
+    for (size_t i = 0; i < FATAL_SIGNAL_COUNT; i++) {
+        if (fatal_signals[i] == signal_number) {
+            old = &logger.old_actions[i];
+        }
+    }
+    if (old && (old->sa_flags & SA_SIGINFO)) {
+        sigaction(signal_number, old, NULL);
+        old->sa_sigaction(signal_number, info, context);
+        return;
+    }
+    if (old && old->sa_handler != SIG_DFL && old->sa_handler != SIG_IGN) {
+        sigaction(signal_number, old, NULL);
+        old->sa_handler(signal_number);
+        return;
+    }
+
+    // SA_RESETHAND restored the default action, an ignored fault would
+    // only come back
+    raise(signal_number);
+}
+
+bool wavo_log_init(enum wlr_log_importance verbosity, int fd) {
+    if (atomic_load(&logger.running)) {
+        return false;
+    }
+
+    logger.verbosity = verbosity;
+    logger.fd = fd;
+    clock_gettime(CLOCK_MONOTONIC, &logger.start);
+    for (size_t i = 0; i < WAVO_LOG_RING_SIZE; i++) {
+        atomic_init(&logger.ring[i].seq, i);
+    }
+    atomic_store(&logger.enqueue_pos, 0);
+    atomic_store(&logger.dequeue_pos, 0);
+    atomic_store(&logger.stopping, false);
+
+    if (sem_init(&logger.pending, 0, 0) != 0) {
+        wlr_log_init(verbosity, NULL);
+        return false;
+    }
+
+    // Signals are for the event loop, the writer must never take one
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    int ret = pthread_create(&logger.thread, NULL, log_thread, NULL);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (ret != 0) {
+        sem_destroy(&logger.pending);
+        wlr_log_init(verbosity, NULL);
+        return false;
+    }
+
+    atomic_store_explicit(&logger.running, true, memory_order_release);
+    wlr_log_init(verbosity, log_callback);
+
+    struct sigaction action = {
+        .sa_sigaction = handle_fatal_signal,
+        .sa_flags = SA_SIGINFO | SA_RESETHAND,
+    };
+    sigemptyset(&action.sa_mask);
+    for (size_t i = 0; i < FATAL_SIGNAL_COUNT; i++) {
+        sigaction(fatal_signals[i], &action, &logger.old_actions[i]);
+    }
+    return true;
+}
+
+void wavo_log_finish(void) {
+    if (!atomic_load(&logger.running)) {
+        return;
+    }
+
+    for (size_t i = 0; i < FATAL_SIGNAL_COUNT; i++) {
+        sigaction(fatal_signals[i], &logger.old_actions[i], NULL);
+    }
+
+    atomic_store_explicit(&logger.stopping, true, memory_order_release);
+    sem_post(&logger.pending);
+    pthread_join(logger.thread, NULL);
+
+    // New messages are written synchronously from here on, collect what
+    // was queued before they noticed
+    atomic_store_explicit(&logger.running, false, memory_order_release);
+    while (log_write_next()) {
+        continue;
+    }
+    sem_destroy(&logger.pending);
+}
+
+void wavo_log_get_stats(struct wavo_log_stats *stats) {
+    stats->written = atomic_load_explicit(&logger.written,
+        memory_order_relaxed);
+    stats->suppressed = atomic_load_explicit(&logger.suppressed,
+        memory_order_relaxed);
+    stats->dropped = atomic_load_explicit(&logger.dropped,
+        memory_order_relaxed);
+}
+
+void wavo_log_print_metrics(FILE *out) {
+    struct wavo_log_stats stats;
+    wavo_log_get_stats(&stats);
+    fprintf(out, "log.written %" PRIu64 "\n", stats.written);
+    fprintf(out, "log.suppressed %" PRIu64 "\n", stats.suppressed);
+    fprintf(out, "log.dropped %" PRIu64 "\n", stats.dropped);
+}
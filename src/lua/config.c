@@ -1,34 +1,39 @@
 #define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <lauxlib.h>
+#include <lua.h>
+#include <lualib.h>
+#include <wlr/util/log.h>
 #include "wavo/config.h"
 
 bool wavo_config_load_default(struct wavo_config *config) {
     if (!config) return false;
-    
+
     // Set default values
     config->terminal = strdup("alacritty");
     if (!config->terminal) goto error;
-    
+
     config->mod_key = strdup("Mod4");
     if (!config->mod_key) goto error;
-    
+
     config->menu = strdup("rofi -show drun");
     if (!config->menu) goto error;
-    
+
     config->enable_animations = true;
     config->workspace_count = 9;
-    
+
     config->repeat_rate = 25;
     config->repeat_delay = 600;
-    
+
     config->background_color = strdup("#000000");
     if (!config->background_color) goto error;
-    
+
     config->border_width = 2;
     config->border_color = strdup("#333333");
     if (!config->border_color) goto error;
-    
+
     return true;
 
 error:
@@ -36,10 +41,184 @@ error:
     return false;
 }
 
+// Replace *value with the string field `key` of the table on top of the stack
+static bool read_string(lua_State *L, const char *key, char **value) {
+    bool ok = true;
+    if (lua_getfield(L, -1, key) == LUA_TSTRING) {
+        char *copy = strdup(lua_tostring(L, -1));
+        if (copy) {
+            free(*value);
+            *value = copy;
+        } else {
+            ok = false;
+        }
+    }
+    lua_pop(L, 1);
+    return ok;
+}
+
+static void read_int(lua_State *L, const char *key, int *value) {
+    if (lua_getfield(L, -1, key) == LUA_TNUMBER) {
+        *value = (int)lua_tonumber(L, -1);
+    }
+    lua_pop(L, 1);
+}
+
+// Hooks run sandboxed, so they live in hooks.lua rather than in a config
+// that may use anything. Not an error, the rest of the config still holds.
+static int config_lua_on(lua_State *L) {
+    (void)L;
+    wlr_log(WLR_ERROR, "%s", "wavo.on() is ignored in the config, move "
+        "hooks to hooks.lua next to it");
+    return 0;
+}
+
+// hooks.lua in the config's directory
+static char *hooks_path_for(const char *path) {
+    const char *slash = strrchr(path, '/');
+    int dir_len = slash ? (int)(slash - path) : 1;
+    const char *dir = slash ? path : ".";
+
+    size_t size = (size_t)dir_len + sizeof("/hooks.lua");
+    char *hooks_path = malloc(size);
+    if (hooks_path) {
+        snprintf(hooks_path, size, "%.*s/hooks.lua", dir_len, dir);
+    }
+    return hooks_path;
+}
+
+static bool read_outputs(lua_State *L, struct wavo_config *config) {
+    size_t count = (size_t)luaL_len(L, -1);
+    if (count == 0) {
+        return true;
+    }
+
+    config->outputs = calloc(count, sizeof(struct wavo_output_config));
+    if (!config->outputs) {
+        return false;
+    }
+
+    for (size_t i = 1; i <= count; i++) {
+        if (lua_geti(L, -1, (lua_Integer)i) != LUA_TTABLE) {
+            lua_pop(L, 1);
+            continue;
+        }
+
+        struct wavo_output_config *output =
+            &config->outputs[config->output_count];
+        output->scale = 1.0f;
+
+        if (!read_string(L, "name", &output->name)) {
+            lua_pop(L, 1);
+            return false;
+        }
+        if (!output->name) {
+            wlr_log(WLR_ERROR, "Output entry %zu has no name", i);
+            lua_pop(L, 1);
+            continue;
+        }
+
+        if (!read_string(L, "mirror", &output->mirror)) {
+            lua_pop(L, 1);
+            return false;
+        }
+
+        if (lua_getfield(L, -1, "scale") == LUA_TNUMBER) {
+            output->scale = (float)lua_tonumber(L, -1);
+        }
+        lua_pop(L, 1);
+
+        if (lua_getfield(L, -1, "mode") == LUA_TSTRING &&
+                !wavo_config_parse_mode(lua_tostring(L, -1), &output->width,
+                    &output->height, &output->refresh)) {
+            wlr_log(WLR_ERROR, "Invalid mode for output %s", output->name);
+        }
+        lua_pop(L, 1);
+
+        config->output_count++;
+        lua_pop(L, 1);
+    }
+
+    return true;
+}
+
 bool wavo_config_load_file(struct wavo_config *config, const char *path) {
-    (void)path; // Suppress unused parameter warning
-    // TODO: Implement Lua configuration loading
-    return wavo_config_load_default(config);
+    if (!config || !path) return false;
+
+    if (!wavo_config_load_default(config)) {
+        return false;
+    }
+    config->path = strdup(path);
+    config->hooks_path = hooks_path_for(path);
+    if (!config->path || !config->hooks_path) {
+        return false;
+    }
+
+    lua_State *L = luaL_newstate();
+    if (!L) {
+        wlr_log(WLR_ERROR, "%s", "Failed to create Lua state");
+        return false;
+    }
+    luaL_openlibs(L);
+
+    lua_newtable(L);
+    lua_pushcfunction(L, config_lua_on);
+    lua_setfield(L, -2, "on");
+    lua_setglobal(L, "wavo");
+
+    if (luaL_dofile(L, path) != LUA_OK) {
+        wlr_log(WLR_ERROR, "Failed to load config %s: %s", path,
+            lua_tostring(L, -1));
+        lua_close(L);
+        return false;
+    }
+
+    bool ok = true;
+
+    if (lua_getglobal(L, "config") == LUA_TTABLE) {
+        ok = read_string(L, "terminal", &config->terminal) &&
+            read_string(L, "mod_key", &config->mod_key) &&
+            read_string(L, "menu", &config->menu);
+        read_int(L, "repeat_rate", &config->repeat_rate);
+        read_int(L, "repeat_delay", &config->repeat_delay);
+    }
+    lua_pop(L, 1);
+
+    if (ok && lua_getglobal(L, "workspaces") == LUA_TTABLE) {
+        read_int(L, "count", &config->workspace_count);
+    }
+    lua_pop(L, 1);
+
+    if (ok && lua_getglobal(L, "keyboard") == LUA_TTABLE) {
+        struct wavo_keyboard_config *keyboard = &config->keyboard;
+        ok = read_string(L, "rules", &keyboard->rules) &&
+            read_string(L, "model", &keyboard->model) &&
+            read_string(L, "layout", &keyboard->layout) &&
+            read_string(L, "variant", &keyboard->variant) &&
+            read_string(L, "options", &keyboard->options);
+    }
+    lua_pop(L, 1);
+
+    if (ok && lua_getglobal(L, "idle") == LUA_TTABLE) {
+        // Seconds, fractions allowed
+        if (lua_getfield(L, -1, "timeout") == LUA_TNUMBER) {
+            config->idle_timeout_msec = (int)(lua_tonumber(L, -1) * 1000);
+        }
+        lua_pop(L, 1);
+        if (lua_getfield(L, -1, "power_off") == LUA_TBOOLEAN) {
+            config->idle_power_off = lua_toboolean(L, -1);
+        }
+        lua_pop(L, 1);
+    }
+    lua_pop(L, 1);
+
+    if (ok && lua_getglobal(L, "outputs") == LUA_TTABLE) {
+        ok = read_outputs(L, config);
+    }
+    lua_pop(L, 1);
+
+    lua_close(L);
+    return ok;
 }
 
 bool wavo_config_validate(struct wavo_config *config) {
@@ -47,19 +226,83 @@ bool wavo_config_validate(struct wavo_config *config) {
     if (!config->terminal) return false;
     if (!config->mod_key) return false;
     if (!config->menu) return false;
-    
+    if (config->idle_timeout_msec < 0) return false;
+
+    for (size_t i = 0; i < config->output_count; i++) {
+        const struct wavo_output_config *output = &config->outputs[i];
+        if (output->scale <= 0.0f) return false;
+        if (output->mirror && strcmp(output->mirror, output->name) == 0) {
+            return false;
+        }
+    }
+
     return true;
 }
 
 void wavo_config_free(struct wavo_config *config) {
     if (!config) return;
-    
+
+    free(config->path);
+    free(config->hooks_path);
     free(config->terminal);
     free(config->mod_key);
     free(config->menu);
     free(config->background_color);
     free(config->border_color);
-    
+
+    free(config->keyboard.rules);
+    free(config->keyboard.model);
+    free(config->keyboard.layout);
+    free(config->keyboard.variant);
+    free(config->keyboard.options);
+
+    for (size_t i = 0; i < config->output_count; i++) {
+        free(config->outputs[i].name);
+        free(config->outputs[i].mirror);
+    }
+    free(config->outputs);
+
     // Reset all pointers to NULL
     memset(config, 0, sizeof(*config));
 }
+
+const struct wavo_output_config *wavo_config_find_output(
+    const struct wavo_config *config, const char *name) {
+    if (!config || !name) return NULL;
+
+    for (size_t i = 0; i < config->output_count; i++) {
+        if (strcmp(config->outputs[i].name, name) == 0) {
+            return &config->outputs[i];
+        }
+    }
+    return NULL;
+}
+
+bool wavo_config_parse_mode(const char *mode, int *width, int *height,
+    int *refresh) {
+    if (!mode) return false;
+
+    int w = 0, h = 0, consumed = 0;
+    if (sscanf(mode, "%dx%d%n", &w, &h, &consumed) != 2 || w <= 0 || h <= 0) {
+        return false;
+    }
+
+    float hz = 0.0f;
+    if (mode[consumed] == '@') {
+        char *end = NULL;
+        hz = strtof(mode + consumed + 1, &end);
+        if (end == mode + consumed + 1 || hz <= 0.0f) {
+            return false;
+        }
+        if (strcmp(end, "Hz") != 0 && *end != '\0') {
+            return false;
+        }
+    } else if (mode[consumed] != '\0') {
+        return false;
+    }
+
+    *width = w;
+    *height = h;
+    *refresh = (int)(hz * 1000.0f + 0.5f);
+    return true;
+}
@@ -0,0 +1,526 @@
+#define _POSIX_C_SOURCE 200809L
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <lauxlib.h>
+#include <lua.h>
+#include <lualib.h>
+#include <wayland-server-core.h>
+#include <wlr/types/wlr_output.h>
+#include <wlr/types/wlr_xdg_shell.h>
+#include <wlr/util/log.h>
+#include "wavo/hooks.h"
+#include "wavo/latency.h"
+#include "wavo/output.h"
+#include "wavo/server.h"
+#include "wavo/view.h"
+
+// Per call. Lua runs a few hundred simple instructions a microsecond, so
+// both limits are about the same. Both are only checked between
+// instructions: a single library call runs to the end, which is why the
+// library functions whose run time a script controls are left out, see
+// hooks_open_libs().
+#define HOOK_TIME_USEC 1000
+#define HOOK_INSTRUCTIONS 200000
+#define HOOK_CHECK_INTERVAL 1000  // Instructions between budget checks
+#define HOOK_MAX_OVERRUNS 3       // In a row, then the hook is disabled
+
+// Loading runs the whole config, not a single callback
+#define HOOKS_LOAD_SCALE 20
+#define HOOKS_MEMORY_LIMIT (8 * 1024 * 1024)
+
+// Longest run in one go
+#define HOOKS_SLICE_USEC 4000
+// For events when no frame is coming to run them after
+#define HOOKS_TIMER_MSEC 5
+
+static const char *const hook_names[WAVO_HOOK_TYPE_COUNT] = {
+    [WAVO_HOOK_MAP] = "map",
+    [WAVO_HOOK_UNMAP] = "unmap",
+    [WAVO_HOOK_FOCUS] = "focus",
+    [WAVO_HOOK_OUTPUT_ADD] = "output_add",
+    [WAVO_HOOK_OUTPUT_REMOVE] = "output_remove",
+};
+
+// Refusing to grow past the limit raises an error in the script. Not
+// always a memory error (string buffers raise a plain one), so the call is
+// marked over budget here, which also stops it at the next budget check if
+// the script catches the error.
+static void *hooks_alloc(void *ud, void *ptr, size_t osize, size_t nsize) {
+    struct wavo_hooks *hooks = ud;
+    size_t old = ptr ? osize : 0;
+
+    if (nsize == 0) {
+        free(ptr);
+        hooks->memory -= old;
+        return NULL;
+    }
+    if (nsize > old && hooks->memory - old + nsize > HOOKS_MEMORY_LIMIT) {
+        hooks->overrun = true;
+        return NULL;
+    }
+
+    void *block = realloc(ptr, nsize);
+    if (!block) {
+        return NULL;
+    }
+    hooks->memory = hooks->memory - old + nsize;
+    if (hooks->memory > hooks->memory_peak) {
+        hooks->memory_peak = hooks->memory;
+    }
+    return block;
+}
+
+static void hooks_count_hook(lua_State *L, lua_Debug *ar) {
+    (void)ar;
+    void *ud;
+    lua_getallocf(L, &ud);
+    struct wavo_hooks *hooks = ud;
+
+    if (!hooks->overrun) {
+        if (hooks->checks_left > 0) {
+            hooks->checks_left--;
+        }
+        if (hooks->checks_left > 0 &&
+                wavo_latency_now_usec() < hooks->deadline_usec) {
+            return;
+        }
+        hooks->overrun = true;
+    }
+    // From here on every instruction raises, so a script catching the error
+    // with pcall cannot carry on
+    lua_sethook(L, hooks_count_hook, LUA_MASKCOUNT, 1);
+    luaL_error(L, "%s", "over budget");
+}
+
+// Calls the function below nargs arguments on the stack, leaving an error
+// message on the stack if it fails
+static int hooks_pcall(struct wavo_hooks *hooks, int nargs,
+    uint64_t time_usec, uint64_t instructions) {
+    lua_State *L = hooks->L;
+    hooks->deadline_usec = wavo_latency_now_usec() + time_usec;
+    hooks->checks_left = instructions / HOOK_CHECK_INTERVAL;
+    hooks->overrun = false;
+
+    lua_sethook(L, hooks_count_hook, LUA_MASKCOUNT, HOOK_CHECK_INTERVAL);
+    int status = lua_pcall(L, nargs, 0, 0);
+    lua_sethook(L, NULL, 0, 0);
+    return status;
+}
+
+static const char *hooks_error_message(lua_State *L) {
+    // lua_tostring() would allocate to convert anything else
+    return lua_type(L, -1) == LUA_TSTRING ?
+        lua_tostring(L, -1) : "error object is not a string";
+}
+
+static int hooks_lua_on(lua_State *L) {
+    struct wavo_hooks *hooks = lua_touserdata(L, lua_upvalueindex(1));
+    const char *name = luaL_checkstring(L, 1);
+    luaL_checktype(L, 2, LUA_TFUNCTION);
+    if (!hooks->loading) {
+        return luaL_error(L, "%s", "wavo.on only works in hooks.lua itself");
+    }
+
+    int type = -1;
+    for (int i = 0; i < WAVO_HOOK_TYPE_COUNT; i++) {
+        if (strcmp(name, hook_names[i]) == 0) {
+            type = i;
+        }
+    }
+    if (type < 0) {
+        return luaL_argerror(L, 1, "unknown event");
+    }
+
+    if (hooks->hook_count == hooks->hook_capacity) {
+        size_t capacity = hooks->hook_capacity ? hooks->hook_capacity * 2 : 8;
+        struct wavo_hook *grown = realloc(hooks->hooks,
+            capacity * sizeof(struct wavo_hook));
+        if (!grown) {
+            return luaL_error(L, "%s", "out of memory");
+        }
+        hooks->hooks = grown;
+        hooks->hook_capacity = capacity;
+    }
+
+    lua_pushvalue(L, 2);
+    int ref = luaL_ref(L, LUA_REGISTRYINDEX);
+
+    struct wavo_hook *hook = &hooks->hooks[hooks->hook_count++];
+    memset(hook, 0, sizeof(*hook));
+    hook->type = (enum wavo_hook_type)type;
+    hook->ref = ref;
+    hooks->type_count[type]++;
+    return 0;
+}
+
+// No io, package or debug, and nothing that runs programs or touches files:
+// a hook blocking on those would stall the compositor. Nor the library
+// functions that may run for long in a single call, where no budget check
+// can interrupt them: pattern matching backtracks exponentially on some
+// patterns, string.rep and table.concat, move, sort and unpack take time in
+// proportion to what they are given.
+static void hooks_open_libs(lua_State *L) {
+    static const luaL_Reg libs[] = {
+        { LUA_GNAME, luaopen_base },
+        { LUA_TABLIBNAME, luaopen_table },
+        { LUA_STRLIBNAME, luaopen_string },
+        { LUA_MATHLIBNAME, luaopen_math },
+        { LUA_UTF8LIBNAME, luaopen_utf8 },
+        { LUA_OSLIBNAME, luaopen_os },
+    };
+    for (size_t i = 0; i < sizeof(libs) / sizeof(libs[0]); i++) {
+        luaL_requiref(L, libs[i].name, libs[i].func, 1);
+        lua_pop(L, 1);
+    }
+
+    static const char *const base_unsafe[] = { "dofile", "loadfile" };
+    for (size_t i = 0; i < sizeof(base_unsafe) / sizeof(base_unsafe[0]); i++) {
+        lua_pushnil(L);
+        lua_setglobal(L, base_unsafe[i]);
+    }
+
+    // Keeps clock, date, difftime, getenv and time
+    static const char *const os_unsafe[] = {
+        "execute", "exit", "remove", "rename", "setlocale", "tmpname",
+    };
+    lua_getglobal(L, LUA_OSLIBNAME);
+    for (size_t i = 0; i < sizeof(os_unsafe) / sizeof(os_unsafe[0]); i++) {
+        lua_pushnil(L);
+        lua_setfield(L, -2, os_unsafe[i]);
+    }
+    lua_pop(L, 1);
+
+    // Also gone from string methods, which look them up in this table
+    static const char *const string_slow[] = {
+        "find", "gmatch", "gsub", "match", "rep",
+    };
+    lua_getglobal(L, LUA_STRLIBNAME);
+    for (size_t i = 0; i < sizeof(string_slow) / sizeof(string_slow[0]); i++) {
+        lua_pushnil(L);
+        lua_setfield(L, -2, string_slow[i]);
+    }
+    lua_pop(L, 1);
+
+    static const char *const table_slow[] = {
+        "concat", "move", "sort", "unpack",
+    };
+    lua_getglobal(L, LUA_TABLIBNAME);
+    for (size_t i = 0; i < sizeof(table_slow) / sizeof(table_slow[0]); i++) {
+        lua_pushnil(L);
+        lua_setfield(L, -2, table_slow[i]);
+    }
+    lua_pop(L, 1);
+}
+
+static int hooks_timer(void *data);
+
+struct wavo_hooks *wavo_hooks_create(struct wavo_server *server,
+    const char *path) {
+    struct wavo_hooks *hooks = calloc(1, sizeof(struct wavo_hooks));
+    if (!hooks) {
+        wlr_log(WLR_ERROR, "Failed to allocate hooks: %s", "Out of memory");
+        return NULL;
+    }
+    hooks->server = server;
+
+    hooks->L = lua_newstate(hooks_alloc, hooks);
+    if (!hooks->L) {
+        wlr_log(WLR_ERROR, "%s", "Failed to create Lua state for hooks");
+        free(hooks);
+        return NULL;
+    }
+    lua_State *L = hooks->L;
+    hooks_open_libs(L);
+
+    lua_newtable(L);
+    lua_pushlightuserdata(L, hooks);
+    lua_pushcclosure(L, hooks_lua_on, 1);
+    lua_setfield(L, -2, "on");
+    lua_setglobal(L, "wavo");
+
+    if (luaL_loadfile(L, path) != LUA_OK) {
+        wlr_log(WLR_ERROR, "Failed to load hooks from %s: %s", path,
+            hooks_error_message(L));
+        goto error;
+    }
+    hooks->loading = true;
+    int status = hooks_pcall(hooks, 0, HOOK_TIME_USEC * HOOKS_LOAD_SCALE,
+        HOOK_INSTRUCTIONS * HOOKS_LOAD_SCALE);
+    hooks->loading = false;
+    if (status != LUA_OK) {
+        wlr_log(WLR_ERROR, "Failed to load hooks from %s: %s", path,
+            hooks_error_message(L));
+        goto error;
+    }
+
+    if (server) {
+        hooks->timer = wl_event_loop_add_timer(server->event_loop,
+            hooks_timer, hooks);
+        if (!hooks->timer) {
+            wlr_log(WLR_ERROR, "%s", "Failed to create hooks timer");
+            goto error;
+        }
+    }
+    return hooks;
+
+error:
+    lua_close(L);
+    free(hooks->hooks);
+    free(hooks);
+    return NULL;
+}
+
+void wavo_hooks_destroy(struct wavo_hooks *hooks) {
+    if (!hooks) {
+        return;
+    }
+
+    if (hooks->timer) {
+        wl_event_source_remove(hooks->timer);
+    }
+    // Frees through hooks_alloc, which still needs hooks
+    lua_close(hooks->L);
+    free(hooks->hooks);
+    free(hooks);
+}
+
+void wavo_hooks_emit(struct wavo_hooks *hooks,
+    const struct wavo_hook_event *event) {
+    if (!hooks || hooks->type_count[event->type] == 0) {
+        return;
+    }
+    if (hooks->queue_length == WAVO_HOOKS_QUEUE_SIZE) {
+        hooks->dropped++;
+        return;
+    }
+
+    size_t tail = (hooks->queue_head + hooks->queue_length) %
+        WAVO_HOOKS_QUEUE_SIZE;
+    hooks->queue[tail] = *event;
+    hooks->queue_length++;
+    hooks->queued++;
+
+    if (hooks->timer && !hooks->timer_armed) {
+        wl_event_source_timer_update(hooks->timer, HOOKS_TIMER_MSEC);
+        hooks->timer_armed = true;
+    }
+}
+
+void wavo_hooks_emit_view(struct wavo_hooks *hooks, enum wavo_hook_type type,
+    struct wavo_view *view) {
+    if (!hooks || hooks->type_count[type] == 0) {
+        return;
+    }
+
+    struct wlr_xdg_toplevel *toplevel = view->xdg_surface->toplevel;
+    struct wavo_hook_event event = { .type = type, .id = view->id };
+    snprintf(event.name, sizeof(event.name), "%s",
+        toplevel && toplevel->app_id ? toplevel->app_id : "");
+    snprintf(event.title, sizeof(event.title), "%s",
+        toplevel && toplevel->title ? toplevel->title : "");
+    wavo_hooks_emit(hooks, &event);
+}
+
+void wavo_hooks_emit_output(struct wavo_hooks *hooks,
+    enum wavo_hook_type type, struct wavo_output *output) {
+    if (!hooks || hooks->type_count[type] == 0) {
+        return;
+    }
+
+    struct wlr_output *wlr_output = output->wlr_output;
+    struct wavo_hook_event event = {
+        .type = type,
+        .id = output->id,
+        .width = wlr_output->width,
+        .height = wlr_output->height,
+        .refresh = wlr_output->refresh,
+    };
+    snprintf(event.name, sizeof(event.name), "%s", wlr_output->name);
+    wavo_hooks_emit(hooks, &event);
+}
+
+// Protected, building the argument table can run out of memory too
+static int hooks_lua_call(lua_State *L) {
+    const struct wavo_hook_event *event = lua_touserdata(L, 2);
+    lua_settop(L, 1);
+
+    lua_createtable(L, 0, 5);
+    lua_pushinteger(L, event->id);
+    lua_setfield(L, -2, "id");
+    if (event->type == WAVO_HOOK_OUTPUT_ADD ||
+            event->type == WAVO_HOOK_OUTPUT_REMOVE) {
+        lua_pushstring(L, event->name);
+        lua_setfield(L, -2, "name");
+        lua_pushinteger(L, event->width);
+        lua_setfield(L, -2, "width");
+        lua_pushinteger(L, event->height);
+        lua_setfield(L, -2, "height");
+        lua_pushnumber(L, event->refresh / 1000.0);
+        lua_setfield(L, -2, "refresh");
+    } else {
+        lua_pushstring(L, event->name);
+        lua_setfield(L, -2, "app_id");
+        lua_pushstring(L, event->title);
+        lua_setfield(L, -2, "title");
+    }
+
+    lua_call(L, 1, 0);
+    return 0;
+}
+
+// Hooks are numbered per event in the order the config registered them
+static size_t hook_index(const struct wavo_hooks *hooks,
+    const struct wavo_hook *hook) {
+    size_t index = 0;
+    for (const struct wavo_hook *other = hooks->hooks; other < hook; other++) {
+        if (other->type == hook->type) {
+            index++;
+        }
+    }
+    return index;
+}
+
+static void hooks_call(struct wavo_hooks *hooks, struct wavo_hook *hook,
+    const struct wavo_hook_event *event) {
+    lua_State *L = hooks->L;
+    uint64_t start = wavo_latency_now_usec();
+
+    lua_pushcfunction(L, hooks_lua_call);
+    lua_rawgeti(L, LUA_REGISTRYINDEX, hook->ref);
+    lua_pushlightuserdata(L, (void *)event);
+    int status = hooks_pcall(hooks, 2, HOOK_TIME_USEC, HOOK_INSTRUCTIONS);
+
+    wavo_latency_histogram_add(&hook->run_time,
+        wavo_latency_now_usec() - start);
+    hook->calls++;
+    if (status == LUA_OK) {
+        hook->overruns_in_row = 0;
+        return;
+    }
+
+    size_t index = hook_index(hooks, hook);
+    const char *name = hook_names[hook->type];
+    if (!hooks->overrun) {
+        hook->failures++;
+        wlr_log(WLR_ERROR, "Lua %s hook #%zu failed: %s", name, index,
+            hooks_error_message(L));
+    } else if (++hook->overruns_in_row < HOOK_MAX_OVERRUNS) {
+        hook->overruns++;
+        wlr_log(WLR_ERROR, "Lua %s hook #%zu aborted: %s", name, index,
+            hooks_error_message(L));
+    } else {
+        hook->overruns++;
+        hook->disabled = true;
+        hooks->type_count[hook->type]--;
+        wlr_log(WLR_ERROR, "Disabling Lua %s hook #%zu, over budget %d times "
+            "in a row", name, index, HOOK_MAX_OVERRUNS);
+    }
+    lua_pop(L, 1);
+}
+
+size_t wavo_hooks_run(struct wavo_hooks *hooks, uint64_t budget_usec) {
+    if (!hooks) {
+        return 0;
+    }
+
+    uint64_t start = wavo_latency_now_usec();
+    size_t done = 0;
+    while (hooks->queue_length > 0) {
+        const struct wavo_hook_event *event = &hooks->queue[hooks->queue_head];
+
+        for (; hooks->next_hook < hooks->hook_count; hooks->next_hook++) {
+            struct wavo_hook *hook = &hooks->hooks[hooks->next_hook];
+            if (hook->type != event->type || hook->disabled) {
+                continue;
+            }
+            if (wavo_latency_now_usec() - start + HOOK_TIME_USEC >
+                    budget_usec) {
+                hooks->deferred++;
+                return done;
+            }
+            hooks_call(hooks, hook, event);
+        }
+
+        hooks->next_hook = 0;
+        hooks->queue_head = (hooks->queue_head + 1) % WAVO_HOOKS_QUEUE_SIZE;
+        hooks->queue_length--;
+        done++;
+    }
+    return done;
+}
+
+// Half the time until the earliest next frame of the outputs that are in
+// the middle of one, the rest is for handling events and drawing it. An
+// output whose last frame started more than a period ago is waiting for
+// damage and its next frame has no deadline yet.
+static uint64_t hooks_budget(struct wavo_hooks *hooks) {
+    uint64_t budget = HOOKS_SLICE_USEC;
+    if (!hooks->server) {
+        return budget;
+    }
+
+    uint64_t now = wavo_latency_now_usec();
+    struct wavo_output *output;
+    wl_list_for_each(output, &hooks->server->outputs, link) {
+        int refresh = output->wlr_output->refresh;
+        uint64_t period = refresh > 0 ?
+            1000000000 / (uint64_t)refresh : 1000000 / 60;
+        uint64_t next = output->frame_start_usec + period;
+        if (output->frame_start_usec == 0 || now >= next) {
+            continue;
+        }
+        if ((next - now) / 2 < budget) {
+            budget = (next - now) / 2;
+        }
+    }
+    return budget;
+}
+
+static int hooks_timer(void *data) {
+    struct wavo_hooks *hooks = data;
+    hooks->timer_armed = false;
+
+    wavo_hooks_run(hooks, hooks_budget(hooks));
+    if (hooks->queue_length > 0) {
+        wl_event_source_timer_update(hooks->timer, HOOKS_TIMER_MSEC);
+        hooks->timer_armed = true;
+    }
+    return 0;
+}
+
+void wavo_hooks_run_after_frame(struct wavo_hooks *hooks) {
+    if (!hooks || hooks->queue_length == 0) {
+        return;
+    }
+    // The timer stays armed for whatever does not fit
+    wavo_hooks_run(hooks, hooks_budget(hooks));
+}
+
+void wavo_hooks_print_metrics(struct wavo_hooks *hooks, FILE *out) {
+    if (!hooks) {
+        return;
+    }
+
+    fprintf(out, "hooks.queued %" PRIu64 "\n", hooks->queued);
+    fprintf(out, "hooks.dropped %" PRIu64 "\n", hooks->dropped);
+    fprintf(out, "hooks.deferred %" PRIu64 "\n", hooks->deferred);
+    fprintf(out, "hooks.memory_bytes %zu\n", hooks->memory);
+    fprintf(out, "hooks.memory_peak_bytes %zu\n", hooks->memory_peak);
+
+    for (size_t i = 0; i < hooks->hook_count; i++) {
+        const struct wavo_hook *hook = &hooks->hooks[i];
+        char prefix[64];
+        snprintf(prefix, sizeof(prefix), "hooks.%s.%zu",
+            hook_names[hook->type], hook_index(hooks, hook));
+
+        fprintf(out, "%s.calls %" PRIu64 "\n", prefix, hook->calls);
+        fprintf(out, "%s.failures %" PRIu64 "\n", prefix, hook->failures);
+        fprintf(out, "%s.overruns %" PRIu64 "\n", prefix, hook->overruns);
+        fprintf(out, "%s.disabled %d\n", prefix, hook->disabled ? 1 : 0);
+
+        char run_time[80];
+        snprintf(run_time, sizeof(run_time), "%s.run_time", prefix);
+        wavo_latency_histogram_print(&hook->run_time, run_time, out);
+    }
+}
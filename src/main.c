@@ -1,20 +1,187 @@
+#define _POSIX_C_SOURCE 200809L
+#include <getopt.h>
+#include <limits.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 #include <wayland-server-core.h>
+#include "wavo/config.h"
+#include "wavo/ipc.h"
+#include "wavo/log.h"
+#include "wavo/output.h"
+#include "wavo/realtime.h"
+#include "wavo/record.h"
+#include "wavo/render.h"
 #include "wavo/server.h"
 
+#define MAX_VIRTUAL_OUTPUTS 64
+
+static const char usage[] =
+    "Usage: wavo [options]\n"
+    "       wavo msg <command> [args...]\n"
+    "\n"
+    "  -n, --virtual-outputs <count>  Start with headless outputs\n"
+    "  -m, --virtual-mode <WxH@Hz>    Mode of those outputs (1920x1080@60)\n"
+    "  -r, --realtime                 Realtime priority, hot memory locked\n"
+    "  -p, --parallel-render          Draw outputs on worker threads (pixman)\n"
+    "  -R, --record <file>            Record input and frames for wavo-replay\n"
+    "  -d, --debug                    Enable debug logging\n"
+    "  -h, --help                     Show this help\n";
+
+static bool config_path(char *path, size_t size) {
+    const char *config_home = getenv("XDG_CONFIG_HOME");
+    if (config_home && config_home[0] != '\0') {
+        snprintf(path, size, "%s/wavo/config.lua", config_home);
+        return true;
+    }
+
+    const char *home = getenv("HOME");
+    if (!home) {
+        return false;
+    }
+    snprintf(path, size, "%s/.config/wavo/config.lua", home);
+    return true;
+}
+
+static bool load_config(struct wavo_config *config) {
+    char path[PATH_MAX];
+    if (config_path(path, sizeof(path)) && access(path, R_OK) == 0) {
+        if (wavo_config_load_file(config, path) && wavo_config_validate(config)) {
+            return true;
+        }
+        fprintf(stderr, "Invalid config %s, using defaults\n", path);
+        wavo_config_free(config);
+    }
+    return wavo_config_load_default(config);
+}
+
 int main(int argc, char *argv[]) {
-    (void)argc;
-    (void)argv;
+    if (argc > 1 && strcmp(argv[1], "msg") == 0) {
+        if (!wavo_realtime_drop_privileges()) {
+            return 1;
+        }
+        return wavo_ipc_client_run(argc - 2, argv + 2);
+    }
+
+    static const struct option long_options[] = {
+        { "virtual-outputs", required_argument, NULL, 'n' },
+        { "virtual-mode", required_argument, NULL, 'm' },
+        { "realtime", no_argument, NULL, 'r' },
+        { "parallel-render", no_argument, NULL, 'p' },
+        { "record", required_argument, NULL, 'R' },
+        { "debug", no_argument, NULL, 'd' },
+        { "help", no_argument, NULL, 'h' },
+        { 0 },
+    };
+
+    int virtual_count = 0;
+    int virtual_width = 1920, virtual_height = 1080, virtual_refresh = 60000;
+    bool realtime = false;
+    bool parallel_render = false;
+    const char *record_path = NULL;
+    enum wlr_log_importance verbosity = WLR_ERROR;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "n:m:rpR:dh", long_options, NULL)) != -1) {
+        switch (opt) {
+        case 'n':
+            virtual_count = atoi(optarg);
+            if (virtual_count < 0 || virtual_count > MAX_VIRTUAL_OUTPUTS) {
+                fprintf(stderr, "Virtual output count must be 0-%d\n",
+                    MAX_VIRTUAL_OUTPUTS);
+                return 1;
+            }
+            break;
+        case 'm':
+            if (!wavo_config_parse_mode(optarg, &virtual_width,
+                    &virtual_height, &virtual_refresh)) {
+                fprintf(stderr, "Invalid mode '%s'\n", optarg);
+                return 1;
+            }
+            break;
+        case 'r':
+            realtime = true;
+            break;
+        case 'p':
+            parallel_render = true;
+            break;
+        case 'R':
+            record_path = optarg;
+            break;
+        case 'd':
+            verbosity = WLR_DEBUG;
+            break;
+        case 'h':
+            fputs(usage, stdout);
+            return 0;
+        default:
+            fputs(usage, stderr);
+            return 1;
+        }
+    }
+
+    // A setuid wavo is only privileged for the priority: nothing else may
+    // run before the privileges are gone, least of all the user's config
+    struct wavo_realtime realtime_state = {0};
+    if (realtime) {
+        wavo_realtime_set_priority(&realtime_state);
+    }
+    if (!wavo_realtime_drop_privileges()) {
+        return 1;
+    }
+
+    // Logging from the render loop must never wait on stderr
+    wavo_log_init(verbosity, STDERR_FILENO);
 
-    struct wavo_server *server = wavo_server_create();
+    struct wavo_config config = {0};
+    if (!load_config(&config)) {
+        fprintf(stderr, "Failed to load wavo config\n");
+        wavo_log_finish();
+        return 1;
+    }
+
+    struct wavo_server *server = wavo_server_create(&config);
     if (!server) {
         fprintf(stderr, "Failed to create wavo server\n");
+        wavo_config_free(&config);
+        wavo_log_finish();
         return 1;
     }
+
+    // Not fatal, outputs are then drawn on the main thread as usual
+    if (parallel_render) {
+        server->render = wavo_render_create(server);
+    }
+
+    if (realtime) {
+        server->realtime = realtime_state;
+        wavo_realtime_lock_memory(server);
+    }
+
+    if (record_path) {
+        server->recorder = wavo_recorder_start(server, record_path,
+            true);
+        if (!server->recorder) {
+            fprintf(stderr, "Failed to record to %s\n", record_path);
+            wavo_server_destroy(server);
+            wavo_config_free(&config);
+            wavo_log_finish();
+            return 1;
+        }
+    }
     
+    for (int i = 0; i < virtual_count; i++) {
+        if (!wavo_output_create_virtual(server, virtual_width, virtual_height,
+                virtual_refresh)) {
+            fprintf(stderr, "Failed to create virtual output %d\n", i + 1);
+        }
+    }
+
     printf("Running wavo compositor...\n");
-    wl_display_run(server->wl_display);
+    wavo_server_run(server);
     
     wavo_server_destroy(server);
+    wavo_config_free(&config);
+    wavo_log_finish();
     return 0;
 }
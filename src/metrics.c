@@ -0,0 +1,83 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <wayland-server-core.h>
+#include "wavo/budget.h"
+#include "wavo/foreign_toplevel.h"
+#include "wavo/hooks.h"
+#include "wavo/idle.h"
+#include "wavo/input.h"
+#include "wavo/latency.h"
+#include "wavo/log.h"
+#include "wavo/metrics.h"
+#include "wavo/output.h"
+#include "wavo/pool.h"
+#include "wavo/pressure.h"
+#include "wavo/realtime.h"
+#include "wavo/record.h"
+#include "wavo/render.h"
+#include "wavo/screencopy.h"
+#include "wavo/server.h"
+#include "wavo/thumbnail.h"
+#include "wavo/watchdog.h"
+#include "wavo/workers.h"
+
+void wavo_metrics_dump(struct wavo_server *server, FILE *out) {
+    char prefix[128];
+
+    struct wavo_output *output;
+    wl_list_for_each(output, &server->outputs, link) {
+        snprintf(prefix, sizeof(prefix), "output.%s.input_latency",
+            output->wlr_output->name);
+        wavo_latency_histogram_print(&output->input_latency, prefix, out);
+        fprintf(out, "output.%s.stale_inputs %" PRIu64 "\n",
+            output->wlr_output->name, output->stale_inputs);
+        snprintf(prefix, sizeof(prefix), "output.%s.present_delay",
+            output->wlr_output->name);
+        wavo_latency_histogram_print(&output->present_delay, prefix, out);
+        snprintf(prefix, sizeof(prefix), "output.%s.frame_jitter",
+            output->wlr_output->name);
+        wavo_latency_histogram_print(&output->frame_jitter, prefix, out);
+        snprintf(prefix, sizeof(prefix), "output.%s.frame_time",
+            output->wlr_output->name);
+        wavo_latency_histogram_print(&output->frame_time, prefix, out);
+
+        if (wavo_output_is_mirror(output)) {
+            fprintf(out, "output.%s.mirror_direct_frames %" PRIu64 "\n",
+                output->wlr_output->name, output->mirror_direct_frames);
+            fprintf(out, "output.%s.mirror_blit_frames %" PRIu64 "\n",
+                output->wlr_output->name, output->mirror_blit_frames);
+        }
+    }
+
+    if (server->input) {
+        fprintf(out, "input.keyboard_groups %d\n",
+            wl_list_length(&server->input->keyboard_groups));
+        fprintf(out, "input.seat_keyboard_switches %" PRIu64 "\n",
+            server->input->seat_keyboard_switches);
+    }
+
+    fprintf(out, "server.wakeups %" PRIu64 "\n", server->wakeups);
+    fprintf(out, "server.idle_wakeups %" PRIu64 "\n", server->idle_wakeups);
+    wavo_realtime_print_metrics(server, out);
+    wavo_idle_print_metrics(server->idle, out);
+    wavo_pressure_print_metrics(server->pressure, out);
+    wavo_budgets_print_metrics(server->budgets, out);
+    wavo_foreign_toplevels_print_metrics(server->foreign_toplevels, out);
+    wavo_watchdog_print_metrics(server->watchdog, out);
+    wavo_hooks_print_metrics(server->hooks, out);
+
+    wavo_pool_print(&server->view_pool, out);
+    wavo_pool_print(&server->popup_pool, out);
+    wavo_pool_print(&server->keyboard_pool, out);
+    wavo_pool_print(&server->pointer_pool, out);
+    wavo_pool_print(&server->grab_pool, out);
+
+    wavo_render_print_metrics(server->render, out);
+    wavo_recorder_print_metrics(server->recorder, out);
+    wavo_screencopy_print_metrics(server->screencopy, out);
+    wavo_thumbnails_print_metrics(server->thumbnails, out);
+    wavo_workers_print_metrics(server->workers, out);
+    wavo_log_print_metrics(out);
+
+    fflush(out);
+}
@@ -0,0 +1,200 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <link.h>
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <wlr/util/log.h>
+#include "wavo/pool.h"
+#include "wavo/realtime.h"
+#include "wavo/server.h"
+
+// Niced rather than realtime, still ahead of ordinary desktop processes
+#define REALTIME_NICE -10
+
+// Stack the compositor thread may touch during a frame, faulted in up front
+#define REALTIME_STACK_SIZE (256 * 1024)
+
+// Libraries whose code runs on every frame or input event, besides our own
+static const char *const hot_libraries[] = {
+    "libwlroots",
+    "libwayland-server",
+    "libpixman",
+    "libxkbcommon",
+};
+
+void wavo_realtime_set_priority(struct wavo_realtime *realtime) {
+    realtime->enabled = true;
+
+    // Reset on fork and clone, so neither threads started later nor clients
+    // spawned from the compositor inherit it
+    struct sched_param param = {
+        .sched_priority = sched_get_priority_min(SCHED_RR),
+    };
+    if (sched_setscheduler(0, SCHED_RR | SCHED_RESET_ON_FORK, &param) == 0) {
+        realtime->sched_rr = true;
+        realtime->priority = param.sched_priority;
+        return;
+    }
+    realtime->sched_error = errno;
+
+    param.sched_priority = 0;
+    sched_setscheduler(0, SCHED_OTHER | SCHED_RESET_ON_FORK, &param);
+
+    // Per thread on Linux, and also undone in new threads by the reset flag
+    if (setpriority(PRIO_PROCESS, 0, REALTIME_NICE) == 0) {
+        realtime->priority = REALTIME_NICE;
+    } else {
+        realtime->nice_error = errno;
+    }
+}
+
+static void lock_range(struct wavo_realtime *realtime, const void *start,
+    size_t size) {
+    if (mlock(start, size) == 0) {
+        realtime->locked_bytes += size;
+    } else {
+        realtime->lock_failed = true;
+    }
+}
+
+static bool is_hot_object(const char *name) {
+    // The main program has an empty name
+    if (name[0] == '\0') {
+        return true;
+    }
+    const char *base = strrchr(name, '/');
+    base = base ? base + 1 : name;
+    for (size_t i = 0; i < sizeof(hot_libraries) / sizeof(hot_libraries[0]);
+            i++) {
+        if (strncmp(base, hot_libraries[i], strlen(hot_libraries[i])) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static int lock_object_code(struct dl_phdr_info *info, size_t size,
+    void *data) {
+    (void)size;  // Unused parameter
+    struct wavo_realtime *realtime = data;
+
+    if (!info->dlpi_name || !is_hot_object(info->dlpi_name)) {
+        return 0;
+    }
+    for (ElfW(Half) i = 0; i < info->dlpi_phnum; i++) {
+        const ElfW(Phdr) *phdr = &info->dlpi_phdr[i];
+        if (phdr->p_type == PT_LOAD && (phdr->p_flags & PF_X)) {
+            lock_range(realtime, (const void *)(info->dlpi_addr +
+                phdr->p_vaddr), phdr->p_memsz);
+        }
+    }
+    return 0;
+}
+
+// Faults in the stack below the caller, which stays mapped and locked after
+// this returns
+static void __attribute__((noinline)) lock_stack(
+    struct wavo_realtime *realtime) {
+    volatile char stack[REALTIME_STACK_SIZE];
+    memset((char *)stack, 0, sizeof(stack));
+    lock_range(realtime, (const char *)stack, sizeof(stack));
+}
+
+#define REALTIME_POOLS 5
+
+// Pools keep locking the slabs they add, see wavo_pool_lock()
+static size_t realtime_pools(struct wavo_server *server,
+    struct wavo_pool **pools) {
+    pools[0] = &server->view_pool;
+    pools[1] = &server->popup_pool;
+    pools[2] = &server->keyboard_pool;
+    pools[3] = &server->pointer_pool;
+    pools[4] = &server->grab_pool;
+    return REALTIME_POOLS;
+}
+
+static void log_priority(const struct wavo_realtime *realtime) {
+    if (realtime->sched_rr) {
+        wlr_log(WLR_INFO, "Using SCHED_RR priority %d", realtime->priority);
+        return;
+    }
+    wlr_log(WLR_INFO, "SCHED_RR not permitted (%s)",
+        strerror(realtime->sched_error));
+    if (realtime->priority != 0) {
+        wlr_log(WLR_INFO, "Using nice %d", realtime->priority);
+    } else {
+        wlr_log(WLR_ERROR, "Failed to raise compositor priority: %s",
+            strerror(realtime->nice_error));
+    }
+}
+
+void wavo_realtime_lock_memory(struct wavo_server *server) {
+    struct wavo_realtime *realtime = &server->realtime;
+    // The logger did not run yet when the priority was set
+    log_priority(realtime);
+
+    // Not mlockall(): client buffers and the renderer's allocations would
+    // count against RLIMIT_MEMLOCK and make unrelated allocations fail
+    dl_iterate_phdr(lock_object_code, realtime);
+    lock_stack(realtime);
+
+    struct wavo_pool *pools[REALTIME_POOLS];
+    size_t count = realtime_pools(server, pools);
+    for (size_t i = 0; i < count; i++) {
+        if (!wavo_pool_lock(pools[i])) {
+            realtime->lock_failed = true;
+        }
+    }
+
+    if (realtime->lock_failed) {
+        struct rlimit limit;
+        getrlimit(RLIMIT_MEMLOCK, &limit);
+        wlr_log(WLR_ERROR, "Failed to lock all hot memory, RLIMIT_MEMLOCK "
+            "is %llu bytes", (unsigned long long)limit.rlim_cur);
+    }
+}
+
+bool wavo_realtime_drop_privileges(void) {
+    // Only a setuid or setgid binary has something to drop
+    uid_t uid = getuid();
+    gid_t gid = getgid();
+    if (uid == geteuid() && gid == getegid()) {
+        return true;
+    }
+
+    // Saved IDs too, or they could be taken back. Group first, dropping the
+    // user may take away the right to change it.
+    if (setresgid(gid, gid, gid) != 0 || setresuid(uid, uid, uid) != 0) {
+        fprintf(stderr, "Failed to drop privileges: %s\n", strerror(errno));
+        return false;
+    }
+    if (uid != 0 && (setuid(0) == 0 || seteuid(0) == 0)) {
+        fprintf(stderr, "%s\n", "Privileges could be regained after dropping");
+        return false;
+    }
+    return true;
+}
+
+void wavo_realtime_print_metrics(struct wavo_server *server, FILE *out) {
+    const struct wavo_realtime *realtime = &server->realtime;
+    fprintf(out, "realtime.enabled %d\n", realtime->enabled ? 1 : 0);
+    if (!realtime->enabled) {
+        return;
+    }
+
+    // Including slabs the pools added and locked since
+    size_t locked_bytes = realtime->locked_bytes;
+    struct wavo_pool *pools[REALTIME_POOLS];
+    size_t count = realtime_pools(server, pools);
+    for (size_t i = 0; i < count; i++) {
+        locked_bytes += pools[i]->locked_bytes;
+    }
+    fprintf(out, "realtime.sched_rr %d\n", realtime->sched_rr ? 1 : 0);
+    fprintf(out, "realtime.priority %d\n", realtime->priority);
+    fprintf(out, "realtime.locked_bytes %zu\n", locked_bytes);
+    fprintf(out, "realtime.lock_failed %d\n", realtime->lock_failed ? 1 : 0);
+}
@@ -0,0 +1,738 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <linux/input-event-codes.h>
+#include <pixman.h>
+#include <wayland-server-core.h>
+#include <wayland-server-protocol.h>
+#include <wlr/types/wlr_compositor.h>
+#include <wlr/types/wlr_output.h>
+#include <wlr/types/wlr_output_layout.h>
+#include <wlr/util/log.h>
+#include "wavo/latency.h"
+#include "wavo/output.h"
+#include "wavo/record.h"
+#include "wavo/server.h"
+#include "wavo/view.h"
+#include "wavo/workers.h"
+
+#define CHUNK_SIZE (64 * 1024)
+
+// Stand-ins for every key that is not a modifier
+static const uint32_t letters[26] = {
+    KEY_A, KEY_B, KEY_C, KEY_D, KEY_E, KEY_F, KEY_G, KEY_H, KEY_I, KEY_J,
+    KEY_K, KEY_L, KEY_M, KEY_N, KEY_O, KEY_P, KEY_Q, KEY_R, KEY_S, KEY_T,
+    KEY_U, KEY_V, KEY_W, KEY_X, KEY_Y, KEY_Z,
+};
+
+// A full chunk on its way to the file
+struct record_write {
+    struct wavo_recorder *recorder;
+    int fd;
+    uint8_t *data;
+    size_t size;
+    off_t offset;
+    bool failed;
+};
+
+static uint8_t *put_u32(uint8_t *p, uint32_t value) {
+    p[0] = (uint8_t)value;
+    p[1] = (uint8_t)(value >> 8);
+    p[2] = (uint8_t)(value >> 16);
+    p[3] = (uint8_t)(value >> 24);
+    return p + 4;
+}
+
+static uint8_t *put_i32(uint8_t *p, int32_t value) {
+    return put_u32(p, (uint32_t)value);
+}
+
+static uint8_t *put_f32(uint8_t *p, float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return put_u32(p, bits);
+}
+
+static uint8_t *put_box(uint8_t *p, const struct wlr_box *box) {
+    p = put_i32(p, box->x);
+    p = put_i32(p, box->y);
+    p = put_i32(p, box->width);
+    return put_i32(p, box->height);
+}
+
+static uint32_t get_u32(const uint8_t **p) {
+    const uint8_t *b = *p;
+    *p += 4;
+    return (uint32_t)b[0] | (uint32_t)b[1] << 8 | (uint32_t)b[2] << 16 |
+        (uint32_t)b[3] << 24;
+}
+
+static int32_t get_i32(const uint8_t **p) {
+    return (int32_t)get_u32(p);
+}
+
+static float get_f32(const uint8_t **p) {
+    uint32_t bits = get_u32(p);
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static void get_box(const uint8_t **p, struct wlr_box *box) {
+    box->x = get_i32(p);
+    box->y = get_i32(p);
+    box->width = get_i32(p);
+    box->height = get_i32(p);
+}
+
+size_t wavo_record_encode(const struct wavo_record_event *event,
+    uint64_t prev_usec, uint8_t *buf) {
+    uint8_t *p = buf + WAVO_RECORD_HEADER_SIZE;
+
+    switch (event->type) {
+    case WAVO_RECORD_OUTPUT:
+        p = put_u32(p, event->output.id);
+        p = put_i32(p, event->output.x);
+        p = put_i32(p, event->output.y);
+        p = put_i32(p, event->output.width);
+        p = put_i32(p, event->output.height);
+        p = put_i32(p, event->output.refresh);
+        p = put_f32(p, event->output.scale);
+        break;
+    case WAVO_RECORD_FRAME:
+        p = put_u32(p, event->frame.output_id);
+        p = put_u32(p, event->frame.frame_usec);
+        break;
+    case WAVO_RECORD_KEY:
+        p = put_u32(p, event->key.time_msec);
+        p = put_u32(p, event->key.keycode);
+        p = put_u32(p, event->key.state);
+        break;
+    case WAVO_RECORD_MOTION:
+        p = put_u32(p, event->motion.time_msec);
+        p = put_f32(p, event->motion.dx);
+        p = put_f32(p, event->motion.dy);
+        p = put_f32(p, event->motion.unaccel_dx);
+        p = put_f32(p, event->motion.unaccel_dy);
+        break;
+    case WAVO_RECORD_BUTTON:
+        p = put_u32(p, event->button.time_msec);
+        p = put_u32(p, event->button.button);
+        p = put_u32(p, event->button.state);
+        break;
+    case WAVO_RECORD_AXIS:
+        p = put_u32(p, event->axis.time_msec);
+        *p++ = event->axis.orientation;
+        *p++ = event->axis.source;
+        *p++ = event->axis.relative_direction;
+        *p++ = 0;
+        p = put_i32(p, event->axis.delta_discrete);
+        p = put_f32(p, event->axis.delta);
+        break;
+    case WAVO_RECORD_POINTER_FRAME:
+        break;
+    case WAVO_RECORD_MAP:
+        p = put_u32(p, event->map.view_id);
+        p = put_box(p, &event->map.box);
+        break;
+    case WAVO_RECORD_UNMAP:
+        p = put_u32(p, event->unmap.view_id);
+        break;
+    case WAVO_RECORD_COMMIT: {
+        uint32_t count = event->commit.rect_count;
+        if (count > WAVO_RECORD_MAX_RECTS) {
+            count = WAVO_RECORD_MAX_RECTS;
+        }
+        p = put_u32(p, event->commit.view_id);
+        p = put_i32(p, event->commit.width);
+        p = put_i32(p, event->commit.height);
+        p = put_u32(p, count);
+        for (uint32_t i = 0; i < count; i++) {
+            p = put_box(p, &event->commit.rects[i]);
+        }
+        break;
+    }
+    }
+
+    // Events more than ~71 minutes apart lose the rest of the gap
+    uint64_t delta = event->usec > prev_usec ? event->usec - prev_usec : 0;
+    if (delta > UINT32_MAX) {
+        delta = UINT32_MAX;
+    }
+    size_t length = (size_t)(p - buf) - WAVO_RECORD_HEADER_SIZE;
+    buf[0] = (uint8_t)event->type;
+    buf[1] = 0;
+    buf[2] = (uint8_t)length;
+    buf[3] = (uint8_t)(length >> 8);
+    put_u32(buf + 4, (uint32_t)delta);
+    return WAVO_RECORD_HEADER_SIZE + length;
+}
+
+static size_t payload_length(enum wavo_record_type type) {
+    switch (type) {
+    case WAVO_RECORD_OUTPUT:
+        return 28;
+    case WAVO_RECORD_FRAME:
+        return 8;
+    case WAVO_RECORD_KEY:
+    case WAVO_RECORD_BUTTON:
+        return 12;
+    case WAVO_RECORD_MOTION:
+        return 20;
+    case WAVO_RECORD_AXIS:
+        return 16;
+    case WAVO_RECORD_POINTER_FRAME:
+        return 0;
+    case WAVO_RECORD_MAP:
+        return 20;
+    case WAVO_RECORD_UNMAP:
+        return 4;
+    case WAVO_RECORD_COMMIT:
+        return 16;  // Without the rects
+    }
+    return SIZE_MAX;
+}
+
+bool wavo_record_decode(const uint8_t *data, size_t size, size_t *offset,
+    uint64_t prev_usec, struct wavo_record_event *event) {
+    if (*offset > size || size - *offset < WAVO_RECORD_HEADER_SIZE) {
+        return false;
+    }
+
+    const uint8_t *p = data + *offset;
+    enum wavo_record_type type = p[0];
+    size_t length = (size_t)p[2] | (size_t)p[3] << 8;
+    size_t expected = payload_length(type);
+    if (expected == SIZE_MAX || length < expected ||
+            size - *offset - WAVO_RECORD_HEADER_SIZE < length) {
+        return false;
+    }
+    p += 4;
+    uint32_t delta = get_u32(&p);
+
+    memset(event, 0, sizeof(*event));
+    event->type = type;
+    event->usec = prev_usec + delta;
+
+    switch (type) {
+    case WAVO_RECORD_OUTPUT:
+        event->output.id = get_u32(&p);
+        event->output.x = get_i32(&p);
+        event->output.y = get_i32(&p);
+        event->output.width = get_i32(&p);
+        event->output.height = get_i32(&p);
+        event->output.refresh = get_i32(&p);
+        event->output.scale = get_f32(&p);
+        break;
+    case WAVO_RECORD_FRAME:
+        event->frame.output_id = get_u32(&p);
+        event->frame.frame_usec = get_u32(&p);
+        break;
+    case WAVO_RECORD_KEY:
+        event->key.time_msec = get_u32(&p);
+        event->key.keycode = get_u32(&p);
+        event->key.state = get_u32(&p);
+        break;
+    case WAVO_RECORD_MOTION:
+        event->motion.time_msec = get_u32(&p);
+        event->motion.dx = get_f32(&p);
+        event->motion.dy = get_f32(&p);
+        event->motion.unaccel_dx = get_f32(&p);
+        event->motion.unaccel_dy = get_f32(&p);
+        break;
+    case WAVO_RECORD_BUTTON:
+        event->button.time_msec = get_u32(&p);
+        event->button.button = get_u32(&p);
+        event->button.state = get_u32(&p);
+        break;
+    case WAVO_RECORD_AXIS:
+        event->axis.time_msec = get_u32(&p);
+        event->axis.orientation = p[0];
+        event->axis.source = p[1];
+        event->axis.relative_direction = p[2];
+        p += 4;
+        event->axis.delta_discrete = get_i32(&p);
+        event->axis.delta = get_f32(&p);
+        break;
+    case WAVO_RECORD_POINTER_FRAME:
+        break;
+    case WAVO_RECORD_MAP:
+        event->map.view_id = get_u32(&p);
+        get_box(&p, &event->map.box);
+        break;
+    case WAVO_RECORD_UNMAP:
+        event->unmap.view_id = get_u32(&p);
+        break;
+    case WAVO_RECORD_COMMIT:
+        event->commit.view_id = get_u32(&p);
+        event->commit.width = get_i32(&p);
+        event->commit.height = get_i32(&p);
+        event->commit.rect_count = get_u32(&p);
+        if (event->commit.rect_count > WAVO_RECORD_MAX_RECTS ||
+                length < expected + event->commit.rect_count * 16) {
+            return false;
+        }
+        for (uint32_t i = 0; i < event->commit.rect_count; i++) {
+            get_box(&p, &event->commit.rects[i]);
+        }
+        break;
+    }
+
+    // Longer payloads than we know come from newer versions, skip the rest
+    *offset += WAVO_RECORD_HEADER_SIZE + length;
+    return true;
+}
+
+static void recorder_free(struct wavo_recorder *recorder) {
+    if (close(recorder->fd) != 0 && !recorder->failed) {
+        wlr_log(WLR_ERROR, "Failed to write recording: %s", strerror(errno));
+    }
+    free(recorder->chunk);
+    free(recorder);
+}
+
+static void record_write_run(void *data) {
+    struct record_write *job = data;
+    size_t done = 0;
+    while (done < job->size) {
+        ssize_t n = pwrite(job->fd, job->data + done, job->size - done,
+            job->offset + (off_t)done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            job->failed = true;
+            return;
+        }
+        done += (size_t)n;
+    }
+}
+
+static void record_write_done(void *data) {
+    struct record_write *job = data;
+    struct wavo_recorder *recorder = job->recorder;
+
+    if (job->failed && !recorder->failed) {
+        wlr_log(WLR_ERROR, "%s", "Failed to write recording, stopping it");
+        recorder->failed = true;
+    }
+    recorder->writes_pending--;
+    free(job->data);
+    free(job);
+
+    if (recorder->stopped && recorder->writes_pending == 0) {
+        recorder_free(recorder);
+    }
+}
+
+// Hands the chunk to a worker, and starts a new one unless stopping
+static void recorder_flush(struct wavo_recorder *recorder, bool more) {
+    if (!recorder->chunk || recorder->chunk_size == 0) {
+        return;
+    }
+
+    struct record_write *job = calloc(1, sizeof(struct record_write));
+    if (!job) {
+        wlr_log(WLR_ERROR, "Failed to allocate recording write: %s",
+            "Out of memory");
+        recorder->failed = true;
+        return;
+    }
+    job->recorder = recorder;
+    job->fd = recorder->fd;
+    job->data = recorder->chunk;
+    job->size = recorder->chunk_size;
+    job->offset = recorder->offset;
+
+    recorder->offset += (off_t)recorder->chunk_size;
+    recorder->chunk = more ? malloc(CHUNK_SIZE) : NULL;
+    recorder->chunk_size = 0;
+    if (more && !recorder->chunk) {
+        wlr_log(WLR_ERROR, "Failed to allocate recording chunk: %s",
+            "Out of memory");
+        recorder->failed = true;
+    }
+
+    recorder->writes_pending++;
+    if (!wavo_workers_submit(recorder->server->workers, record_write_run,
+            record_write_done, job)) {
+        // Blocks this once rather than losing the chunk
+        record_write_run(job);
+        record_write_done(job);
+    }
+}
+
+static void recorder_emit(struct wavo_recorder *recorder,
+    struct wavo_record_event *event) {
+    if (recorder->failed || recorder->stopped) {
+        return;
+    }
+
+    uint64_t now = wavo_latency_now_usec();
+    uint64_t usec = now > recorder->start_usec ? now - recorder->start_usec : 0;
+    // Whatever the encoding keeps of the gap, so replays see the same times
+    if (usec < recorder->last_usec) {
+        usec = recorder->last_usec;
+    } else if (usec - recorder->last_usec > UINT32_MAX) {
+        usec = recorder->last_usec + UINT32_MAX;
+    }
+    event->usec = usec;
+
+    if (recorder->chunk_size + WAVO_RECORD_MAX_SIZE > CHUNK_SIZE) {
+        recorder_flush(recorder, true);
+        if (recorder->failed) {
+            return;
+        }
+    }
+    recorder->chunk_size += wavo_record_encode(event, recorder->last_usec,
+        recorder->chunk + recorder->chunk_size);
+    recorder->last_usec = usec;
+    recorder->events++;
+}
+
+bool wavo_record_dir(char *path, size_t size) {
+    int len;
+    const char *state_home = getenv("XDG_STATE_HOME");
+    if (state_home && state_home[0] != '\0') {
+        len = snprintf(path, size, "%s/wavo/recordings", state_home);
+    } else {
+        const char *home = getenv("HOME");
+        if (!home) {
+            return false;
+        }
+        len = snprintf(path, size, "%s/.local/state/wavo/recordings", home);
+    }
+    if (len <= 0 || (size_t)len >= size) {
+        return false;
+    }
+
+    // Each missing level, the last one private
+    for (char *p = path + 1; *p; p++) {
+        if (*p != '/') {
+            continue;
+        }
+        *p = '\0';
+        int ret = mkdir(path, 0755);
+        *p = '/';
+        if (ret != 0 && errno != EEXIST) {
+            return false;
+        }
+    }
+    return mkdir(path, 0700) == 0 || errno == EEXIST;
+}
+
+struct wavo_recorder *wavo_recorder_start(struct wavo_server *server,
+    const char *path, bool replace) {
+    struct wavo_recorder *recorder = calloc(1, sizeof(struct wavo_recorder));
+    if (!recorder) {
+        wlr_log(WLR_ERROR, "Failed to allocate recorder: %s", "Out of memory");
+        return NULL;
+    }
+    recorder->chunk = malloc(CHUNK_SIZE);
+    if (!recorder->chunk) {
+        wlr_log(WLR_ERROR, "Failed to allocate recorder: %s", "Out of memory");
+        free(recorder);
+        return NULL;
+    }
+
+    // Recordings hold input, keep them private
+    recorder->fd = open(path, O_WRONLY | O_CREAT | O_CLOEXEC |
+        (replace ? O_TRUNC : O_EXCL), 0600);
+    if (recorder->fd < 0) {
+        wlr_log(WLR_ERROR, "Failed to create recording '%s': %s", path,
+            strerror(errno));
+        free(recorder->chunk);
+        free(recorder);
+        return NULL;
+    }
+
+    recorder->server = server;
+    recorder->start_usec = wavo_latency_now_usec();
+    memcpy(recorder->chunk, WAVO_RECORD_MAGIC, WAVO_RECORD_MAGIC_SIZE);
+    recorder->chunk_size = WAVO_RECORD_MAGIC_SIZE;
+
+    // Replays start from the same layout
+    struct wavo_output *output;
+    wl_list_for_each_reverse(output, &server->outputs, link) {
+        wavo_record_output(recorder, output);
+    }
+    struct wavo_view *view;
+    wl_list_for_each_reverse(view, &server->views, link) {
+        wavo_record_map(recorder, view);
+    }
+
+    wlr_log(WLR_INFO, "Recording to '%s'", path);
+    return recorder;
+}
+
+void wavo_recorder_stop(struct wavo_recorder *recorder) {
+    if (!recorder) {
+        return;
+    }
+
+    recorder_flush(recorder, false);
+    recorder->stopped = true;
+    if (recorder->writes_pending == 0) {
+        recorder_free(recorder);
+    }
+}
+
+void wavo_record_output(struct wavo_recorder *recorder,
+    struct wavo_output *output) {
+    // Mirror targets show another output's frames, nothing to replay
+    if (!recorder || !output->scene_output) {
+        return;
+    }
+
+    struct wlr_box box;
+    wlr_output_layout_get_box(output->server->output_layout,
+        output->wlr_output, &box);
+    struct wavo_record_event event = {
+        .type = WAVO_RECORD_OUTPUT,
+        .output = {
+            .id = output->id,
+            .x = box.x,
+            .y = box.y,
+            .width = output->wlr_output->width,
+            .height = output->wlr_output->height,
+            .refresh = output->wlr_output->refresh,
+            .scale = output->wlr_output->scale,
+        },
+    };
+    recorder_emit(recorder, &event);
+}
+
+void wavo_record_frame(struct wavo_recorder *recorder,
+    struct wavo_output *output, uint64_t frame_usec) {
+    if (!recorder) {
+        return;
+    }
+
+    struct wavo_record_event event = {
+        .type = WAVO_RECORD_FRAME,
+        .frame = {
+            .output_id = output->id,
+            .frame_usec = frame_usec > UINT32_MAX ?
+                UINT32_MAX : (uint32_t)frame_usec,
+        },
+    };
+    recorder_emit(recorder, &event);
+}
+
+static bool is_modifier(uint32_t keycode) {
+    switch (keycode) {
+    case KEY_LEFTCTRL:
+    case KEY_RIGHTCTRL:
+    case KEY_LEFTSHIFT:
+    case KEY_RIGHTSHIFT:
+    case KEY_LEFTALT:
+    case KEY_RIGHTALT:
+    case KEY_LEFTMETA:
+    case KEY_RIGHTMETA:
+    case KEY_CAPSLOCK:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Gives each held key its own letter so replays press and release the same
+// number of keys in the same order, without the text typed
+static uint32_t scrub_keycode(struct wavo_recorder *recorder,
+    uint32_t keycode, uint32_t state) {
+    if (is_modifier(keycode)) {
+        return keycode;
+    }
+
+    // KEY_RESERVED is 0, shift by one so 0 marks a free slot
+    uint32_t held = keycode + 1;
+    size_t slot = 26;
+    for (size_t i = 0; i < 26; i++) {
+        if (recorder->key_map[i] == held) {
+            slot = i;
+            break;
+        }
+    }
+
+    if (state == WL_KEYBOARD_KEY_STATE_PRESSED) {
+        for (size_t i = 0; slot == 26 && i < 26; i++) {
+            if (recorder->key_map[i] == 0) {
+                slot = i;
+            }
+        }
+        if (slot == 26) {
+            // More than 26 keys held, share a letter
+            slot = keycode % 26;
+        }
+        recorder->key_map[slot] = held;
+    } else if (slot == 26) {
+        // Pressed before the recording started
+        slot = keycode % 26;
+    } else {
+        recorder->key_map[slot] = 0;
+    }
+    return letters[slot];
+}
+
+void wavo_record_key(struct wavo_recorder *recorder, uint32_t time_msec,
+    uint32_t keycode, uint32_t state) {
+    if (!recorder) {
+        return;
+    }
+
+    struct wavo_record_event event = {
+        .type = WAVO_RECORD_KEY,
+        .key = {
+            .time_msec = time_msec,
+            .keycode = scrub_keycode(recorder, keycode, state),
+            .state = state,
+        },
+    };
+    recorder_emit(recorder, &event);
+}
+
+void wavo_record_motion(struct wavo_recorder *recorder, uint32_t time_msec,
+    double dx, double dy, double unaccel_dx, double unaccel_dy) {
+    if (!recorder) {
+        return;
+    }
+
+    struct wavo_record_event event = {
+        .type = WAVO_RECORD_MOTION,
+        .motion = {
+            .time_msec = time_msec,
+            .dx = (float)dx,
+            .dy = (float)dy,
+            .unaccel_dx = (float)unaccel_dx,
+            .unaccel_dy = (float)unaccel_dy,
+        },
+    };
+    recorder_emit(recorder, &event);
+}
+
+void wavo_record_button(struct wavo_recorder *recorder, uint32_t time_msec,
+    uint32_t button, uint32_t state) {
+    if (!recorder) {
+        return;
+    }
+
+    struct wavo_record_event event = {
+        .type = WAVO_RECORD_BUTTON,
+        .button = {
+            .time_msec = time_msec,
+            .button = button,
+            .state = state,
+        },
+    };
+    recorder_emit(recorder, &event);
+}
+
+void wavo_record_axis(struct wavo_recorder *recorder, uint32_t time_msec,
+    uint32_t orientation, uint32_t source, uint32_t relative_direction,
+    double delta, int32_t delta_discrete) {
+    if (!recorder) {
+        return;
+    }
+
+    struct wavo_record_event event = {
+        .type = WAVO_RECORD_AXIS,
+        .axis = {
+            .time_msec = time_msec,
+            .orientation = (uint8_t)orientation,
+            .source = (uint8_t)source,
+            .relative_direction = (uint8_t)relative_direction,
+            .delta_discrete = delta_discrete,
+            .delta = (float)delta,
+        },
+    };
+    recorder_emit(recorder, &event);
+}
+
+void wavo_record_pointer_frame(struct wavo_recorder *recorder) {
+    if (!recorder) {
+        return;
+    }
+
+    struct wavo_record_event event = {
+        .type = WAVO_RECORD_POINTER_FRAME,
+    };
+    recorder_emit(recorder, &event);
+}
+
+void wavo_record_map(struct wavo_recorder *recorder, struct wavo_view *view) {
+    if (!recorder) {
+        return;
+    }
+
+    struct wavo_record_event event = {
+        .type = WAVO_RECORD_MAP,
+        .map.view_id = view->id,
+    };
+    wavo_view_get_box(view, &event.map.box);
+    recorder_emit(recorder, &event);
+}
+
+void wavo_record_unmap(struct wavo_recorder *recorder,
+    struct wavo_view *view) {
+    if (!recorder) {
+        return;
+    }
+
+    struct wavo_record_event event = {
+        .type = WAVO_RECORD_UNMAP,
+        .unmap.view_id = view->id,
+    };
+    recorder_emit(recorder, &event);
+}
+
+void wavo_record_commit(struct wavo_recorder *recorder,
+    struct wavo_view *view) {
+    if (!recorder) {
+        return;
+    }
+
+    struct wlr_surface *surface = view->xdg_surface->surface;
+    struct wavo_record_event event = {
+        .type = WAVO_RECORD_COMMIT,
+        .commit = {
+            .view_id = view->id,
+            .width = surface->current.width,
+            .height = surface->current.height,
+        },
+    };
+
+    int count;
+    const pixman_box32_t *rects =
+        pixman_region32_rectangles(&surface->buffer_damage, &count);
+    if (count > WAVO_RECORD_MAX_RECTS) {
+        rects = pixman_region32_extents(&surface->buffer_damage);
+        count = 1;
+    }
+    for (int i = 0; i < count; i++) {
+        event.commit.rects[i] = (struct wlr_box){
+            .x = rects[i].x1,
+            .y = rects[i].y1,
+            .width = rects[i].x2 - rects[i].x1,
+            .height = rects[i].y2 - rects[i].y1,
+        };
+    }
+    event.commit.rect_count = (uint32_t)count;
+    recorder_emit(recorder, &event);
+}
+
+void wavo_recorder_print_metrics(struct wavo_recorder *recorder, FILE *out) {
+    if (!recorder) {
+        return;
+    }
+
+    fprintf(out, "record.events %" PRIu64 "\n", recorder->events);
+    fprintf(out, "record.bytes %" PRIu64 "\n",
+        (uint64_t)recorder->offset + recorder->chunk_size);
+    fprintf(out, "record.failed %d\n", recorder->failed ? 1 : 0);
+}
@@ -1,22 +1,47 @@
 #define _POSIX_C_SOURCE 200112L
 #include <assert.h>
+#include <signal.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
 #include <wayland-server-core.h>
 #include <wlr/backend.h>
+#include <wlr/backend/headless.h>
+#include <wlr/backend/multi.h>
 #include <wlr/render/allocator.h>
+#include <wlr/render/drm_format_set.h>
 #include <wlr/render/wlr_renderer.h>
 #include <wlr/types/wlr_compositor.h>
+#include <wlr/types/wlr_drm.h>
+#include <wlr/types/wlr_linux_dmabuf_v1.h>
+#include <wlr/types/wlr_fractional_scale_v1.h>
 #include <wlr/types/wlr_output.h>
 #include <wlr/types/wlr_output_layout.h>
+#include <wlr/types/wlr_presentation_time.h>
 #include <wlr/types/wlr_scene.h>
+#include <wlr/types/wlr_viewporter.h>
 #include <wlr/types/wlr_xdg_shell.h>
 #include <wlr/util/log.h>
 #include <wlr/xwayland.h>
 #include <wlr/types/wlr_output_management_v1.h>
+#include "wavo/budget.h"
+#include "wavo/foreign_toplevel.h"
+#include "wavo/hooks.h"
+#include "wavo/idle.h"
 #include "wavo/input.h"
+#include "wavo/ipc.h"
+#include "wavo/metrics.h"
 #include "wavo/output.h"
+#include "wavo/pressure.h"
+#include "wavo/record.h"
+#include "wavo/render.h"
+#include "wavo/screencopy.h"
 #include "wavo/server.h"
+#include "wavo/shm.h"
+#include "wavo/thumbnail.h"
 #include "wavo/view.h"
+#include "wavo/watchdog.h"
+#include "wavo/workers.h"
 
 static void server_new_output(struct wl_listener *listener, void *data) {
     struct wavo_server *server = wl_container_of(listener, server, new_output);
@@ -42,81 +67,174 @@ static void server_new_output(struct wl_listener *listener, void *data) {
     wlr_output_state_finish(&state);
 }
 
-static void xdg_surface_map(struct wl_listener *listener, void *data) {
-    (void)data;
-    struct wavo_view *view = wl_container_of(listener, view, map);
-    view->mapped = true;
+static int handle_sigusr1(int signal_number, void *data) {
+    (void)signal_number;
+    struct wavo_server *server = data;
+    wavo_metrics_dump(server, stderr);
+    return 0;
 }
 
-static void xdg_surface_unmap(struct wl_listener *listener, void *data) {
-    (void)data;
-    struct wavo_view *view = wl_container_of(listener, view, unmap);
-    view->mapped = false;
+static int handle_sigterm(int signal_number, void *data) {
+    (void)signal_number;
+    wavo_server_terminate(data);
+    return 0;
 }
 
-static void xdg_surface_destroy(struct wl_listener *listener, void *data) {
-    (void)data;
-    struct wavo_view *view = wl_container_of(listener, view, destroy);
-    wl_list_remove(&view->map.link);
-    wl_list_remove(&view->unmap.link);
-    wl_list_remove(&view->destroy.link);
-    free(view);
+static void server_new_xdg_toplevel(struct wl_listener *listener, void *data) {
+    struct wavo_server *server = wl_container_of(listener, server, new_xdg_toplevel);
+    struct wlr_xdg_toplevel *toplevel = data;
+
+    wlr_log(WLR_DEBUG, "%s", "New toplevel xdg surface");
+
+    struct wavo_view *view = wavo_view_create(server, toplevel->base);
+    if (!view) {
+        wlr_log(WLR_ERROR, "%s", "Failed to create view");
+    }
 }
 
-static void server_new_xdg_surface(struct wl_listener *listener, void *data) {
-    struct wavo_server *server = wl_container_of(listener, server, new_xdg_surface);
-    struct wlr_xdg_surface *xdg_surface = data;
+static void server_new_xdg_popup(struct wl_listener *listener, void *data) {
+    struct wavo_server *server = wl_container_of(listener, server, new_xdg_popup);
+    struct wlr_xdg_popup *xdg_popup = data;
 
-    if (xdg_surface->role != WLR_XDG_SURFACE_ROLE_TOPLEVEL) {
-        return;
+    if (!wavo_popup_create(server, xdg_popup)) {
+        wlr_log(WLR_ERROR, "%s", "Failed to create popup");
     }
+}
 
-    wlr_log(WLR_DEBUG, "%s", "New toplevel xdg surface");
+static void server_layout_change(struct wl_listener *listener, void *data) {
+    (void)data;
+    struct wavo_server *server = wl_container_of(listener, server, layout_change);
 
-    struct wavo_view *view = wavo_view_create(server, xdg_surface);
-    if (!view) {
-        wlr_log(WLR_ERROR, "%s", "Failed to create view");
-        return;
+    // Outputs moved, changed mode or scale
+    struct wavo_view *view;
+    wl_list_for_each(view, &server->views, link) {
+        wavo_view_update_output(view);
+    }
+}
+
+// Same globals as wlr_renderer_init_wl_display(), except that wl_shm also
+// accepts the YUV formats screencopy offers, without advertising them
+static bool server_init_buffer_globals(struct wavo_server *server) {
+    const struct wlr_drm_format_set *texture_formats =
+        wlr_renderer_get_texture_formats(server->renderer,
+            WLR_BUFFER_CAP_DATA_PTR);
+    if (!texture_formats) {
+        wlr_log(WLR_ERROR, "%s", "Renderer has no shm texture formats");
+        return false;
     }
 
-    view->map.notify = xdg_surface_map;
-    wl_signal_add(&xdg_surface->surface->events.map, &view->map);
+    if (!wavo_shm_create(server->wl_display, server->compositor,
+            texture_formats)) {
+        return false;
+    }
+
+    if (wlr_renderer_get_texture_formats(server->renderer,
+            WLR_BUFFER_CAP_DMABUF)) {
+        if (wlr_renderer_get_drm_fd(server->renderer) >= 0) {
+            wlr_drm_create(server->wl_display, server->renderer);
+        }
+        if (!wlr_linux_dmabuf_v1_create_with_renderer(server->wl_display, 4,
+                server->renderer)) {
+            wlr_log(WLR_ERROR, "%s", "Failed to create linux-dmabuf");
+            return false;
+        }
+    }
 
-    view->unmap.notify = xdg_surface_unmap;
-    wl_signal_add(&xdg_surface->surface->events.unmap, &view->unmap);
+    return true;
+}
+
+static void server_init_pools(struct wavo_server *server) {
+    wavo_pool_init(&server->view_pool, "view", sizeof(struct wavo_view), 32);
+    wavo_pool_init(&server->popup_pool, "popup", sizeof(struct wavo_popup), 8);
+    wavo_pool_init(&server->keyboard_pool, "keyboard",
+        sizeof(struct wavo_keyboard), 8);
+    wavo_pool_init(&server->pointer_pool, "pointer",
+        sizeof(struct wavo_pointer), 8);
+    wavo_pool_init(&server->grab_pool, "grab", wavo_view_grab_size(), 4);
+}
 
-    view->destroy.notify = xdg_surface_destroy;
-    wl_signal_add(&xdg_surface->events.destroy, &view->destroy);
+static void server_finish_pools(struct wavo_server *server) {
+    wavo_pool_finish(&server->view_pool);
+    wavo_pool_finish(&server->popup_pool);
+    wavo_pool_finish(&server->keyboard_pool);
+    wavo_pool_finish(&server->pointer_pool);
+    wavo_pool_finish(&server->grab_pool);
 }
 
-struct wavo_server *wavo_server_create(void) {
+struct wavo_server *wavo_server_create(struct wavo_config *config) {
     struct wavo_server *server = calloc(1, sizeof(struct wavo_server));
     if (!server) {
         wlr_log(WLR_ERROR, "%s", "Failed to allocate server");
         return NULL;
     }
 
+    server->config = config;
+    server_init_pools(server);
+
     server->wl_display = wl_display_create();
     if (!server->wl_display) {
         wlr_log(WLR_ERROR, "%s", "Failed to create wayland display");
+        server_finish_pools(server);
         free(server);
         return NULL;
     }
 
     struct wl_event_loop *event_loop = wl_display_get_event_loop(server->wl_display);
+    server->event_loop = event_loop;
+
+    // Blocking jobs report back through the event loop
+    server->workers = wavo_workers_create(event_loop, 0);
+    if (!server->workers) {
+        goto error_display;
+    }
+
     server->backend = wlr_backend_autocreate(event_loop, NULL);
     if (!server->backend) {
         wlr_log(WLR_ERROR, "%s", "Failed to create wlr_backend");
         goto error_display;
     }
 
+    // A headless backend next to the real ones lets virtual outputs be
+    // added at runtime, for load tests and remote sessions
+    if (!wlr_backend_is_multi(server->backend)) {
+        struct wlr_backend *multi = wlr_multi_backend_create(event_loop);
+        if (!multi || !wlr_multi_backend_add(multi, server->backend)) {
+            wlr_log(WLR_ERROR, "%s", "Failed to create multi-backend");
+            if (multi) {
+                wlr_backend_destroy(multi);
+            }
+            goto error_backend;
+        }
+        server->backend = multi;
+    }
+
+    server->headless_backend = wlr_headless_backend_create(event_loop);
+    if (!server->headless_backend ||
+            !wlr_multi_backend_add(server->backend, server->headless_backend)) {
+        wlr_log(WLR_ERROR, "%s", "Failed to add headless backend");
+        if (server->headless_backend) {
+            wlr_backend_destroy(server->headless_backend);
+        }
+        goto error_backend;
+    }
+
     server->renderer = wlr_renderer_autocreate(server->backend);
     if (!server->renderer) {
         wlr_log(WLR_ERROR, "%s", "Failed to create renderer");
         goto error_backend;
     }
 
-    wlr_renderer_init_wl_display(server->renderer, server->wl_display);
+    // Before the buffer globals, wl_shm watches its surfaces
+    server->compositor = wlr_compositor_create(server->wl_display, 6,
+        server->renderer);
+    if (!server->compositor) {
+        wlr_log(WLR_ERROR, "%s", "Failed to create compositor");
+        goto error_renderer;
+    }
+
+    if (!server_init_buffer_globals(server)) {
+        goto error_renderer;
+    }
 
     server->allocator = wlr_allocator_autocreate(server->backend,
         server->renderer);
@@ -125,11 +243,30 @@ struct wavo_server *wavo_server_create(void) {
         goto error_renderer;
     }
 
-    server->compositor = wlr_compositor_create(server->wl_display, 6,
-        server->renderer);
-    if (!server->compositor) {
-        wlr_log(WLR_ERROR, "%s", "Failed to create compositor");
-        goto error_allocator;
+    // Scene surfaces report sampled/scanned-out state to wp_presentation
+    server->presentation = wlr_presentation_create(server->wl_display,
+        server->backend);
+    if (!server->presentation) {
+        wlr_log(WLR_ERROR, "%s", "Failed to create presentation");
+        goto error_compositor;
+    }
+
+    // Let clients crop/scale their own buffers and learn the real output
+    // scale, so HiDPI outputs get native-size buffers
+    if (!wlr_viewporter_create(server->wl_display)) {
+        wlr_log(WLR_ERROR, "%s", "Failed to create viewporter");
+        goto error_compositor;
+    }
+
+    if (!wlr_fractional_scale_manager_v1_create(server->wl_display, 1)) {
+        wlr_log(WLR_ERROR, "%s", "Failed to create fractional scale manager");
+        goto error_compositor;
+    }
+
+    // Damage-tracked screen capture for recording and remote support
+    server->screencopy = wavo_screencopy_manager_create(server);
+    if (!server->screencopy) {
+        goto error_compositor;
     }
 
     server->scene = wlr_scene_create();
@@ -138,15 +275,31 @@ struct wavo_server *wavo_server_create(void) {
         goto error_compositor;
     }
 
+    server->view_tree = wlr_scene_tree_create(&server->scene->tree);
+    if (!server->view_tree) {
+        wlr_log(WLR_ERROR, "%s", "Failed to create view tree");
+        goto error_scene;
+    }
+
     server->output_layout = wlr_output_layout_create(server->wl_display);
     if (!server->output_layout) {
         wlr_log(WLR_ERROR, "%s", "Failed to create output layout");
         goto error_scene;
     }
 
+    server->scene_layout = wlr_scene_attach_output_layout(server->scene,
+        server->output_layout);
+    if (!server->scene_layout) {
+        wlr_log(WLR_ERROR, "%s", "Failed to attach output layout to scene");
+        wlr_output_layout_destroy(server->output_layout);
+        goto error_scene;
+    }
+
     wl_list_init(&server->outputs);
+    wl_list_init(&server->views);
 
-    server->xdg_shell = wlr_xdg_shell_create(server->wl_display, 3);
+    // Version 6 for the suspended state, see pressure.h
+    server->xdg_shell = wlr_xdg_shell_create(server->wl_display, 6);
     if (!server->xdg_shell) {
         wlr_log(WLR_ERROR, "%s", "Failed to create XDG shell");
         goto error_output_layout;
@@ -161,31 +314,103 @@ struct wavo_server *wavo_server_create(void) {
     server->new_output.notify = server_new_output;
     wl_signal_add(&server->backend->events.new_output, &server->new_output);
 
-    server->new_xdg_surface.notify = server_new_xdg_surface;
-    wl_signal_add(&server->xdg_shell->events.new_surface,
-        &server->new_xdg_surface);
+    server->new_xdg_toplevel.notify = server_new_xdg_toplevel;
+    wl_signal_add(&server->xdg_shell->events.new_toplevel,
+        &server->new_xdg_toplevel);
+
+    server->new_xdg_popup.notify = server_new_xdg_popup;
+    wl_signal_add(&server->xdg_shell->events.new_popup,
+        &server->new_xdg_popup);
+
+    server->layout_change.notify = server_layout_change;
+    wl_signal_add(&server->output_layout->events.change,
+        &server->layout_change);
+
+    server->idle = wavo_idle_create(server);
+    if (!server->idle) {
+        goto error_input;
+    }
+
+    server->pressure = wavo_pressure_create(server);
+    if (!server->pressure) {
+        goto error_idle;
+    }
+
+    server->thumbnails = wavo_thumbnails_create(server);
+    if (!server->thumbnails) {
+        goto error_pressure;
+    }
+
+    server->budgets = wavo_budgets_create(server);
+    if (!server->budgets) {
+        goto error_thumbnails;
+    }
+
+    server->foreign_toplevels = wavo_foreign_toplevels_create(server);
+    if (!server->foreign_toplevels) {
+        goto error_budgets;
+    }
+
+    server->watchdog = wavo_watchdog_create(server);
+    if (!server->watchdog) {
+        goto error_foreign_toplevels;
+    }
+
+    // Not fatal either, hooks that fail to load leave the config as it is;
+    // created before the backend starts so the first outputs reach
+    // output_add
+    if (config->hooks_path && access(config->hooks_path, R_OK) == 0) {
+        server->hooks = wavo_hooks_create(server, config->hooks_path);
+    }
 
     const char *socket = wl_display_add_socket_auto(server->wl_display);
     if (!socket) {
         wlr_log(WLR_ERROR, "%s", "Failed to create wayland socket");
-        goto error_input;
+        goto error_hooks;
     }
 
     if (!wlr_backend_start(server->backend)) {
         wlr_log(WLR_ERROR, "%s", "Failed to start backend");
         wl_display_destroy_clients(server->wl_display);
-        goto error_input;
+        goto error_hooks;
     }
 
+    server->sigusr1_source = wl_event_loop_add_signal(event_loop, SIGUSR1,
+        handle_sigusr1, server);
+    server->sigint_source = wl_event_loop_add_signal(event_loop, SIGINT,
+        handle_sigterm, server);
+    server->sigterm_source = wl_event_loop_add_signal(event_loop, SIGTERM,
+        handle_sigterm, server);
+
+    // Not fatal, the compositor works without remote control
+    server->ipc = wavo_ipc_create(server, socket);
+
     setenv("WAYLAND_DISPLAY", socket, true);
     wlr_log(WLR_INFO, "Running compositor on wayland display '%s'", socket);
 
     return server;
 
+error_hooks:
+    // Outputs of the backend still emit output_remove when it goes
+    wavo_hooks_destroy(server->hooks);
+    server->hooks = NULL;
+    wavo_watchdog_destroy(server->watchdog);
+error_foreign_toplevels:
+    wavo_foreign_toplevels_destroy(server->foreign_toplevels);
+error_budgets:
+    wavo_budgets_destroy(server->budgets);
+error_thumbnails:
+    wavo_thumbnails_destroy(server->thumbnails);
+error_pressure:
+    wavo_pressure_destroy(server->pressure);
+error_idle:
+    wavo_idle_destroy(server->idle);
 error_input:
     wavo_input_destroy(server->input);
+    wl_list_remove(&server->layout_change.link);
 error_xdg_shell:
-    wl_list_remove(&server->new_xdg_surface.link);
+    wl_list_remove(&server->new_xdg_toplevel.link);
+    wl_list_remove(&server->new_xdg_popup.link);
     wl_global_destroy(server->xdg_shell->global);
 error_output_layout:
     wl_list_remove(&server->new_output.link);
@@ -193,7 +418,6 @@ error_output_layout:
 error_scene:
     wlr_scene_node_destroy(&server->scene->tree.node);
 error_compositor:
-    wl_list_remove(&server->new_xdg_surface.link);
 error_allocator:
     wlr_allocator_destroy(server->allocator);
 error_renderer:
@@ -201,7 +425,9 @@ error_renderer:
 error_backend:
     wlr_backend_destroy(server->backend);
 error_display:
+    wavo_workers_destroy(server->workers);
     wl_display_destroy(server->wl_display);
+    server_finish_pools(server);
     free(server);
     return NULL;
 }
@@ -211,10 +437,37 @@ void wavo_server_destroy(struct wavo_server *server) {
         return;
     }
 
+    // Its last chunk is written by the workers
+    wavo_recorder_stop(server->recorder);
+    server->recorder = NULL;
+
+    // Done callbacks may still need clients and outputs
+    wavo_workers_destroy(server->workers);
+    wavo_render_destroy(server->render);
     wl_display_destroy_clients(server->wl_display);
+    wavo_hooks_destroy(server->hooks);
+    server->hooks = NULL;
 
+    wavo_ipc_destroy(server->ipc);
+    if (server->sigusr1_source) {
+        wl_event_source_remove(server->sigusr1_source);
+    }
+    if (server->sigint_source) {
+        wl_event_source_remove(server->sigint_source);
+    }
+    if (server->sigterm_source) {
+        wl_event_source_remove(server->sigterm_source);
+    }
+    wavo_watchdog_destroy(server->watchdog);
+    wavo_foreign_toplevels_destroy(server->foreign_toplevels);
+    wavo_budgets_destroy(server->budgets);
+    wavo_thumbnails_destroy(server->thumbnails);
+    wavo_pressure_destroy(server->pressure);
+    wavo_idle_destroy(server->idle);
     wavo_input_destroy(server->input);
-    wl_list_remove(&server->new_xdg_surface.link);
+    wl_list_remove(&server->layout_change.link);
+    wl_list_remove(&server->new_xdg_toplevel.link);
+    wl_list_remove(&server->new_xdg_popup.link);
     wl_global_destroy(server->xdg_shell->global);
     wl_list_remove(&server->new_output.link);
     wlr_output_layout_destroy(server->output_layout);
@@ -223,5 +476,29 @@ void wavo_server_destroy(struct wavo_server *server) {
     wlr_renderer_destroy(server->renderer);
     wlr_backend_destroy(server->backend);
     wl_display_destroy(server->wl_display);
+    server_finish_pools(server);
     free(server);
 }
+
+void wavo_server_dispatch(struct wavo_server *server, int timeout_msec) {
+    bool idle = server->idle && server->idle->idle;
+
+    wl_display_flush_clients(server->wl_display);
+    wl_event_loop_dispatch(server->event_loop, timeout_msec);
+
+    server->wakeups++;
+    if (idle) {
+        server->idle_wakeups++;
+    }
+}
+
+void wavo_server_run(struct wavo_server *server) {
+    server->running = true;
+    while (server->running) {
+        wavo_server_dispatch(server, -1);
+    }
+}
+
+void wavo_server_terminate(struct wavo_server *server) {
+    server->running = false;
+}
@@ -0,0 +1,229 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <wayland-server-core.h>
+#include <wlr/util/log.h>
+#include "wavo/latency.h"
+#include "wavo/workers.h"
+
+struct wavo_work {
+    wavo_work_func_t work;
+    wavo_work_done_func_t done;
+    void *data;
+    uint64_t submit_usec;
+    struct wl_list link;
+};
+
+static void *worker_thread(void *data) {
+    struct wavo_workers *workers = data;
+
+    pthread_mutex_lock(&workers->lock);
+    for (;;) {
+        while (wl_list_empty(&workers->queue) && !workers->stopping) {
+            pthread_cond_wait(&workers->cond, &workers->lock);
+        }
+        // Stopping still drains the queue, see wavo_workers_destroy()
+        if (wl_list_empty(&workers->queue)) {
+            break;
+        }
+
+        struct wavo_work *work =
+            wl_container_of(workers->queue.prev, work, link);
+        wl_list_remove(&work->link);
+        pthread_mutex_unlock(&workers->lock);
+
+        uint64_t start_usec = wavo_latency_now_usec();
+        work->work(work->data);
+        uint64_t end_usec = wavo_latency_now_usec();
+
+        pthread_mutex_lock(&workers->lock);
+        wavo_latency_histogram_add(&workers->queue_wait,
+            start_usec - work->submit_usec);
+        wavo_latency_histogram_add(&workers->run_time, end_usec - start_usec);
+        bool was_empty = wl_list_empty(&workers->done);
+        wl_list_insert(workers->done.prev, &work->link);
+
+        // One wakeup per batch, the main thread takes the whole list
+        if (was_empty) {
+            uint64_t one = 1;
+            if (write(workers->event_fd, &one, sizeof(one)) < 0 &&
+                    errno != EAGAIN) {
+                wlr_log(WLR_ERROR, "%s", "Failed to signal worker completion");
+            }
+        }
+    }
+    pthread_mutex_unlock(&workers->lock);
+    return NULL;
+}
+
+static void workers_run_done(struct wavo_workers *workers) {
+    struct wl_list done;
+    wl_list_init(&done);
+
+    pthread_mutex_lock(&workers->lock);
+    wl_list_insert_list(&done, &workers->done);
+    wl_list_init(&workers->done);
+    pthread_mutex_unlock(&workers->lock);
+
+    struct wavo_work *work, *tmp;
+    wl_list_for_each_safe(work, tmp, &done, link) {
+        wl_list_remove(&work->link);
+        workers->completed++;
+        if (work->done) {
+            work->done(work->data);
+        }
+        free(work);
+    }
+}
+
+static int workers_handle_event(int fd, uint32_t mask, void *data) {
+    (void)mask;
+    struct wavo_workers *workers = data;
+
+    uint64_t count;
+    if (read(fd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+        wlr_log(WLR_ERROR, "%s", "Failed to read worker completion");
+    }
+    workers_run_done(workers);
+    return 0;
+}
+
+static int default_thread_count(void) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus <= 2) {
+        return 1;
+    }
+    return cpus - 1 < WAVO_WORKERS_MAX ? (int)cpus - 1 : WAVO_WORKERS_MAX;
+}
+
+struct wavo_workers *wavo_workers_create(struct wl_event_loop *loop,
+    int thread_count) {
+    struct wavo_workers *workers = calloc(1, sizeof(struct wavo_workers));
+    if (!workers) {
+        wlr_log(WLR_ERROR, "%s", "Failed to allocate worker pool");
+        return NULL;
+    }
+
+    wl_list_init(&workers->queue);
+    wl_list_init(&workers->done);
+    pthread_mutex_init(&workers->lock, NULL);
+    pthread_cond_init(&workers->cond, NULL);
+
+    workers->event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (workers->event_fd < 0) {
+        wlr_log(WLR_ERROR, "%s", "Failed to create worker eventfd");
+        goto error;
+    }
+
+    workers->event_source = wl_event_loop_add_fd(loop, workers->event_fd,
+        WL_EVENT_READABLE, workers_handle_event, workers);
+    if (!workers->event_source) {
+        wlr_log(WLR_ERROR, "%s", "Failed to add worker eventfd to event loop");
+        goto error_fd;
+    }
+
+    if (thread_count <= 0) {
+        thread_count = default_thread_count();
+    }
+    if (thread_count > WAVO_WORKERS_MAX) {
+        thread_count = WAVO_WORKERS_MAX;
+    }
+
+    // Signals are for the event loop, workers never take one
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    for (int i = 0; i < thread_count; i++) {
+        if (pthread_create(&workers->threads[i], NULL, worker_thread,
+                workers) != 0) {
+            break;
+        }
+        workers->thread_count++;
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    if (workers->thread_count == 0) {
+        wlr_log(WLR_ERROR, "%s", "Failed to start worker threads");
+        wl_event_source_remove(workers->event_source);
+        goto error_fd;
+    }
+
+    wlr_log(WLR_DEBUG, "Started %d worker threads", workers->thread_count);
+    return workers;
+
+error_fd:
+    close(workers->event_fd);
+error:
+    pthread_cond_destroy(&workers->cond);
+    pthread_mutex_destroy(&workers->lock);
+    free(workers);
+    return NULL;
+}
+
+void wavo_workers_destroy(struct wavo_workers *workers) {
+    if (!workers) {
+        return;
+    }
+
+    pthread_mutex_lock(&workers->lock);
+    workers->stopping = true;
+    pthread_cond_broadcast(&workers->cond);
+    pthread_mutex_unlock(&workers->lock);
+
+    for (int i = 0; i < workers->thread_count; i++) {
+        pthread_join(workers->threads[i], NULL);
+    }
+
+    // Owners get their data back even for jobs that finished just now
+    workers_run_done(workers);
+
+    wl_event_source_remove(workers->event_source);
+    close(workers->event_fd);
+    pthread_cond_destroy(&workers->cond);
+    pthread_mutex_destroy(&workers->lock);
+    free(workers);
+}
+
+bool wavo_workers_submit(struct wavo_workers *workers, wavo_work_func_t work,
+    wavo_work_done_func_t done, void *data) {
+    struct wavo_work *job = calloc(1, sizeof(struct wavo_work));
+    if (!job) {
+        wlr_log(WLR_ERROR, "Failed to allocate work: %s", "Out of memory");
+        return false;
+    }
+
+    job->work = work;
+    job->done = done;
+    job->data = data;
+    job->submit_usec = wavo_latency_now_usec();
+
+    pthread_mutex_lock(&workers->lock);
+    // Taken from the tail, so the oldest job runs first
+    wl_list_insert(&workers->queue, &job->link);
+    pthread_cond_signal(&workers->cond);
+    pthread_mutex_unlock(&workers->lock);
+
+    workers->submitted++;
+    return true;
+}
+
+void wavo_workers_print_metrics(struct wavo_workers *workers, FILE *out) {
+    if (!workers) {
+        return;
+    }
+
+    pthread_mutex_lock(&workers->lock);
+    struct wavo_latency_histogram queue_wait = workers->queue_wait;
+    struct wavo_latency_histogram run_time = workers->run_time;
+    pthread_mutex_unlock(&workers->lock);
+
+    fprintf(out, "workers.threads %d\n", workers->thread_count);
+    fprintf(out, "workers.submitted %" PRIu64 "\n", workers->submitted);
+    fprintf(out, "workers.completed %" PRIu64 "\n", workers->completed);
+    wavo_latency_histogram_print(&queue_wait, "workers.queue_wait", out);
+    wavo_latency_histogram_print(&run_time, "workers.run_time", out);
+}
@@ -0,0 +1,315 @@
+#define _GNU_SOURCE
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <wayland-client.h>
+#include <wayland-server-core.h>
+#include "wavo/latency.h"
+#include "wavo/server.h"
+#include "client.h"
+#include "xdg-shell-client-protocol.h"
+
+#define ROUNDTRIP_TIMEOUT_MSEC 1000
+
+static void wm_base_ping(void *data, struct xdg_wm_base *wm_base,
+    uint32_t serial) {
+    struct headless_client *client = data;
+    client->pings++;
+    client->ping_serial = serial;
+    if (!client->ignore_pings) {
+        xdg_wm_base_pong(wm_base, serial);
+    }
+}
+
+static const struct xdg_wm_base_listener wm_base_listener = {
+    .ping = wm_base_ping,
+};
+
+static void registry_global(void *data, struct wl_registry *registry,
+    uint32_t name, const char *interface, uint32_t version) {
+    (void)version;
+    struct headless_client *client = data;
+
+    if (strcmp(interface, wl_compositor_interface.name) == 0) {
+        client->compositor = wl_registry_bind(registry, name,
+            &wl_compositor_interface, 4);
+    } else if (strcmp(interface, wl_shm_interface.name) == 0) {
+        client->shm = wl_registry_bind(registry, name, &wl_shm_interface, 1);
+    } else if (strcmp(interface, xdg_wm_base_interface.name) == 0) {
+        client->wm_base = wl_registry_bind(registry, name,
+            &xdg_wm_base_interface, 1);
+        xdg_wm_base_add_listener(client->wm_base, &wm_base_listener, client);
+    }
+}
+
+static void registry_global_remove(void *data, struct wl_registry *registry,
+    uint32_t name) {
+    (void)data;
+    (void)registry;
+    (void)name;
+}
+
+static const struct wl_registry_listener registry_listener = {
+    .global = registry_global,
+    .global_remove = registry_global_remove,
+};
+
+bool headless_client_connect(struct headless_client *client,
+    struct wavo_server *server) {
+    memset(client, 0, sizeof(*client));
+    client->display = wl_display_connect(NULL);
+    if (!client->display) {
+        perror("wl_display_connect");
+        return false;
+    }
+    client->registry = wl_display_get_registry(client->display);
+    wl_registry_add_listener(client->registry, &registry_listener, client);
+    if (!headless_client_roundtrip(client, server) || !client->compositor ||
+            !client->shm || !client->wm_base) {
+        fprintf(stderr, "%s\n", "compositor is missing globals");
+        headless_client_disconnect(client);
+        return false;
+    }
+    return true;
+}
+
+void headless_client_disconnect(struct headless_client *client) {
+    if (!client->display) {
+        return;
+    }
+    if (client->wm_base) {
+        xdg_wm_base_destroy(client->wm_base);
+    }
+    if (client->shm) {
+        wl_shm_destroy(client->shm);
+    }
+    if (client->compositor) {
+        wl_compositor_destroy(client->compositor);
+    }
+    wl_registry_destroy(client->registry);
+    wl_display_disconnect(client->display);
+    client->display = NULL;
+}
+
+void headless_client_dispatch(struct headless_client *client,
+    struct wavo_server *server, int timeout_msec) {
+    wl_display_flush(client->display);
+    wavo_server_dispatch(server, timeout_msec);
+    // The server only flushes before it waits
+    wl_display_flush_clients(server->wl_display);
+
+    while (wl_display_prepare_read(client->display) != 0) {
+        wl_display_dispatch_pending(client->display);
+    }
+    struct pollfd pollfd = {
+        .fd = wl_display_get_fd(client->display),
+        .events = POLLIN,
+    };
+    if (poll(&pollfd, 1, 0) > 0) {
+        wl_display_read_events(client->display);
+    } else {
+        wl_display_cancel_read(client->display);
+    }
+    wl_display_dispatch_pending(client->display);
+}
+
+void headless_client_run_for(struct headless_client *client,
+    struct wavo_server *server, int msec) {
+    uint64_t end = wavo_latency_now_usec() + (uint64_t)msec * 1000;
+    while (wavo_latency_now_usec() < end) {
+        headless_client_dispatch(client, server, 1);
+    }
+}
+
+static void sync_done(void *data, struct wl_callback *callback,
+    uint32_t time) {
+    (void)time;
+    bool *done = data;
+    *done = true;
+    wl_callback_destroy(callback);
+}
+
+static const struct wl_callback_listener sync_listener = {
+    .done = sync_done,
+};
+
+bool headless_client_roundtrip(struct headless_client *client,
+    struct wavo_server *server) {
+    bool done = false;
+    struct wl_callback *callback = wl_display_sync(client->display);
+    wl_callback_add_listener(callback, &sync_listener, &done);
+
+    uint64_t end = wavo_latency_now_usec() +
+        (uint64_t)ROUNDTRIP_TIMEOUT_MSEC * 1000;
+    while (!done && wl_display_get_error(client->display) == 0 &&
+            wavo_latency_now_usec() < end) {
+        headless_client_dispatch(client, server, 1);
+    }
+    if (!done) {
+        wl_callback_destroy(callback);
+    }
+    return done;
+}
+
+static void xdg_surface_configure(void *data, struct xdg_surface *xdg_surface,
+    uint32_t serial) {
+    struct headless_window *window = data;
+    window->configures++;
+    window->configure_serial = serial;
+    if (window->ack_configures) {
+        xdg_surface_ack_configure(xdg_surface, serial);
+    }
+}
+
+static const struct xdg_surface_listener xdg_surface_listener = {
+    .configure = xdg_surface_configure,
+};
+
+static void toplevel_configure(void *data, struct xdg_toplevel *toplevel,
+    int32_t width, int32_t height, struct wl_array *states) {
+    (void)toplevel;
+    (void)states;
+    struct headless_window *window = data;
+    window->configure_width = width;
+    window->configure_height = height;
+}
+
+static void toplevel_close(void *data, struct xdg_toplevel *toplevel) {
+    (void)data;
+    (void)toplevel;
+}
+
+static const struct xdg_toplevel_listener toplevel_listener = {
+    .configure = toplevel_configure,
+    .close = toplevel_close,
+};
+
+static void buffer_release(void *data, struct wl_buffer *wl_buffer) {
+    struct headless_window *window = data;
+    for (int i = 0; i < 2; i++) {
+        if (window->buffers[i] == wl_buffer) {
+            window->busy[i] = false;
+        }
+    }
+}
+
+static const struct wl_buffer_listener buffer_listener = {
+    .release = buffer_release,
+};
+
+static bool window_create_buffers(struct headless_window *window,
+    uint32_t color) {
+    int stride = window->width * 4;
+    size_t size = (size_t)stride * (size_t)window->height;
+    int fd = memfd_create("wavo-test", MFD_CLOEXEC);
+    if (fd < 0 || ftruncate(fd, (off_t)(size * 2)) != 0) {
+        perror("memfd");
+        if (fd >= 0) {
+            close(fd);
+        }
+        return false;
+    }
+    uint32_t *pixels = mmap(NULL, size * 2, PROT_READ | PROT_WRITE,
+        MAP_SHARED, fd, 0);
+    if (pixels == MAP_FAILED) {
+        perror("mmap");
+        close(fd);
+        return false;
+    }
+    for (size_t i = 0; i < size * 2 / 4; i++) {
+        pixels[i] = color;
+    }
+    munmap(pixels, size * 2);
+
+    struct wl_shm_pool *pool = wl_shm_create_pool(window->client->shm, fd,
+        (int32_t)(size * 2));
+    for (int i = 0; i < 2; i++) {
+        window->buffers[i] = wl_shm_pool_create_buffer(pool,
+            (int32_t)size * i, window->width, window->height, stride,
+            WL_SHM_FORMAT_XRGB8888);
+        wl_buffer_add_listener(window->buffers[i], &buffer_listener, window);
+    }
+    wl_shm_pool_destroy(pool);
+    close(fd);
+    return true;
+}
+
+bool headless_window_map(struct headless_window *window,
+    struct headless_client *client, struct wavo_server *server, int width,
+    int height, uint32_t color) {
+    memset(window, 0, sizeof(*window));
+    window->client = client;
+    window->width = width;
+    window->height = height;
+    window->ack_configures = true;
+    if (!window_create_buffers(window, color)) {
+        return false;
+    }
+
+    window->surface = wl_compositor_create_surface(client->compositor);
+    window->xdg_surface = xdg_wm_base_get_xdg_surface(client->wm_base,
+        window->surface);
+    xdg_surface_add_listener(window->xdg_surface, &xdg_surface_listener,
+        window);
+    window->toplevel = xdg_surface_get_toplevel(window->xdg_surface);
+    xdg_toplevel_add_listener(window->toplevel, &toplevel_listener, window);
+    wl_surface_commit(window->surface);
+    if (!headless_client_roundtrip(client, server) ||
+            window->configures == 0) {
+        fprintf(stderr, "%s\n", "no configure for the new toplevel");
+        return false;
+    }
+
+    headless_window_commit(window, false);
+    return headless_client_roundtrip(client, server);
+}
+
+void headless_window_finish(struct headless_window *window) {
+    if (window->toplevel) {
+        xdg_toplevel_destroy(window->toplevel);
+    }
+    if (window->xdg_surface) {
+        xdg_surface_destroy(window->xdg_surface);
+    }
+    if (window->surface) {
+        wl_surface_destroy(window->surface);
+    }
+    for (int i = 0; i < 2; i++) {
+        if (window->buffers[i]) {
+            wl_buffer_destroy(window->buffers[i]);
+        }
+    }
+    memset(window, 0, sizeof(*window));
+}
+
+static void frame_done(void *data, struct wl_callback *callback,
+    uint32_t time) {
+    (void)time;
+    struct headless_window *window = data;
+    window->frames++;
+    wl_callback_destroy(callback);
+}
+
+static const struct wl_callback_listener frame_listener = {
+    .done = frame_done,
+};
+
+bool headless_window_commit(struct headless_window *window, bool frame) {
+    int free_buffer = !window->busy[0] ? 0 : !window->busy[1] ? 1 : -1;
+    if (free_buffer < 0) {
+        return false;
+    }
+    window->busy[free_buffer] = true;
+
+    wl_surface_attach(window->surface, window->buffers[free_buffer], 0, 0);
+    wl_surface_damage_buffer(window->surface, 0, 0, window->width,
+        window->height);
+    if (frame) {
+        struct wl_callback *callback = wl_surface_frame(window->surface);
+        wl_callback_add_listener(callback, &frame_listener, window);
+    }
+    wl_surface_commit(window->surface);
+    return true;
+}
@@ -0,0 +1,72 @@
+#ifndef WAVO_TESTS_CLIENT_H
+#define WAVO_TESTS_CLIENT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct wavo_server;
+
+// A Wayland client inside the test process, talking to a headless server
+// over its socket. Nothing blocks: each headless_client_dispatch() flushes
+// the client's requests, dispatches the server once and handles the events
+// that came back, so a test drives both sides from one thread.
+struct headless_client {
+    struct wl_display *display;
+    struct wl_registry *registry;
+    struct wl_compositor *compositor;
+    struct wl_shm *shm;
+    struct xdg_wm_base *wm_base;
+
+    bool ignore_pings;  // Leave xdg_wm_base pings unanswered
+    int pings;  // Received, answered or not
+    uint32_t ping_serial;  // Of the last one
+};
+
+// A toplevel showing one of two shm buffers, whichever the compositor
+// released
+struct headless_window {
+    struct headless_client *client;
+    struct wl_surface *surface;
+    struct xdg_surface *xdg_surface;
+    struct xdg_toplevel *toplevel;
+    struct wl_buffer *buffers[2];
+    bool busy[2];  // Attached and not released yet
+    int width, height;
+
+    bool ack_configures;  // Ack each configure as it comes, the default
+    int configures;
+    uint32_t configure_serial;  // Of the last configure
+    int configure_width, configure_height;  // 0 when left to the client
+    int frames;  // Frame callbacks done
+};
+
+// Connects to the server's WAYLAND_DISPLAY and binds its globals
+bool headless_client_connect(struct headless_client *client,
+    struct wavo_server *server);
+void headless_client_disconnect(struct headless_client *client);
+
+// One turn of both sides, the server waiting up to timeout_msec
+void headless_client_dispatch(struct headless_client *client,
+    struct wavo_server *server, int timeout_msec);
+
+// Dispatches both sides for msec
+void headless_client_run_for(struct headless_client *client,
+    struct wavo_server *server, int msec);
+
+// Until the server handled every request sent so far. False if it did not
+// within a second, or the client was disconnected.
+bool headless_client_roundtrip(struct headless_client *client,
+    struct wavo_server *server);
+
+// Creates a toplevel of width x height pixels, all of them color, and maps
+// it with its first configure
+bool headless_window_map(struct headless_window *window,
+    struct headless_client *client, struct wavo_server *server, int width,
+    int height, uint32_t color);
+void headless_window_finish(struct headless_window *window);
+
+// Attaches whichever buffer is free, damages all of it and commits, asking
+// for a frame callback if frame is set. False while both buffers are busy.
+bool headless_window_commit(struct headless_window *window, bool frame);
+
+#endif // WAVO_TESTS_CLIENT_H
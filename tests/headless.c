@@ -0,0 +1,63 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include "wavo/buffer.h"
+#include "wavo/config.h"
+#include "wavo/latency.h"
+#include "wavo/server.h"
+#include "headless.h"
+
+bool headless_init_env(void) {
+    setenv("WLR_BACKENDS", "headless", true);
+    setenv("WLR_RENDERER", "pixman", true);
+    if (getenv("XDG_RUNTIME_DIR")) {
+        return true;
+    }
+
+    static char runtime_dir[] = "/tmp/wavo-headless-XXXXXX";
+    if (!mkdtemp(runtime_dir)) {
+        perror("mkdtemp");
+        return false;
+    }
+    setenv("XDG_RUNTIME_DIR", runtime_dir, true);
+    return true;
+}
+
+struct wavo_server *headless_server_create(struct wavo_config *config,
+    int idle_timeout_msec) {
+    if (!headless_init_env()) {
+        return NULL;
+    }
+    if (!wavo_config_load_default(config)) {
+        fprintf(stderr, "%s\n", "failed to load the default config");
+        return NULL;
+    }
+    config->idle_timeout_msec = idle_timeout_msec;
+
+    struct wavo_server *server = wavo_server_create(config);
+    if (!server) {
+        fprintf(stderr, "%s\n", "failed to create a headless server");
+    }
+    return server;
+}
+
+void headless_run_for(struct wavo_server *server, int msec) {
+    uint64_t end = wavo_latency_now_usec() + (uint64_t)msec * 1000;
+    for (uint64_t now = wavo_latency_now_usec(); now < end;
+            now = wavo_latency_now_usec()) {
+        // Rounded up, waking early would just spin
+        wavo_server_dispatch(server, (int)((end - now + 999) / 1000));
+    }
+}
+
+struct wavo_pixel_buffer *headless_buffer_create(int width, int height,
+    uint32_t color) {
+    struct wavo_pixel_buffer *buffer = wavo_pixel_buffer_create(width, height);
+    if (!buffer) {
+        return NULL;
+    }
+    for (size_t i = 0; i < (size_t)width * (size_t)height; i++) {
+        buffer->pixels[i] = color;
+    }
+    return buffer;
+}
@@ -0,0 +1,35 @@
+#ifndef WAVO_TESTS_HEADLESS_H
+#define WAVO_TESTS_HEADLESS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct wavo_config;
+struct wavo_server;
+struct wavo_pixel_buffer;
+
+// A server on the headless backend and pixman renderer, shared by the unit
+// tests, the benchmarks and wavo-replay. Outputs are virtual ones, and
+// "client" content is usually a wavo_pixel_buffer put straight into the
+// scene.
+
+// Selects the headless backend and pixman renderer, and makes a private
+// XDG_RUNTIME_DIR unless there is one. Done by headless_server_create(),
+// but must come first in a process that forks a client before that.
+bool headless_init_env(void);
+
+// Loads the default config with the given idle timeout, 0 for none (idle
+// would stop the outputs partway through a run), and creates a server on
+// it. config must outlive the server, and is the caller's to free even if
+// this fails.
+struct wavo_server *headless_server_create(struct wavo_config *config,
+    int idle_timeout_msec);
+
+// Dispatches the server's events for msec
+void headless_run_for(struct wavo_server *server, int msec);
+
+// Buffer of width x height pixels, all of them color
+struct wavo_pixel_buffer *headless_buffer_create(int width, int height,
+    uint32_t color);
+
+#endif // WAVO_TESTS_HEADLESS_H
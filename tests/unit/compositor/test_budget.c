@@ -0,0 +1,51 @@
+#include <criterion/criterion.h>
+#include "wavo/budget.h"
+
+#define RATE 10.0
+#define BURST 5.0
+
+static int take_all(struct wavo_token_bucket *bucket, uint64_t now_usec) {
+    int taken = 0;
+    while (wavo_token_bucket_take(bucket, RATE, BURST, now_usec)) {
+        taken++;
+    }
+    return taken;
+}
+
+Test(budget, starts_full) {
+    struct wavo_token_bucket bucket = {0};
+    cr_assert_eq(take_all(&bucket, 1000000), 5);
+    cr_assert_not(wavo_token_bucket_take(&bucket, RATE, BURST, 1000000));
+}
+
+Test(budget, refills_at_rate) {
+    struct wavo_token_bucket bucket = {0};
+    take_all(&bucket, 1000000);
+
+    // 10 per second is one token every 100ms
+    cr_assert_not(wavo_token_bucket_take(&bucket, RATE, BURST, 1050000));
+    cr_assert(wavo_token_bucket_take(&bucket, RATE, BURST, 1100000));
+    cr_assert_not(wavo_token_bucket_take(&bucket, RATE, BURST, 1100000));
+    cr_assert_eq(take_all(&bucket, 1400000), 3);
+}
+
+Test(budget, refill_caps_at_burst) {
+    struct wavo_token_bucket bucket = {0};
+    take_all(&bucket, 1000000);
+    cr_assert_eq(take_all(&bucket, 61000000), 5);
+}
+
+Test(budget, clock_going_back_adds_nothing) {
+    struct wavo_token_bucket bucket = {0};
+    take_all(&bucket, 2000000);
+    cr_assert_not(wavo_token_bucket_take(&bucket, RATE, BURST, 1000000));
+    cr_assert_not(wavo_token_bucket_take(&bucket, RATE, BURST, 2050000));
+    cr_assert(wavo_token_bucket_take(&bucket, RATE, BURST, 2100000));
+}
+
+Test(budget, steady_rate_is_never_throttled) {
+    struct wavo_token_bucket bucket = {0};
+    for (uint64_t now = 1000000; now < 11000000; now += 100000) {
+        cr_assert(wavo_token_bucket_take(&bucket, RATE, BURST, now));
+    }
+}
@@ -0,0 +1,112 @@
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <criterion/criterion.h>
+#include "wavo/convert.h"
+
+#define WIDTH 70
+#define HEIGHT 12
+
+static uint8_t src[WIDTH * HEIGHT * 4];
+
+static void fill_random(void) {
+    srand(1234);
+    for (size_t i = 0; i < sizeof(src); i++) {
+        src[i] = (uint8_t)rand();
+    }
+}
+
+static void fill_color(uint8_t r, uint8_t g, uint8_t b) {
+    for (size_t i = 0; i < WIDTH * HEIGHT; i++) {
+        src[i * 4 + 0] = b;
+        src[i * 4 + 1] = g;
+        src[i * 4 + 2] = r;
+        src[i * 4 + 3] = 0xff;
+    }
+}
+
+// Backing store for a WIDTH x HEIGHT image; all planes are zeroed
+struct image {
+    uint8_t y[WIDTH * HEIGHT];
+    uint8_t u[WIDTH * HEIGHT / 2];
+    uint8_t v[WIDTH * HEIGHT / 4];
+    struct wavo_yuv_image yuv;
+};
+
+static void image_init(struct image *image, enum wavo_yuv_layout layout) {
+    memset(image, 0, sizeof(*image));
+    image->yuv.layout = layout;
+    image->yuv.planes[0] = image->y;
+    image->yuv.strides[0] = WIDTH;
+    image->yuv.planes[1] = image->u;
+    if (layout == WAVO_YUV_NV12) {
+        image->yuv.strides[1] = WIDTH;
+    } else {
+        image->yuv.strides[1] = WIDTH / 2;
+        image->yuv.planes[2] = image->v;
+        image->yuv.strides[2] = WIDTH / 2;
+    }
+}
+
+static void convert_rect(enum wavo_convert_impl impl, struct image *image,
+    int x, int y, int width, int height) {
+    wavo_convert_to_yuv(impl, src + (y * WIDTH + x) * 4, WIDTH * 4,
+        &image->yuv, x, y, width, height);
+}
+
+static void assert_matches_scalar(enum wavo_yuv_layout layout,
+    int x, int y, int width, int height) {
+    static struct image expected, actual;
+    image_init(&expected, layout);
+    convert_rect(WAVO_CONVERT_SCALAR, &expected, x, y, width, height);
+
+    for (int impl = WAVO_CONVERT_SSE41; impl <= WAVO_CONVERT_AVX2; impl++) {
+        if (!wavo_convert_impl_supported(impl)) {
+            continue;
+        }
+        image_init(&actual, layout);
+        convert_rect(impl, &actual, x, y, width, height);
+        cr_assert(memcmp(&expected, &actual,
+                offsetof(struct image, yuv)) == 0,
+            "%s differs from scalar", wavo_convert_impl_name(impl));
+    }
+}
+
+Test(convert, simd_matches_scalar) {
+    fill_random();
+    assert_matches_scalar(WAVO_YUV_NV12, 0, 0, WIDTH, HEIGHT);
+    assert_matches_scalar(WAVO_YUV_I420, 0, 0, WIDTH, HEIGHT);
+}
+
+Test(convert, damaged_rect_only) {
+    // Odd-sized tails after the vector loops, and nothing outside the rect
+    fill_random();
+    assert_matches_scalar(WAVO_YUV_NV12, 2, 4, 38, 6);
+    assert_matches_scalar(WAVO_YUV_I420, 10, 2, 22, 8);
+
+    struct image image;
+    image_init(&image, WAVO_YUV_I420);
+    convert_rect(wavo_convert_best_impl(), &image, 10, 2, 22, 8);
+    cr_assert_eq(image.y[1 * WIDTH + 20], 0);
+    cr_assert_eq(image.y[2 * WIDTH + 9], 0);
+    cr_assert_eq(image.y[2 * WIDTH + 32], 0);
+    cr_assert_neq(image.y[2 * WIDTH + 10], 0);
+}
+
+Test(convert, reference_colors) {
+    struct image image;
+
+    fill_color(0, 0, 0);
+    image_init(&image, WAVO_YUV_NV12);
+    convert_rect(wavo_convert_best_impl(), &image, 0, 0, WIDTH, HEIGHT);
+    cr_assert_eq(image.y[0], 16);
+    cr_assert_eq(image.u[0], 128);
+    cr_assert_eq(image.u[1], 128);
+
+    fill_color(255, 255, 255);
+    image_init(&image, WAVO_YUV_I420);
+    convert_rect(wavo_convert_best_impl(), &image, 0, 0, WIDTH, HEIGHT);
+    cr_assert_eq(image.y[WIDTH * HEIGHT - 1], 235);
+    cr_assert_eq(image.u[0], 128);
+    cr_assert_eq(image.v[0], 128);
+}
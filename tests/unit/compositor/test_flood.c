@@ -0,0 +1,164 @@
+#include <inttypes.h>
+#include <criterion/criterion.h>
+#include <wayland-client.h>
+#include <wayland-server-core.h>
+#include <wlr/types/wlr_output_layout.h>
+#include <wlr/types/wlr_scene.h>
+#include "wavo/budget.h"
+#include "wavo/buffer.h"
+#include "wavo/config.h"
+#include "wavo/latency.h"
+#include "wavo/output.h"
+#include "wavo/server.h"
+#include "client.h"
+#include "headless.h"
+
+// A client committing as fast as the compositor releases its buffers, next
+// to a surface redrawn from its frame callbacks on a 60 Hz output. The
+// client must be held to its commit budget, and the surface must keep its
+// frame rate.
+
+#define RUN_MSEC 500
+#define WINDOW_SIZE 64
+
+// Commits the budget allows over RUN_MSEC, burst included, and some slack
+#define MAX_FLOOD_COMMITS (2000 * RUN_MSEC / 1000 + 500 + 100)
+
+struct frame_timer {
+    struct wlr_scene_buffer *scene_buffer;
+    struct wl_listener frame_done;
+    int frames;
+    uint64_t last_usec;
+    uint64_t max_interval_usec;
+};
+
+static struct wavo_config config;
+static struct wavo_server *server;
+static struct wlr_buffer *buffer;
+static struct headless_client client;
+
+static void timer_handle_frame_done(struct wl_listener *listener,
+    void *data) {
+    (void)data;
+    struct frame_timer *timer = wl_container_of(listener, timer, frame_done);
+    uint64_t now = wavo_latency_now_usec();
+    if (timer->last_usec != 0 &&
+            now - timer->last_usec > timer->max_interval_usec) {
+        timer->max_interval_usec = now - timer->last_usec;
+    }
+    timer->last_usec = now;
+    timer->frames++;
+    wlr_scene_buffer_set_buffer(timer->scene_buffer, buffer);
+}
+
+// Frames and the longest wait for one over msec, the flood window
+// committing meanwhile if there is one
+static void run_timed(struct frame_timer *timer,
+    struct headless_window *flood, int msec, int *commits) {
+    timer->frames = 0;
+    timer->last_usec = 0;
+    timer->max_interval_usec = 0;
+
+    uint64_t end = wavo_latency_now_usec() + (uint64_t)msec * 1000;
+    while (wavo_latency_now_usec() < end) {
+        while (flood && headless_window_commit(flood, false)) {
+            (*commits)++;
+        }
+        headless_client_dispatch(&client, server, 1);
+    }
+}
+
+static void setup(void) {
+    server = headless_server_create(&config, 0);
+    cr_assert_not_null(server);
+    cr_assert(headless_client_connect(&client, server));
+
+    struct wavo_pixel_buffer *pixel_buffer =
+        headless_buffer_create(WINDOW_SIZE, WINDOW_SIZE, 0xFF808080);
+    cr_assert_not_null(pixel_buffer);
+    buffer = &pixel_buffer->base;
+}
+
+static void teardown(void) {
+    headless_client_disconnect(&client);
+    wavo_server_destroy(server);
+    wlr_buffer_drop(buffer);
+    wavo_config_free(&config);
+}
+
+TestSuite(flood, .init = setup, .fini = teardown);
+
+Test(flood, commit_flood_leaves_other_frames_alone) {
+    struct wavo_output *output = wavo_output_create_virtual(server, 640, 480,
+        60000);
+    cr_assert_not_null(output);
+    struct wlr_box box;
+    wlr_output_layout_get_box(server->output_layout, output->wlr_output, &box);
+
+    static struct frame_timer timer;
+    timer.scene_buffer = wlr_scene_buffer_create(server->view_tree, buffer);
+    cr_assert_not_null(timer.scene_buffer);
+    wlr_scene_node_set_position(&timer.scene_buffer->node, box.x + 400,
+        box.y + 300);
+    timer.frame_done.notify = timer_handle_frame_done;
+    wl_signal_add(&timer.scene_buffer->events.frame_done, &timer.frame_done);
+
+    struct headless_window flood;
+    cr_assert(headless_window_map(&flood, &client, server, WINDOW_SIZE,
+        WINDOW_SIZE, 0xFF00FF00));
+
+    run_timed(&timer, NULL, RUN_MSEC, NULL);
+    int quiet_frames = timer.frames;
+    uint64_t quiet_interval = timer.max_interval_usec;
+
+    int commits = 0;
+    run_timed(&timer, &flood, RUN_MSEC, &commits);
+
+    cr_assert_gt(server->budgets->throttled[WAVO_BUDGET_COMMIT], 0,
+        "%d commits were never throttled", commits);
+    cr_assert_leq(commits, MAX_FLOOD_COMMITS,
+        "client got %d commits through", commits);
+    cr_assert_geq(timer.frames, quiet_frames - 3,
+        "%d frames during the flood, %d without", timer.frames,
+        quiet_frames);
+    cr_assert_leq(timer.max_interval_usec, quiet_interval + 17000,
+        "frames %" PRIu64 "us apart during the flood, %" PRIu64 "us "
+        "without", timer.max_interval_usec, quiet_interval);
+
+    // Once the client calms down its held commits go through
+    headless_client_run_for(&client, server, 100);
+    int frames = flood.frames;
+    cr_assert(headless_window_commit(&flood, true));
+    headless_client_run_for(&client, server, 100);
+    cr_assert_gt(flood.frames, frames, "the surface stayed held");
+
+    headless_window_finish(&flood);
+    wl_list_remove(&timer.frame_done.link);
+    wlr_scene_node_destroy(&timer.scene_buffer->node);
+}
+
+Test(flood, commits_into_held_surface_disconnect) {
+    cr_assert_not_null(wavo_output_create_virtual(server, 640, 480, 60000));
+
+    struct headless_window flood;
+    cr_assert(headless_window_map(&flood, &client, server, WINDOW_SIZE,
+        WINDOW_SIZE, 0xFF00FF00));
+
+    // Not waiting for anything: the burst goes through, then the surface is
+    // held and every further commit piles up
+    for (int batch = 0; batch < 40; batch++) {
+        for (int i = 0; i < 100; i++) {
+            wl_surface_damage_buffer(flood.surface, 0, 0, WINDOW_SIZE,
+                WINDOW_SIZE);
+            wl_surface_commit(flood.surface);
+        }
+        headless_client_dispatch(&client, server, 0);
+        if (wl_display_get_error(client.display) != 0) {
+            break;
+        }
+    }
+    cr_assert_neq(wl_display_get_error(client.display), 0,
+        "client was never disconnected");
+
+    headless_window_finish(&flood);
+}
@@ -0,0 +1,125 @@
+#include <criterion/criterion.h>
+#include <wayland-client.h>
+#include <wayland-server-core.h>
+#include <wlr/types/wlr_foreign_toplevel_management_v1.h>
+#include <wlr/types/wlr_seat.h>
+#include "wavo/config.h"
+#include "wavo/foreign_toplevel.h"
+#include "wavo/input.h"
+#include "wavo/output.h"
+#include "wavo/server.h"
+#include "wavo/view.h"
+#include "client.h"
+#include "headless.h"
+#include "xdg-shell-client-protocol.h"
+
+// A client retitling its window in bursts while nothing on screen changes.
+// Each burst must reach panels as one update, on a frame of its own.
+
+#define SETTLE_MSEC 200
+#define WINDOW_SIZE 32
+
+static struct wavo_config config;
+static struct wavo_server *server;
+static struct headless_client client;
+static struct headless_window window;
+
+static void setup(void) {
+    server = headless_server_create(&config, 0);
+    cr_assert_not_null(server);
+    cr_assert_not_null(wavo_output_create_virtual(server, 640, 480, 60000));
+    cr_assert(headless_client_connect(&client, server));
+    cr_assert(headless_window_map(&window, &client, server, WINDOW_SIZE,
+        WINDOW_SIZE, 0xFF0000FF));
+
+    // Until the output stops drawing
+    headless_client_run_for(&client, server, SETTLE_MSEC);
+}
+
+static void teardown(void) {
+    headless_window_finish(&window);
+    headless_client_disconnect(&client);
+    wavo_server_destroy(server);
+    wavo_config_free(&config);
+}
+
+TestSuite(foreign_toplevel, .init = setup, .fini = teardown);
+
+static struct wlr_foreign_toplevel_handle_v1 *window_handle(void) {
+    cr_assert_not(wl_list_empty(&server->views));
+    struct wavo_view *view = wl_container_of(server->views.next, view, link);
+    cr_assert_not_null(view->output, "view is on no output");
+    cr_assert_not_null(view->foreign_toplevel);
+    return view->foreign_toplevel->handle;
+}
+
+Test(foreign_toplevel, burst_is_one_update_on_next_frame) {
+    struct wavo_foreign_toplevels *toplevels = server->foreign_toplevels;
+    cr_assert_not_null(toplevels);
+    uint64_t updates = toplevels->updates;
+    uint64_t coalesced = toplevels->coalesced;
+
+    xdg_toplevel_set_title(window.toplevel, "one");
+    xdg_toplevel_set_title(window.toplevel, "two");
+    xdg_toplevel_set_title(window.toplevel, "three");
+    cr_assert(headless_client_roundtrip(&client, server));
+    headless_client_run_for(&client, server, 50);
+
+    struct wlr_foreign_toplevel_handle_v1 *handle = window_handle();
+    cr_assert_str_eq(handle->title, "three");
+    cr_assert_eq(toplevels->updates, updates + 1);
+    cr_assert_eq(toplevels->coalesced, coalesced + 2);
+    cr_assert(wl_list_empty(&toplevels->dirty));
+}
+
+Test(foreign_toplevel, flicker_sends_nothing) {
+    struct wavo_foreign_toplevels *toplevels = server->foreign_toplevels;
+    xdg_toplevel_set_title(window.toplevel, "steady");
+    cr_assert(headless_client_roundtrip(&client, server));
+    headless_client_run_for(&client, server, 50);
+    uint64_t updates = toplevels->updates;
+
+    xdg_toplevel_set_title(window.toplevel, "busy");
+    xdg_toplevel_set_title(window.toplevel, "steady");
+    cr_assert(headless_client_roundtrip(&client, server));
+    headless_client_run_for(&client, server, 50);
+
+    cr_assert_str_eq(window_handle()->title, "steady");
+    cr_assert_eq(toplevels->updates, updates);
+    cr_assert(wl_list_empty(&toplevels->dirty));
+}
+
+Test(foreign_toplevel, activate_request_moves_focus) {
+    struct headless_window other;
+    cr_assert(headless_window_map(&other, &client, server, WINDOW_SIZE,
+        WINDOW_SIZE, 0xFF00FF00));
+    struct wavo_view *focused = server->focused_view;
+    cr_assert_not_null(focused);
+
+    // The window mapped first, as a taskbar would ask for it
+    struct wavo_view *view = NULL;
+    struct wavo_view *each;
+    wl_list_for_each(each, &server->views, link) {
+        if (each != focused) {
+            view = each;
+        }
+    }
+    cr_assert_not_null(view);
+    struct wlr_foreign_toplevel_handle_v1 *handle =
+        view->foreign_toplevel->handle;
+    struct wlr_foreign_toplevel_handle_v1_activated_event event = {
+        .toplevel = handle,
+        .seat = server->input->seat,
+    };
+    wl_signal_emit_mutable(&handle->events.request_activate, &event);
+
+    cr_assert_eq(server->focused_view, view);
+    cr_assert_eq(wl_container_of(server->views.next, each, link), view);
+    cr_assert(view->xdg_surface->toplevel->scheduled.activated);
+    cr_assert_not(focused->xdg_surface->toplevel->scheduled.activated,
+        "two windows are active");
+    cr_assert_eq(server->input->seat->keyboard_state.focused_surface,
+        view->xdg_surface->surface);
+
+    headless_window_finish(&other);
+}
@@ -0,0 +1,114 @@
+#include <criterion/criterion.h>
+#include <wayland-server-core.h>
+#include <wlr/types/wlr_output.h>
+#include <wlr/types/wlr_scene.h>
+#include "wavo/buffer.h"
+#include "wavo/config.h"
+#include "wavo/idle.h"
+#include "wavo/output.h"
+#include "wavo/server.h"
+#include "headless.h"
+
+// A headless 60 Hz output with a surface that redraws from every frame
+// callback, like an animating client. With a 100ms idle timeout the
+// compositor has to stop it and then sleep.
+
+#define IDLE_TIMEOUT_MSEC 100
+#define BUFFER_SIZE 16
+
+static struct wavo_config config;
+static struct wavo_server *server;
+static struct wlr_buffer *buffer;
+static struct wavo_output *output;
+static struct wlr_scene_buffer *scene_buffer;
+static struct wl_listener frame_done;
+static int frames;
+
+static void handle_frame_done(struct wl_listener *listener, void *data) {
+    (void)listener;
+    (void)data;
+    frames++;
+    wlr_scene_buffer_set_buffer(scene_buffer, buffer);
+}
+
+static void setup(void) {
+    server = headless_server_create(&config, IDLE_TIMEOUT_MSEC);
+    cr_assert_not_null(server);
+
+    struct wavo_pixel_buffer *pixel_buffer =
+        headless_buffer_create(BUFFER_SIZE, BUFFER_SIZE, 0);
+    cr_assert_not_null(pixel_buffer);
+    buffer = &pixel_buffer->base;
+
+    output = wavo_output_create_virtual(server, 640, 480, 60000);
+    cr_assert_not_null(output);
+
+    frames = 0;
+    scene_buffer = wlr_scene_buffer_create(server->view_tree, buffer);
+    cr_assert_not_null(scene_buffer);
+    wlr_scene_buffer_set_dest_size(scene_buffer, 100, 100);
+    frame_done.notify = handle_frame_done;
+    wl_signal_add(&scene_buffer->events.frame_done, &frame_done);
+}
+
+static void teardown(void) {
+    wl_list_remove(&frame_done.link);
+    wlr_scene_node_destroy(&scene_buffer->node);
+    wavo_server_destroy(server);
+    wlr_buffer_drop(buffer);
+    wavo_config_free(&config);
+}
+
+TestSuite(idle, .init = setup, .fini = teardown);
+
+Test(idle, stops_frames_and_sleeps) {
+    headless_run_for(server, IDLE_TIMEOUT_MSEC * 3);
+    cr_assert(server->idle->idle);
+    cr_assert_eq(server->idle->idle_entered, 1);
+    cr_assert_gt(frames, 0);
+
+    int idle_frames = frames;
+    uint64_t idle_wakeups = server->idle_wakeups;
+    headless_run_for(server, 500);
+
+    cr_assert_eq(frames, idle_frames, "%d frame callbacks while idle",
+        frames - idle_frames);
+    // Only the dispatch timeouts of headless_run_for() itself
+    cr_assert_leq(server->idle_wakeups - idle_wakeups, 3,
+        "%d wakeups while idle", (int)(server->idle_wakeups - idle_wakeups));
+}
+
+Test(idle, input_wakes_within_a_frame) {
+    headless_run_for(server, IDLE_TIMEOUT_MSEC * 3);
+    cr_assert(server->idle->idle);
+
+    int idle_frames = frames;
+    wavo_idle_notify_activity(server->idle);
+    cr_assert_not(server->idle->idle);
+
+    // Two 60 Hz frame periods, the first one may already be half over
+    headless_run_for(server, 34);
+    cr_assert_gt(frames, idle_frames);
+
+    // And idles again once input stops
+    headless_run_for(server, IDLE_TIMEOUT_MSEC * 3);
+    cr_assert(server->idle->idle);
+    cr_assert_eq(server->idle->idle_entered, 2);
+}
+
+Test(idle, powers_off_outputs) {
+    config.idle_power_off = true;
+
+    headless_run_for(server, IDLE_TIMEOUT_MSEC * 3);
+    cr_assert(server->idle->idle);
+    cr_assert_not(output->wlr_output->enabled);
+    cr_assert(output->idle_off);
+
+    wavo_idle_notify_activity(server->idle);
+    cr_assert(output->wlr_output->enabled);
+    cr_assert_not(output->idle_off);
+
+    int wake_frames = frames;
+    headless_run_for(server, 50);
+    cr_assert_gt(frames, wake_frames);
+}
@@ -0,0 +1,135 @@
+#include <inttypes.h>
+#include <criterion/criterion.h>
+#include <wlr/types/wlr_output_layout.h>
+#include <wlr/types/wlr_scene.h>
+#include "wavo/config.h"
+#include "wavo/latency.h"
+#include "wavo/output.h"
+#include "wavo/server.h"
+#include "headless.h"
+
+static struct wavo_latency_histogram hist;
+
+static void setup(void) {
+    wavo_latency_histogram_reset(&hist);
+}
+
+TestSuite(latency, .init = setup);
+
+Test(latency, bucket_bounds) {
+    // Every value must land in a bucket whose upper bound covers it
+    for (uint64_t usec = 0; usec < 200000; usec += 7) {
+        size_t index = wavo_latency_bucket_index(usec);
+        cr_assert_lt(index, WAVO_LATENCY_BUCKETS);
+        cr_assert_geq(wavo_latency_bucket_upper(index), usec);
+        if (index > 0) {
+            cr_assert_lt(wavo_latency_bucket_upper(index - 1), usec);
+        }
+    }
+}
+
+Test(latency, empty_percentile) {
+    cr_assert_eq(wavo_latency_histogram_percentile(&hist, 99.0), 0);
+}
+
+Test(latency, percentiles) {
+    for (uint64_t i = 1; i <= 100; i++) {
+        wavo_latency_histogram_add(&hist, i * 1000);
+    }
+
+    cr_assert_eq(hist.count, 100);
+    cr_assert_eq(hist.max_usec, 100000);
+
+    // Buckets are at most 25% wide and report their upper bound
+    uint64_t p50 = wavo_latency_histogram_percentile(&hist, 50.0);
+    cr_assert_geq(p50, 50000);
+    cr_assert_leq(p50, 50000 * 5 / 4);
+
+    uint64_t p99 = wavo_latency_histogram_percentile(&hist, 99.0);
+    cr_assert_geq(p99, 99000);
+    cr_assert_leq(p99, 100000);
+
+    cr_assert_eq(wavo_latency_histogram_percentile(&hist, 100.0), 100000);
+}
+
+Test(latency, input_timestamp) {
+    uint64_t now_usec = 5000000123;  // ~83 minutes after boot
+    uint32_t now_msec = (uint32_t)(now_usec / 1000);
+
+    cr_assert_eq(wavo_latency_input_usec(now_msec - 16, now_usec),
+        now_usec - 16000);
+
+    // Timestamps from the future or another clock are clamped to now
+    cr_assert_eq(wavo_latency_input_usec(now_msec + 5, now_usec), now_usec);
+    cr_assert_eq(wavo_latency_input_usec(12, now_usec), now_usec);
+}
+
+Test(latency, input_timestamp_wrap) {
+    // The 32-bit millisecond clock wrapped 2ms ago
+    uint64_t now_usec = ((uint64_t)1 << 32) * 1000 + 2000;
+    cr_assert_eq(wavo_latency_input_usec(UINT32_MAX - 7, now_usec),
+        now_usec - 10000);
+}
+
+// Input noted on a 60 Hz output showing one rect, which the "client" toggles
+// to redraw
+
+static struct wavo_config config;
+static struct wavo_server *server;
+static struct wavo_output *output;
+static struct wlr_scene_rect *rect;
+
+static void input_setup(void) {
+    server = headless_server_create(&config, 0);
+    cr_assert_not_null(server);
+    output = wavo_output_create_virtual(server, 320, 240, 60000);
+    cr_assert_not_null(output);
+    struct wlr_box box;
+    wlr_output_layout_get_box(server->output_layout, output->wlr_output, &box);
+    rect = wlr_scene_rect_create(server->view_tree, 32, 32,
+        (const float[4]){ 1.0f, 0.0f, 0.0f, 1.0f });
+    cr_assert_not_null(rect);
+    wlr_scene_node_set_position(&rect->node, box.x + 10, box.y + 10);
+
+    // Until the output stops drawing
+    headless_run_for(server, 100);
+}
+
+static void input_teardown(void) {
+    wavo_server_destroy(server);
+    wavo_config_free(&config);
+}
+
+static void note_input(void) {
+    wavo_latency_note_input(server,
+        (uint32_t)(wavo_latency_now_usec() / 1000));
+}
+
+static void redraw(void) {
+    wlr_scene_node_set_enabled(&rect->node, !rect->node.enabled);
+}
+
+TestSuite(input_latency, .init = input_setup, .fini = input_teardown);
+
+Test(input_latency, redraw_is_sampled) {
+    note_input();
+    redraw();
+    headless_run_for(server, 100);
+
+    cr_assert_eq(output->input_latency.count, 1);
+    cr_assert_lt(output->input_latency.max_usec, 100000);
+    cr_assert_eq(output->stale_inputs, 0);
+}
+
+Test(input_latency, input_without_redraw_is_dropped) {
+    // A key press nothing on screen reacts to, then an unrelated redraw
+    note_input();
+    headless_run_for(server, 200);
+    redraw();
+    headless_run_for(server, 100);
+
+    cr_assert_eq(output->input_latency.count, 0,
+        "sample of %" PRIu64 "us from input that redrew nothing",
+        output->input_latency.max_usec);
+    cr_assert_eq(output->stale_inputs, 1);
+}
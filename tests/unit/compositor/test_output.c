@@ -0,0 +1,184 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <criterion/criterion.h>
+#include <wayland-server-core.h>
+#include <wlr/types/wlr_buffer.h>
+#include <wlr/types/wlr_output.h>
+#include <wlr/types/wlr_output_layout.h>
+#include <wlr/types/wlr_scene.h>
+#include "wavo/config.h"
+#include "wavo/output.h"
+#include "wavo/server.h"
+#include "headless.h"
+
+Test(output, letterbox_same_aspect) {
+    struct wlr_box box;
+    wavo_output_letterbox(1920, 1080, 3840, 2160, &box);
+    cr_assert_eq(box.x, 0);
+    cr_assert_eq(box.y, 0);
+    cr_assert_eq(box.width, 3840);
+    cr_assert_eq(box.height, 2160);
+}
+
+Test(output, letterbox_pillarbox) {
+    // 16:10 panel on a 16:9 projector, bars left and right
+    struct wlr_box box;
+    wavo_output_letterbox(2560, 1600, 1920, 1080, &box);
+    cr_assert_eq(box.height, 1080);
+    cr_assert_eq(box.width, 1728);
+    cr_assert_eq(box.x, 96);
+    cr_assert_eq(box.y, 0);
+}
+
+Test(output, letterbox_bars_above_below) {
+    struct wlr_box box;
+    wavo_output_letterbox(1920, 1080, 1024, 768, &box);
+    cr_assert_eq(box.width, 1024);
+    cr_assert_eq(box.height, 576);
+    cr_assert_eq(box.x, 0);
+    cr_assert_eq(box.y, 96);
+}
+
+Test(output, letterbox_empty_source) {
+    struct wlr_box box;
+    wavo_output_letterbox(0, 0, 800, 600, &box);
+    cr_assert_eq(box.width, 800);
+    cr_assert_eq(box.height, 600);
+}
+
+// A virtual output mirrored by a second one, configured before it appears.
+// The source shows a red rect on black; the target must show the same.
+
+#define SOURCE_WIDTH 320
+#define SOURCE_HEIGHT 240
+#define RUN_MSEC 200
+
+struct frame_probe {
+    int frames;
+    uint32_t inside, outside;  // XRGB at the rect's center and a corner
+    int inside_x, inside_y;
+    struct wl_listener commit;
+};
+
+static struct wavo_config config;
+static struct wavo_server *server;
+
+static void probe_handle_commit(struct wl_listener *listener, void *data) {
+    struct frame_probe *probe = wl_container_of(listener, probe, commit);
+    const struct wlr_output_event_commit *event = data;
+    if (!(event->state->committed & WLR_OUTPUT_STATE_BUFFER)) {
+        return;
+    }
+
+    void *pixels;
+    uint32_t format;
+    size_t stride;
+    cr_assert(wlr_buffer_begin_data_ptr_access(event->state->buffer,
+        WLR_BUFFER_DATA_PTR_ACCESS_READ, &pixels, &format, &stride));
+    const uint8_t *bytes = pixels;
+    probe->inside = *(const uint32_t *)(bytes +
+        (size_t)probe->inside_y * stride + (size_t)probe->inside_x * 4) &
+        0x00FFFFFF;
+    probe->outside = *(const uint32_t *)bytes & 0x00FFFFFF;
+    wlr_buffer_end_data_ptr_access(event->state->buffer);
+    probe->frames++;
+}
+
+static void mirror_setup(void) {
+    server = headless_server_create(&config, 0);
+    cr_assert_not_null(server);
+}
+
+static void mirror_teardown(void) {
+    wavo_server_destroy(server);
+    wavo_config_free(&config);
+}
+
+TestSuite(output_mirror, .init = mirror_setup, .fini = mirror_teardown);
+
+// The source with a rect in its middle, and the config for the next
+// virtual output to mirror it
+static struct wavo_output *create_source(void) {
+    struct wavo_output *source = wavo_output_create_virtual(server,
+        SOURCE_WIDTH, SOURCE_HEIGHT, 60000);
+    cr_assert_not_null(source);
+    struct wlr_box box;
+    wlr_output_layout_get_box(server->output_layout, source->wlr_output,
+        &box);
+    struct wlr_scene_rect *rect = wlr_scene_rect_create(server->view_tree,
+        SOURCE_WIDTH / 2, SOURCE_HEIGHT / 2,
+        (const float[4]){ 1.0f, 0.0f, 0.0f, 1.0f });
+    cr_assert_not_null(rect);
+    wlr_scene_node_set_position(&rect->node, box.x + SOURCE_WIDTH / 4,
+        box.y + SOURCE_HEIGHT / 4);
+
+    // Headless outputs are numbered in creation order
+    int number;
+    cr_assert_eq(sscanf(source->wlr_output->name, "HEADLESS-%d", &number),
+        1);
+    char name[32];
+    snprintf(name, sizeof(name), "HEADLESS-%d", number + 1);
+    config.outputs = calloc(1, sizeof(struct wavo_output_config));
+    cr_assert_not_null(config.outputs);
+    config.outputs[0] = (struct wavo_output_config){
+        .name = strdup(name),
+        .scale = 1.0f,
+        .mirror = strdup(source->wlr_output->name),
+    };
+    config.output_count = 1;
+    return source;
+}
+
+static void run_mirror(struct wavo_output *source, struct wavo_output *target,
+    struct frame_probe *source_probe, struct frame_probe *target_probe) {
+    cr_assert(wavo_output_is_mirror(target));
+    cr_assert_eq(target->mirror_source, source);
+    cr_assert_null(target->scene_output, "mirror target composites itself");
+
+    source_probe->inside_x = SOURCE_WIDTH / 2;
+    source_probe->inside_y = SOURCE_HEIGHT / 2;
+    source_probe->commit.notify = probe_handle_commit;
+    wl_signal_add(&source->wlr_output->events.commit, &source_probe->commit);
+    target_probe->inside_x = target->wlr_output->width / 2;
+    target_probe->inside_y = target->wlr_output->height / 2;
+    target_probe->commit.notify = probe_handle_commit;
+    wl_signal_add(&target->wlr_output->events.commit, &target_probe->commit);
+
+    headless_run_for(server, RUN_MSEC);
+    wl_list_remove(&source_probe->commit.link);
+    wl_list_remove(&target_probe->commit.link);
+
+    cr_assert_gt(source_probe->frames, 0, "source drew no frame");
+    cr_assert_gt(target_probe->frames, 0, "target showed no frame");
+    cr_assert_eq(source_probe->inside, 0xFF0000);
+    cr_assert_eq(target_probe->inside, source_probe->inside,
+        "target shows %06X where the source has %06X", target_probe->inside,
+        source_probe->inside);
+    cr_assert_eq(target_probe->outside, source_probe->outside);
+}
+
+Test(output_mirror, same_mode_scans_out_source_frames) {
+    struct wavo_output *source = create_source();
+    struct wavo_output *target = wavo_output_create_virtual(server,
+        SOURCE_WIDTH, SOURCE_HEIGHT, 60000);
+    cr_assert_not_null(target);
+
+    static struct frame_probe source_probe, target_probe;
+    run_mirror(source, target, &source_probe, &target_probe);
+    cr_assert_gt(target->mirror_direct_frames, 0);
+    cr_assert_eq(target->mirror_blit_frames, 0);
+}
+
+Test(output_mirror, other_mode_gets_scaled_copies) {
+    struct wavo_output *source = create_source();
+    struct wavo_output *target = wavo_output_create_virtual(server,
+        SOURCE_WIDTH * 2, SOURCE_HEIGHT * 2, 60000);
+    cr_assert_not_null(target);
+
+    static struct frame_probe source_probe, target_probe;
+    run_mirror(source, target, &source_probe, &target_probe);
+    cr_assert_eq(target->mirror_direct_frames, 0);
+    cr_assert_gt(target->mirror_blit_frames, 0);
+}
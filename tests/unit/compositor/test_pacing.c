@@ -0,0 +1,136 @@
+#include <criterion/criterion.h>
+#include <wayland-server-core.h>
+#include <wlr/types/wlr_output_layout.h>
+#include <wlr/types/wlr_scene.h>
+#include "wavo/buffer.h"
+#include "wavo/config.h"
+#include "wavo/output.h"
+#include "wavo/server.h"
+#include "wavo/view.h"
+#include "headless.h"
+
+// Two headless outputs side by side at 60 and 144 Hz. A view sits mostly on
+// the 60 Hz one, with a popup entirely on the 144 Hz one. Every frame_done is
+// answered with a redraw, like a client drawing from its frame callback.
+
+#define RUN_MSEC 1000
+#define BUFFER_SIZE 16
+
+struct test_surface {
+    struct wlr_scene_buffer *scene_buffer;
+    struct wlr_buffer *buffer;
+    struct wl_listener frame_done;
+    int frames;
+};
+
+static struct wavo_config config;
+static struct wavo_server *server;
+static struct wlr_buffer *buffer;
+
+static void surface_handle_frame_done(struct wl_listener *listener,
+    void *data) {
+    (void)data;
+    struct test_surface *surface = wl_container_of(listener, surface,
+        frame_done);
+    surface->frames++;
+
+    // A new buffer damages every output the surface is on
+    wlr_scene_buffer_set_buffer(surface->scene_buffer, surface->buffer);
+}
+
+static void surface_init(struct test_surface *surface,
+    struct wlr_scene_tree *parent, int x, int y, int width, int height) {
+    surface->buffer = buffer;
+    surface->scene_buffer = wlr_scene_buffer_create(parent, buffer);
+    cr_assert_not_null(surface->scene_buffer);
+    wlr_scene_buffer_set_dest_size(surface->scene_buffer, width, height);
+    wlr_scene_node_set_position(&surface->scene_buffer->node, x, y);
+
+    surface->frame_done.notify = surface_handle_frame_done;
+    wl_signal_add(&surface->scene_buffer->events.frame_done,
+        &surface->frame_done);
+}
+
+static void surface_finish(struct test_surface *surface) {
+    wl_list_remove(&surface->frame_done.link);
+}
+
+static void setup(void) {
+    server = headless_server_create(&config, 0);
+    cr_assert_not_null(server);
+
+    struct wavo_pixel_buffer *pixel_buffer =
+        headless_buffer_create(BUFFER_SIZE, BUFFER_SIZE, 0);
+    cr_assert_not_null(pixel_buffer);
+    buffer = &pixel_buffer->base;
+}
+
+static void teardown(void) {
+    wavo_server_destroy(server);
+    wlr_buffer_drop(buffer);
+    wavo_config_free(&config);
+}
+
+TestSuite(pacing, .init = setup, .fini = teardown);
+
+Test(pacing, view_follows_primary_output) {
+    struct wavo_output *slow = wavo_output_create_virtual(server, 1280, 720,
+        60000);
+    struct wavo_output *fast = wavo_output_create_virtual(server, 1280, 720,
+        144000);
+    cr_assert_not_null(slow);
+    cr_assert_not_null(fast);
+
+    struct wlr_box slow_box, fast_box;
+    wlr_output_layout_get_box(server->output_layout, slow->wlr_output,
+        &slow_box);
+    wlr_output_layout_get_box(server->output_layout, fast->wlr_output,
+        &fast_box);
+    cr_assert(slow_box.x + slow_box.width <= fast_box.x);
+
+    // Added after the outputs, layout changes would look for an xdg_surface
+    struct wavo_view view = {
+        .server = server,
+        .mapped = true,
+        .output = slow,
+    };
+    view.scene_tree = wlr_scene_tree_create(server->view_tree);
+    cr_assert_not_null(view.scene_tree);
+    view.scene_tree->node.data = &view;
+    wl_list_insert(&server->views, &view.link);
+    struct wlr_scene_tree *popup_tree = wlr_scene_tree_create(view.scene_tree);
+    cr_assert_not_null(popup_tree);
+
+    // 300px on the slow output, 100px on the fast one
+    struct test_surface toplevel, popup, other;
+    surface_init(&toplevel, view.scene_tree,
+        slow_box.x + slow_box.width - 300, 100, 400, 300);
+    surface_init(&popup, popup_tree, fast_box.x + 200, 200, 100, 100);
+
+    // Not part of a view, keeps the fast output at its own rate
+    surface_init(&other, server->view_tree, fast_box.x + 600, 200, 100, 100);
+
+    headless_run_for(server, RUN_MSEC);
+
+    wl_list_remove(&view.link);
+    surface_finish(&toplevel);
+    surface_finish(&popup);
+    surface_finish(&other);
+    wlr_scene_node_destroy(&view.scene_tree->node);
+    wlr_scene_node_destroy(&other.scene_buffer->node);
+
+    cr_assert_gt(toplevel.frames, 30, "toplevel got %d frames",
+        toplevel.frames);
+    cr_assert_lt(toplevel.frames, 90, "toplevel got %d frames",
+        toplevel.frames);
+    cr_assert_gt(other.frames, toplevel.frames * 3 / 2,
+        "fast output only ran %d frames against %d", other.frames,
+        toplevel.frames);
+
+    // The popup is paced by the view's output, not the one it is on
+    int slack = toplevel.frames / 10 + 1;
+    cr_assert_leq(popup.frames, toplevel.frames + slack,
+        "popup got %d frames, toplevel %d", popup.frames, toplevel.frames);
+    cr_assert_geq(popup.frames, toplevel.frames - slack,
+        "popup got %d frames, toplevel %d", popup.frames, toplevel.frames);
+}
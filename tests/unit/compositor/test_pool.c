@@ -0,0 +1,163 @@
+#include <stdalign.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <criterion/criterion.h>
+#include "wavo/pool.h"
+
+struct object {
+    char name[24];
+    double value;
+};
+
+Test(pool, alloc_returns_zeroed_aligned_objects) {
+    struct wavo_pool pool;
+    wavo_pool_init(&pool, "test", sizeof(struct object), 4);
+
+    struct object *object = wavo_pool_alloc(&pool);
+    cr_assert_not_null(object);
+    cr_assert_eq((uintptr_t)object % alignof(max_align_t), 0);
+    cr_assert_eq(object->value, 0.0);
+    object->value = 42.0;
+
+    wavo_pool_free(&pool, object);
+    object = wavo_pool_alloc(&pool);
+    cr_assert_eq(object->value, 0.0);
+
+    wavo_pool_free(&pool, object);
+    wavo_pool_finish(&pool);
+}
+
+Test(pool, freed_objects_are_reused_first) {
+    struct wavo_pool pool;
+    wavo_pool_init(&pool, "test", sizeof(struct object), 4);
+
+    void *a = wavo_pool_alloc(&pool);
+    void *b = wavo_pool_alloc(&pool);
+    wavo_pool_free(&pool, a);
+    cr_assert_eq(wavo_pool_alloc(&pool), a);
+
+    wavo_pool_free(&pool, a);
+    wavo_pool_free(&pool, b);
+    cr_assert_eq(pool.in_use, 0);
+    cr_assert_eq(pool.slab_count, 1);
+    wavo_pool_finish(&pool);
+}
+
+Test(pool, grows_by_whole_slabs) {
+    struct wavo_pool pool;
+    wavo_pool_init(&pool, "test", sizeof(struct object), 4);
+
+    void *objects[9];
+    for (size_t i = 0; i < 9; i++) {
+        objects[i] = wavo_pool_alloc(&pool);
+        cr_assert_not_null(objects[i]);
+        for (size_t j = 0; j < i; j++) {
+            cr_assert_neq(objects[i], objects[j]);
+        }
+    }
+    cr_assert_eq(pool.in_use, 9);
+    cr_assert_eq(pool.capacity, 12);
+    cr_assert_eq(pool.slab_count, 3);
+    cr_assert_eq(pool.allocs, 9);
+
+    for (size_t i = 0; i < 9; i++) {
+        wavo_pool_free(&pool, objects[i]);
+    }
+    cr_assert_eq(pool.capacity, 12);
+    wavo_pool_finish(&pool);
+}
+
+Test(pool, locked_pool_locks_new_slabs) {
+    struct wavo_pool pool;
+    wavo_pool_init(&pool, "test", sizeof(struct object), 4);
+
+    if (!wavo_pool_lock(&pool)) {
+        wavo_pool_finish(&pool);
+        cr_skip_test("mlock() not permitted");
+    }
+    size_t slab_bytes = pool.locked_bytes;
+    cr_assert_eq(pool.slab_count, 1);
+    cr_assert_gt(slab_bytes, 4 * sizeof(struct object));
+
+    void *objects[5];
+    for (size_t i = 0; i < 5; i++) {
+        objects[i] = wavo_pool_alloc(&pool);
+        cr_assert_not_null(objects[i]);
+    }
+    cr_assert_eq(pool.slab_count, 2);
+    cr_assert_eq(pool.locked_bytes, 2 * slab_bytes);
+
+    for (size_t i = 0; i < 5; i++) {
+        wavo_pool_free(&pool, objects[i]);
+    }
+    wavo_pool_finish(&pool);
+    cr_assert_eq(pool.locked_bytes, 0);
+}
+
+Test(pool, locked_slabs_own_their_pages) {
+    struct wavo_pool pool;
+    wavo_pool_init(&pool, "test", sizeof(struct object), 4);
+    bool locked = wavo_pool_lock(&pool);
+
+    void *objects[12];
+    for (size_t i = 0; i < 12; i++) {
+        objects[i] = wavo_pool_alloc(&pool);
+        cr_assert_not_null(objects[i]);
+    }
+    cr_assert_eq(pool.slab_count, 3);
+    uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+    cr_assert_eq((uintptr_t)pool.slabs % page, 0);
+    if (locked) {
+        cr_assert_eq(pool.locked_bytes % page, 0);
+    }
+
+    // Whether or not mlock() was permitted, trimming takes off only what
+    // was counted
+    for (size_t i = 0; i < 12; i++) {
+        wavo_pool_free(&pool, objects[i]);
+    }
+    cr_assert_gt(wavo_pool_trim(&pool), 0);
+    cr_assert_eq(pool.slab_count, 0);
+    cr_assert_eq(pool.locked_bytes, 0);
+    wavo_pool_finish(&pool);
+}
+
+Test(pool, trim_releases_only_empty_slabs) {
+    struct wavo_pool pool;
+    wavo_pool_init(&pool, "test", sizeof(struct object), 4);
+
+    struct object *objects[12];
+    for (size_t i = 0; i < 12; i++) {
+        objects[i] = wavo_pool_alloc(&pool);
+        cr_assert_not_null(objects[i]);
+    }
+    cr_assert_eq(pool.slab_count, 3);
+    cr_assert_eq(wavo_pool_trim(&pool), 0);
+
+    // Empties the first and last slab, one object keeps the middle one
+    for (size_t i = 0; i < 12; i++) {
+        if (i != 5) {
+            wavo_pool_free(&pool, objects[i]);
+        }
+    }
+    cr_assert_gt(wavo_pool_trim(&pool), 2 * 4 * sizeof(struct object));
+    cr_assert_eq(pool.slab_count, 1);
+    cr_assert_eq(pool.capacity, 4);
+    cr_assert_eq(pool.in_use, 1);
+
+    // The survivors of the middle slab are still handed out
+    objects[5]->value = 1.0;
+    for (size_t i = 0; i < 3; i++) {
+        objects[i] = wavo_pool_alloc(&pool);
+        cr_assert_neq(objects[i], objects[5]);
+        cr_assert_eq(objects[i]->value, 0.0);
+    }
+    cr_assert_eq(pool.slab_count, 1);
+
+    for (size_t i = 0; i < 3; i++) {
+        wavo_pool_free(&pool, objects[i]);
+    }
+    wavo_pool_free(&pool, objects[5]);
+    wavo_pool_finish(&pool);
+}
@@ -0,0 +1,150 @@
+#include <stdlib.h>
+#include <criterion/criterion.h>
+#include <wayland-server-core.h>
+#include <wlr/types/wlr_buffer.h>
+#include <wlr/types/wlr_output.h>
+#include <wlr/types/wlr_output_layout.h>
+#include <wlr/types/wlr_scene.h>
+#include "wavo/buffer.h"
+#include "wavo/config.h"
+#include "wavo/output.h"
+#include "wavo/render.h"
+#include "wavo/server.h"
+#include "headless.h"
+
+// One scene, drawn first by the scene renderer and then by a render worker:
+// a solid rect, a buffer at its own size, a scaled one and a translucent one
+// overlapping the rect. Both frames must come out the same.
+
+#define WIDTH 160
+#define HEIGHT 120
+#define RUN_MSEC 100
+
+// Rounding of blends and scaling may differ by a step
+#define CHANNEL_TOLERANCE 2
+
+struct frame_capture {
+    uint32_t pixels[WIDTH * HEIGHT];  // XRGB, alpha cleared
+    int frames;
+
+    struct wl_listener commit;
+};
+
+static struct wavo_config config;
+static struct wavo_server *server;
+static struct wlr_buffer *buffers[3];
+
+static void capture_handle_commit(struct wl_listener *listener, void *data) {
+    struct frame_capture *capture = wl_container_of(listener, capture, commit);
+    const struct wlr_output_event_commit *event = data;
+    if (!(event->state->committed & WLR_OUTPUT_STATE_BUFFER)) {
+        return;
+    }
+
+    void *pixels;
+    uint32_t format;
+    size_t stride;
+    cr_assert(wlr_buffer_begin_data_ptr_access(event->state->buffer,
+        WLR_BUFFER_DATA_PTR_ACCESS_READ, &pixels, &format, &stride));
+    for (int y = 0; y < HEIGHT; y++) {
+        const uint32_t *row =
+            (const uint32_t *)((const uint8_t *)pixels + (size_t)y * stride);
+        for (int x = 0; x < WIDTH; x++) {
+            capture->pixels[y * WIDTH + x] = row[x] & 0x00FFFFFF;
+        }
+    }
+    wlr_buffer_end_data_ptr_access(event->state->buffer);
+    capture->frames++;
+}
+
+static int channel_diff(uint32_t a, uint32_t b, int shift) {
+    return abs((int)((a >> shift) & 0xFF) - (int)((b >> shift) & 0xFF));
+}
+
+static void setup(void) {
+    server = headless_server_create(&config, 0);
+    cr_assert_not_null(server);
+
+    static const uint32_t colors[] = { 0xFFFF0000, 0xFF00FF00, 0xFF0000FF };
+    static const int sizes[] = { 32, 16, 40 };
+    for (int i = 0; i < 3; i++) {
+        struct wavo_pixel_buffer *buffer =
+            headless_buffer_create(sizes[i], sizes[i], colors[i]);
+        cr_assert_not_null(buffer);
+        buffers[i] = &buffer->base;
+    }
+}
+
+static void teardown(void) {
+    wavo_server_destroy(server);
+    for (int i = 0; i < 3; i++) {
+        wlr_buffer_drop(buffers[i]);
+    }
+    wavo_config_free(&config);
+}
+
+TestSuite(render, .init = setup, .fini = teardown);
+
+Test(render, worker_matches_scene_renderer) {
+    struct wavo_output *output = wavo_output_create_virtual(server, WIDTH,
+        HEIGHT, 60000);
+    cr_assert_not_null(output);
+    struct wlr_box box;
+    wlr_output_layout_get_box(server->output_layout, output->wlr_output, &box);
+
+    struct wlr_scene_rect *rect = wlr_scene_rect_create(server->view_tree,
+        60, 40, (const float[4]){ 0.2f, 0.4f, 0.6f, 1.0f });
+    cr_assert_not_null(rect);
+    wlr_scene_node_set_position(&rect->node, box.x + 10, box.y + 10);
+
+    struct wlr_scene_buffer *plain = wlr_scene_buffer_create(server->view_tree,
+        buffers[0]);
+    cr_assert_not_null(plain);
+    wlr_scene_node_set_position(&plain->node, box.x + 80, box.y + 20);
+
+    struct wlr_scene_buffer *scaled = wlr_scene_buffer_create(server->view_tree,
+        buffers[1]);
+    cr_assert_not_null(scaled);
+    wlr_scene_buffer_set_dest_size(scaled, 48, 24);
+    wlr_scene_buffer_set_filter_mode(scaled, WLR_SCALE_FILTER_NEAREST);
+    wlr_scene_node_set_position(&scaled->node, box.x + 100, box.y + 80);
+
+    struct wlr_scene_buffer *translucent =
+        wlr_scene_buffer_create(server->view_tree, buffers[2]);
+    cr_assert_not_null(translucent);
+    wlr_scene_buffer_set_opacity(translucent, 0.5f);
+    wlr_scene_node_set_position(&translucent->node, box.x + 40, box.y + 30);
+
+    static struct frame_capture serial, parallel;
+    serial.commit.notify = capture_handle_commit;
+    wl_signal_add(&output->wlr_output->events.commit, &serial.commit);
+    headless_run_for(server, RUN_MSEC);
+    wl_list_remove(&serial.commit.link);
+    cr_assert_gt(serial.frames, 0, "scene renderer drew no frame");
+
+    server->render = wavo_render_create(server);
+    cr_assert_not_null(server->render);
+
+    // Damage brings a new frame, which the worker repaints in full
+    wlr_scene_node_set_enabled(&rect->node, false);
+    wlr_scene_node_set_enabled(&rect->node, true);
+    parallel.commit.notify = capture_handle_commit;
+    wl_signal_add(&output->wlr_output->events.commit, &parallel.commit);
+    headless_run_for(server, RUN_MSEC);
+    wl_list_remove(&parallel.commit.link);
+    cr_assert_gt(parallel.frames, 0, "worker drew no frame");
+    cr_assert_gt(server->render->frames, 0, "frames went to the fallback");
+
+    for (int i = 0; i < WIDTH * HEIGHT; i++) {
+        uint32_t a = serial.pixels[i];
+        uint32_t b = parallel.pixels[i];
+        for (int shift = 0; shift < 24; shift += 8) {
+            cr_assert_leq(channel_diff(a, b, shift), CHANNEL_TOLERANCE,
+                "pixel %d,%d is %06X from the scene renderer, %06X from "
+                "the worker", i % WIDTH, i / WIDTH, a, b);
+        }
+    }
+
+    // The plain buffer, so the scene did make it into both
+    cr_assert_eq(serial.pixels[25 * WIDTH + 90], 0xFF0000);
+}
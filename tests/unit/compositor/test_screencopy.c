@@ -0,0 +1,498 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <criterion/criterion.h>
+#include <pixman.h>
+#include <wayland-client.h>
+#include <wayland-server-core.h>
+#include <wlr/types/wlr_output_layout.h>
+#include <wlr/types/wlr_scene.h>
+#include "wavo/config.h"
+#include "wavo/convert.h"
+#include "wavo/latency.h"
+#include "wavo/output.h"
+#include "wavo/screencopy.h"
+#include "wavo/server.h"
+#include "client.h"
+#include "headless.h"
+#include "wlr-screencopy-unstable-v1-client-protocol.h"
+
+// A client capturing a virtual output showing two rects on black: plain
+// copies, damage copies that only complete once something changed, the
+// buffers the compositor refuses, and YUV captures that must match the
+// scalar conversion of an XRGB8888 capture bit for bit.
+
+#define WIDTH 64
+#define HEIGHT 48
+#define RECT_SIZE 8
+#define CAPTURE_TIMEOUT_USEC 1000000
+
+// One frame as the client sees it
+struct capture {
+    struct zwlr_screencopy_frame_v1 *frame;
+    uint32_t formats[4];  // Offered by buffer events
+    int format_count;
+    uint32_t stride;  // Of XRGB8888
+    bool buffer_done, ready, failed;
+    pixman_region32_t damage;  // Reported by damage events
+};
+
+// A client buffer the compositor copies into, mapped for the test to read
+struct target {
+    struct wl_buffer *buffer;
+    uint8_t *data;
+    size_t size;
+};
+
+static struct wavo_config config;
+static struct wavo_server *server;
+static struct headless_client client;
+static struct wl_registry *registry;
+static uint32_t manager_name;
+static struct zwlr_screencopy_manager_v1 *manager;
+static struct wl_output *output;
+static struct wlr_scene_rect *rects[2];
+static const int rect_x[2] = { 8, 40 };
+static const int rect_y[2] = { 8, 24 };
+
+static void registry_global(void *data, struct wl_registry *registry,
+    uint32_t name, const char *interface, uint32_t version) {
+    (void)data;
+    (void)version;
+    if (strcmp(interface, zwlr_screencopy_manager_v1_interface.name) == 0) {
+        manager_name = name;
+    } else if (strcmp(interface, wl_output_interface.name) == 0 &&
+            !output) {
+        output = wl_registry_bind(registry, name, &wl_output_interface, 1);
+    }
+}
+
+static void registry_global_remove(void *data, struct wl_registry *registry,
+    uint32_t name) {
+    (void)data;
+    (void)registry;
+    (void)name;
+}
+
+static const struct wl_registry_listener registry_listener = {
+    .global = registry_global,
+    .global_remove = registry_global_remove,
+};
+
+static void frame_buffer(void *data, struct zwlr_screencopy_frame_v1 *frame,
+    uint32_t format, uint32_t width, uint32_t height, uint32_t stride) {
+    (void)frame;
+    struct capture *capture = data;
+    cr_assert_eq(width, WIDTH);
+    cr_assert_eq(height, HEIGHT);
+    cr_assert_lt(capture->format_count, 4);
+    capture->formats[capture->format_count++] = format;
+    if (format == WL_SHM_FORMAT_XRGB8888) {
+        capture->stride = stride;
+    }
+}
+
+static void frame_flags(void *data, struct zwlr_screencopy_frame_v1 *frame,
+    uint32_t flags) {
+    (void)data;
+    (void)frame;
+    (void)flags;
+}
+
+static void frame_ready(void *data, struct zwlr_screencopy_frame_v1 *frame,
+    uint32_t tv_sec_hi, uint32_t tv_sec_lo, uint32_t tv_nsec) {
+    (void)frame;
+    (void)tv_sec_hi;
+    (void)tv_sec_lo;
+    (void)tv_nsec;
+    struct capture *capture = data;
+    capture->ready = true;
+}
+
+static void frame_failed(void *data, struct zwlr_screencopy_frame_v1 *frame) {
+    (void)frame;
+    struct capture *capture = data;
+    capture->failed = true;
+}
+
+static void frame_damage(void *data, struct zwlr_screencopy_frame_v1 *frame,
+    uint32_t x, uint32_t y, uint32_t width, uint32_t height) {
+    (void)frame;
+    struct capture *capture = data;
+    pixman_region32_union_rect(&capture->damage, &capture->damage, (int)x,
+        (int)y, width, height);
+}
+
+static void frame_linux_dmabuf(void *data,
+    struct zwlr_screencopy_frame_v1 *frame, uint32_t format, uint32_t width,
+    uint32_t height) {
+    (void)data;
+    (void)frame;
+    (void)format;
+    (void)width;
+    (void)height;
+}
+
+static void frame_buffer_done(void *data,
+    struct zwlr_screencopy_frame_v1 *frame) {
+    (void)frame;
+    struct capture *capture = data;
+    capture->buffer_done = true;
+}
+
+static const struct zwlr_screencopy_frame_v1_listener frame_listener = {
+    .buffer = frame_buffer,
+    .flags = frame_flags,
+    .ready = frame_ready,
+    .failed = frame_failed,
+    .damage = frame_damage,
+    .linux_dmabuf = frame_linux_dmabuf,
+    .buffer_done = frame_buffer_done,
+};
+
+// Asks for a capture of the whole output and waits for its buffer events
+static void capture_start(struct capture *capture,
+    struct zwlr_screencopy_manager_v1 *from) {
+    memset(capture, 0, sizeof(*capture));
+    pixman_region32_init(&capture->damage);
+    capture->frame = zwlr_screencopy_manager_v1_capture_output(from, 0,
+        output);
+    zwlr_screencopy_frame_v1_add_listener(capture->frame, &frame_listener,
+        capture);
+    cr_assert(headless_client_roundtrip(&client, server));
+    cr_assert_gt(capture->format_count, 0);
+    cr_assert_eq(capture->stride, WIDTH * 4);
+}
+
+static void capture_finish(struct capture *capture) {
+    zwlr_screencopy_frame_v1_destroy(capture->frame);
+    pixman_region32_fini(&capture->damage);
+}
+
+static bool capture_offers(struct capture *capture, uint32_t format) {
+    for (int i = 0; i < capture->format_count; i++) {
+        if (capture->formats[i] == format) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Dispatches both sides until the capture is over or times out, true if it
+// succeeded
+static bool capture_wait(struct capture *capture) {
+    uint64_t end = wavo_latency_now_usec() + CAPTURE_TIMEOUT_USEC;
+    while (!capture->ready && !capture->failed &&
+            wl_display_get_error(client.display) == 0 &&
+            wavo_latency_now_usec() < end) {
+        headless_client_dispatch(&client, server, 1);
+    }
+    return capture->ready;
+}
+
+static struct target target_create(int width, int height, int stride,
+    uint32_t format, size_t size) {
+    struct target target = { .size = size };
+    int fd = memfd_create("wavo-test-screencopy", MFD_CLOEXEC);
+    cr_assert_geq(fd, 0);
+    cr_assert_eq(ftruncate(fd, (off_t)size), 0);
+    target.data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+        0);
+    cr_assert_neq(target.data, MAP_FAILED);
+
+    struct wl_shm_pool *pool = wl_shm_create_pool(client.shm, fd,
+        (int32_t)size);
+    target.buffer = wl_shm_pool_create_buffer(pool, 0, width, height, stride,
+        format);
+    wl_shm_pool_destroy(pool);
+    close(fd);
+    return target;
+}
+
+static struct target target_create_xrgb(void) {
+    return target_create(WIDTH, HEIGHT, WIDTH * 4, WL_SHM_FORMAT_XRGB8888,
+        WIDTH * HEIGHT * 4);
+}
+
+static void target_destroy(struct target *target) {
+    wl_buffer_destroy(target->buffer);
+    munmap(target->data, target->size);
+}
+
+static uint32_t target_pixel(struct target *target, int x, int y) {
+    const uint32_t *row =
+        (const uint32_t *)(target->data + (size_t)y * WIDTH * 4);
+    return row[x] & 0x00FFFFFF;
+}
+
+static uint32_t rect_pixel(struct target *target, int i) {
+    return target_pixel(target, rect_x[i] + RECT_SIZE / 2,
+        rect_y[i] + RECT_SIZE / 2);
+}
+
+static bool damage_covers_rect(struct capture *capture, int i) {
+    pixman_box32_t box = {
+        .x1 = rect_x[i],
+        .y1 = rect_y[i],
+        .x2 = rect_x[i] + RECT_SIZE,
+        .y2 = rect_y[i] + RECT_SIZE,
+    };
+    return pixman_region32_contains_rectangle(&capture->damage, &box) ==
+        PIXMAN_REGION_IN;
+}
+
+// Recolors a rect and lets the output commit the change
+static void paint(int i, const float color[4]) {
+    wlr_scene_rect_set_color(rects[i], color);
+    headless_client_run_for(&client, server, 50);
+}
+
+// The client was disconnected for a screencopy frame error of code
+static void assert_frame_error(uint32_t code) {
+    cr_assert_not(headless_client_roundtrip(&client, server));
+    cr_assert_eq(wl_display_get_error(client.display), EPROTO);
+    const struct wl_interface *interface;
+    cr_assert_eq(wl_display_get_protocol_error(client.display, &interface,
+        NULL), code);
+    cr_assert_eq(interface, &zwlr_screencopy_frame_v1_interface);
+}
+
+static const float red[4] = { 1.0f, 0.0f, 0.0f, 1.0f };
+static const float green[4] = { 0.0f, 1.0f, 0.0f, 1.0f };
+static const float blue[4] = { 0.0f, 0.0f, 1.0f, 1.0f };
+static const float white[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+
+static void setup(void) {
+    server = headless_server_create(&config, 0);
+    cr_assert_not_null(server);
+    struct wavo_output *wavo_output =
+        wavo_output_create_virtual(server, WIDTH, HEIGHT, 60000);
+    cr_assert_not_null(wavo_output);
+
+    struct wlr_box box;
+    wlr_output_layout_get_box(server->output_layout, wavo_output->wlr_output,
+        &box);
+    const float *colors[2] = { red, blue };
+    for (int i = 0; i < 2; i++) {
+        rects[i] = wlr_scene_rect_create(server->view_tree, RECT_SIZE,
+            RECT_SIZE, colors[i]);
+        cr_assert_not_null(rects[i]);
+        wlr_scene_node_set_position(&rects[i]->node, box.x + rect_x[i],
+            box.y + rect_y[i]);
+    }
+
+    cr_assert(headless_client_connect(&client, server));
+    manager_name = 0;
+    output = NULL;
+    registry = wl_display_get_registry(client.display);
+    wl_registry_add_listener(registry, &registry_listener, NULL);
+    cr_assert(headless_client_roundtrip(&client, server));
+    cr_assert_neq(manager_name, 0);
+    cr_assert_not_null(output);
+    manager = wl_registry_bind(registry, manager_name,
+        &zwlr_screencopy_manager_v1_interface, 3);
+    headless_client_run_for(&client, server, 50);
+}
+
+static void teardown(void) {
+    zwlr_screencopy_manager_v1_destroy(manager);
+    wl_output_destroy(output);
+    wl_registry_destroy(registry);
+    headless_client_disconnect(&client);
+    wavo_server_destroy(server);
+    wavo_config_free(&config);
+}
+
+TestSuite(screencopy, .init = setup, .fini = teardown);
+
+Test(screencopy, copy_reads_output) {
+    struct capture capture;
+    capture_start(&capture, manager);
+    cr_assert(capture.buffer_done);
+    struct target target = target_create_xrgb();
+
+    zwlr_screencopy_frame_v1_copy(capture.frame, target.buffer);
+    cr_assert(capture_wait(&capture));
+    cr_assert_eq(rect_pixel(&target, 0), 0xFF0000);
+    cr_assert_eq(rect_pixel(&target, 1), 0x0000FF);
+    cr_assert_eq(target_pixel(&target, 0, 0), 0);
+    cr_assert_not(pixman_region32_not_empty(&capture.damage),
+        "plain copies report no damage");
+
+    capture_finish(&capture);
+    target_destroy(&target);
+}
+
+Test(screencopy, damage_accumulates_between_captures) {
+    struct target target = target_create_xrgb();
+
+    // A client that has seen nothing gets everything
+    struct capture capture;
+    capture_start(&capture, manager);
+    zwlr_screencopy_frame_v1_copy_with_damage(capture.frame, target.buffer);
+    cr_assert(capture_wait(&capture));
+    pixman_box32_t *extents = pixman_region32_extents(&capture.damage);
+    cr_assert_eq(extents->x1, 0);
+    cr_assert_eq(extents->y1, 0);
+    cr_assert_eq(extents->x2, WIDTH);
+    cr_assert_eq(extents->y2, HEIGHT);
+    capture_finish(&capture);
+
+    // Two frames of changes, both reported by the next capture and copied
+    // into the same buffer, but not the black in between
+    paint(0, green);
+    paint(1, white);
+    capture_start(&capture, manager);
+    zwlr_screencopy_frame_v1_copy_with_damage(capture.frame, target.buffer);
+    cr_assert(capture_wait(&capture));
+    cr_assert(damage_covers_rect(&capture, 0));
+    cr_assert(damage_covers_rect(&capture, 1));
+    cr_assert_not(pixman_region32_contains_point(&capture.damage, 0, 0,
+        NULL));
+    cr_assert_eq(rect_pixel(&target, 0), 0x00FF00);
+    cr_assert_eq(rect_pixel(&target, 1), 0xFFFFFF);
+    capture_finish(&capture);
+
+    // Nothing changed since, so the capture waits for the next change
+    capture_start(&capture, manager);
+    zwlr_screencopy_frame_v1_copy_with_damage(capture.frame, target.buffer);
+    headless_client_run_for(&client, server, 100);
+    cr_assert_not(capture.ready, "damage copy completed without damage");
+    wlr_scene_rect_set_color(rects[0], red);
+    cr_assert(capture_wait(&capture));
+    cr_assert(damage_covers_rect(&capture, 0));
+    cr_assert_not(damage_covers_rect(&capture, 1));
+    cr_assert_eq(rect_pixel(&target, 0), 0xFF0000);
+    cr_assert_eq(rect_pixel(&target, 1), 0xFFFFFF);
+    capture_finish(&capture);
+
+    target_destroy(&target);
+}
+
+Test(screencopy, copy_does_not_wait_for_damage) {
+    struct target target = target_create_xrgb();
+    struct capture capture;
+    capture_start(&capture, manager);
+    zwlr_screencopy_frame_v1_copy_with_damage(capture.frame, target.buffer);
+    cr_assert(capture_wait(&capture));
+    capture_finish(&capture);
+
+    // Everything seen, a plain copy still gets the next frame
+    capture_start(&capture, manager);
+    zwlr_screencopy_frame_v1_copy(capture.frame, target.buffer);
+    cr_assert(capture_wait(&capture));
+    cr_assert_eq(rect_pixel(&target, 0), 0xFF0000);
+    capture_finish(&capture);
+
+    target_destroy(&target);
+}
+
+Test(screencopy, buffer_of_other_size_is_invalid) {
+    struct capture capture;
+    capture_start(&capture, manager);
+    struct target target = target_create(WIDTH - 2, HEIGHT, WIDTH * 4,
+        WL_SHM_FORMAT_XRGB8888, WIDTH * HEIGHT * 4);
+
+    zwlr_screencopy_frame_v1_copy(capture.frame, target.buffer);
+    assert_frame_error(ZWLR_SCREENCOPY_FRAME_V1_ERROR_INVALID_BUFFER);
+
+    capture_finish(&capture);
+    target_destroy(&target);
+}
+
+Test(screencopy, buffer_of_other_format_is_invalid) {
+    struct capture capture;
+    capture_start(&capture, manager);
+    cr_assert_not(capture_offers(&capture, WL_SHM_FORMAT_ARGB8888));
+    struct target target = target_create(WIDTH, HEIGHT, WIDTH * 4,
+        WL_SHM_FORMAT_ARGB8888, WIDTH * HEIGHT * 4);
+
+    zwlr_screencopy_frame_v1_copy(capture.frame, target.buffer);
+    assert_frame_error(ZWLR_SCREENCOPY_FRAME_V1_ERROR_INVALID_BUFFER);
+
+    capture_finish(&capture);
+    target_destroy(&target);
+}
+
+Test(screencopy, yuv_needs_version_3) {
+    struct zwlr_screencopy_manager_v1 *old_manager = wl_registry_bind(
+        registry, manager_name, &zwlr_screencopy_manager_v1_interface, 2);
+    struct capture capture;
+    capture_start(&capture, old_manager);
+    cr_assert_not(capture_offers(&capture, WL_SHM_FORMAT_NV12));
+    struct target target = target_create(WIDTH, HEIGHT, WIDTH,
+        WL_SHM_FORMAT_NV12, WIDTH * HEIGHT * 3 / 2);
+
+    zwlr_screencopy_frame_v1_copy(capture.frame, target.buffer);
+    assert_frame_error(ZWLR_SCREENCOPY_FRAME_V1_ERROR_INVALID_BUFFER);
+
+    capture_finish(&capture);
+    target_destroy(&target);
+    zwlr_screencopy_manager_v1_destroy(old_manager);
+}
+
+Test(screencopy, frame_copies_once) {
+    struct capture capture;
+    capture_start(&capture, manager);
+    struct target target = target_create_xrgb();
+
+    zwlr_screencopy_frame_v1_copy(capture.frame, target.buffer);
+    zwlr_screencopy_frame_v1_copy(capture.frame, target.buffer);
+    assert_frame_error(ZWLR_SCREENCOPY_FRAME_V1_ERROR_ALREADY_USED);
+
+    capture_finish(&capture);
+    target_destroy(&target);
+}
+
+// Captures the output as XRGB8888, then in format, and compares the latter
+// with the scalar conversion of the former
+static void assert_yuv_capture(uint32_t format, enum wavo_yuv_layout layout) {
+    struct target reference = target_create_xrgb();
+    struct capture capture;
+    capture_start(&capture, manager);
+    zwlr_screencopy_frame_v1_copy(capture.frame, reference.buffer);
+    cr_assert(capture_wait(&capture));
+    capture_finish(&capture);
+
+    static uint8_t expected[WIDTH * HEIGHT * 3 / 2];
+    memset(expected, 0, sizeof(expected));
+    struct wavo_yuv_image image = {
+        .layout = layout,
+        .planes = { expected, expected + WIDTH * HEIGHT },
+        .strides = { WIDTH, WIDTH },
+    };
+    if (layout == WAVO_YUV_I420) {
+        image.strides[1] = WIDTH / 2;
+        image.planes[2] = image.planes[1] + WIDTH / 2 * HEIGHT / 2;
+        image.strides[2] = WIDTH / 2;
+    }
+    wavo_convert_to_yuv(WAVO_CONVERT_SCALAR, reference.data, WIDTH * 4,
+        &image, 0, 0, WIDTH, HEIGHT);
+
+    uint64_t converted = server->screencopy->converted_pixels;
+    capture_start(&capture, manager);
+    cr_assert(capture_offers(&capture, format));
+    struct target target = target_create(WIDTH, HEIGHT, WIDTH, format,
+        sizeof(expected));
+    zwlr_screencopy_frame_v1_copy(capture.frame, target.buffer);
+    cr_assert(capture_wait(&capture));
+    cr_assert_eq(server->screencopy->converted_pixels,
+        converted + WIDTH * HEIGHT);
+    cr_assert_eq(memcmp(target.data, expected, sizeof(expected)), 0,
+        "%s capture differs from the scalar conversion",
+        wavo_convert_impl_name(server->screencopy->convert_impl));
+    capture_finish(&capture);
+
+    target_destroy(&target);
+    target_destroy(&reference);
+}
+
+Test(screencopy, nv12_capture_matches_scalar) {
+    assert_yuv_capture(WL_SHM_FORMAT_NV12, WAVO_YUV_NV12);
+}
+
+Test(screencopy, yuv420_capture_matches_scalar) {
+    assert_yuv_capture(WL_SHM_FORMAT_YUV420, WAVO_YUV_I420);
+}
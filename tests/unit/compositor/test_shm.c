@@ -0,0 +1,229 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <drm_fourcc.h>
+#include <criterion/criterion.h>
+#include <wayland-client.h>
+#include <wayland-server-core.h>
+#include <wlr/render/wlr_texture.h>
+#include <wlr/types/wlr_compositor.h>
+#include <wlr/types/wlr_xdg_shell.h>
+#include "wavo/config.h"
+#include "wavo/output.h"
+#include "wavo/server.h"
+#include "wavo/view.h"
+#include "client.h"
+#include "headless.h"
+
+// Buffers created from wavo's own wl_shm pools: the size each format needs,
+// pools growing under live buffers, and the YUV formats screencopy offers
+// staying off surfaces.
+
+#define SIZE 16
+#define RGB_BYTES (SIZE * SIZE * 4)
+#define YUV_BYTES (SIZE * SIZE * 3 / 2)
+
+static struct wavo_config config;
+static struct wavo_server *server;
+static struct headless_client client;
+static struct headless_window window;
+
+// A memfd of size bytes, each 32-bit word of it set to color
+static int shm_file_create(size_t size, uint32_t color) {
+    int fd = memfd_create("wavo-test-shm", MFD_CLOEXEC);
+    cr_assert_geq(fd, 0);
+    cr_assert_eq(ftruncate(fd, (off_t)size), 0);
+    uint32_t *words = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+        fd, 0);
+    cr_assert_neq(words, MAP_FAILED);
+    for (size_t i = 0; i < size / 4; i++) {
+        words[i] = color;
+    }
+    munmap(words, size);
+    return fd;
+}
+
+// Fills bytes [offset, offset + size) of fd with color, growing it to fit
+static void shm_file_fill(int fd, size_t offset, size_t size,
+    uint32_t color) {
+    cr_assert_eq(ftruncate(fd, (off_t)(offset + size)), 0);
+    uint8_t *bytes = mmap(NULL, offset + size, PROT_READ | PROT_WRITE,
+        MAP_SHARED, fd, 0);
+    cr_assert_neq(bytes, MAP_FAILED);
+    uint32_t *words = (uint32_t *)(bytes + offset);
+    for (size_t i = 0; i < size / 4; i++) {
+        words[i] = color;
+    }
+    munmap(bytes, offset + size);
+}
+
+// The client was disconnected for a wl_shm_pool error of code
+static void assert_pool_error(uint32_t code) {
+    cr_assert_not(headless_client_roundtrip(&client, server));
+    cr_assert_eq(wl_display_get_error(client.display), EPROTO);
+    const struct wl_interface *interface;
+    cr_assert_eq(wl_display_get_protocol_error(client.display, &interface,
+        NULL), code);
+    cr_assert_eq(interface, &wl_shm_pool_interface);
+}
+
+// The top-left pixel of the window's surface, as the server textures it
+static uint32_t surface_first_pixel(void) {
+    struct wavo_view *view =
+        wl_container_of(server->views.next, view, link);
+    struct wlr_texture *texture =
+        wlr_surface_get_texture(view->xdg_surface->surface);
+    cr_assert_not_null(texture);
+
+    uint32_t pixels[SIZE * SIZE];
+    cr_assert(wlr_texture_read_pixels(texture,
+        &(struct wlr_texture_read_pixels_options){
+            .data = pixels,
+            .format = DRM_FORMAT_XRGB8888,
+            .stride = SIZE * 4,
+        }));
+    return pixels[0] & 0x00FFFFFF;
+}
+
+static void show(struct wl_buffer *buffer) {
+    wl_surface_attach(window.surface, buffer, 0, 0);
+    wl_surface_damage_buffer(window.surface, 0, 0, SIZE, SIZE);
+    wl_surface_commit(window.surface);
+}
+
+static void setup(void) {
+    server = headless_server_create(&config, 0);
+    cr_assert_not_null(server);
+    cr_assert_not_null(wavo_output_create_virtual(server, 640, 480, 60000));
+    cr_assert(headless_client_connect(&client, server));
+    cr_assert(headless_window_map(&window, &client, server, SIZE, SIZE,
+        0xFF0000FF));
+}
+
+static void teardown(void) {
+    headless_window_finish(&window);
+    headless_client_disconnect(&client);
+    wavo_server_destroy(server);
+    wavo_config_free(&config);
+}
+
+TestSuite(shm, .init = setup, .fini = teardown);
+
+Test(shm, yuv_pool_must_hold_chroma) {
+    int fd = shm_file_create(YUV_BYTES, 0);
+    struct wl_shm_pool *pool = wl_shm_create_pool(client.shm, fd, YUV_BYTES);
+    close(fd);
+
+    // Luma and both chroma planes fit exactly
+    struct wl_buffer *nv12 = wl_shm_pool_create_buffer(pool, 0, SIZE, SIZE,
+        SIZE, WL_SHM_FORMAT_NV12);
+    struct wl_buffer *yuv420 = wl_shm_pool_create_buffer(pool, 0, SIZE, SIZE,
+        SIZE, WL_SHM_FORMAT_YUV420);
+    cr_assert(headless_client_roundtrip(&client, server));
+    wl_buffer_destroy(nv12);
+    wl_buffer_destroy(yuv420);
+
+    // One luma row further in, the chroma would run past the pool
+    struct wl_buffer *past = wl_shm_pool_create_buffer(pool, SIZE, SIZE,
+        SIZE, SIZE, WL_SHM_FORMAT_NV12);
+    assert_pool_error(WL_SHM_ERROR_INVALID_STRIDE);
+    wl_buffer_destroy(past);
+    wl_shm_pool_destroy(pool);
+}
+
+Test(shm, yuv_needs_even_size) {
+    int fd = shm_file_create(YUV_BYTES, 0);
+    struct wl_shm_pool *pool = wl_shm_create_pool(client.shm, fd, YUV_BYTES);
+    close(fd);
+
+    // Fits the pool, but a 4:2:0 chroma sample cannot cover half a pixel
+    struct wl_buffer *odd = wl_shm_pool_create_buffer(pool, 0, SIZE - 1,
+        SIZE - 1, SIZE, WL_SHM_FORMAT_NV12);
+    assert_pool_error(WL_SHM_ERROR_INVALID_STRIDE);
+    wl_buffer_destroy(odd);
+    wl_shm_pool_destroy(pool);
+}
+
+Test(shm, stride_narrower_than_row_is_rejected) {
+    int fd = shm_file_create(RGB_BYTES, 0);
+    struct wl_shm_pool *pool = wl_shm_create_pool(client.shm, fd, RGB_BYTES);
+    close(fd);
+
+    struct wl_buffer *narrow = wl_shm_pool_create_buffer(pool, 0, SIZE, SIZE,
+        SIZE * 4 - 1, WL_SHM_FORMAT_XRGB8888);
+    assert_pool_error(WL_SHM_ERROR_INVALID_STRIDE);
+    wl_buffer_destroy(narrow);
+    wl_shm_pool_destroy(pool);
+}
+
+Test(shm, unknown_format_is_rejected) {
+    int fd = shm_file_create(RGB_BYTES, 0);
+    struct wl_shm_pool *pool = wl_shm_create_pool(client.shm, fd, RGB_BYTES);
+    close(fd);
+
+    struct wl_buffer *buffer = wl_shm_pool_create_buffer(pool, 0, SIZE, SIZE,
+        SIZE * 4, 0x20202020);
+    assert_pool_error(WL_SHM_ERROR_INVALID_FORMAT);
+    wl_buffer_destroy(buffer);
+    wl_shm_pool_destroy(pool);
+}
+
+Test(shm, pool_grows_under_live_buffers) {
+    int fd = shm_file_create(RGB_BYTES, 0xFFFF0000);
+    struct wl_shm_pool *pool = wl_shm_create_pool(client.shm, fd, RGB_BYTES);
+    struct wl_buffer *first = wl_shm_pool_create_buffer(pool, 0, SIZE, SIZE,
+        SIZE * 4, WL_SHM_FORMAT_XRGB8888);
+    show(first);
+    cr_assert(headless_client_roundtrip(&client, server));
+    cr_assert_eq(surface_first_pixel(), 0xFF0000);
+
+    // Past the old end only once the pool has grown
+    shm_file_fill(fd, RGB_BYTES, RGB_BYTES, 0xFF00FF00);
+    wl_shm_pool_resize(pool, RGB_BYTES * 2);
+    struct wl_buffer *second = wl_shm_pool_create_buffer(pool, RGB_BYTES,
+        SIZE, SIZE, SIZE * 4, WL_SHM_FORMAT_XRGB8888);
+    show(second);
+    cr_assert(headless_client_roundtrip(&client, server));
+    cr_assert_eq(surface_first_pixel(), 0x00FF00);
+
+    // The first buffer kept reading its old mapping through the resize,
+    // and still does once the pool is gone
+    wl_shm_pool_destroy(pool);
+    close(fd);
+    show(first);
+    cr_assert(headless_client_roundtrip(&client, server));
+    cr_assert_eq(surface_first_pixel(), 0xFF0000);
+
+    wl_buffer_destroy(first);
+    wl_buffer_destroy(second);
+}
+
+Test(shm, pool_cannot_shrink) {
+    int fd = shm_file_create(RGB_BYTES, 0);
+    struct wl_shm_pool *pool = wl_shm_create_pool(client.shm, fd, RGB_BYTES);
+    close(fd);
+
+    wl_shm_pool_resize(pool, RGB_BYTES / 2);
+    assert_pool_error(WL_SHM_ERROR_INVALID_STRIDE);
+    wl_shm_pool_destroy(pool);
+}
+
+Test(shm, yuv_buffer_on_surface_disconnects) {
+    int fd = shm_file_create(YUV_BYTES, 0);
+    struct wl_shm_pool *pool = wl_shm_create_pool(client.shm, fd, YUV_BYTES);
+    close(fd);
+    struct wl_buffer *nv12 = wl_shm_pool_create_buffer(pool, 0, SIZE, SIZE,
+        SIZE, WL_SHM_FORMAT_NV12);
+    wl_shm_pool_destroy(pool);
+
+    show(nv12);
+    cr_assert_not(headless_client_roundtrip(&client, server));
+    cr_assert_eq(wl_display_get_error(client.display), EPROTO);
+    const struct wl_interface *interface;
+    cr_assert_eq(wl_display_get_protocol_error(client.display, &interface,
+        NULL), WL_DISPLAY_ERROR_IMPLEMENTATION);
+    cr_assert_eq(interface, &wl_display_interface);
+    wl_buffer_destroy(nv12);
+}
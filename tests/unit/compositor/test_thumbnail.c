@@ -0,0 +1,141 @@
+#define _POSIX_C_SOURCE 200809L
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <criterion/criterion.h>
+#include <wayland-client.h>
+#include "wavo/buffer.h"
+#include "wavo/config.h"
+#include "wavo/ipc.h"
+#include "wavo/output.h"
+#include "wavo/server.h"
+#include "wavo/thumbnail.h"
+#include "wavo/view.h"
+#include "client.h"
+#include "headless.h"
+#include "xdg-shell-client-protocol.h"
+
+Test(thumbnail, size_keeps_aspect_ratio) {
+    int width, height;
+    wavo_thumbnail_get_size(1920, 1080, &width, &height);
+    cr_assert_eq(width, WAVO_THUMBNAIL_SIZE);
+    cr_assert_eq(height, 144);
+
+    wavo_thumbnail_get_size(600, 1200, &width, &height);
+    cr_assert_eq(width, 128);
+    cr_assert_eq(height, WAVO_THUMBNAIL_SIZE);
+}
+
+Test(thumbnail, size_never_upscales_or_vanishes) {
+    int width, height;
+    wavo_thumbnail_get_size(100, 40, &width, &height);
+    cr_assert_eq(width, 100);
+    cr_assert_eq(height, 40);
+
+    wavo_thumbnail_get_size(10000, 1, &width, &height);
+    cr_assert_eq(width, WAVO_THUMBNAIL_SIZE);
+    cr_assert_eq(height, 1);
+}
+
+Test(thumbnail, scale_averages_blocks) {
+    // 4x2 source: left half opaque red, right half transparent
+    uint32_t src[8];
+    for (int y = 0; y < 2; y++) {
+        for (int x = 0; x < 4; x++) {
+            src[y * 4 + x] = x < 2 ? 0xffff0000 : 0x00000000;
+        }
+    }
+
+    uint32_t dst[2];
+    wavo_thumbnail_scale(src, 4, 2, 4, dst, 2, 1, 2);
+    cr_assert_eq(dst[0], 0xffff0000);
+    cr_assert_eq(dst[1], 0x00000000);
+
+    uint32_t single;
+    wavo_thumbnail_scale(src, 4, 2, 4, &single, 1, 1, 1);
+    cr_assert_eq(single, 0x80800000);
+}
+
+Test(thumbnail, scale_honors_strides) {
+    // 2x2 image in rows of 3, the padding must not leak in
+    uint32_t src[6] = {
+        0xff102030, 0xff102030, 0xffffffff,
+        0xff102030, 0xff102030, 0xffffffff,
+    };
+    uint32_t dst[2] = { 0, 0xdeadbeef };
+    wavo_thumbnail_scale(src, 2, 2, 3, dst, 1, 1, 2);
+    cr_assert_eq(dst[0], 0xff102030);
+    cr_assert_eq(dst[1], 0xdeadbeef);
+}
+
+// A client window whose geometry leaves out a margin of its buffer, like a
+// client-side shadow
+#define WINDOW_SIZE 64
+#define GEOMETRY_X 8
+#define GEOMETRY_Y 12
+#define GEOMETRY_WIDTH 48
+#define GEOMETRY_HEIGHT 32
+
+static struct wavo_config config;
+static struct wavo_server *server;
+static struct headless_client client;
+
+static void setup(void) {
+    server = headless_server_create(&config, 0);
+    cr_assert_not_null(server);
+    cr_assert_not_null(wavo_output_create_virtual(server, 640, 480, 60000));
+    cr_assert(headless_client_connect(&client, server));
+}
+
+static void teardown(void) {
+    headless_client_disconnect(&client);
+    wavo_server_destroy(server);
+    wavo_config_free(&config);
+}
+
+TestSuite(thumbnail_view, .init = setup, .fini = teardown);
+
+Test(thumbnail_view, covers_window_geometry) {
+    struct headless_window window;
+    cr_assert(headless_window_map(&window, &client, server, WINDOW_SIZE,
+        WINDOW_SIZE, 0xFFFF0000));
+    xdg_surface_set_window_geometry(window.xdg_surface, GEOMETRY_X,
+        GEOMETRY_Y, GEOMETRY_WIDTH, GEOMETRY_HEIGHT);
+    cr_assert(headless_window_commit(&window, false));
+    headless_client_run_for(&client, server, 500);
+
+    cr_assert_not(wl_list_empty(&server->views));
+    struct wavo_view *view = wl_container_of(server->views.next, view, link);
+    struct wavo_thumbnail *thumbnail = view->thumbnail;
+    cr_assert_not_null(thumbnail);
+    cr_assert_not_null(thumbnail->buffer, "never refreshed");
+    cr_assert_eq(thumbnail->buffer->width, GEOMETRY_WIDTH);
+    cr_assert_eq(thumbnail->buffer->height, GEOMETRY_HEIGHT);
+    struct wavo_pixel_buffer *buffer =
+        wl_container_of(thumbnail->buffer, buffer, base);
+    cr_assert_eq(buffer->pixels[0], 0xFFFF0000);
+
+    // Comes back over the socket, not written anywhere
+    char line[32];
+    snprintf(line, sizeof(line), "thumbnail %" PRIu32, view->id);
+    char *reply = NULL;
+    size_t reply_len = 0;
+    FILE *out = open_memstream(&reply, &reply_len);
+    cr_assert_not_null(out);
+    cr_assert(wavo_ipc_execute(server, line, out));
+    fclose(out);
+    cr_assert_gt(reply_len, (size_t)GEOMETRY_WIDTH * GEOMETRY_HEIGHT * 4);
+    cr_assert_eq(strncmp(reply, "P7\n", 3), 0);
+    free(reply);
+
+    snprintf(line, sizeof(line), "thumbnail %" PRIu32 " /tmp/x", view->id);
+    out = open_memstream(&reply, &reply_len);
+    cr_assert_not_null(out);
+    cr_assert_not(wavo_ipc_execute(server, line, out));
+    fclose(out);
+    free(reply);
+
+    headless_window_finish(&window);
+}
@@ -0,0 +1,74 @@
+#include <criterion/criterion.h>
+#include <wayland-client.h>
+#include <wayland-server-core.h>
+#include "wavo/config.h"
+#include "wavo/output.h"
+#include "wavo/server.h"
+#include "wavo/view.h"
+#include "wavo/watchdog.h"
+#include "client.h"
+#include "headless.h"
+#include "xdg-shell-client-protocol.h"
+
+// A client that leaves pings unanswered for a while, then answers one.
+// Miss, re-ping, held configure and recovery must all follow within a
+// timeout or so of each other, not on the five second round.
+
+#define TIMEOUT_MSEC 1500
+#define WINDOW_SIZE 32
+
+static struct wavo_config config;
+static struct wavo_server *server;
+static struct headless_client client;
+
+static void setup(void) {
+    server = headless_server_create(&config, 0);
+    cr_assert_not_null(server);
+    cr_assert_not_null(wavo_output_create_virtual(server, 640, 480, 60000));
+    cr_assert(headless_client_connect(&client, server));
+}
+
+static void teardown(void) {
+    headless_client_disconnect(&client);
+    wavo_server_destroy(server);
+    wavo_config_free(&config);
+}
+
+TestSuite(watchdog, .init = setup, .fini = teardown);
+
+Test(watchdog, unresponsive_client_recovers) {
+    struct wavo_watchdog *watchdog = server->watchdog;
+    cr_assert_not_null(watchdog);
+
+    // Mapping focuses the view, which pings it
+    client.ignore_pings = true;
+    struct headless_window window;
+    cr_assert(headless_window_map(&window, &client, server, WINDOW_SIZE,
+        WINDOW_SIZE, 0xFF00FF00));
+    cr_assert_not(wl_list_empty(&server->views));
+    struct wavo_view *view = wl_container_of(server->views.next, view, link);
+    cr_assert_eq(client.pings, 1);
+
+    headless_client_run_for(&client, server, TIMEOUT_MSEC + 200);
+    cr_assert(view->unresponsive, "missed ping went unnoticed");
+    cr_assert_eq(watchdog->timeouts, 1);
+    cr_assert_eq(client.pings, 2, "no new ping after the miss");
+
+    // Owed, but held while nobody reads it
+    int configures = window.configures;
+    xdg_toplevel_set_maximized(window.toplevel);
+    cr_assert(headless_client_roundtrip(&client, server));
+    cr_assert(view->configure_held);
+    cr_assert_eq(window.configures, configures);
+
+    // Answering the latest ping brings it back within a recheck
+    client.ignore_pings = false;
+    xdg_wm_base_pong(client.wm_base, client.ping_serial);
+    headless_client_run_for(&client, server, TIMEOUT_MSEC / 2);
+    cr_assert_not(view->unresponsive, "answer went unnoticed");
+    cr_assert_eq(watchdog->recovered, 1);
+    cr_assert_not(view->configure_held);
+    cr_assert_gt(window.configures, configures, "held configure never sent");
+
+    headless_window_finish(&window);
+}
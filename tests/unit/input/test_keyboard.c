@@ -0,0 +1,249 @@
+#include <string.h>
+#include <unistd.h>
+#include <criterion/criterion.h>
+#include <wayland-client.h>
+#include <wayland-server-core.h>
+#include <wlr/interfaces/wlr_keyboard.h>
+#include "wavo/config.h"
+#include "wavo/input.h"
+#include "wavo/output.h"
+#include "wavo/server.h"
+#include "client.h"
+#include "headless.h"
+
+// Keyboards plugged into one seat, typed on in turn while a client has
+// keyboard focus. Keyboards alike must not make the client reload its
+// keymap.
+
+#define KEY_A 30  // Linux evdev code
+
+// What the client saw of the keyboard
+struct keyboard_client {
+    struct wl_registry *registry;
+    struct wl_seat *seat;
+    struct wl_keyboard *keyboard;
+
+    int keymaps;
+    int presses, releases;
+};
+
+static struct wavo_config config;
+static struct wavo_server *server;
+static struct wlr_keyboard devices[3];
+static int device_count;
+static struct headless_client client;
+static struct headless_window window;
+static struct keyboard_client keyboard;
+static uint32_t time_msec;
+
+static const struct wlr_keyboard_impl device_impl = {
+    .name = "test-keyboard",
+};
+
+static void keyboard_keymap(void *data, struct wl_keyboard *wl_keyboard,
+    uint32_t format, int32_t fd, uint32_t size) {
+    (void)wl_keyboard;
+    (void)format;
+    (void)size;
+    struct keyboard_client *keyboard = data;
+    keyboard->keymaps++;
+    close(fd);
+}
+
+static void keyboard_enter(void *data, struct wl_keyboard *wl_keyboard,
+    uint32_t serial, struct wl_surface *surface, struct wl_array *keys) {
+    (void)data;
+    (void)wl_keyboard;
+    (void)serial;
+    (void)surface;
+    (void)keys;
+}
+
+static void keyboard_leave(void *data, struct wl_keyboard *wl_keyboard,
+    uint32_t serial, struct wl_surface *surface) {
+    (void)data;
+    (void)wl_keyboard;
+    (void)serial;
+    (void)surface;
+}
+
+static void keyboard_key(void *data, struct wl_keyboard *wl_keyboard,
+    uint32_t serial, uint32_t time, uint32_t key, uint32_t state) {
+    (void)wl_keyboard;
+    (void)serial;
+    (void)time;
+    (void)key;
+    struct keyboard_client *keyboard = data;
+    if (state == WL_KEYBOARD_KEY_STATE_PRESSED) {
+        keyboard->presses++;
+    } else {
+        keyboard->releases++;
+    }
+}
+
+static void keyboard_modifiers(void *data, struct wl_keyboard *wl_keyboard,
+    uint32_t serial, uint32_t depressed, uint32_t latched, uint32_t locked,
+    uint32_t group) {
+    (void)data;
+    (void)wl_keyboard;
+    (void)serial;
+    (void)depressed;
+    (void)latched;
+    (void)locked;
+    (void)group;
+}
+
+// Bound at version 1, so no repeat_info
+static const struct wl_keyboard_listener keyboard_listener = {
+    .keymap = keyboard_keymap,
+    .enter = keyboard_enter,
+    .leave = keyboard_leave,
+    .key = keyboard_key,
+    .modifiers = keyboard_modifiers,
+};
+
+static void registry_global(void *data, struct wl_registry *registry,
+    uint32_t name, const char *interface, uint32_t version) {
+    (void)version;
+    struct keyboard_client *keyboard = data;
+    if (strcmp(interface, wl_seat_interface.name) == 0) {
+        keyboard->seat = wl_registry_bind(registry, name, &wl_seat_interface,
+            1);
+    }
+}
+
+static void registry_global_remove(void *data, struct wl_registry *registry,
+    uint32_t name) {
+    (void)data;
+    (void)registry;
+    (void)name;
+}
+
+static const struct wl_registry_listener registry_listener = {
+    .global = registry_global,
+    .global_remove = registry_global_remove,
+};
+
+static struct wlr_keyboard *plug_keyboard(void) {
+    cr_assert_lt(device_count, 3);
+    struct wlr_keyboard *device = &devices[device_count++];
+    wlr_keyboard_init(device, &device_impl, device_impl.name);
+    wavo_input_add_device(server->input, &device->base);
+    return device;
+}
+
+static struct wavo_keyboard *find_keyboard(struct wlr_keyboard *device) {
+    struct wavo_keyboard *keyboard;
+    wl_list_for_each(keyboard, &server->input->keyboards, link) {
+        if (keyboard->wlr_keyboard == device) {
+            return keyboard;
+        }
+    }
+    cr_assert_fail("keyboard was not set up");
+    return NULL;
+}
+
+// Presses and releases A on device, the way a backend reports it
+static void type_on(struct wlr_keyboard *device) {
+    uint32_t states[] = {
+        WL_KEYBOARD_KEY_STATE_PRESSED,
+        WL_KEYBOARD_KEY_STATE_RELEASED,
+    };
+    for (int i = 0; i < 2; i++) {
+        struct wlr_keyboard_key_event event = {
+            .time_msec = ++time_msec,
+            .keycode = KEY_A,
+            .update_state = true,
+            .state = states[i],
+        };
+        wlr_keyboard_notify_key(device, &event);
+    }
+    cr_assert(headless_client_roundtrip(&client, server));
+}
+
+static void setup(void) {
+    server = headless_server_create(&config, 0);
+    cr_assert_not_null(server);
+    cr_assert_not_null(wavo_output_create_virtual(server, 640, 480, 60000));
+    device_count = 0;
+    plug_keyboard();
+
+    cr_assert(headless_client_connect(&client, server));
+    memset(&keyboard, 0, sizeof(keyboard));
+    keyboard.registry = wl_display_get_registry(client.display);
+    wl_registry_add_listener(keyboard.registry, &registry_listener,
+        &keyboard);
+    cr_assert(headless_client_roundtrip(&client, server));
+    cr_assert_not_null(keyboard.seat);
+    keyboard.keyboard = wl_seat_get_keyboard(keyboard.seat);
+    wl_keyboard_add_listener(keyboard.keyboard, &keyboard_listener,
+        &keyboard);
+
+    // Mapping focuses the window
+    cr_assert(headless_window_map(&window, &client, server, 64, 64,
+        0xFF0000FF));
+    cr_assert_eq(keyboard.keymaps, 1);
+}
+
+static void teardown(void) {
+    headless_window_finish(&window);
+    wl_keyboard_destroy(keyboard.keyboard);
+    wl_seat_destroy(keyboard.seat);
+    wl_registry_destroy(keyboard.registry);
+    headless_client_disconnect(&client);
+    for (int i = 0; i < device_count; i++) {
+        wlr_keyboard_finish(&devices[i]);
+    }
+    wavo_server_destroy(server);
+    wavo_config_free(&config);
+}
+
+TestSuite(keyboard_group, .init = setup, .fini = teardown);
+
+Test(keyboard_group, same_keymap_keeps_seat_keyboard) {
+    struct wavo_input *input = server->input;
+    uint64_t switches = input->seat_keyboard_switches;
+    struct wlr_keyboard *first = &devices[0];
+    struct wlr_keyboard *second = plug_keyboard();
+    cr_assert(headless_client_roundtrip(&client, server));
+
+    cr_assert_eq(wl_list_length(&input->keyboard_groups), 1);
+    cr_assert_not_null(find_keyboard(first)->group);
+    cr_assert_eq(find_keyboard(second)->group, find_keyboard(first)->group);
+
+    type_on(first);
+    type_on(second);
+    type_on(first);
+
+    cr_assert_eq(keyboard.presses, 3);
+    cr_assert_eq(keyboard.releases, 3);
+    cr_assert_eq(input->seat_keyboard_switches, switches);
+    cr_assert_eq(keyboard.keymaps, 1, "keymap sent %d times",
+        keyboard.keymaps);
+}
+
+Test(keyboard_group, other_repeat_info_switches_on_use) {
+    struct wavo_input *input = server->input;
+    uint64_t switches = input->seat_keyboard_switches;
+    struct wlr_keyboard *first = &devices[0];
+
+    // Set up with the configured repeat info, then different from the
+    // group's
+    config.repeat_rate += 5;
+    struct wlr_keyboard *other = plug_keyboard();
+    cr_assert(headless_client_roundtrip(&client, server));
+    cr_assert_eq(wl_list_length(&input->keyboard_groups), 2);
+    cr_assert_neq(find_keyboard(other)->group, find_keyboard(first)->group);
+
+    // Plugging it in does not switch, typing on it does, once
+    cr_assert_eq(input->seat_keyboard_switches, switches);
+    cr_assert_eq(keyboard.keymaps, 1);
+    type_on(other);
+    type_on(other);
+    cr_assert_eq(input->seat_keyboard_switches, switches + 1);
+    cr_assert_eq(keyboard.keymaps, 2);
+
+    type_on(first);
+    cr_assert_eq(input->seat_keyboard_switches, switches + 2);
+    cr_assert_eq(keyboard.presses, 3);
+}
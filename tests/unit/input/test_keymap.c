@@ -0,0 +1,74 @@
+#define _POSIX_C_SOURCE 200809L
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <criterion/criterion.h>
+#include <xkbcommon/xkbcommon.h>
+#include "wavo/keymap.h"
+
+static struct xkb_context *context;
+
+static void setup(void) {
+    context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
+    cr_assert_not_null(context);
+}
+
+static void teardown(void) {
+    xkb_context_unref(context);
+}
+
+TestSuite(keymap, .init = setup, .fini = teardown);
+
+Test(keymap, cache_key_depends_on_names) {
+    struct xkb_rule_names us = { .rules = "evdev", .layout = "us" };
+    struct xkb_rule_names us_again = { .rules = "evdev", .layout = "us" };
+    struct xkb_rule_names de = { .rules = "evdev", .layout = "de" };
+    struct xkb_rule_names us_options = {
+        .rules = "evdev", .layout = "us", .options = "caps:escape",
+    };
+
+    uint64_t key = wavo_keymap_cache_key(context, &us);
+    cr_assert_eq(key, wavo_keymap_cache_key(context, &us_again));
+    cr_assert_neq(key, wavo_keymap_cache_key(context, &de));
+    cr_assert_neq(key, wavo_keymap_cache_key(context, &us_options));
+}
+
+Test(keymap, second_load_hits_cache) {
+    char dir[] = "/tmp/wavo-keymap-XXXXXX";
+    cr_assert_not_null(mkdtemp(dir));
+    char cache_dir[64];
+    snprintf(cache_dir, sizeof(cache_dir), "%s/keymaps", dir);
+
+    struct xkb_rule_names names = { .rules = "evdev", .layout = "us" };
+    bool cache_hit = true;
+    struct xkb_keymap *compiled = wavo_keymap_load(context, &names, cache_dir,
+        &cache_hit);
+    if (!compiled) {
+        rmdir(dir);
+        cr_skip_test("XKB data not installed");
+    }
+    cr_assert_not(cache_hit);
+
+    struct xkb_keymap *cached = wavo_keymap_load(context, &names, cache_dir,
+        &cache_hit);
+    cr_assert_not_null(cached);
+    cr_assert(cache_hit);
+
+    char *expected = xkb_keymap_get_as_string(compiled,
+        XKB_KEYMAP_FORMAT_TEXT_V1);
+    char *actual = xkb_keymap_get_as_string(cached, XKB_KEYMAP_FORMAT_TEXT_V1);
+    cr_assert_str_eq(actual, expected);
+
+    char path[128];
+    snprintf(path, sizeof(path), "%s/%016" PRIx64 ".xkb", cache_dir,
+        wavo_keymap_cache_key(context, &names));
+    unlink(path);
+    rmdir(cache_dir);
+    rmdir(dir);
+
+    free(expected);
+    free(actual);
+    xkb_keymap_unref(cached);
+    xkb_keymap_unref(compiled);
+}
@@ -0,0 +1,378 @@
+#include <string.h>
+#include <criterion/criterion.h>
+#include <wayland-client.h>
+#include <wayland-server-core.h>
+#include <wlr/interfaces/wlr_pointer.h>
+#include <wlr/types/wlr_cursor.h>
+#include <wlr/types/wlr_scene.h>
+#include "wavo/config.h"
+#include "wavo/input.h"
+#include "wavo/output.h"
+#include "wavo/server.h"
+#include "wavo/view.h"
+#include "client.h"
+#include "headless.h"
+#include "pointer-constraints-unstable-v1-client-protocol.h"
+#include "relative-pointer-unstable-v1-client-protocol.h"
+#include "xdg-shell-client-protocol.h"
+
+// A pointer device moving over a window whose client locks or confines the
+// pointer and listens for relative motion
+
+#define WINDOW_SIZE 100
+
+// What the client saw of the pointer
+struct pointer_client {
+    struct wl_registry *registry;
+    struct wl_seat *seat;
+    struct wl_pointer *pointer;
+    struct zwp_pointer_constraints_v1 *constraints;
+    struct zwp_relative_pointer_manager_v1 *relative_mgr;
+    struct zwp_relative_pointer_v1 *relative_pointer;
+
+    bool focused;
+    uint32_t enter_serial;
+    int motions;
+    double sx, sy;  // Last surface-local position
+
+    int relative_motions;
+    double dx, dy, dx_unaccel, dy_unaccel;  // Of the last one
+
+    bool constrained;  // Locked or confined
+};
+
+static struct wavo_config config;
+static struct wavo_server *server;
+static struct wlr_pointer device;
+static struct headless_client client;
+static struct headless_window window;
+static struct pointer_client pointer;
+static uint32_t time_msec;
+
+static const struct wlr_pointer_impl device_impl = {
+    .name = "test-pointer",
+};
+
+static void pointer_enter(void *data, struct wl_pointer *wl_pointer,
+    uint32_t serial, struct wl_surface *surface, wl_fixed_t sx,
+    wl_fixed_t sy) {
+    (void)wl_pointer;
+    (void)surface;
+    struct pointer_client *pointer = data;
+    pointer->focused = true;
+    pointer->enter_serial = serial;
+    pointer->sx = wl_fixed_to_double(sx);
+    pointer->sy = wl_fixed_to_double(sy);
+}
+
+static void pointer_leave(void *data, struct wl_pointer *wl_pointer,
+    uint32_t serial, struct wl_surface *surface) {
+    (void)wl_pointer;
+    (void)serial;
+    (void)surface;
+    struct pointer_client *pointer = data;
+    pointer->focused = false;
+}
+
+static void pointer_motion(void *data, struct wl_pointer *wl_pointer,
+    uint32_t time, wl_fixed_t sx, wl_fixed_t sy) {
+    (void)wl_pointer;
+    (void)time;
+    struct pointer_client *pointer = data;
+    pointer->motions++;
+    pointer->sx = wl_fixed_to_double(sx);
+    pointer->sy = wl_fixed_to_double(sy);
+}
+
+static void pointer_button(void *data, struct wl_pointer *wl_pointer,
+    uint32_t serial, uint32_t time, uint32_t button, uint32_t state) {
+    (void)data;
+    (void)wl_pointer;
+    (void)serial;
+    (void)time;
+    (void)button;
+    (void)state;
+}
+
+static void pointer_axis(void *data, struct wl_pointer *wl_pointer,
+    uint32_t time, uint32_t axis, wl_fixed_t value) {
+    (void)data;
+    (void)wl_pointer;
+    (void)time;
+    (void)axis;
+    (void)value;
+}
+
+// Bound at version 1, so no frame or axis detail events
+static const struct wl_pointer_listener pointer_listener = {
+    .enter = pointer_enter,
+    .leave = pointer_leave,
+    .motion = pointer_motion,
+    .button = pointer_button,
+    .axis = pointer_axis,
+};
+
+static void relative_motion(void *data,
+    struct zwp_relative_pointer_v1 *relative_pointer, uint32_t utime_hi,
+    uint32_t utime_lo, wl_fixed_t dx, wl_fixed_t dy, wl_fixed_t dx_unaccel,
+    wl_fixed_t dy_unaccel) {
+    (void)relative_pointer;
+    (void)utime_hi;
+    (void)utime_lo;
+    struct pointer_client *pointer = data;
+    pointer->relative_motions++;
+    pointer->dx = wl_fixed_to_double(dx);
+    pointer->dy = wl_fixed_to_double(dy);
+    pointer->dx_unaccel = wl_fixed_to_double(dx_unaccel);
+    pointer->dy_unaccel = wl_fixed_to_double(dy_unaccel);
+}
+
+static const struct zwp_relative_pointer_v1_listener relative_listener = {
+    .relative_motion = relative_motion,
+};
+
+static void locked(void *data, struct zwp_locked_pointer_v1 *locked_pointer) {
+    (void)locked_pointer;
+    struct pointer_client *pointer = data;
+    pointer->constrained = true;
+}
+
+static void unlocked(void *data,
+    struct zwp_locked_pointer_v1 *locked_pointer) {
+    (void)locked_pointer;
+    struct pointer_client *pointer = data;
+    pointer->constrained = false;
+}
+
+static const struct zwp_locked_pointer_v1_listener locked_listener = {
+    .locked = locked,
+    .unlocked = unlocked,
+};
+
+static void confined(void *data,
+    struct zwp_confined_pointer_v1 *confined_pointer) {
+    (void)confined_pointer;
+    struct pointer_client *pointer = data;
+    pointer->constrained = true;
+}
+
+static void unconfined(void *data,
+    struct zwp_confined_pointer_v1 *confined_pointer) {
+    (void)confined_pointer;
+    struct pointer_client *pointer = data;
+    pointer->constrained = false;
+}
+
+static const struct zwp_confined_pointer_v1_listener confined_listener = {
+    .confined = confined,
+    .unconfined = unconfined,
+};
+
+static void registry_global(void *data, struct wl_registry *registry,
+    uint32_t name, const char *interface, uint32_t version) {
+    (void)version;
+    struct pointer_client *pointer = data;
+
+    if (strcmp(interface, wl_seat_interface.name) == 0) {
+        pointer->seat = wl_registry_bind(registry, name, &wl_seat_interface,
+            1);
+    } else if (strcmp(interface,
+            zwp_pointer_constraints_v1_interface.name) == 0) {
+        pointer->constraints = wl_registry_bind(registry, name,
+            &zwp_pointer_constraints_v1_interface, 1);
+    } else if (strcmp(interface,
+            zwp_relative_pointer_manager_v1_interface.name) == 0) {
+        pointer->relative_mgr = wl_registry_bind(registry, name,
+            &zwp_relative_pointer_manager_v1_interface, 1);
+    }
+}
+
+static void registry_global_remove(void *data, struct wl_registry *registry,
+    uint32_t name) {
+    (void)data;
+    (void)registry;
+    (void)name;
+}
+
+static const struct wl_registry_listener registry_listener = {
+    .global = registry_global,
+    .global_remove = registry_global_remove,
+};
+
+// Moves the device by dx, dy, unaccelerated by dx_unaccel, dy_unaccel, the
+// way a backend reports it
+static void move(double dx, double dy, double dx_unaccel,
+    double dy_unaccel) {
+    struct wlr_pointer_motion_event event = {
+        .pointer = &device,
+        .time_msec = ++time_msec,
+        .delta_x = dx,
+        .delta_y = dy,
+        .unaccel_dx = dx_unaccel,
+        .unaccel_dy = dy_unaccel,
+    };
+    wl_signal_emit_mutable(&device.events.motion, &event);
+    wl_signal_emit_mutable(&device.events.frame, &device);
+    cr_assert(headless_client_roundtrip(&client, server));
+}
+
+static void move_to(double lx, double ly) {
+    struct wlr_cursor *cursor = server->input->cursor;
+    move(lx - cursor->x, ly - cursor->y, lx - cursor->x, ly - cursor->y);
+}
+
+static struct wavo_view *window_view(void) {
+    cr_assert_not(wl_list_empty(&server->views));
+    struct wavo_view *view = wl_container_of(server->views.next, view, link);
+    return view;
+}
+
+// Layout position of the window's top left corner
+static void window_origin(double *x, double *y) {
+    int lx, ly;
+    cr_assert(wlr_scene_node_coords(&window_view()->scene_tree->node, &lx,
+        &ly));
+    *x = lx;
+    *y = ly;
+}
+
+static void setup(void) {
+    server = headless_server_create(&config, 0);
+    cr_assert_not_null(server);
+    cr_assert_not_null(wavo_output_create_virtual(server, 640, 480, 60000));
+
+    // Gives the seat its pointer capability
+    wlr_pointer_init(&device, &device_impl, device_impl.name);
+    wavo_input_add_device(server->input, &device.base);
+
+    cr_assert(headless_client_connect(&client, server));
+    memset(&pointer, 0, sizeof(pointer));
+    pointer.registry = wl_display_get_registry(client.display);
+    wl_registry_add_listener(pointer.registry, &registry_listener, &pointer);
+    cr_assert(headless_client_roundtrip(&client, server));
+    cr_assert_not_null(pointer.seat);
+    cr_assert_not_null(pointer.constraints);
+    cr_assert_not_null(pointer.relative_mgr);
+
+    pointer.pointer = wl_seat_get_pointer(pointer.seat);
+    wl_pointer_add_listener(pointer.pointer, &pointer_listener, &pointer);
+    pointer.relative_pointer = zwp_relative_pointer_manager_v1_get_relative_pointer(
+        pointer.relative_mgr, pointer.pointer);
+    zwp_relative_pointer_v1_add_listener(pointer.relative_pointer,
+        &relative_listener, &pointer);
+
+    cr_assert(headless_window_map(&window, &client, server, WINDOW_SIZE,
+        WINDOW_SIZE, 0xFF0000FF));
+    xdg_surface_set_window_geometry(window.xdg_surface, 0, 0, WINDOW_SIZE,
+        WINDOW_SIZE);
+    wl_surface_commit(window.surface);
+    cr_assert(headless_client_roundtrip(&client, server));
+
+    double x, y;
+    window_origin(&x, &y);
+    move_to(x + WINDOW_SIZE / 2, y + WINDOW_SIZE / 2);
+    cr_assert(pointer.focused, "the window did not get pointer focus");
+}
+
+static void teardown(void) {
+    headless_window_finish(&window);
+    zwp_relative_pointer_v1_destroy(pointer.relative_pointer);
+    wl_pointer_destroy(pointer.pointer);
+    zwp_relative_pointer_manager_v1_destroy(pointer.relative_mgr);
+    zwp_pointer_constraints_v1_destroy(pointer.constraints);
+    wl_seat_destroy(pointer.seat);
+    wl_registry_destroy(pointer.registry);
+    headless_client_disconnect(&client);
+    wlr_pointer_finish(&device);
+    wavo_server_destroy(server);
+    wavo_config_free(&config);
+}
+
+TestSuite(pointer, .init = setup, .fini = teardown);
+
+Test(pointer, locked_pointer_gets_raw_deltas) {
+    struct zwp_locked_pointer_v1 *lock = zwp_pointer_constraints_v1_lock_pointer(
+        pointer.constraints, window.surface, pointer.pointer, NULL,
+        ZWP_POINTER_CONSTRAINTS_V1_LIFETIME_PERSISTENT);
+    zwp_locked_pointer_v1_add_listener(lock, &locked_listener, &pointer);
+    cr_assert(headless_client_roundtrip(&client, server));
+    cr_assert(pointer.constrained, "the lock was never activated");
+
+    struct wlr_cursor *cursor = server->input->cursor;
+    double x = cursor->x, y = cursor->y;
+    int motions = pointer.motions;
+    int relative_motions = pointer.relative_motions;
+    move(10, 5, 4, 2);
+
+    cr_assert_eq(cursor->x, x, "a locked pointer moved the cursor");
+    cr_assert_eq(cursor->y, y);
+    cr_assert_eq(pointer.motions, motions);
+    cr_assert_eq(pointer.relative_motions, relative_motions + 1);
+    cr_assert_eq(pointer.dx, 10.0);
+    cr_assert_eq(pointer.dy, 5.0);
+    cr_assert_eq(pointer.dx_unaccel, 4.0);
+    cr_assert_eq(pointer.dy_unaccel, 2.0);
+
+    zwp_locked_pointer_v1_destroy(lock);
+}
+
+Test(pointer, confined_pointer_follows_moved_window) {
+    struct zwp_confined_pointer_v1 *confine =
+        zwp_pointer_constraints_v1_confine_pointer(pointer.constraints,
+            window.surface, pointer.pointer, NULL,
+            ZWP_POINTER_CONSTRAINTS_V1_LIFETIME_PERSISTENT);
+    zwp_confined_pointer_v1_add_listener(confine, &confined_listener,
+        &pointer);
+    cr_assert(headless_client_roundtrip(&client, server));
+    cr_assert(pointer.constrained, "the confinement was never activated");
+
+    // The pointer is now 20 pixels from the left edge, the region must be
+    // where the window went
+    struct wlr_scene_node *node = &window_view()->scene_tree->node;
+    wlr_scene_node_set_position(node, node->x + 30, node->y);
+    double x, y;
+    window_origin(&x, &y);
+
+    struct wlr_cursor *cursor = server->input->cursor;
+    double start = cursor->x;
+    move(70, 0, 70, 0);
+    cr_assert_float_eq(cursor->x, start + 70, 0.01,
+        "cursor at %.2f, expected %.2f", cursor->x, start + 70);
+    cr_assert_float_eq(pointer.sx, cursor->x - x, 0.01);
+
+    // Held at the right edge
+    move(50, 0, 50, 0);
+    cr_assert_lt(cursor->x, x + WINDOW_SIZE);
+    cr_assert_gt(cursor->x, x + WINDOW_SIZE - 1);
+    cr_assert(pointer.focused);
+
+    zwp_confined_pointer_v1_destroy(confine);
+}
+
+Test(pointer, default_cursor_only_on_leave) {
+    struct wavo_input *input = server->input;
+    struct wl_surface *cursor_surface =
+        wl_compositor_create_surface(client.compositor);
+    wl_pointer_set_cursor(pointer.pointer, pointer.enter_serial,
+        cursor_surface, 0, 0);
+    cr_assert(headless_client_roundtrip(&client, server));
+    cr_assert_not(input->cursor_default, "the client's cursor was ignored");
+
+    // Motion within the window keeps the client's cursor
+    move(5, 5, 5, 5);
+    cr_assert_not(input->cursor_default);
+
+    // Off the window, to where the output shows only background
+    double x, y;
+    window_origin(&x, &y);
+    move_to(x + WINDOW_SIZE + 50 < 640 ? x + WINDOW_SIZE + 50 : x - 50,
+        y + WINDOW_SIZE / 2);
+    cr_assert_not(pointer.focused);
+    cr_assert(input->cursor_default);
+
+    move(0, 10, 0, 10);
+    cr_assert(input->cursor_default);
+    cr_assert_null(input->seat->pointer_state.focused_surface);
+
+    wl_surface_destroy(cursor_surface);
+}
@@ -0,0 +1,323 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <criterion/criterion.h>
+#include <wayland-client.h>
+#include <wayland-server-core.h>
+#include <wlr/types/wlr_cursor.h>
+#include <wlr/types/wlr_scene.h>
+#include <xkbcommon/xkbcommon.h>
+#include "wavo/config.h"
+#include "wavo/input.h"
+#include "wavo/output.h"
+#include "wavo/server.h"
+#include "wavo/view.h"
+#include "client.h"
+#include "headless.h"
+#include "virtual-keyboard-unstable-v1-client-protocol.h"
+#include "wlr-virtual-pointer-unstable-v1-client-protocol.h"
+
+// A client injecting input through the virtual keyboard and pointer
+// protocols into the window it has focused, as wavo-loadgen does. The
+// input must arrive like that of real devices.
+
+#define KEY_A 30  // Linux evdev code
+#define OUTPUT_WIDTH 640
+#define OUTPUT_HEIGHT 480
+#define WINDOW_SIZE 100
+
+// The injecting half and what the receiving half saw
+struct virtual_client {
+    struct wl_registry *registry;
+    struct wl_seat *seat;
+    struct zwp_virtual_keyboard_manager_v1 *keyboard_mgr;
+    struct zwlr_virtual_pointer_manager_v1 *pointer_mgr;
+    struct zwp_virtual_keyboard_v1 *virtual_keyboard;
+    struct zwlr_virtual_pointer_v1 *virtual_pointer;
+
+    struct wl_keyboard *keyboard;
+    int presses, releases;
+    uint32_t last_key;
+
+    struct wl_pointer *pointer;
+    bool focused;
+    double sx, sy;  // Last surface-local position
+};
+
+static struct wavo_config config;
+static struct wavo_server *server;
+static struct headless_client client;
+static struct headless_window window;
+static struct virtual_client input;
+static uint32_t time_msec;
+
+static void keyboard_keymap(void *data, struct wl_keyboard *wl_keyboard,
+    uint32_t format, int32_t fd, uint32_t size) {
+    (void)data;
+    (void)wl_keyboard;
+    (void)format;
+    (void)size;
+    close(fd);
+}
+
+static void keyboard_enter(void *data, struct wl_keyboard *wl_keyboard,
+    uint32_t serial, struct wl_surface *surface, struct wl_array *keys) {
+    (void)data;
+    (void)wl_keyboard;
+    (void)serial;
+    (void)surface;
+    (void)keys;
+}
+
+static void keyboard_leave(void *data, struct wl_keyboard *wl_keyboard,
+    uint32_t serial, struct wl_surface *surface) {
+    (void)data;
+    (void)wl_keyboard;
+    (void)serial;
+    (void)surface;
+}
+
+static void keyboard_key(void *data, struct wl_keyboard *wl_keyboard,
+    uint32_t serial, uint32_t time, uint32_t key, uint32_t state) {
+    (void)wl_keyboard;
+    (void)serial;
+    (void)time;
+    struct virtual_client *input = data;
+    input->last_key = key;
+    if (state == WL_KEYBOARD_KEY_STATE_PRESSED) {
+        input->presses++;
+    } else {
+        input->releases++;
+    }
+}
+
+static void keyboard_modifiers(void *data, struct wl_keyboard *wl_keyboard,
+    uint32_t serial, uint32_t depressed, uint32_t latched, uint32_t locked,
+    uint32_t group) {
+    (void)data;
+    (void)wl_keyboard;
+    (void)serial;
+    (void)depressed;
+    (void)latched;
+    (void)locked;
+    (void)group;
+}
+
+// Bound at version 1, so no repeat_info
+static const struct wl_keyboard_listener keyboard_listener = {
+    .keymap = keyboard_keymap,
+    .enter = keyboard_enter,
+    .leave = keyboard_leave,
+    .key = keyboard_key,
+    .modifiers = keyboard_modifiers,
+};
+
+static void pointer_enter(void *data, struct wl_pointer *wl_pointer,
+    uint32_t serial, struct wl_surface *surface, wl_fixed_t sx,
+    wl_fixed_t sy) {
+    (void)wl_pointer;
+    (void)serial;
+    (void)surface;
+    struct virtual_client *input = data;
+    input->focused = true;
+    input->sx = wl_fixed_to_double(sx);
+    input->sy = wl_fixed_to_double(sy);
+}
+
+static void pointer_leave(void *data, struct wl_pointer *wl_pointer,
+    uint32_t serial, struct wl_surface *surface) {
+    (void)wl_pointer;
+    (void)serial;
+    (void)surface;
+    struct virtual_client *input = data;
+    input->focused = false;
+}
+
+static void pointer_motion(void *data, struct wl_pointer *wl_pointer,
+    uint32_t time, wl_fixed_t sx, wl_fixed_t sy) {
+    (void)wl_pointer;
+    (void)time;
+    struct virtual_client *input = data;
+    input->sx = wl_fixed_to_double(sx);
+    input->sy = wl_fixed_to_double(sy);
+}
+
+static void pointer_button(void *data, struct wl_pointer *wl_pointer,
+    uint32_t serial, uint32_t time, uint32_t button, uint32_t state) {
+    (void)data;
+    (void)wl_pointer;
+    (void)serial;
+    (void)time;
+    (void)button;
+    (void)state;
+}
+
+static void pointer_axis(void *data, struct wl_pointer *wl_pointer,
+    uint32_t time, uint32_t axis, wl_fixed_t value) {
+    (void)data;
+    (void)wl_pointer;
+    (void)time;
+    (void)axis;
+    (void)value;
+}
+
+// Bound at version 1, so no frame or axis detail events
+static const struct wl_pointer_listener pointer_listener = {
+    .enter = pointer_enter,
+    .leave = pointer_leave,
+    .motion = pointer_motion,
+    .button = pointer_button,
+    .axis = pointer_axis,
+};
+
+static void registry_global(void *data, struct wl_registry *registry,
+    uint32_t name, const char *interface, uint32_t version) {
+    (void)version;
+    struct virtual_client *input = data;
+
+    if (strcmp(interface, wl_seat_interface.name) == 0) {
+        input->seat = wl_registry_bind(registry, name, &wl_seat_interface, 1);
+    } else if (strcmp(interface,
+            zwp_virtual_keyboard_manager_v1_interface.name) == 0) {
+        input->keyboard_mgr = wl_registry_bind(registry, name,
+            &zwp_virtual_keyboard_manager_v1_interface, 1);
+    } else if (strcmp(interface,
+            zwlr_virtual_pointer_manager_v1_interface.name) == 0) {
+        input->pointer_mgr = wl_registry_bind(registry, name,
+            &zwlr_virtual_pointer_manager_v1_interface, 1);
+    }
+}
+
+static void registry_global_remove(void *data, struct wl_registry *registry,
+    uint32_t name) {
+    (void)data;
+    (void)registry;
+    (void)name;
+}
+
+static const struct wl_registry_listener registry_listener = {
+    .global = registry_global,
+    .global_remove = registry_global_remove,
+};
+
+// Uploads the server's own keymap, a virtual keyboard has none until then
+static void upload_keymap(struct zwp_virtual_keyboard_v1 *keyboard) {
+    char *keymap = xkb_keymap_get_as_string(server->input->keymap,
+        XKB_KEYMAP_FORMAT_TEXT_V1);
+    cr_assert_not_null(keymap);
+    size_t size = strlen(keymap) + 1;
+
+    int fd = memfd_create("wavo-test-keymap", MFD_CLOEXEC);
+    cr_assert_geq(fd, 0);
+    cr_assert_eq(write(fd, keymap, size), (ssize_t)size);
+    free(keymap);
+
+    zwp_virtual_keyboard_v1_keymap(keyboard, WL_KEYBOARD_KEYMAP_FORMAT_XKB_V1,
+        fd, (uint32_t)size);
+    cr_assert(headless_client_roundtrip(&client, server));
+    close(fd);
+}
+
+static void setup(void) {
+    server = headless_server_create(&config, 0);
+    cr_assert_not_null(server);
+    cr_assert_not_null(wavo_output_create_virtual(server, OUTPUT_WIDTH,
+        OUTPUT_HEIGHT, 60000));
+
+    cr_assert(headless_client_connect(&client, server));
+    memset(&input, 0, sizeof(input));
+    input.registry = wl_display_get_registry(client.display);
+    wl_registry_add_listener(input.registry, &registry_listener, &input);
+    cr_assert(headless_client_roundtrip(&client, server));
+    cr_assert_not_null(input.seat);
+    cr_assert_not_null(input.keyboard_mgr);
+    cr_assert_not_null(input.pointer_mgr);
+
+    // The seat gains its capabilities from the virtual devices
+    input.virtual_keyboard =
+        zwp_virtual_keyboard_manager_v1_create_virtual_keyboard(
+            input.keyboard_mgr, input.seat);
+    input.virtual_pointer =
+        zwlr_virtual_pointer_manager_v1_create_virtual_pointer(
+            input.pointer_mgr, input.seat);
+    upload_keymap(input.virtual_keyboard);
+
+    input.keyboard = wl_seat_get_keyboard(input.seat);
+    wl_keyboard_add_listener(input.keyboard, &keyboard_listener, &input);
+    input.pointer = wl_seat_get_pointer(input.seat);
+    wl_pointer_add_listener(input.pointer, &pointer_listener, &input);
+
+    // Mapping focuses the window
+    cr_assert(headless_window_map(&window, &client, server, WINDOW_SIZE,
+        WINDOW_SIZE, 0xFF0000FF));
+}
+
+static void teardown(void) {
+    headless_window_finish(&window);
+    wl_pointer_destroy(input.pointer);
+    wl_keyboard_destroy(input.keyboard);
+    zwlr_virtual_pointer_v1_destroy(input.virtual_pointer);
+    zwp_virtual_keyboard_v1_destroy(input.virtual_keyboard);
+    zwlr_virtual_pointer_manager_v1_destroy(input.pointer_mgr);
+    zwp_virtual_keyboard_manager_v1_destroy(input.keyboard_mgr);
+    wl_seat_destroy(input.seat);
+    wl_registry_destroy(input.registry);
+    headless_client_disconnect(&client);
+    wavo_server_destroy(server);
+    wavo_config_free(&config);
+}
+
+TestSuite(virtual_input, .init = setup, .fini = teardown);
+
+Test(virtual_input, keys_reach_focused_window) {
+    struct wavo_input *seat_input = server->input;
+    cr_assert_eq(wl_list_length(&seat_input->keyboards), 1);
+    struct wavo_keyboard *keyboard =
+        wl_container_of(seat_input->keyboards.next, keyboard, link);
+    cr_assert_null(keyboard->group, "virtual keyboard joined a group");
+    cr_assert(wl_list_empty(&seat_input->keyboard_groups));
+
+    for (int i = 0; i < 10; i++) {
+        zwp_virtual_keyboard_v1_key(input.virtual_keyboard, ++time_msec,
+            KEY_A, WL_KEYBOARD_KEY_STATE_PRESSED);
+        zwp_virtual_keyboard_v1_key(input.virtual_keyboard, ++time_msec,
+            KEY_A, WL_KEYBOARD_KEY_STATE_RELEASED);
+    }
+    cr_assert(headless_client_roundtrip(&client, server));
+
+    cr_assert_eq(input.presses, 10);
+    cr_assert_eq(input.releases, 10);
+    cr_assert_eq(input.last_key, KEY_A);
+    cr_assert_eq(wlr_seat_get_keyboard(seat_input->seat),
+        keyboard->wlr_keyboard);
+}
+
+Test(virtual_input, pointer_moves_cursor_over_window) {
+    struct wavo_view *view = wl_container_of(server->views.next, view, link);
+    int x, y;
+    cr_assert(wlr_scene_node_coords(&view->scene_tree->node, &x, &y));
+
+    // Absolute motion to the window's center, the extent being the layout
+    zwlr_virtual_pointer_v1_motion_absolute(input.virtual_pointer,
+        ++time_msec, (uint32_t)(x + WINDOW_SIZE / 2),
+        (uint32_t)(y + WINDOW_SIZE / 2), OUTPUT_WIDTH, OUTPUT_HEIGHT);
+    zwlr_virtual_pointer_v1_frame(input.virtual_pointer);
+    cr_assert(headless_client_roundtrip(&client, server));
+
+    struct wlr_cursor *cursor = server->input->cursor;
+    cr_assert_float_eq(cursor->x, x + WINDOW_SIZE / 2, 1.0);
+    cr_assert_float_eq(cursor->y, y + WINDOW_SIZE / 2, 1.0);
+    cr_assert(input.focused, "the window did not get pointer focus");
+
+    // Then relative motion, seen by the window in its own coordinates
+    double start = cursor->x;
+    zwlr_virtual_pointer_v1_motion(input.virtual_pointer, ++time_msec,
+        wl_fixed_from_int(10), wl_fixed_from_int(0));
+    zwlr_virtual_pointer_v1_frame(input.virtual_pointer);
+    cr_assert(headless_client_roundtrip(&client, server));
+
+    cr_assert_float_eq(cursor->x, start + 10, 0.01);
+    cr_assert_float_eq(input.sx, cursor->x - x, 0.01);
+}
@@ -0,0 +1,109 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <criterion/criterion.h>
+#include "wavo/ipc.h"
+#include "wavo/server.h"
+
+static struct wavo_server server;
+static char *reply;
+static size_t reply_len;
+
+static void setup(void) {
+    memset(&server, 0, sizeof(server));
+    wl_list_init(&server.outputs);
+    wl_list_init(&server.views);
+}
+
+static void teardown(void) {
+    free(reply);
+    reply = NULL;
+}
+
+TestSuite(ipc, .init = setup, .fini = teardown);
+
+static bool execute(const char *command) {
+    char line[256];
+    snprintf(line, sizeof(line), "%s", command);
+
+    free(reply);
+    reply = NULL;
+    FILE *out = open_memstream(&reply, &reply_len);
+    cr_assert_not_null(out);
+    bool ok = wavo_ipc_execute(&server, line, out);
+    fclose(out);
+    return ok;
+}
+
+Test(ipc, help_lists_commands) {
+    cr_assert(execute("help\n"));
+    cr_assert_not_null(strstr(reply, "output create"));
+    cr_assert_not_null(strstr(reply, "metrics"));
+}
+
+Test(ipc, empty_and_unknown) {
+    cr_assert_not(execute("  \n"));
+    cr_assert_str_eq(reply, "empty command");
+
+    cr_assert_not(execute("frobnicate now"));
+    cr_assert_str_eq(reply, "unknown command 'frobnicate'");
+}
+
+Test(ipc, output_arguments) {
+    cr_assert_not(execute("output create 1920by1080"));
+    cr_assert_str_eq(reply, "invalid mode '1920by1080'");
+
+    cr_assert_not(execute("output destroy HEADLESS-1"));
+    cr_assert_str_eq(reply, "no output named 'HEADLESS-1'");
+
+    cr_assert_not(execute("output"));
+    cr_assert_not_null(strstr(reply, "usage:"));
+}
+
+Test(ipc, outputs_empty) {
+    cr_assert(execute("outputs"));
+    cr_assert_str_eq(reply, "");
+}
+
+Test(ipc, record_only_new_files_in_recordings_dir) {
+    char state[] = "/tmp/wavo-ipc-XXXXXX";
+    cr_assert_not_null(mkdtemp(state));
+    setenv("XDG_STATE_HOME", state, true);
+    char command[256];
+
+    // Relative, outside the directory, or escaping it
+    cr_assert_not(execute("record session.wrec"));
+    cr_assert_not_null(strstr(reply, "recordings go directly in"));
+    snprintf(command, sizeof(command), "record %s/session.wrec", state);
+    cr_assert_not(execute(command));
+    snprintf(command, sizeof(command),
+        "record %s/wavo/recordings/../session.wrec", state);
+    cr_assert_not(execute(command));
+
+    // An existing recording is left as it is
+    char path[128];
+    snprintf(path, sizeof(path), "%s/wavo/recordings/old.wrec", state);
+    FILE *old = fopen(path, "w");
+    cr_assert_not_null(old);
+    fputs("keep", old);
+    fclose(old);
+    snprintf(command, sizeof(command), "record %s", path);
+    cr_assert_not(execute(command));
+    cr_assert_not_null(strstr(reply, "cannot record"));
+    old = fopen(path, "r");
+    char contents[8] = { 0 };
+    cr_assert_not_null(fgets(contents, sizeof(contents), old));
+    fclose(old);
+    cr_assert_str_eq(contents, "keep");
+    cr_assert_null(server.recorder);
+
+    unlink(path);
+    snprintf(path, sizeof(path), "%s/wavo/recordings", state);
+    rmdir(path);
+    snprintf(path, sizeof(path), "%s/wavo", state);
+    rmdir(path);
+    rmdir(state);
+    unsetenv("XDG_STATE_HOME");
+}
@@ -0,0 +1,150 @@
+#define _POSIX_C_SOURCE 200809L
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <criterion/criterion.h>
+#include <wlr/util/log.h>
+#include "wavo/log.h"
+
+static FILE *file;
+static char contents[16384];
+
+static void setup(void) {
+    file = tmpfile();
+    cr_assert_not_null(file);
+    cr_assert(wavo_log_init(WLR_INFO, fileno(file)));
+}
+
+static void teardown(void) {
+    wavo_log_finish();
+    fclose(file);
+}
+
+TestSuite(log, .init = setup, .fini = teardown);
+
+// Stops the writer and reads back everything it wrote
+static void read_log(void) {
+    wavo_log_finish();
+    rewind(file);
+    size_t len = fread(contents, 1, sizeof(contents) - 1, file);
+    contents[len] = '\0';
+}
+
+static int count_lines(const char *needle) {
+    int count = 0;
+    for (const char *p = strstr(contents, needle); p;
+            p = strstr(p + 1, needle)) {
+        count++;
+    }
+    return count;
+}
+
+// All messages from a single call site
+static void log_from_one_site(const char *message) {
+    wlr_log(WLR_ERROR, "%s", message);
+}
+
+Test(log, collapses_repeats) {
+    for (int i = 0; i < 1000; i++) {
+        log_from_one_site("Failed to commit scene output");
+    }
+    log_from_one_site("Output recovered");
+    read_log();
+
+    cr_assert_eq(count_lines("Failed to commit scene output"), 1);
+    cr_assert_eq(count_lines("999 similar messages suppressed"), 1);
+    cr_assert_eq(count_lines("Output recovered"), 1);
+    cr_assert_not_null(strstr(contents, "[ERROR] "));
+
+    struct wavo_log_stats stats;
+    wavo_log_get_stats(&stats);
+    cr_assert_eq(stats.written, 3);
+    cr_assert_eq(stats.suppressed, 999);
+    cr_assert_eq(stats.dropped, 0);
+}
+
+Test(log, rate_limits_per_site) {
+    for (int i = 0; i < 100; i++) {
+        wlr_log(WLR_ERROR, "Frame %d failed", i);
+    }
+    // Another site is not affected
+    log_from_one_site("Other site");
+    read_log();
+
+    cr_assert_eq(count_lines(" failed\n"), WAVO_LOG_BURST);
+    cr_assert_eq(count_lines("Other site"), 1);
+
+    struct wavo_log_stats stats;
+    wavo_log_get_stats(&stats);
+    cr_assert_eq(stats.suppressed, 100 - WAVO_LOG_BURST);
+}
+
+Test(log, filters_verbosity) {
+    wlr_log(WLR_DEBUG, "%s", "debug message");
+    wlr_log(WLR_INFO, "%s", "info message");
+    read_log();
+
+    cr_assert_eq(count_lines("debug message"), 0);
+    cr_assert_eq(count_lines("[INFO] "), 1);
+}
+
+Test(log, synchronous_after_finish) {
+    wavo_log_finish();
+    log_from_one_site("late message");
+    read_log();
+
+    cr_assert_eq(count_lines("late message"), 1);
+}
+
+// Stands in for a sanitizer's handler, installed before the logger's
+static void crash_handler(int signal_number, siginfo_t *info,
+    void *context) {
+    (void)context;
+    static const char message[] = "chained\n";
+    if (signal_number == SIGABRT && info->si_signo == SIGABRT) {
+        write(STDOUT_FILENO, message, sizeof(message) - 1);
+    }
+    _exit(3);
+}
+
+Test(log_crash, chains_to_previous_handler) {
+    int fds[2];
+    cr_assert_eq(pipe(fds), 0);
+    pid_t pid = fork();
+    cr_assert_geq(pid, 0);
+    if (pid == 0) {
+        close(fds[0]);
+        dup2(fds[1], STDOUT_FILENO);
+        struct sigaction action = {
+            .sa_sigaction = crash_handler,
+            .sa_flags = SA_SIGINFO,
+        };
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGABRT, &action, NULL);
+
+        wavo_log_init(WLR_INFO, fds[1]);
+        wlr_log(WLR_ERROR, "%s", "last words");
+        raise(SIGABRT);
+        _exit(0);
+    }
+
+    close(fds[1]);
+    size_t len = 0;
+    ssize_t n;
+    while ((n = read(fds[0], contents + len, sizeof(contents) - 1 - len)) > 0) {
+        len += (size_t)n;
+    }
+    contents[len] = '\0';
+    close(fds[0]);
+
+    int status;
+    cr_assert_eq(waitpid(pid, &status, 0), pid);
+    cr_assert(WIFEXITED(status) && WEXITSTATUS(status) == 3,
+        "previous handler did not run");
+    cr_assert_eq(count_lines("last words"), 1);
+    cr_assert_eq(count_lines("chained"), 1);
+    // Written out before the previous handler took over
+    cr_assert_lt(strstr(contents, "last words"), strstr(contents, "chained"));
+}
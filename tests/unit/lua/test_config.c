@@ -1,3 +1,6 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <unistd.h>
 #include <criterion/criterion.h>
 #include "wavo/config.h"
 
@@ -92,3 +95,104 @@ Test(config, free) {
     // All boolean values should be false
     cr_assert_not(config.enable_animations);
 }
+
+static char config_path[] = "/tmp/wavo-test-config-XXXXXX";
+
+static void write_config(const char *contents) {
+    int fd = mkstemp(config_path);
+    cr_assert_geq(fd, 0);
+    cr_assert_eq(write(fd, contents, strlen(contents)), (ssize_t)strlen(contents));
+    close(fd);
+}
+
+Test(config, load_file) {
+    write_config(
+        "config = { terminal = 'foot', repeat_rate = 40 }\n"
+        "keyboard = { layout = 'us,de', options = 'caps:escape' }\n"
+        "idle = { timeout = 1.5, power_off = true }\n"
+        "outputs = {\n"
+        "    { name = 'eDP-1', scale = 1.5 },\n"
+        "    { name = 'HDMI-A-1', mode = '2560x1440@144', scale = 2 },\n"
+        "    { scale = 3 },\n"
+        "    { name = 'DP-2', mirror = 'eDP-1' },\n"
+        "}\n");
+    cr_assert(wavo_config_load_file(&config, config_path));
+    unlink(config_path);
+
+    // Overridden and default values
+    cr_assert_str_eq(config.terminal, "foot");
+    cr_assert_str_eq(config.mod_key, "Mod4");
+    cr_assert_eq(config.repeat_rate, 40);
+    cr_assert_eq(config.repeat_delay, 600);
+    cr_assert_str_eq(config.keyboard.layout, "us,de");
+    cr_assert_str_eq(config.keyboard.options, "caps:escape");
+    cr_assert_null(config.keyboard.variant);
+    cr_assert_eq(config.idle_timeout_msec, 1500);
+    cr_assert(config.idle_power_off);
+
+    // Entries without a name are skipped
+    cr_assert_eq(config.output_count, 3);
+
+    const struct wavo_output_config *edp =
+        wavo_config_find_output(&config, "eDP-1");
+    cr_assert_not_null(edp);
+    cr_assert_float_eq(edp->scale, 1.5f, 0.001f);
+    cr_assert_eq(edp->width, 0);
+    cr_assert_null(edp->mirror);
+
+    const struct wavo_output_config *hdmi =
+        wavo_config_find_output(&config, "HDMI-A-1");
+    cr_assert_not_null(hdmi);
+    cr_assert_float_eq(hdmi->scale, 2.0f, 0.001f);
+    cr_assert_eq(hdmi->width, 2560);
+    cr_assert_eq(hdmi->height, 1440);
+    cr_assert_eq(hdmi->refresh, 144000);
+
+    const struct wavo_output_config *dp =
+        wavo_config_find_output(&config, "DP-2");
+    cr_assert_not_null(dp);
+    cr_assert_str_eq(dp->mirror, "eDP-1");
+
+    cr_assert_null(wavo_config_find_output(&config, "DP-3"));
+    cr_assert(wavo_config_validate(&config));
+}
+
+Test(config, load_file_with_hooks) {
+    // Hooks belong in hooks.lua, the config ignores them
+    write_config(
+        "wavo.on('map', function(view) end)\n"
+        "config = { terminal = 'foot' }\n");
+    cr_assert(wavo_config_load_file(&config, config_path));
+    unlink(config_path);
+
+    cr_assert_str_eq(config.terminal, "foot");
+    cr_assert_str_eq(config.path, config_path);
+    cr_assert_str_eq(config.hooks_path, "/tmp/hooks.lua");
+}
+
+Test(config, load_file_missing) {
+    cr_assert_not(wavo_config_load_file(&config, "/nonexistent/wavo.lua"));
+}
+
+Test(config, parse_mode) {
+    int width, height, refresh;
+
+    cr_assert(wavo_config_parse_mode("1920x1080", &width, &height, &refresh));
+    cr_assert_eq(width, 1920);
+    cr_assert_eq(height, 1080);
+    cr_assert_eq(refresh, 0);
+
+    cr_assert(wavo_config_parse_mode("1920x1080@59.94", &width, &height,
+        &refresh));
+    cr_assert_eq(refresh, 59940);
+
+    cr_assert(wavo_config_parse_mode("800x600@60Hz", &width, &height,
+        &refresh));
+    cr_assert_eq(refresh, 60000);
+
+    cr_assert_not(wavo_config_parse_mode("1920", &width, &height, &refresh));
+    cr_assert_not(wavo_config_parse_mode("1920x1080@", &width, &height,
+        &refresh));
+    cr_assert_not(wavo_config_parse_mode("0x1080", &width, &height, &refresh));
+    cr_assert_not(wavo_config_parse_mode(NULL, &width, &height, &refresh));
+}
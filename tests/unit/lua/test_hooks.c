@@ -0,0 +1,216 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <criterion/criterion.h>
+#include <lua.h>
+#include "wavo/hooks.h"
+
+static char hooks_path[] = "/tmp/wavo-test-hooks-XXXXXX";
+
+// Without a server nothing bounds the run but the budget given here
+#define RUN_BUDGET_USEC 1000000
+
+static struct wavo_hooks *load_hooks(const char *contents) {
+    int fd = mkstemp(hooks_path);
+    cr_assert_geq(fd, 0);
+    cr_assert_eq(write(fd, contents, strlen(contents)),
+        (ssize_t)strlen(contents));
+    close(fd);
+
+    struct wavo_hooks *hooks = wavo_hooks_create(NULL, hooks_path);
+    unlink(hooks_path);
+    return hooks;
+}
+
+static void emit(struct wavo_hooks *hooks, enum wavo_hook_type type,
+    uint32_t id, const char *name) {
+    struct wavo_hook_event event = { .type = type, .id = id };
+    snprintf(event.name, sizeof(event.name), "%s", name);
+    wavo_hooks_emit(hooks, &event);
+}
+
+static lua_Integer global_integer(struct wavo_hooks *hooks, const char *name) {
+    lua_getglobal(hooks->L, name);
+    lua_Integer value = lua_tointeger(hooks->L, -1);
+    lua_pop(hooks->L, 1);
+    return value;
+}
+
+Test(hooks, run_with_event_fields) {
+    struct wavo_hooks *hooks = load_hooks(
+        "mapped = 0\n"
+        "wavo.on('map', function(view)\n"
+        "    mapped = mapped + 1\n"
+        "    last_id = view.id\n"
+        "    app_ok = view.app_id == 'foot' and 1 or 0\n"
+        "end)\n"
+        "wavo.on('output_add', function(output) width = output.width end)\n");
+    cr_assert_not_null(hooks);
+    cr_assert_eq(hooks->hook_count, 2);
+
+    emit(hooks, WAVO_HOOK_MAP, 7, "foot");
+    emit(hooks, WAVO_HOOK_MAP, 8, "foot");
+    struct wavo_hook_event output = {
+        .type = WAVO_HOOK_OUTPUT_ADD, .width = 1920, .height = 1080,
+    };
+    wavo_hooks_emit(hooks, &output);
+    cr_assert_eq(wavo_hooks_run(hooks, RUN_BUDGET_USEC), 3);
+
+    cr_assert_eq(global_integer(hooks, "mapped"), 2);
+    cr_assert_eq(global_integer(hooks, "last_id"), 8);
+    cr_assert_eq(global_integer(hooks, "app_ok"), 1);
+    cr_assert_eq(global_integer(hooks, "width"), 1920);
+    cr_assert_eq(hooks->hooks[0].calls, 2);
+    cr_assert_eq(hooks->hooks[0].run_time.count, 2);
+    wavo_hooks_destroy(hooks);
+}
+
+Test(hooks, events_without_hooks_are_not_queued) {
+    struct wavo_hooks *hooks = load_hooks(
+        "wavo.on('map', function(view) end)\n");
+    cr_assert_not_null(hooks);
+
+    emit(hooks, WAVO_HOOK_FOCUS, 1, "");
+    emit(hooks, WAVO_HOOK_OUTPUT_REMOVE, 1, "HEADLESS-1");
+    cr_assert_eq(hooks->queued, 0);
+    cr_assert_eq(hooks->queue_length, 0);
+    wavo_hooks_destroy(hooks);
+}
+
+Test(hooks, small_budget_keeps_queue) {
+    struct wavo_hooks *hooks = load_hooks(
+        "wavo.on('unmap', function(view) end)\n");
+    cr_assert_not_null(hooks);
+
+    emit(hooks, WAVO_HOOK_UNMAP, 1, "");
+    // Less than one call's time limit starts nothing
+    cr_assert_eq(wavo_hooks_run(hooks, 10), 0);
+    cr_assert_eq(hooks->queue_length, 1);
+    cr_assert_eq(hooks->deferred, 1);
+    cr_assert_eq(wavo_hooks_run(hooks, RUN_BUDGET_USEC), 1);
+    cr_assert_eq(hooks->queue_length, 0);
+    wavo_hooks_destroy(hooks);
+}
+
+Test(hooks, full_queue_drops) {
+    struct wavo_hooks *hooks = load_hooks(
+        "wavo.on('focus', function(view) end)\n");
+    cr_assert_not_null(hooks);
+
+    for (uint32_t i = 0; i < WAVO_HOOKS_QUEUE_SIZE + 3; i++) {
+        emit(hooks, WAVO_HOOK_FOCUS, i, "");
+    }
+    cr_assert_eq(hooks->queue_length, WAVO_HOOKS_QUEUE_SIZE);
+    cr_assert_eq(hooks->dropped, 3);
+    wavo_hooks_destroy(hooks);
+}
+
+Test(hooks, endless_loop_is_aborted_then_disabled) {
+    struct wavo_hooks *hooks = load_hooks(
+        "wavo.on('map', function(view) while true do end end)\n"
+        "wavo.on('map', function(view) after = (after or 0) + 1 end)\n");
+    cr_assert_not_null(hooks);
+
+    for (uint32_t i = 0; i < 5; i++) {
+        emit(hooks, WAVO_HOOK_MAP, i, "");
+    }
+    cr_assert_eq(wavo_hooks_run(hooks, RUN_BUDGET_USEC), 5);
+
+    const struct wavo_hook *hook = &hooks->hooks[0];
+    cr_assert_eq(hook->calls, 3);
+    cr_assert_eq(hook->overruns, 3);
+    cr_assert(hook->disabled);
+    // Each call stops near its time limit, not much later
+    cr_assert_lt(hook->run_time.max_usec, 20000);
+
+    // The other hook of the event still ran every time
+    cr_assert_eq(global_integer(hooks, "after"), 5);
+    wavo_hooks_destroy(hooks);
+}
+
+Test(hooks, pcall_cannot_swallow_abort) {
+    struct wavo_hooks *hooks = load_hooks(
+        "wavo.on('map', function(view)\n"
+        "    while true do pcall(function() while true do end end) end\n"
+        "end)\n");
+    cr_assert_not_null(hooks);
+
+    emit(hooks, WAVO_HOOK_MAP, 1, "");
+    cr_assert_eq(wavo_hooks_run(hooks, RUN_BUDGET_USEC), 1);
+    cr_assert_eq(hooks->hooks[0].overruns, 1);
+    wavo_hooks_destroy(hooks);
+}
+
+Test(hooks, memory_is_capped) {
+    struct wavo_hooks *hooks = load_hooks(
+        "wavo.on('map', function(view)\n"
+        "    big = 'x'\n"
+        "    for i = 1, 26 do big = big .. big end\n"
+        "end)\n");
+    cr_assert_not_null(hooks);
+
+    emit(hooks, WAVO_HOOK_MAP, 1, "");
+    cr_assert_eq(wavo_hooks_run(hooks, RUN_BUDGET_USEC), 1);
+    cr_assert_eq(hooks->hooks[0].overruns, 1);
+    cr_assert_lt(hooks->memory_peak, 64 * 1024 * 1024);
+    wavo_hooks_destroy(hooks);
+}
+
+Test(hooks, script_errors_are_failures) {
+    struct wavo_hooks *hooks = load_hooks(
+        "wavo.on('map', function(view) error('broken') end)\n"
+        "wavo.on('unmap', function(view) wavo.on('map', print) end)\n");
+    cr_assert_not_null(hooks);
+
+    emit(hooks, WAVO_HOOK_MAP, 1, "");
+    emit(hooks, WAVO_HOOK_MAP, 2, "");
+    emit(hooks, WAVO_HOOK_UNMAP, 1, "");
+    cr_assert_eq(wavo_hooks_run(hooks, RUN_BUDGET_USEC), 3);
+
+    // Errors never disable a hook, and hooks cannot add hooks
+    cr_assert_eq(hooks->hooks[0].failures, 2);
+    cr_assert_eq(hooks->hooks[0].overruns, 0);
+    cr_assert_not(hooks->hooks[0].disabled);
+    cr_assert_eq(hooks->hooks[1].failures, 1);
+    cr_assert_eq(hooks->hook_count, 2);
+    wavo_hooks_destroy(hooks);
+}
+
+Test(hooks, bad_config_is_rejected) {
+    cr_assert_null(load_hooks("wavo.on('bogus', function() end)\n"));
+}
+
+Test(hooks, unbounded_library_calls_are_missing) {
+    // One call to these runs as long as its arguments make it, with no
+    // budget check in between
+    struct wavo_hooks *hooks = load_hooks(
+        "has_gsub = string.gsub and 1 or 0\n"
+        "has_method = ('x').rep and 1 or 0\n"
+        "has_sort = table.sort and 1 or 0\n"
+        "has_concat = table.concat and 1 or 0\n"
+        "has_move = table.move and 1 or 0\n"
+        "has_unpack = table.unpack and 1 or 0\n"
+        "has_format = string.format and 1 or 0\n");
+    cr_assert_not_null(hooks);
+    cr_assert_eq(global_integer(hooks, "has_gsub"), 0);
+    cr_assert_eq(global_integer(hooks, "has_method"), 0);
+    cr_assert_eq(global_integer(hooks, "has_sort"), 0);
+    cr_assert_eq(global_integer(hooks, "has_concat"), 0);
+    cr_assert_eq(global_integer(hooks, "has_move"), 0);
+    cr_assert_eq(global_integer(hooks, "has_unpack"), 0);
+    cr_assert_eq(global_integer(hooks, "has_format"), 1);
+    wavo_hooks_destroy(hooks);
+}
+
+Test(hooks, blocking_libraries_are_missing) {
+    struct wavo_hooks *hooks = load_hooks(
+        "has_io = io and 1 or 0\n"
+        "has_execute = os.execute and 1 or 0\n"
+        "has_time = os.time and 1 or 0\n");
+    cr_assert_not_null(hooks);
+    cr_assert_eq(global_integer(hooks, "has_io"), 0);
+    cr_assert_eq(global_integer(hooks, "has_execute"), 0);
+    cr_assert_eq(global_integer(hooks, "has_time"), 1);
+    wavo_hooks_destroy(hooks);
+}
@@ -0,0 +1,126 @@
+#include <criterion/criterion.h>
+#include <string.h>
+#include "wavo/record.h"
+
+static struct wavo_record_event round_trip(
+    const struct wavo_record_event *event, uint64_t prev_usec) {
+    uint8_t buf[WAVO_RECORD_MAX_SIZE];
+    size_t size = wavo_record_encode(event, prev_usec, buf);
+    cr_assert_leq(size, sizeof(buf));
+
+    struct wavo_record_event decoded;
+    size_t offset = 0;
+    cr_assert(wavo_record_decode(buf, size, &offset, prev_usec, &decoded));
+    cr_assert_eq(offset, size);
+    return decoded;
+}
+
+Test(record, motion_round_trip) {
+    struct wavo_record_event event = {
+        .type = WAVO_RECORD_MOTION,
+        .usec = 1500,
+        .motion = { .time_msec = 42, .dx = 1.5f, .dy = -2.25f,
+            .unaccel_dx = 3.0f, .unaccel_dy = -0.5f },
+    };
+    struct wavo_record_event decoded = round_trip(&event, 1000);
+    cr_assert_eq(decoded.type, WAVO_RECORD_MOTION);
+    cr_assert_eq(decoded.usec, 1500);
+    cr_assert_eq(decoded.motion.time_msec, 42);
+    cr_assert_float_eq(decoded.motion.dx, 1.5f, 0.0f);
+    cr_assert_float_eq(decoded.motion.dy, -2.25f, 0.0f);
+    cr_assert_float_eq(decoded.motion.unaccel_dx, 3.0f, 0.0f);
+    cr_assert_float_eq(decoded.motion.unaccel_dy, -0.5f, 0.0f);
+}
+
+Test(record, commit_round_trip) {
+    struct wavo_record_event event = {
+        .type = WAVO_RECORD_COMMIT,
+        .commit = { .view_id = 7, .width = 800, .height = 600,
+            .rect_count = 2 },
+    };
+    event.commit.rects[0] = (struct wlr_box){ 0, 0, 800, 30 };
+    event.commit.rects[1] = (struct wlr_box){ 10, -5, 20, 40 };
+
+    struct wavo_record_event decoded = round_trip(&event, 0);
+    cr_assert_eq(decoded.commit.view_id, 7);
+    cr_assert_eq(decoded.commit.width, 800);
+    cr_assert_eq(decoded.commit.height, 600);
+    cr_assert_eq(decoded.commit.rect_count, 2);
+    cr_assert_eq(decoded.commit.rects[1].y, -5);
+    cr_assert_eq(decoded.commit.rects[1].height, 40);
+}
+
+Test(record, sequence_keeps_timestamps) {
+    struct wavo_record_event events[] = {
+        { .type = WAVO_RECORD_OUTPUT, .usec = 0,
+            .output = { .id = 1, .width = 1920, .height = 1080,
+                .refresh = 60000, .scale = 1.0f } },
+        { .type = WAVO_RECORD_KEY, .usec = 250,
+            .key = { .time_msec = 9, .keycode = 30, .state = 1 } },
+        { .type = WAVO_RECORD_POINTER_FRAME, .usec = 250 },
+        { .type = WAVO_RECORD_FRAME, .usec = 16000,
+            .frame = { .output_id = 1, .frame_usec = 1200 } },
+    };
+    size_t count = sizeof(events) / sizeof(events[0]);
+
+    uint8_t buf[4 * WAVO_RECORD_MAX_SIZE];
+    size_t size = 0;
+    uint64_t prev = 0;
+    for (size_t i = 0; i < count; i++) {
+        size += wavo_record_encode(&events[i], prev, buf + size);
+        prev = events[i].usec;
+    }
+
+    size_t offset = 0;
+    prev = 0;
+    struct wavo_record_event decoded;
+    for (size_t i = 0; i < count; i++) {
+        cr_assert(wavo_record_decode(buf, size, &offset, prev, &decoded));
+        cr_assert_eq(decoded.type, events[i].type);
+        cr_assert_eq(decoded.usec, events[i].usec);
+        prev = decoded.usec;
+    }
+    cr_assert_eq(decoded.frame.frame_usec, 1200);
+    cr_assert_not(wavo_record_decode(buf, size, &offset, prev, &decoded));
+}
+
+Test(record, truncated_record_is_rejected) {
+    struct wavo_record_event event = {
+        .type = WAVO_RECORD_BUTTON,
+        .button = { .time_msec = 1, .button = 0x110, .state = 1 },
+    };
+    uint8_t buf[WAVO_RECORD_MAX_SIZE];
+    size_t size = wavo_record_encode(&event, 0, buf);
+
+    struct wavo_record_event decoded;
+    for (size_t cut = 0; cut < size; cut++) {
+        size_t offset = 0;
+        cr_assert_not(wavo_record_decode(buf, cut, &offset, 0, &decoded));
+        cr_assert_eq(offset, 0);
+    }
+}
+
+Test(record, unknown_type_is_rejected) {
+    uint8_t buf[WAVO_RECORD_HEADER_SIZE] = { 0xff };
+    struct wavo_record_event decoded;
+    size_t offset = 0;
+    cr_assert_not(wavo_record_decode(buf, sizeof(buf), &offset, 0, &decoded));
+}
+
+Test(record, long_gaps_saturate) {
+    struct wavo_record_event event = {
+        .type = WAVO_RECORD_POINTER_FRAME,
+        .usec = 10000000000ULL,
+    };
+    struct wavo_record_event decoded = round_trip(&event, 0);
+    cr_assert_eq(decoded.usec, UINT32_MAX);
+}
+
+Test(record, excess_damage_is_capped) {
+    struct wavo_record_event event = {
+        .type = WAVO_RECORD_COMMIT,
+        .commit = { .view_id = 1, .rect_count = WAVO_RECORD_MAX_RECTS + 5 },
+    };
+    struct wavo_record_event decoded = round_trip(&event, 0);
+    cr_assert_eq(decoded.commit.rect_count, WAVO_RECORD_MAX_RECTS);
+}
@@ -0,0 +1,121 @@
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <time.h>
+#include <criterion/criterion.h>
+#include <wayland-server-core.h>
+#include "wavo/latency.h"
+#include "wavo/workers.h"
+
+#define JOBS 64
+
+struct job {
+    pthread_t worker;
+    bool worked;
+    bool done;
+};
+
+static struct wl_event_loop *loop;
+static struct wavo_workers *workers;
+static pthread_t main_thread;
+static struct job jobs[JOBS];
+static int done_count;
+static atomic_int running, max_running;
+
+static void setup(void) {
+    loop = wl_event_loop_create();
+    cr_assert_not_null(loop);
+    main_thread = pthread_self();
+    memset(jobs, 0, sizeof(jobs));
+    done_count = 0;
+    atomic_store(&running, 0);
+    atomic_store(&max_running, 0);
+}
+
+static void teardown(void) {
+    wavo_workers_destroy(workers);
+    workers = NULL;
+    wl_event_loop_destroy(loop);
+}
+
+TestSuite(workers, .init = setup, .fini = teardown);
+
+static void job_work(void *data) {
+    struct job *job = data;
+    job->worker = pthread_self();
+
+    int now_running = atomic_fetch_add(&running, 1) + 1;
+    int max = atomic_load(&max_running);
+    while (now_running > max &&
+            !atomic_compare_exchange_weak(&max_running, &max, now_running)) {
+        continue;
+    }
+
+    // A blocking call, like file I/O
+    struct timespec delay = { .tv_nsec = 2000000 };
+    nanosleep(&delay, NULL);
+
+    atomic_fetch_sub(&running, 1);
+    job->worked = true;
+}
+
+static void job_done(void *data) {
+    struct job *job = data;
+    cr_assert(pthread_equal(pthread_self(), main_thread));
+    cr_assert(job->worked);
+    job->done = true;
+    done_count++;
+}
+
+static void dispatch_until_done(int count, int timeout_msec) {
+    uint64_t end = wavo_latency_now_usec() + (uint64_t)timeout_msec * 1000;
+    while (done_count < count && wavo_latency_now_usec() < end) {
+        wl_event_loop_dispatch(loop, 10);
+    }
+}
+
+Test(workers, runs_off_main_thread) {
+    workers = wavo_workers_create(loop, 4);
+    cr_assert_not_null(workers);
+    cr_assert_eq(workers->thread_count, 4);
+
+    for (int i = 0; i < JOBS; i++) {
+        cr_assert(wavo_workers_submit(workers, job_work, job_done, &jobs[i]));
+    }
+    // Nothing completes behind the event loop's back
+    cr_assert_eq(done_count, 0);
+
+    dispatch_until_done(JOBS, 5000);
+    cr_assert_eq(done_count, JOBS);
+    cr_assert_eq(workers->completed, JOBS);
+    for (int i = 0; i < JOBS; i++) {
+        cr_assert(jobs[i].done);
+        cr_assert_not(pthread_equal(jobs[i].worker, main_thread));
+    }
+    cr_assert_gt(atomic_load(&max_running), 1, "jobs never overlapped");
+    cr_assert_eq(workers->run_time.count, JOBS);
+}
+
+Test(workers, destroy_finishes_queue) {
+    workers = wavo_workers_create(loop, 1);
+    cr_assert_not_null(workers);
+
+    for (int i = 0; i < 8; i++) {
+        cr_assert(wavo_workers_submit(workers, job_work, job_done, &jobs[i]));
+    }
+    wavo_workers_destroy(workers);
+    workers = NULL;
+
+    cr_assert_eq(done_count, 8);
+    for (int i = 0; i < 8; i++) {
+        cr_assert(jobs[i].done);
+    }
+}
+
+Test(workers, default_thread_count) {
+    workers = wavo_workers_create(loop, 0);
+    cr_assert_not_null(workers);
+    cr_assert_geq(workers->thread_count, 1);
+    cr_assert_leq(workers->thread_count, WAVO_WORKERS_MAX);
+}
@@ -0,0 +1,275 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/input-event-codes.h>
+#include <wayland-client.h>
+#include <xkbcommon/xkbcommon.h>
+#include "virtual-keyboard-unstable-v1-client-protocol.h"
+#include "wlr-virtual-pointer-unstable-v1-client-protocol.h"
+
+// Drives the compositor's input path through zwp_virtual_keyboard_v1 and
+// zwlr_virtual_pointer_v1 at a fixed event rate, for headless input latency
+// and throughput runs:
+//
+//   wavo -n 1 &
+//   wavo-loadgen --rate 8000 --duration 10
+
+static const char usage[] =
+    "Usage: wavo-loadgen [options]\n"
+    "\n"
+    "  -r, --rate <hz>        Ticks per second (1000)\n"
+    "  -d, --duration <sec>   Run time (10)\n"
+    "  -k, --keyboard-only    Only send key press/release pairs\n"
+    "  -p, --pointer-only     Only send pointer motion\n"
+    "  -c, --keycode <code>   Evdev keycode to send (KEY_F24)\n"
+    "  -h, --help             Show this help\n";
+
+struct loadgen {
+    struct wl_display *display;
+    struct wl_seat *seat;
+    struct zwp_virtual_keyboard_manager_v1 *keyboard_mgr;
+    struct zwlr_virtual_pointer_manager_v1 *pointer_mgr;
+    struct zwp_virtual_keyboard_v1 *keyboard;
+    struct zwlr_virtual_pointer_v1 *pointer;
+};
+
+static void registry_global(void *data, struct wl_registry *registry,
+    uint32_t name, const char *interface, uint32_t version) {
+    (void)version;
+    struct loadgen *gen = data;
+
+    if (strcmp(interface, wl_seat_interface.name) == 0 && !gen->seat) {
+        gen->seat = wl_registry_bind(registry, name, &wl_seat_interface, 1);
+    } else if (strcmp(interface,
+            zwp_virtual_keyboard_manager_v1_interface.name) == 0) {
+        gen->keyboard_mgr = wl_registry_bind(registry, name,
+            &zwp_virtual_keyboard_manager_v1_interface, 1);
+    } else if (strcmp(interface,
+            zwlr_virtual_pointer_manager_v1_interface.name) == 0) {
+        gen->pointer_mgr = wl_registry_bind(registry, name,
+            &zwlr_virtual_pointer_manager_v1_interface, 1);
+    }
+}
+
+static void registry_global_remove(void *data, struct wl_registry *registry,
+    uint32_t name) {
+    (void)data;
+    (void)registry;
+    (void)name;
+}
+
+static const struct wl_registry_listener registry_listener = {
+    .global = registry_global,
+    .global_remove = registry_global_remove,
+};
+
+static uint64_t now_nsec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+// Virtual keyboards must upload a keymap before sending keys
+static bool send_keymap(struct zwp_virtual_keyboard_v1 *keyboard) {
+    struct xkb_context *context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
+    struct xkb_keymap *keymap = context ?
+        xkb_keymap_new_from_names(context, NULL, XKB_KEYMAP_COMPILE_NO_FLAGS) :
+        NULL;
+    char *text = keymap ?
+        xkb_keymap_get_as_string(keymap, XKB_KEYMAP_FORMAT_TEXT_V1) : NULL;
+    xkb_keymap_unref(keymap);
+    xkb_context_unref(context);
+    if (!text) {
+        fprintf(stderr, "Failed to compile keymap\n");
+        return false;
+    }
+
+    char path[] = "/tmp/wavo-loadgen-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        perror("mkstemp");
+        free(text);
+        return false;
+    }
+    unlink(path);
+
+    size_t size = strlen(text) + 1;
+    bool ok = write(fd, text, size) == (ssize_t)size;
+    free(text);
+    if (ok) {
+        zwp_virtual_keyboard_v1_keymap(keyboard,
+            WL_KEYBOARD_KEYMAP_FORMAT_XKB_V1, fd, (uint32_t)size);
+    }
+    close(fd);
+    return ok;
+}
+
+// Blocks until the socket drains, so bursts are not dropped on EAGAIN
+static bool flush(struct wl_display *display) {
+    while (wl_display_flush(display) < 0) {
+        if (errno != EAGAIN) {
+            return false;
+        }
+        struct pollfd pfd = {
+            .fd = wl_display_get_fd(display),
+            .events = POLLOUT,
+        };
+        if (poll(&pfd, 1, -1) < 0 && errno != EINTR) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    static const struct option long_options[] = {
+        { "rate", required_argument, NULL, 'r' },
+        { "duration", required_argument, NULL, 'd' },
+        { "keyboard-only", no_argument, NULL, 'k' },
+        { "pointer-only", no_argument, NULL, 'p' },
+        { "keycode", required_argument, NULL, 'c' },
+        { "help", no_argument, NULL, 'h' },
+        { 0 },
+    };
+
+    double rate = 1000.0, duration = 10.0;
+    bool use_keyboard = true, use_pointer = true;
+    uint32_t keycode = KEY_F24;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "r:d:kpc:h", long_options,
+            NULL)) != -1) {
+        switch (opt) {
+        case 'r':
+            rate = atof(optarg);
+            break;
+        case 'd':
+            duration = atof(optarg);
+            break;
+        case 'k':
+            use_pointer = false;
+            break;
+        case 'p':
+            use_keyboard = false;
+            break;
+        case 'c':
+            keycode = (uint32_t)atoi(optarg);
+            break;
+        case 'h':
+            fputs(usage, stdout);
+            return 0;
+        default:
+            fputs(usage, stderr);
+            return 1;
+        }
+    }
+    if (rate <= 0.0 || duration <= 0.0 || (!use_keyboard && !use_pointer)) {
+        fputs(usage, stderr);
+        return 1;
+    }
+
+    struct loadgen gen = {0};
+    gen.display = wl_display_connect(NULL);
+    if (!gen.display) {
+        fprintf(stderr, "Failed to connect to the Wayland display\n");
+        return 1;
+    }
+
+    struct wl_registry *registry = wl_display_get_registry(gen.display);
+    wl_registry_add_listener(registry, &registry_listener, &gen);
+    wl_display_roundtrip(gen.display);
+
+    if (!gen.seat || (use_keyboard && !gen.keyboard_mgr) ||
+            (use_pointer && !gen.pointer_mgr)) {
+        fprintf(stderr, "Compositor lacks a seat or virtual input support\n");
+        wl_display_disconnect(gen.display);
+        return 1;
+    }
+
+    if (use_keyboard) {
+        gen.keyboard = zwp_virtual_keyboard_manager_v1_create_virtual_keyboard(
+            gen.keyboard_mgr, gen.seat);
+        if (!send_keymap(gen.keyboard)) {
+            wl_display_disconnect(gen.display);
+            return 1;
+        }
+    }
+    if (use_pointer) {
+        gen.pointer = zwlr_virtual_pointer_manager_v1_create_virtual_pointer(
+            gen.pointer_mgr, gen.seat);
+    }
+    wl_display_roundtrip(gen.display);
+
+    uint64_t period = (uint64_t)(1e9 / rate);
+    uint64_t ticks = (uint64_t)(rate * duration);
+    uint64_t start = now_nsec();
+    uint64_t max_late = 0, late_ticks = 0;
+
+    for (uint64_t i = 0; i < ticks; i++) {
+        uint64_t deadline = start + i * period;
+        uint64_t now = now_nsec();
+        if (now < deadline) {
+            struct timespec ts = {
+                .tv_sec = (time_t)(deadline / 1000000000),
+                .tv_nsec = (long)(deadline % 1000000000),
+            };
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+        } else if (now - deadline > period) {
+            late_ticks++;
+            if (now - deadline > max_late) {
+                max_late = now - deadline;
+            }
+        }
+
+        uint32_t time_msec = (uint32_t)(now_nsec() / 1000000);
+        if (gen.keyboard) {
+            uint32_t state = (i & 1) ? WL_KEYBOARD_KEY_STATE_RELEASED :
+                WL_KEYBOARD_KEY_STATE_PRESSED;
+            zwp_virtual_keyboard_v1_key(gen.keyboard, time_msec, keycode,
+                state);
+        }
+        if (gen.pointer) {
+            wl_fixed_t dx = wl_fixed_from_int((i & 1) ? -1 : 1);
+            zwlr_virtual_pointer_v1_motion(gen.pointer, time_msec, dx, 0);
+            zwlr_virtual_pointer_v1_frame(gen.pointer);
+        }
+
+        if (!flush(gen.display)) {
+            fprintf(stderr, "Lost connection to the compositor\n");
+            return 1;
+        }
+    }
+
+    // Release the key if the run ended on a press
+    if (gen.keyboard && ticks % 2 == 1) {
+        zwp_virtual_keyboard_v1_key(gen.keyboard,
+            (uint32_t)(now_nsec() / 1000000), keycode,
+            WL_KEYBOARD_KEY_STATE_RELEASED);
+    }
+
+    // Everything was processed once the roundtrip returns
+    int ret = wl_display_roundtrip(gen.display) < 0 ? 1 : 0;
+    double elapsed = (double)(now_nsec() - start) / 1e9;
+
+    printf("ticks %" PRIu64 "\n", ticks);
+    printf("elapsed_sec %.3f\n", elapsed);
+    printf("achieved_rate_hz %.1f\n", (double)ticks / elapsed);
+    printf("late_ticks %" PRIu64 "\n", late_ticks);
+    printf("max_late_usec %" PRIu64 "\n", max_late / 1000);
+
+    if (gen.keyboard) {
+        zwp_virtual_keyboard_v1_destroy(gen.keyboard);
+    }
+    if (gen.pointer) {
+        zwlr_virtual_pointer_v1_destroy(gen.pointer);
+    }
+    wl_display_disconnect(gen.display);
+    return ret;
+}
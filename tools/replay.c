@@ -0,0 +1,471 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pixman.h>
+#include <wayland-server-core.h>
+#include <wlr/interfaces/wlr_keyboard.h>
+#include <wlr/interfaces/wlr_pointer.h>
+#include <wlr/types/wlr_output.h>
+#include <wlr/types/wlr_output_layout.h>
+#include <wlr/types/wlr_scene.h>
+#include <wlr/util/log.h>
+#include "wavo/buffer.h"
+#include "wavo/config.h"
+#include "wavo/input.h"
+#include "wavo/latency.h"
+#include "wavo/output.h"
+#include "wavo/record.h"
+#include "wavo/render.h"
+#include "wavo/server.h"
+#include "headless.h"
+
+// Plays a recording from `wavo --record` against a headless pixman server:
+// the recorded outputs are recreated, input goes through a synthetic
+// keyboard and pointer, and toplevels become scene buffers committed with
+// the recorded sizes and damage, each at its recorded time. Frame times
+// seen while recording are then compared with the replay's:
+//
+//   wavo --record session.wrec
+//   wavo-replay session.wrec
+
+static const char usage[] =
+    "Usage: wavo-replay [options] <file>\n"
+    "\n"
+    "  -p, --parallel-render  Draw outputs on worker threads\n"
+    "  -h, --help             Show this help\n";
+
+#define MAX_OUTPUTS 16
+#define TAIL_MSEC 100  // Lets the last frames finish
+
+struct replay_output {
+    uint32_t id;
+    struct wavo_output *output;
+    struct wavo_latency_histogram recorded;
+};
+
+// A recorded toplevel
+struct replay_view {
+    uint32_t id;
+    struct wlr_scene_buffer *scene_buffer;
+    struct wlr_buffer *buffer;
+    struct wl_list link;  // replay::views
+};
+
+struct replay {
+    struct wavo_server *server;
+    struct wlr_keyboard keyboard;
+    struct wlr_pointer pointer;
+
+    struct replay_output outputs[MAX_OUTPUTS];
+    int output_count;
+    struct wl_list views;  // replay_view::link
+
+    uint64_t events;
+    uint64_t skipped;  // Referring to outputs or views we do not have
+};
+
+// Opaque, in a color picked by the view id so windows can be told apart
+static struct wlr_buffer *replay_buffer_create(int width, int height,
+    uint32_t id) {
+    struct wavo_pixel_buffer *buffer = headless_buffer_create(width, height,
+        0xFF000000 | ((id * 2654435761u) >> 8));
+    return buffer ? &buffer->base : NULL;
+}
+
+static const struct wlr_keyboard_impl replay_keyboard_impl = {
+    .name = "wavo-replay-keyboard",
+};
+
+static const struct wlr_pointer_impl replay_pointer_impl = {
+    .name = "wavo-replay-pointer",
+};
+
+static struct replay_output *replay_find_output(struct replay *replay,
+    uint32_t id) {
+    for (int i = 0; i < replay->output_count; i++) {
+        if (replay->outputs[i].id == id) {
+            return &replay->outputs[i];
+        }
+    }
+    return NULL;
+}
+
+static struct replay_view *replay_find_view(struct replay *replay,
+    uint32_t id) {
+    struct replay_view *view;
+    wl_list_for_each(view, &replay->views, link) {
+        if (view->id == id) {
+            return view;
+        }
+    }
+    return NULL;
+}
+
+static void replay_view_destroy(struct replay_view *view) {
+    wlr_scene_node_destroy(&view->scene_buffer->node);
+    wlr_buffer_drop(view->buffer);
+    wl_list_remove(&view->link);
+    free(view);
+}
+
+// Swaps in a buffer of the new size, the scene damages all of it
+static bool replay_view_resize(struct replay_view *view, int width,
+    int height) {
+    if (view->buffer && view->buffer->width == width &&
+            view->buffer->height == height) {
+        return true;
+    }
+    struct wlr_buffer *buffer = replay_buffer_create(width, height, view->id);
+    if (!buffer) {
+        return false;
+    }
+    wlr_scene_buffer_set_buffer(view->scene_buffer, buffer);
+    wlr_buffer_drop(view->buffer);
+    view->buffer = buffer;
+    return true;
+}
+
+static void replay_output(struct replay *replay,
+    const struct wavo_record_event *event) {
+    if (replay->output_count == MAX_OUTPUTS ||
+            replay_find_output(replay, event->output.id)) {
+        replay->skipped++;
+        return;
+    }
+
+    struct wavo_output *output = wavo_output_create_virtual(replay->server,
+        event->output.width, event->output.height, event->output.refresh);
+    if (!output) {
+        fprintf(stderr, "failed to create output %" PRIu32 "\n",
+            event->output.id);
+        replay->skipped++;
+        return;
+    }
+    if (event->output.scale != 1.0f) {
+        struct wlr_output_state state;
+        wlr_output_state_init(&state);
+        wlr_output_state_set_scale(&state, event->output.scale);
+        wlr_output_commit_state(output->wlr_output, &state);
+        wlr_output_state_finish(&state);
+    }
+    wlr_output_layout_add(replay->server->output_layout, output->wlr_output,
+        event->output.x, event->output.y);
+
+    struct replay_output *replay_output =
+        &replay->outputs[replay->output_count++];
+    replay_output->id = event->output.id;
+    replay_output->output = output;
+}
+
+static void replay_map(struct replay *replay,
+    const struct wavo_record_event *event) {
+    const struct wlr_box *box = &event->map.box;
+    if (replay_find_view(replay, event->map.view_id) ||
+            box->width <= 0 || box->height <= 0) {
+        replay->skipped++;
+        return;
+    }
+
+    struct replay_view *view = calloc(1, sizeof(struct replay_view));
+    if (!view) {
+        replay->skipped++;
+        return;
+    }
+    view->id = event->map.view_id;
+    view->scene_buffer = wlr_scene_buffer_create(replay->server->view_tree,
+        NULL);
+    if (!view->scene_buffer) {
+        free(view);
+        replay->skipped++;
+        return;
+    }
+    wl_list_insert(&replay->views, &view->link);
+    wlr_scene_node_set_position(&view->scene_buffer->node, box->x, box->y);
+    if (!replay_view_resize(view, box->width, box->height)) {
+        replay_view_destroy(view);
+        replay->skipped++;
+    }
+}
+
+static void replay_commit(struct replay *replay,
+    const struct wavo_record_event *event) {
+    struct replay_view *view = replay_find_view(replay, event->commit.view_id);
+    if (!view || event->commit.width <= 0 || event->commit.height <= 0) {
+        replay->skipped++;
+        return;
+    }
+
+    struct wlr_buffer *old_buffer = view->buffer;
+    if (!replay_view_resize(view, event->commit.width, event->commit.height)) {
+        replay->skipped++;
+        return;
+    }
+    if (view->buffer != old_buffer) {
+        return;
+    }
+
+    pixman_region32_t damage;
+    pixman_region32_init(&damage);
+    for (uint32_t i = 0; i < event->commit.rect_count; i++) {
+        const struct wlr_box *rect = &event->commit.rects[i];
+        pixman_region32_union_rect(&damage, &damage, rect->x, rect->y,
+            (unsigned int)rect->width, (unsigned int)rect->height);
+    }
+    wlr_scene_buffer_set_buffer_with_damage(view->scene_buffer, view->buffer,
+        &damage);
+    pixman_region32_fini(&damage);
+}
+
+// Input is stamped with the replay's clock, not the recorded one, so
+// latency metrics of the replay stay meaningful
+static void replay_event(struct replay *replay,
+    const struct wavo_record_event *event) {
+    uint32_t time_msec = (uint32_t)(wavo_latency_now_usec() / 1000);
+
+    switch (event->type) {
+    case WAVO_RECORD_OUTPUT:
+        replay_output(replay, event);
+        break;
+    case WAVO_RECORD_FRAME: {
+        struct replay_output *output =
+            replay_find_output(replay, event->frame.output_id);
+        if (!output) {
+            replay->skipped++;
+            break;
+        }
+        wavo_latency_histogram_add(&output->recorded,
+            event->frame.frame_usec);
+        break;
+    }
+    case WAVO_RECORD_KEY: {
+        struct wlr_keyboard_key_event key = {
+            .time_msec = time_msec,
+            .keycode = event->key.keycode,
+            .update_state = true,
+            .state = event->key.state,
+        };
+        wlr_keyboard_notify_key(&replay->keyboard, &key);
+        break;
+    }
+    case WAVO_RECORD_MOTION: {
+        struct wlr_pointer_motion_event motion = {
+            .pointer = &replay->pointer,
+            .time_msec = time_msec,
+            .delta_x = event->motion.dx,
+            .delta_y = event->motion.dy,
+            .unaccel_dx = event->motion.unaccel_dx,
+            .unaccel_dy = event->motion.unaccel_dy,
+        };
+        wl_signal_emit_mutable(&replay->pointer.events.motion, &motion);
+        break;
+    }
+    case WAVO_RECORD_BUTTON: {
+        struct wlr_pointer_button_event button = {
+            .pointer = &replay->pointer,
+            .time_msec = time_msec,
+            .button = event->button.button,
+            .state = event->button.state,
+        };
+        wl_signal_emit_mutable(&replay->pointer.events.button, &button);
+        break;
+    }
+    case WAVO_RECORD_AXIS: {
+        struct wlr_pointer_axis_event axis = {
+            .pointer = &replay->pointer,
+            .time_msec = time_msec,
+            .source = event->axis.source,
+            .orientation = event->axis.orientation,
+            .relative_direction = event->axis.relative_direction,
+            .delta = event->axis.delta,
+            .delta_discrete = event->axis.delta_discrete,
+        };
+        wl_signal_emit_mutable(&replay->pointer.events.axis, &axis);
+        break;
+    }
+    case WAVO_RECORD_POINTER_FRAME:
+        wl_signal_emit_mutable(&replay->pointer.events.frame, &replay->pointer);
+        break;
+    case WAVO_RECORD_MAP:
+        replay_map(replay, event);
+        break;
+    case WAVO_RECORD_UNMAP: {
+        struct replay_view *view =
+            replay_find_view(replay, event->unmap.view_id);
+        if (view) {
+            replay_view_destroy(view);
+        } else {
+            replay->skipped++;
+        }
+        break;
+    }
+    case WAVO_RECORD_COMMIT:
+        replay_commit(replay, event);
+        break;
+    }
+    replay->events++;
+}
+
+static void print_frames(const char *label,
+    const struct wavo_latency_histogram *hist) {
+    printf("  %-8s %8" PRIu64 " frames  p50 %7" PRIu64 "us  p90 %7" PRIu64
+        "us  p99 %7" PRIu64 "us  max %7" PRIu64 "us\n", label, hist->count,
+        wavo_latency_histogram_percentile(hist, 50.0),
+        wavo_latency_histogram_percentile(hist, 90.0),
+        wavo_latency_histogram_percentile(hist, 99.0), hist->max_usec);
+}
+
+static uint8_t *read_file(const char *path, size_t *size) {
+    FILE *f = fopen(path, "rbe");
+    if (!f) {
+        fprintf(stderr, "cannot open '%s': %s\n", path, strerror(errno));
+        return NULL;
+    }
+
+    size_t capacity = 1 << 20;
+    uint8_t *data = malloc(capacity);
+    *size = 0;
+    while (data) {
+        *size += fread(data + *size, 1, capacity - *size, f);
+        if (*size < capacity) {
+            break;
+        }
+        capacity *= 2;
+        uint8_t *grown = realloc(data, capacity);
+        if (!grown) {
+            free(data);
+        }
+        data = grown;
+    }
+    if (!data) {
+        fprintf(stderr, "%s\n", "out of memory");
+    } else if (ferror(f)) {
+        fprintf(stderr, "cannot read '%s'\n", path);
+        free(data);
+        data = NULL;
+    }
+    fclose(f);
+    return data;
+}
+
+// Dispatches every event at its recorded offset from the start
+static void replay_run(struct replay *replay, const uint8_t *data,
+    size_t size) {
+    size_t offset = WAVO_RECORD_MAGIC_SIZE;
+    uint64_t prev_usec = 0;
+    uint64_t start_usec = wavo_latency_now_usec();
+
+    struct wavo_record_event event;
+    while (wavo_record_decode(data, size, &offset, prev_usec, &event)) {
+        prev_usec = event.usec;
+        for (;;) {
+            uint64_t elapsed = wavo_latency_now_usec() - start_usec;
+            if (elapsed >= event.usec) {
+                break;
+            }
+            // Rounded up, waking early would just spin
+            wavo_server_dispatch(replay->server,
+                (int)((event.usec - elapsed + 999) / 1000));
+        }
+        replay_event(replay, &event);
+    }
+    if (offset != size) {
+        fprintf(stderr, "stopped at a damaged record, offset %zu of %zu\n",
+            offset, size);
+    }
+
+    headless_run_for(replay->server, TAIL_MSEC);
+}
+
+int main(int argc, char *argv[]) {
+    static const struct option long_options[] = {
+        { "parallel-render", no_argument, NULL, 'p' },
+        { "help", no_argument, NULL, 'h' },
+        { 0 },
+    };
+
+    bool parallel_render = false;
+    int opt;
+    while ((opt = getopt_long(argc, argv, "ph", long_options, NULL)) != -1) {
+        switch (opt) {
+        case 'p':
+            parallel_render = true;
+            break;
+        case 'h':
+            fputs(usage, stdout);
+            return 0;
+        default:
+            fputs(usage, stderr);
+            return 1;
+        }
+    }
+    if (optind != argc - 1) {
+        fputs(usage, stderr);
+        return 1;
+    }
+
+    size_t size;
+    uint8_t *data = read_file(argv[optind], &size);
+    if (!data) {
+        return 1;
+    }
+    if (size < WAVO_RECORD_MAGIC_SIZE ||
+            memcmp(data, WAVO_RECORD_MAGIC, WAVO_RECORD_MAGIC_SIZE) != 0) {
+        fprintf(stderr, "'%s' is not a wavo recording\n", argv[optind]);
+        free(data);
+        return 1;
+    }
+
+    wlr_log_init(WLR_ERROR, NULL);
+
+    // Idle would stop the outputs during pauses in the recording
+    struct wavo_config config = {0};
+    struct replay replay = {0};
+    wl_list_init(&replay.views);
+    replay.server = headless_server_create(&config, 0);
+    if (!replay.server) {
+        wavo_config_free(&config);
+        free(data);
+        return 1;
+    }
+    if (parallel_render) {
+        replay.server->render = wavo_render_create(replay.server);
+        if (!replay.server->render) {
+            fprintf(stderr, "parallel rendering unavailable\n");
+        }
+    }
+
+    wlr_keyboard_init(&replay.keyboard, &replay_keyboard_impl,
+        replay_keyboard_impl.name);
+    wlr_pointer_init(&replay.pointer, &replay_pointer_impl,
+        replay_pointer_impl.name);
+    wavo_input_add_device(replay.server->input, &replay.keyboard.base);
+    wavo_input_add_device(replay.server->input, &replay.pointer.base);
+
+    replay_run(&replay, data, size);
+
+    printf("%" PRIu64 " events replayed, %" PRIu64 " skipped\n",
+        replay.events, replay.skipped);
+    for (int i = 0; i < replay.output_count; i++) {
+        struct replay_output *output = &replay.outputs[i];
+        struct wlr_output *wlr_output = output->output->wlr_output;
+        printf("output %" PRIu32 " %dx%d frame time\n", output->id,
+            wlr_output->width, wlr_output->height);
+        print_frames("recorded", &output->recorded);
+        print_frames("replayed", &output->output->frame_time);
+    }
+
+    struct replay_view *view, *tmp;
+    wl_list_for_each_safe(view, tmp, &replay.views, link) {
+        replay_view_destroy(view);
+    }
+    wlr_keyboard_finish(&replay.keyboard);
+    wlr_pointer_finish(&replay.pointer);
+    wavo_server_destroy(replay.server);
+    wavo_config_free(&config);
+    free(data);
+    return 0;
+}